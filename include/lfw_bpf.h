@@ -3,12 +3,30 @@
 #ifndef LFW_BPF_H
 #define LFW_BPF_H
 
+#include "lfw_bpf_shared.h"
 #include "lfw_types.h"
 #include "lfw_rules.h"
 
+struct lfw_telemetry_stats;
+
 // Initialize BPF subsystem, load program, and attach to interface TC hooks
 lfw_status_t lfw_bpf_init(const char *ifname, const char *bpf_obj_path);
 
+// Size the drop and allow events rings in bytes (0: default; a power of
+// two and a multiple of the page size) and optionally give every CPU its
+// own pair. Must be called before lfw_bpf_init.
+void lfw_bpf_set_event_rings(lfw_u32 drop_size, lfw_u32 allow_size, bool per_cpu);
+
+// Aggregate telemetry per flow over window_ms (0: one event per packet).
+// Takes effect with the next rules sync or reload.
+void lfw_bpf_set_telemetry_window(lfw_u32 window_ms);
+
+// Report one in every `packets` allowed packets and one in every `flows`
+// new connections (0: off; allowed packets then follow the log level).
+// Rules with their own sample rate override the packet rate. Takes effect with the next
+// rules sync or reload.
+void lfw_bpf_set_telemetry_sampling(lfw_u32 packets, lfw_u32 flows);
+
 // Synchronize user-space rules to BPF maps
 lfw_status_t lfw_bpf_sync_rules(const lfw_rule_t *rules, lfw_u32 rule_count, lfw_action_t default_action, lfw_loglevel_t log_level);
 
@@ -28,6 +46,116 @@ void lfw_bpf_cleanup(void);
 // Read statistics from BPF maps and dump to syslog
 void lfw_bpf_dump_stats(const lfw_rule_t *orig_rules, lfw_u32 orig_rule_count, lfw_action_t default_action);
 
+// Sum the per-CPU telemetry counters in the telemetry_stats map behind fd
+lfw_status_t lfw_bpf_read_telemetry_stats(int fd, struct lfw_telemetry_stats *stats);
+
+// Sum the per-CPU verdict reason counters in the reason_stats map behind
+// fd into counts, which holds LFW_REASON_MAX entries
+lfw_status_t lfw_bpf_read_reason_stats(int fd, lfw_u64 *counts);
+
+// Short name of a verdict reason (LFW_REASON_*), "unknown" if out of range
+const char *lfw_bpf_reason_name(lfw_u32 reason);
+
+// Sum the per-CPU rule_stats counters of the first count rules into
+// totals. Counters start from zero with every reload.
+lfw_status_t lfw_bpf_read_rule_stats(lfw_u32 count, struct lfw_rule_stats *totals);
+
+// Conntrack occupancy, indexed by LFW_CT_IPV4/LFW_CT_IPV6 and LFW_TCP_STATE_*
+typedef struct {
+    lfw_u64 entries[LFW_CT_FAMILIES];
+    lfw_u64 tcp_states[LFW_CT_FAMILIES][LFW_TCP_STATES];
+} lfw_bpf_conntrack_counts_t;
+
+// Sum the per-CPU conntrack_stats counters, net of the daemon's own
+// deletions. O(CPUs): the conntrack tables are not walked.
+lfw_status_t lfw_bpf_read_conntrack_counts(lfw_bpf_conntrack_counts_t *counts);
+
+// Whether a conntrack entry is still to be deleted, asked about the value
+// actually removed
+typedef bool (*lfw_bpf_conntrack_doomed_t)(const struct conntrack_val *val, void *ctx);
+
+// Delete the entry at key (struct conntrack_key for LFW_CT_IPV4, struct
+// conntrack_key_v6 for LFW_CT_IPV6), chosen from an earlier read. It may
+// have been refreshed, or replaced by a new connection, since: doomed
+// judges the value the deletion removed, and one it spares is put back.
+// Returns true if an entry was deleted, accounted with the state it had.
+// Caller holds the BPF lock.
+bool lfw_bpf_conntrack_delete(lfw_u32 family, const void *key, lfw_bpf_conntrack_doomed_t doomed, void *ctx);
+
+// One tracked connection. Endpoints are in the table's canonical order,
+// lower address first, not in the direction the connection was opened.
+typedef struct {
+    lfw_u32 family;       // LFW_CT_IPV4 or LFW_CT_IPV6
+    lfw_u8  proto;
+    lfw_u8  state;        // LFW_TCP_STATE_*, TCP only
+    lfw_u16 port_a;       // Host byte order
+    lfw_u16 port_b;
+    lfw_u8  addr_a[16];   // Network byte order; IPv4 uses the first 4 bytes
+    lfw_u8  addr_b[16];
+    lfw_u32 action;       // LFW_ACTION_ACCEPT or LFW_ACTION_DROP
+    lfw_u32 rule;         // Opening rule, LFW_EVENT_RULE_NONE for the default policy
+    lfw_u64 last_seen_ns; // bpf_ktime_get_ns() of the last packet
+    lfw_u64 packets;
+    lfw_u64 bytes;
+} lfw_bpf_conntrack_entry_t;
+
+// Called for each tracked connection; return true to delete it
+typedef bool (*lfw_bpf_conntrack_visit_t)(const lfw_bpf_conntrack_entry_t *entry, void *ctx);
+
+// Walk both conntrack tables. Entries visit asks for are deleted once the
+// walk is done and counted in *deleted (may be NULL); visit is asked again
+// about each as it is deleted, and one it no longer selects is kept.
+// Caller holds the BPF lock. One syscall per entry, so this is for
+// on-demand use only.
+lfw_status_t lfw_bpf_conntrack_walk(lfw_bpf_conntrack_visit_t visit, void *ctx, lfw_u64 *deleted);
+
+// Find the connection of a 5-tuple given in either direction: family,
+// proto, addr_a/port_a (source) and addr_b/port_b (destination) of entry
+// are read, and on LFW_OK the entry is filled as the walk would report it.
+// Caller holds the BPF lock.
+lfw_status_t lfw_bpf_conntrack_lookup(lfw_bpf_conntrack_entry_t *entry);
+
+// Walk both conntrack tables and log their size and TCP states next to the
+// maintained counters. One syscall per entry: a debugging aid only.
+void lfw_bpf_dump_conntrack(void);
+
+// One entry of a dynamic list (LFW_DYN_BLOCK or LFW_DYN_ALLOW)
+typedef struct {
+    lfw_u32 list;       // LFW_DYN_BLOCK or LFW_DYN_ALLOW
+    lfw_u32 family;     // LFW_CT_IPV4 or LFW_CT_IPV6
+    lfw_u32 prefixlen;  // Up to 32 or 128
+    lfw_u8  addr[16];   // Network byte order; IPv4 uses the first 4 bytes
+    lfw_u64 added_ns;   // bpf_ktime_get_ns() clock
+    lfw_u64 expires_ns; // Same clock, 0 for never
+} lfw_bpf_dyn_entry_t;
+
+// Add an entry to its list, or replace the one with the same prefix.
+// Address bits past the prefix are ignored. LFW_ERR_NO_MEMORY if the list
+// is full. The lists are pinned and survive a reload, not a restart.
+// Caller holds the BPF lock.
+lfw_status_t lfw_bpf_dyn_add(const lfw_bpf_dyn_entry_t *entry);
+
+// Remove the entry with the prefix of entry from its list; added_ns and
+// expires_ns are not read. LFW_ERR_GENERIC if there is none.
+// Caller holds the BPF lock.
+lfw_status_t lfw_bpf_dyn_del(const lfw_bpf_dyn_entry_t *entry);
+
+// Whether an unexpired entry of list covers the address, as the filter
+// would find it at now_ns (kernel clock). Caller holds the BPF lock.
+bool lfw_bpf_dyn_listed(lfw_u32 list, lfw_u32 family, const lfw_u8 *addr, lfw_u64 now_ns);
+
+// Called for each dynamic list entry, expired or not; return true to delete it
+typedef bool (*lfw_bpf_dyn_visit_t)(const lfw_bpf_dyn_entry_t *entry, void *ctx);
+
+// Walk every dynamic list like lfw_bpf_conntrack_walk. Caller holds the
+// BPF lock.
+lfw_status_t lfw_bpf_dyn_walk(lfw_bpf_dyn_visit_t visit, void *ctx, lfw_u64 *deleted);
+
+// Delete entries expired by now_ns (kernel clock). The filter only drops
+// an expired entry when a packet hits it, so this reclaims the rest.
+// Caller holds the BPF lock.
+lfw_status_t lfw_bpf_dyn_sweep(lfw_u64 now_ns, lfw_u64 *deleted);
+
 // Map file descriptor getters
 int lfw_bpf_get_conntrack_map_fd(void);
 int lfw_bpf_get_rules_map_fd(void);
@@ -37,7 +165,17 @@ int lfw_bpf_get_dst_ip_trie_fd(void);
 int lfw_bpf_get_src_ip6_trie_fd(void);
 int lfw_bpf_get_dst_ip6_trie_fd(void);
 int lfw_bpf_get_conntrack_map_v6_fd(void);
-int lfw_bpf_get_events_ringbuf_fd(void);
+// Rings of one events class (LFW_EVENTS_DROP or LFW_EVENTS_ALLOW): the
+// shared ring, then the per-CPU rings if any. Returns the count stored.
+int lfw_bpf_get_event_ring_fds(int event_class, int *fds, int max_fds);
+int lfw_bpf_get_telemetry_stats_fd(void);
+int lfw_bpf_get_telemetry_agg_fd(void);
+int lfw_bpf_get_telemetry_idle_fd(void);
+int lfw_bpf_get_reason_stats_fd(void);
+int lfw_bpf_get_conntrack_stats_fd(void);
+int lfw_bpf_get_rule_stats_fd(void);
+// Dynamic list map of list (LFW_DYN_*) and family (LFW_CT_*), -1 if none
+int lfw_bpf_get_dyn_fd(lfw_u32 list, lfw_u32 family);
 
 // Thread safety locking helpers
 void lfw_bpf_lock(void);
@@ -32,8 +32,15 @@ struct conntrack_val {
     __u64 bytes;
     __u64 packets;
     __u32 action;  // LFW_ACTION_ACCEPT (1) or LFW_ACTION_DROP (2)
-    __u8  state;   // TCP connection state
-    __u8  pad2[3]; // Keep 8-byte alignment
+    union {
+        struct {
+            __u8 state;   // TCP connection state
+            __u8 pad2[3]; // Keep 8-byte alignment
+        };
+        __u32 state_word; // state as the first byte, for the filter's compare-and-swap
+    };
+    __u32 rule;    // Rule that opened the connection, LFW_EVENT_RULE_NONE for the default policy
+    __u32 sample_rate; // The rule's packet sample rate, 0 for the global one
 };
 
 #define LFW_TCP_STATE_NONE 0
@@ -42,6 +49,22 @@ struct conntrack_val {
 #define LFW_TCP_STATE_ESTABLISHED 3
 #define LFW_TCP_STATE_FIN_WAIT 4
 #define LFW_TCP_STATE_CLOSED 5
+#define LFW_TCP_STATES 6
+
+// Conntrack table families (index of the occupancy counters)
+#define LFW_CT_IPV4 0
+#define LFW_CT_IPV6 1
+#define LFW_CT_FAMILIES 2
+
+// Per-CPU conntrack occupancy counters (conntrack_stats map). Each CPU
+// counts the changes it made, so one CPU's state gauge can go negative;
+// the sums over all CPUs, less the entries the daemon deleted, give the
+// table size and TCP state breakdown without walking the tables.
+struct lfw_conntrack_stats {
+    __u64 inserts[LFW_CT_FAMILIES]; // Entries added by the filter
+    __u64 deletes[LFW_CT_FAMILIES]; // Expired entries deleted by the filter
+    __s64 tcp_states[LFW_CT_FAMILIES][LFW_TCP_STATES]; // TCP entries that entered minus left each state
+};
 
 
 // Rule structure for BPF rules map
@@ -78,8 +101,13 @@ struct bpf_rule {
     __u8   action;
     __u8   ip_version; // 0: any, 4: IPv4, 6: IPv6
     __u8   pad;
-    __u64  hit_count;
-    __u64  byte_count;
+    __u16  sample_rate; // Report 1 in N allowed packets, 0 for the global rate
+};
+
+// Per-CPU totals of one rule (rule_stats map, indexed like rules_details_map)
+struct lfw_rule_stats {
+    __u64 hits;
+    __u64 bytes;
 };
 
 // LPM Key for BPF LPM Trie map (IPv4)
@@ -99,6 +127,24 @@ struct rule_mask {
     __u64 bits[4];
 };
 
+// Dynamic lists (dyn_* maps): address prefixes blocked or allowed at run
+// time ahead of the rules, keyed like the rule tries, each until an
+// optional deadline. A block also cuts off tracked connections; an allow
+// stands in for the rules when a connection is opened.
+#define LFW_DYN_BLOCK 0
+#define LFW_DYN_ALLOW 1
+#define LFW_DYN_LISTS 2
+
+// Entries of each list, per address family
+#define LFW_DYN_MAX_ENTRIES 65536
+
+struct lfw_dyn_val {
+    __u64 added;     // bpf_ktime_get_ns() when added
+    __u64 expires;   // bpf_ktime_get_ns() deadline, 0 for never
+    __u32 prefixlen; // The key's, so the filter can delete the entry once expired
+    __u32 pad;
+};
+
 // Telemetry event for Ring Buffer
 struct lfw_event {
     union {
@@ -114,9 +160,99 @@ struct lfw_event {
     __u8   proto;
     __u8   action; // 1: ALLOW, 2: DROP
     __u8   ip_version; // 4: IPv4, 6: IPv6
-    __u8   pad;
-    __u64  pkt_len;
+    __u8   kind; // LFW_EVENT_*
+    __u64  pkt_len; // Bytes of all packets the event covers
     __u64  timestamp;
+    __u32  packets; // Packets the event covers (1 unless aggregated)
+    __u32  rule; // Index of the deciding rule, LFW_EVENT_RULE_NONE otherwise
+    __u32  sample_rate; // The event stands for this many packets (flows for FLOW_NEW)
+    __u32  pad2;
 };
 
+// Event kinds
+#define LFW_EVENT_PACKET       0 // A single packet
+#define LFW_EVENT_FLOW_FIRST   1 // First packet of an aggregated flow
+#define LFW_EVENT_FLOW_SUMMARY 2 // Packets of an aggregated flow since its last event
+#define LFW_EVENT_FLOW_NEW     3 // A sampled new connection
+
+// Verdict not made by a rule (out-of-state or default policy)
+#define LFW_EVENT_RULE_NONE 0xFFFFFFFFu
+
+// config_map indices
+#define LFW_CONFIG_DEFAULT_ACTION   0
+#define LFW_CONFIG_RULE_COUNT       1
+#define LFW_CONFIG_LOG_LEVEL        2
+#define LFW_CONFIG_TELEMETRY_WINDOW 3 // Aggregation window in ms, 0 for per-packet events
+#define LFW_CONFIG_SAMPLE_PACKETS   4 // Report 1 in N allowed packets, 0 for log level rules
+#define LFW_CONFIG_SAMPLE_FLOWS     5 // Report 1 in N new connections, 0 for none
+#define LFW_CONFIG_MAX              6
+
+// Aggregated flows tracked by telemetry_agg
+#define LFW_AGG_MAX_FLOWS 16384
+
+// Aggregation key: source port is left out so a scan from many ports is
+// one flow. IPv4 addresses occupy the first 4 bytes, the rest is zero.
+struct lfw_agg_key {
+    struct in6_addr src_ip;
+    struct in6_addr dst_ip;
+    __be16 dst_port;
+    __u8   proto;
+    __u8   action;
+    __u8   ip_version;
+    __u8   pad[3];
+    __u32  rule;
+};
+
+// Per-CPU aggregation state: counts since the last event of the flow
+struct lfw_agg_val {
+    __u64 packets;
+    __u64 bytes;
+    __u64 window_start; // 0 until this CPU has seen the flow
+    __u64 last_seen;
+    __u32 sample_rate;  // Rate the counted packets were sampled at
+    __u32 pad;
+};
+
+// Telemetry classes: drops and allows travel in separate rings, so a
+// flood of one cannot crowd out the other
+#define LFW_EVENTS_DROP  0
+#define LFW_EVENTS_ALLOW 1
+#define LFW_EVENTS_CLASSES 2
+
+// Default size of each events ring in bytes (per CPU with per-CPU rings)
+#define LFW_EVENTS_RINGBUF_SIZE (256 * 1024)
+
+// Events are submitted without waking the consumer until this fraction
+// (1 / 2^shift) of their ring is pending; below it the consumer picks
+// them up on its poll timer
+#define LFW_EVENTS_WAKEUP_SHIFT 3
+
+// Per-CPU telemetry counters (telemetry_stats map)
+struct lfw_telemetry_stats {
+    __u64 submitted;      // Events written to the events rings
+    __u64 reserve_failed; // Events lost because their ring was full
+    __u64 wakeups;        // Submissions that woke the consumer
+    __u64 drop_reserve_failed; // Drop events among reserve_failed
+};
+
+// Verdict reasons: index of the per-CPU reason_stats counters, one per
+// way a packet can leave the filter, plus the conntrack events along the
+// way. Counted for every packet whatever the log level.
+#define LFW_REASON_NOT_IP            0  // Neither IPv4 nor IPv6, passed
+#define LFW_REASON_TRUNCATED         1  // Headers cut short, passed unparsed
+#define LFW_REASON_IPV6_EXT          2  // IPv6 extension headers too deep to parse, passed
+#define LFW_REASON_CT_ALLOW          3  // Packet of a tracked connection, allowed
+#define LFW_REASON_CT_DROP           4  // Packet of a tracked connection, dropped
+#define LFW_REASON_OUT_OF_STATE      5  // TCP packet of no tracked connection that is not a SYN, dropped
+#define LFW_REASON_RULE_ALLOW        6  // Allowed by a rule
+#define LFW_REASON_RULE_DROP         7  // Dropped by a rule
+#define LFW_REASON_DEFAULT_ALLOW     8  // No rule matched, allowed by the default policy
+#define LFW_REASON_DEFAULT_DROP      9  // No rule matched, dropped by the default policy
+#define LFW_REASON_CT_NEW            10 // Connections added to the conntrack map
+#define LFW_REASON_CT_INSERT_FAILED  11 // Connections the conntrack map had no room for
+#define LFW_REASON_CT_EXPIRED        12 // Expired connections deleted on lookup
+#define LFW_REASON_DYN_BLOCK         13 // Source or destination on the dynamic block list, dropped
+#define LFW_REASON_DYN_ALLOW         14 // New connection on the dynamic allow list, allowed
+#define LFW_REASON_MAX               15
+
 #endif
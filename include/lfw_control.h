@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_CONTROL_H
+#define LFW_CONTROL_H
+
+#include "lfw_types.h"
+
+// Control socket (lfw --control): a Unix stream socket over which lfwctl
+// asks the daemon to reload, report statistics, list or flush conntrack
+// entries, tell which rule a 5-tuple would hit, and edit the dynamic
+// block and allow lists.
+//
+// Every message is an lfw_ctl_header_t followed by length bytes of
+// payload, in host byte order. A request's code is an lfw_ctl_cmd_t and
+// its reply's code an lfw_ctl_status_t; a failed request's payload is a
+// message for the user, not NUL-terminated. A connection may carry any
+// number of requests, each answered in turn.
+
+#define LFW_CONTROL_MAGIC   0x4c465743u // "LFWC"
+#define LFW_CONTROL_VERSION 1
+
+// Large enough for a batch of LFW_CTL_DYN_BATCH_MAX dynamic list entries
+#define LFW_CONTROL_MAX_REQUEST  (64u << 10)
+#define LFW_CONTROL_MAX_RESPONSE (16u << 20)
+
+typedef struct {
+    lfw_u32 magic;   // LFW_CONTROL_MAGIC
+    lfw_u16 version; // LFW_CONTROL_VERSION
+    lfw_u16 code;    // lfw_ctl_cmd_t or lfw_ctl_status_t
+    lfw_u32 length;  // Payload bytes that follow
+} lfw_ctl_header_t;
+
+typedef enum {
+    LFW_CTL_RELOAD          = 1, // No payload; replies lfw_ctl_reload_t
+    LFW_CTL_STATS           = 2, // No payload; replies lfw_stats_t
+    LFW_CTL_CONNTRACK_LIST  = 3, // lfw_ctl_ct_filter_t; replies lfw_ctl_ct_list_t
+    LFW_CTL_CONNTRACK_FLUSH = 4, // lfw_ctl_ct_filter_t; replies lfw_ctl_ct_flush_t
+    LFW_CTL_MATCH           = 5, // lfw_ctl_match_t; replies lfw_ctl_match_result_t
+    LFW_CTL_DYN_ADD         = 6, // lfw_ctl_dyn_entry_t array; replies lfw_ctl_dyn_result_t
+    LFW_CTL_DYN_DEL         = 7, // lfw_ctl_dyn_entry_t array; replies lfw_ctl_dyn_result_t
+    LFW_CTL_DYN_LIST        = 8, // lfw_ctl_dyn_filter_t; replies lfw_ctl_dyn_list_t
+    LFW_CTL_DYN_FLUSH       = 9, // lfw_ctl_dyn_filter_t; replies lfw_ctl_dyn_result_t
+} lfw_ctl_cmd_t;
+
+typedef enum {
+    LFW_CTL_OK = 0,
+    LFW_CTL_ERR_INVALID,     // Malformed request
+    LFW_CTL_ERR_UNSUPPORTED, // Unknown command
+    LFW_CTL_ERR_FAILED,      // The command failed
+} lfw_ctl_status_t;
+
+// Rule index meaning the default policy decided
+#define LFW_CTL_RULE_NONE 0xFFFFFFFFu
+
+// Conntrack state that matches any state
+#define LFW_CTL_STATE_ANY 0xFF
+
+typedef struct {
+    lfw_u32 rule_count;     // Rules installed
+    lfw_u32 default_action; // LFW_ACTION_ACCEPT or LFW_ACTION_DROP
+    lfw_u64 duration_ns;    // Time the reload took
+} lfw_ctl_reload_t;
+
+// Selects conntrack entries; zeroed fields match anything. Address and
+// port match either endpoint, as entries do not record a direction.
+typedef struct {
+    lfw_u8  family;     // 0, 4 or 6
+    lfw_u8  proto;      // 0 or an IP protocol number
+    lfw_u8  state;      // LFW_TCP_STATE_* or LFW_CTL_STATE_ANY
+    lfw_u8  prefix;     // Leading bits of addr to compare, 0 for any address; needs family
+    lfw_u16 port;       // 0 for any port
+    lfw_u16 reserved;
+    lfw_u8  addr[16];   // Network byte order; IPv4 uses the first 4 bytes
+    lfw_u32 limit;      // Entries to list at most, 0 for LFW_CTL_LIST_DEFAULT
+} lfw_ctl_ct_filter_t;
+
+#define LFW_CTL_LIST_DEFAULT 1000
+#define LFW_CTL_LIST_MAX     100000
+
+typedef struct {
+    lfw_u8  family;   // 4 or 6
+    lfw_u8  proto;
+    lfw_u8  state;    // LFW_TCP_STATE_*, TCP only
+    lfw_u8  action;   // LFW_ACTION_ACCEPT or LFW_ACTION_DROP
+    lfw_u16 port_a;   // Endpoints in the table's order, lower address first
+    lfw_u16 port_b;
+    lfw_u8  addr_a[16];
+    lfw_u8  addr_b[16];
+    lfw_u32 rule;     // Rule that opened it, from 0, or LFW_CTL_RULE_NONE
+    lfw_u32 idle_ms;  // Since the last packet
+    lfw_u64 packets;
+    lfw_u64 bytes;
+} lfw_ctl_ct_entry_t;
+
+// Followed by count lfw_ctl_ct_entry_t
+typedef struct {
+    lfw_u32 matched; // Entries the filter selected
+    lfw_u32 count;   // Entries listed, at most the filter's limit
+} lfw_ctl_ct_list_t;
+
+typedef struct {
+    lfw_u64 deleted;
+} lfw_ctl_ct_flush_t;
+
+// A packet of a new connection, from src to dst
+typedef struct {
+    lfw_u8  family;   // 4 or 6
+    lfw_u8  proto;
+    lfw_u16 src_port; // Host byte order; ignored unless TCP or UDP
+    lfw_u16 dst_port;
+    lfw_u16 reserved;
+    lfw_u8  src[16];  // Network byte order; IPv4 uses the first 4 bytes
+    lfw_u8  dst[16];
+} lfw_ctl_match_t;
+
+typedef struct {
+    lfw_u32 rule;           // First matching rule, from 0, or LFW_CTL_RULE_NONE
+    lfw_u8  action;         // Verdict of the rules for a new connection
+    lfw_u8  tracked;        // 1 if a conntrack entry decides this tuple instead
+    lfw_u8  tracked_action; // Its action and TCP state, if tracked
+    lfw_u8  tracked_state;
+    lfw_u8  dynamic;        // Dynamic list that decides first (LFW_CTL_DYN_*), LFW_CTL_DYN_ANY if none
+    lfw_u8  reserved[3];
+} lfw_ctl_match_result_t;
+
+// Dynamic lists: address prefixes blocked or allowed ahead of the rules.
+// A block drops every packet from or to the prefix, tracked connections
+// included; an allow admits new connections the rules would not look at.
+// A block wins over an allow. Entries outlive a reload, not a restart.
+#define LFW_CTL_DYN_BLOCK 0
+#define LFW_CTL_DYN_ALLOW 1
+#define LFW_CTL_DYN_ANY   0xFF // Either list, in a filter
+
+typedef struct {
+    lfw_u8  list;     // LFW_CTL_DYN_BLOCK or LFW_CTL_DYN_ALLOW
+    lfw_u8  family;   // 4 or 6
+    lfw_u8  prefix;   // 1 to 32 or 128; bits of addr past it are ignored
+    lfw_u8  reserved;
+    lfw_u32 ttl_s;    // Seconds until the entry lapses, 0 for never; when listed, seconds left
+    lfw_u8  addr[16]; // Network byte order; IPv4 uses the first 4 bytes
+} lfw_ctl_dyn_entry_t;
+
+#define LFW_CTL_DYN_BATCH_MAX (LFW_CONTROL_MAX_REQUEST / sizeof(lfw_ctl_dyn_entry_t))
+
+// An add applies entries in order and stops at the first the list has no
+// room for, failing the request with the ones before it applied. A delete
+// skips prefixes that are not listed.
+typedef struct {
+    lfw_u32 applied; // Entries added or deleted
+} lfw_ctl_dyn_result_t;
+
+// Selects dynamic list entries
+typedef struct {
+    lfw_u8  list;     // LFW_CTL_DYN_BLOCK, LFW_CTL_DYN_ALLOW or LFW_CTL_DYN_ANY
+    lfw_u8  family;   // 0, 4 or 6
+    lfw_u16 reserved;
+    lfw_u32 limit;    // Entries to list at most, 0 for LFW_CTL_LIST_DEFAULT
+} lfw_ctl_dyn_filter_t;
+
+// Followed by count lfw_ctl_dyn_entry_t
+typedef struct {
+    lfw_u32 matched; // Unexpired entries the filter selected
+    lfw_u32 count;   // Entries listed, at most the filter's limit
+} lfw_ctl_dyn_list_t;
+
+// Daemon side
+
+typedef struct lfw_control lfw_control_t;
+typedef struct lfw_control_reply lfw_control_reply_t;
+
+// Answer one request by filling reply; it starts as LFW_CTL_OK and empty
+typedef void (*lfw_control_handler_t)(void *ctx, lfw_u16 command, const void *payload, lfw_u32 length,
+                                      lfw_control_reply_t *reply);
+
+#define LFW_CONTROL_MAX_CLIENTS 8
+
+// Listen on path, mode 0600, replacing a stale socket there. The socket
+// never blocks: requests are read and replies written as the caller's
+// event loop finds them ready. handler runs in lfw_control_run, which the
+// caller hands to a worker so a slow request never holds up the loop.
+// Returns NULL with errno set on failure.
+lfw_control_t *lfw_control_open(const char *path, lfw_control_handler_t handler, void *ctx);
+
+// Descriptor that turns readable when lfw_control_process has work: an
+// epoll set over the listening socket, every connection and the answers
+// of lfw_control_run
+int lfw_control_fd(const lfw_control_t *ctl);
+
+// Serve whatever is ready, send the replies lfw_control_run finished and
+// drop clients idle for too long. A client waiting for its answer is
+// never idle. Returns the milliseconds until the next idle client is due
+// to be dropped, 0 if no client is connected, for the caller to process
+// again by then.
+lfw_u32 lfw_control_process(lfw_control_t *ctl);
+
+// Whether requests read by lfw_control_process wait for lfw_control_run;
+// safe from any thread
+bool lfw_control_pending(lfw_control_t *ctl);
+
+// Answer every waiting request, one at a time, on the calling thread. The
+// replies go out from lfw_control_process. Call it from one thread at a
+// time, concurrently with the loop.
+void lfw_control_run(lfw_control_t *ctl);
+
+// Close every connection and remove the socket. No lfw_control_run may
+// be in progress.
+void lfw_control_close(lfw_control_t *ctl);
+
+// Append to the reply payload. Returns false, and fails the request, if
+// the reply would exceed LFW_CONTROL_MAX_RESPONSE or memory runs out.
+bool lfw_control_reply_append(lfw_control_reply_t *reply, const void *data, size_t length);
+
+// Payload appended so far, valid until the next append
+void *lfw_control_reply_data(lfw_control_reply_t *reply);
+
+// Fail the request with status and a message, discarding any payload
+void lfw_control_reply_error(lfw_control_reply_t *reply, lfw_ctl_status_t status, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Client side
+
+// Send one request to the daemon at path and wait up to timeout_ms for
+// the reply. On LFW_OK, *status is the reply code and *reply a malloc'ed
+// payload of *reply_length bytes, NUL-terminated for convenience.
+// Other returns leave errno set.
+lfw_status_t lfw_control_call(const char *path, lfw_u16 command, const void *payload, lfw_u32 length,
+                              int timeout_ms, lfw_u16 *status, void **reply, lfw_u32 *reply_length);
+
+#endif
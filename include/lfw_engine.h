@@ -9,6 +9,7 @@
 #include <pthread.h>
 
 struct lfw_state;
+struct lfw_matcher;
 
 // Engine config
 typedef struct {
@@ -17,8 +18,9 @@ typedef struct {
 
 // Ruleset
 typedef struct {
-    const lfw_rule_t *rules;
-    lfw_u32           rule_count;
+    const lfw_rule_t   *rules;
+    lfw_u32             rule_count;
+    struct lfw_matcher *matcher; // SoA index of rules (optional)
 } lfw_ruleset_t;
 
 // Engine context
@@ -36,6 +38,23 @@ lfw_verdict_t lfw_engine_evaluate(
     lfw_packet_t *packet
 );
 
+// Packets resolved per ruleset snapshot by lfw_engine_evaluate_batch
+#define LFW_ENGINE_BATCH_MAX 64
+
+// Evaluate count packets into verdicts (thread-safe). Verdicts, state
+// updates and rule counters match calling lfw_engine_evaluate in order.
+lfw_status_t lfw_engine_evaluate_batch(
+    lfw_engine_t *engine,
+    lfw_packet_t *packets,
+    lfw_u32 count,
+    lfw_verdict_t *verdicts
+);
+
+// Expire connections up to the state clock's current time. Only needed
+// when connection_state was created with a caller-driven clock: call it
+// as that clock advances (thread-safe)
+void lfw_engine_tick(lfw_engine_t *engine);
+
 // Reload rules dynamically from config_path (thread-safe)
 lfw_status_t lfw_engine_reload_rules(lfw_engine_t *engine);
 
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_EVENTLOG_H
+#define LFW_EVENTLOG_H
+
+#include "lfw_bpf_shared.h"
+#include "lfw_types.h"
+
+// Binary telemetry log: raw struct lfw_event records appended to
+// size-rotated files, decoded offline by lfw-eventdump. Records are
+// staged in a buffer and written in large batches, so appending costs a
+// memcpy. The active file is <path>; on rotation it becomes <path>.1,
+// older files shift up and the oldest beyond max_files is removed.
+
+#define LFW_EVENTLOG_MAGIC   "LFWEVLOG"
+#define LFW_EVENTLOG_VERSION 1
+
+// File header, followed by records of record_size bytes each. Fields
+// are in host byte order; addresses and ports inside records keep the
+// network byte order they had on the ring buffer.
+typedef struct {
+    char    magic[8];          // LFW_EVENTLOG_MAGIC, not NUL-terminated
+    lfw_u32 version;           // LFW_EVENTLOG_VERSION
+    lfw_u32 record_size;       // sizeof(struct lfw_event) of the writer
+    lfw_u64 mono_to_epoch_ns;  // Added to event timestamps for wall-clock time
+    lfw_u64 reserved;
+} lfw_eventlog_header_t;
+
+// Sink configuration
+typedef struct {
+    const char *path;      // Active file
+    lfw_u64     max_bytes; // Rotate once the active file reaches this size (0: default)
+    lfw_u32     max_files; // Rotated files kept besides the active one (0: default)
+    lfw_u32     flush_ms;  // Longest time records stay buffered (0: default)
+} lfw_eventlog_config_t;
+
+// Sink counters
+typedef struct {
+    lfw_u64 records;   // Records written to disk
+    lfw_u64 lost;      // Records discarded after a failed write
+    lfw_u64 rotations;
+} lfw_eventlog_stats_t;
+
+typedef struct lfw_eventlog lfw_eventlog_t;
+
+// Open the sink. An existing active file is rotated away so every file
+// starts with a header. Returns NULL on failure, with the reason logged.
+// Not thread-safe: one thread appends and flushes.
+lfw_eventlog_t *lfw_eventlog_open(const lfw_eventlog_config_t *config);
+
+// Append count records; the buffer is written out when it fills up
+lfw_status_t lfw_eventlog_append(lfw_eventlog_t *log, const struct lfw_event *events, lfw_u32 count);
+
+// Write buffered records if they are older than flush_ms, or always when force is set
+lfw_status_t lfw_eventlog_flush(lfw_eventlog_t *log, bool force);
+
+// Read counters
+void lfw_eventlog_get_stats(const lfw_eventlog_t *log, lfw_eventlog_stats_t *stats);
+
+// Flush and close
+void lfw_eventlog_close(lfw_eventlog_t *log);
+
+#endif
@@ -9,13 +9,37 @@
 // Log target configuration
 typedef enum {
     LFW_LOG_CONSOLE = 0,
-    LFW_LOG_SYSLOG
+    LFW_LOG_SYSLOG,
+    LFW_LOG_FILE
 } lfw_log_target_t;
 
-// Initialize the logging subsystem
+// Asynchronous logging config
+typedef struct {
+    lfw_u32 ring_cells; // 64-byte cells per thread ring, rounded up to a power of two (0: default)
+    lfw_u32 flush_ms;   // Writer wakeup interval when rings are not filling up, while anything is logged (0: default)
+} lfw_log_async_config_t;
+
+// Initialize the logging subsystem (console or syslog)
 void lfw_log_init(lfw_log_target_t target);
 
-// Close the logging subsystem
+// Initialize the logging subsystem, appending to a file
+lfw_status_t lfw_log_init_file(const char *path);
+
+// Switch to asynchronous logging (config may be NULL for defaults).
+// Callers then only copy a fixed-size record into a per-thread ring; a
+// background thread formats and writes records in batches. A full ring
+// drops the record and counts it instead of blocking the caller. Once a
+// wakeup finds nothing to write, the thread sleeps until the next record.
+lfw_status_t lfw_log_start_async(const lfw_log_async_config_t *config);
+
+// Wait until records logged so far have been written (no-op when synchronous)
+void lfw_log_flush(void);
+
+// Records dropped on full rings since lfw_log_start_async
+lfw_u64 lfw_log_get_dropped(void);
+
+// Close the logging subsystem, writing out pending records first. Other
+// threads must have stopped logging.
 void lfw_log_close(void);
 
 // Log raw packet verdict decisions
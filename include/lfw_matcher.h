@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_MATCHER_H
+#define LFW_MATCHER_H
+
+#include "lfw_types.h"
+#include "lfw_packet.h"
+#include "lfw_rules.h"
+
+// Returned by lfw_matcher_first when no rule matches
+#define LFW_MATCHER_NONE 0xFFFFFFFFu
+
+// Structure-of-arrays index of a ruleset, compared against one packet
+// several rules at a time (AVX-512, AVX2 or scalar, picked at runtime)
+typedef struct lfw_matcher lfw_matcher_t;
+
+// Build index over rules; the rules array is not referenced afterwards
+lfw_matcher_t *lfw_matcher_create(const lfw_rule_t *rules, lfw_u32 rule_count);
+
+// Destroy index
+void lfw_matcher_destroy(lfw_matcher_t *matcher);
+
+// Index of the first rule matching packet (same semantics as
+// lfw_rule_match in rule order), or LFW_MATCHER_NONE
+lfw_u32 lfw_matcher_first(const lfw_matcher_t *matcher, const lfw_packet_t *packet);
+
+// Name of the instruction set selected at runtime
+const char *lfw_matcher_isa(const lfw_matcher_t *matcher);
+
+#endif
@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_METRICS_H
+#define LFW_METRICS_H
+
+#include "lfw_stats.h"
+#include "lfw_types.h"
+
+// OpenMetrics exporter (lfw --metrics): answers HTTP GET requests with
+// the daemon's statistics in OpenMetrics text format, on a Unix socket or
+// a loopback TCP port. A scrape is built from the snapshot last handed to
+// lfw_metrics_update, so it never reads BPF maps or takes the BPF lock.
+
+// Start serving. listen is an absolute Unix socket path or a TCP port
+// number bound on 127.0.0.1. Returns an error, logged, if the socket
+// cannot be set up.
+lfw_status_t lfw_metrics_start(const char *listen);
+
+// Replace the snapshot served to scrapes; a no-op when not started
+void lfw_metrics_update(const lfw_stats_t *snapshot);
+
+// Stop serving and remove the Unix socket, if any
+void lfw_metrics_stop(void);
+
+#endif
@@ -18,6 +18,9 @@ typedef struct {
     lfw_port_t dst_port;
 } lfw_l4_ports_t;
 
+// lfw_packet_t.rule_index when no rule decided the verdict
+#define LFW_RULE_INDEX_NONE 0xFFFFFFFFu
+
 // Normalized firewall packet
 typedef struct {
     lfw_direction_t direction;
@@ -28,6 +31,7 @@ typedef struct {
 
     bool is_new_connection;
     bool is_established;
+    lfw_u32      rule_index;  // Rule that decided the verdict, set by the engine
     lfw_u8       tcp_flags;
     lfw_u32      length;
     bool         is_v6;
@@ -11,6 +11,42 @@
 #include "lfw_packet.h"
 #include "lfw_types.h"
 
+// Link-layer framing in front of the IP header
+typedef enum {
+    LFW_LINK_RAW = 0,      // Frame starts at the IP header
+    LFW_LINK_ETHERNET,     // Ethernet II, optionally 802.1Q / 802.1ad (QinQ) tagged
+    LFW_LINK_LINUX_SLL,    // Linux cooked capture v1 (16-byte header)
+    LFW_LINK_LINUX_SLL2    // Linux cooked capture v2 (20-byte header)
+} lfw_link_t;
+
+// Zero-copy view of one frame: header offsets into the caller's buffer and
+// the 5-tuple in a fixed layout. Only valid while the frame buffer is.
+typedef struct {
+    const uint8_t *frame;
+    lfw_u32        frame_len;
+    lfw_u16        l3_offset;
+    lfw_u16        l4_offset;   // 0 when there is no TCP/UDP header
+    lfw_u16        vlan_id;     // Outermost VLAN id, 0 if untagged
+    lfw_u8         ip_version;  // 4 or 6, 0 if the frame failed to parse
+    lfw_u8         protocol;
+    lfw_u8         tcp_flags;
+    lfw_u16        src_port;    // Network byte order
+    lfw_u16        dst_port;
+    lfw_u32        src_v4;      // IPv4 only; IPv6 addresses stay in the frame
+    lfw_u32        dst_v4;
+} lfw_packet_view_t;
+
+// Address pointers of a view (4 or 16 bytes, network byte order)
+static inline const uint8_t *lfw_view_src_ip(const lfw_packet_view_t *v)
+{
+    return v->ip_version == 4 ? (const uint8_t *)&v->src_v4 : v->frame + v->l3_offset + 8;
+}
+
+static inline const uint8_t *lfw_view_dst_ip(const lfw_packet_view_t *v)
+{
+    return v->ip_version == 4 ? (const uint8_t *)&v->dst_v4 : v->frame + v->l3_offset + 24;
+}
+
 // Parse IP packet (IPv4 or IPv6)
 lfw_status_t lfw_parse_packet(
     const uint8_t *data,
@@ -19,4 +55,38 @@ lfw_status_t lfw_parse_packet(
     lfw_packet_t *out_packet
 );
 
+// Parse a link-layer frame into a view without copying the packet
+lfw_status_t lfw_parse_view(
+    lfw_link_t link,
+    const uint8_t *frame,
+    size_t len,
+    lfw_packet_view_t *out_view
+);
+
+// Parse count frames, prefetching ahead; returns the number parsed.
+// Frames that fail to parse get ip_version 0.
+lfw_u32 lfw_parse_view_batch(
+    lfw_link_t link,
+    const uint8_t *const *frames,
+    const lfw_u32 *lens,
+    lfw_u32 count,
+    lfw_packet_view_t *out_views
+);
+
+// Fill a normalized packet from a view (every field is written, no memset)
+void lfw_packet_from_view(
+    const lfw_packet_view_t *view,
+    lfw_direction_t direction,
+    lfw_packet_t *out_packet
+);
+
+// Parse a link-layer frame straight into a normalized packet
+lfw_status_t lfw_parse_frame(
+    lfw_link_t link,
+    const uint8_t *frame,
+    size_t len,
+    lfw_direction_t direction,
+    lfw_packet_t *out_packet
+);
+
 #endif
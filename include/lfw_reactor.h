@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_REACTOR_H
+#define LFW_REACTOR_H
+
+#include <signal.h>
+
+#include "lfw_types.h"
+
+// Event loop of the daemon's main thread: one epoll set watching
+// descriptors, timers (timerfd) and signals (signalfd), whose callbacks
+// run on the thread in lfw_reactor_run. Callbacks must not block for
+// long; heavy work is queued as a task to a small pool of worker threads,
+// so the loop keeps answering while a sweep or a DNS lookup runs.
+
+typedef struct lfw_reactor lfw_reactor_t;
+typedef struct lfw_reactor_timer lfw_reactor_timer_t;
+
+// A descriptor is ready; events are the EPOLL* bits reported
+typedef void (*lfw_reactor_fd_cb_t)(void *ctx, lfw_u32 events);
+typedef void (*lfw_reactor_timer_cb_t)(void *ctx);
+typedef void (*lfw_reactor_signal_cb_t)(void *ctx, int signo);
+typedef void (*lfw_reactor_task_fn_t)(void *ctx);
+
+// Work run on the pool, one run at a time. Queueing a task that is
+// already waiting does nothing; queueing one that is running has it run
+// once more afterwards. Requests made during a run are not lost, and a
+// timer firing faster than the task completes does not pile runs up.
+typedef struct lfw_reactor_task {
+    lfw_reactor_task_fn_t fn;
+    void                 *ctx;
+
+    // Owned by the reactor
+    bool                     queued;
+    bool                     running;
+    struct lfw_reactor_task *next;
+} lfw_reactor_task_t;
+
+#define LFW_REACTOR_TASK(task_fn, task_ctx) {.fn = (task_fn), .ctx = (task_ctx)}
+
+#define LFW_REACTOR_MAX_WORKERS 8
+
+// Create a reactor with workers pool threads (1 to LFW_REACTOR_MAX_WORKERS).
+// Returns NULL with errno set on failure.
+lfw_reactor_t *lfw_reactor_create(lfw_u32 workers);
+
+// Watch fd for events (EPOLLIN, EPOLLOUT); the caller keeps owning fd
+lfw_status_t lfw_reactor_add_fd(lfw_reactor_t *r, int fd, lfw_u32 events, lfw_reactor_fd_cb_t cb, void *ctx);
+
+// Stop watching fd; safe from its own callback
+void lfw_reactor_del_fd(lfw_reactor_t *r, int fd);
+
+// Add a timer, disarmed. Returns NULL with errno set on failure.
+lfw_reactor_timer_t *lfw_reactor_timer_add(lfw_reactor_t *r, lfw_reactor_timer_cb_t cb, void *ctx);
+
+// Fire after first_ms, then every interval_ms (0: once); a first_ms of 0
+// disarms. Rearming restarts the countdown.
+lfw_status_t lfw_reactor_timer_set(lfw_reactor_timer_t *timer, lfw_u32 first_ms, lfw_u32 interval_ms);
+
+// Take delivery of signals through a signalfd. They must already be
+// blocked in every thread: block them with pthread_sigmask before any
+// thread is created, so threads inherit the mask.
+lfw_status_t lfw_reactor_add_signals(lfw_reactor_t *r, const sigset_t *signals, lfw_reactor_signal_cb_t cb,
+                                     void *ctx);
+
+// Queue task for the pool; false if it is already waiting or the pool
+// is being destroyed
+bool lfw_reactor_queue(lfw_reactor_t *r, lfw_reactor_task_t *task);
+
+// Dispatch events until lfw_reactor_stop. Returns an error if waiting
+// for events fails.
+lfw_status_t lfw_reactor_run(lfw_reactor_t *r);
+
+// Make lfw_reactor_run return once the current callback is done; safe
+// from any thread
+void lfw_reactor_stop(lfw_reactor_t *r);
+
+// Stop the pool, dropping tasks not yet started and waiting for those
+// running, then close every timer and the signalfd
+void lfw_reactor_destroy(lfw_reactor_t *r);
+
+#endif
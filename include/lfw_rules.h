@@ -13,28 +13,34 @@ typedef enum {
     LFW_ACTION_DROP
 } lfw_action_t;
 
-// Rule match fields
+// Interned FQDN id meaning "no FQDN"
+#define LFW_FQDN_NONE 0
+
+// Longest FQDN accepted in a rule
+#define LFW_FQDN_MAX_LEN 253
+
+// Rule match fields and per-rule options (108 bytes, a rule spans two cache lines)
 typedef struct {
     lfw_ip_t src_ip;
     lfw_ip_t src_mask;
     lfw_ip_t dst_ip;
     lfw_ip_t dst_mask;
-    bool     match_src_ip;
-    bool     match_dst_ip;
 
     lfw_proto_t protocol;
 
     lfw_port_range_t src_port;
     lfw_port_range_t dst_port;
+
+    lfw_u32          src_fqdn;   // Interned FQDN id, LFW_FQDN_NONE if unset
+    lfw_u32          dst_fqdn;
+
+    bool             match_src_ip;
+    bool             match_dst_ip;
     bool             match_src_port;
     bool             match_dst_port;
 
     uint8_t          ip_version; // 0: any, 4: IPv4, 6: IPv6
-
-    char             src_fqdn[128];
-    char             dst_fqdn[128];
-    bool             has_src_fqdn;
-    bool             has_dst_fqdn;
+    lfw_u16          sample_rate; // Telemetry: report 1 in N allowed packets (0: global rate)
 } lfw_rule_match_t;
 
 // Firewall rule
@@ -45,10 +51,18 @@ typedef struct {
     lfw_u64          byte_count;
 } lfw_rule_t;
 
+_Static_assert(sizeof(lfw_rule_t) <= 128, "lfw_rule_t should fit two cache lines");
+
 // Match API
 bool lfw_rule_match(const lfw_rule_t *rule, const lfw_packet_t *packet);
 
 // FQDN API
+// Intern name (thread-safe); returns LFW_FQDN_NONE on failure
+lfw_u32 lfw_fqdn_intern(const char *name);
+
+// Name of an interned id, or NULL; the string lives until process exit
+const char *lfw_fqdn_name(lfw_u32 id);
+
 lfw_status_t lfw_rules_expand_fqdn(const lfw_rule_t *raw_rules, lfw_u32 raw_count,
                                    lfw_rule_t **expanded_rules, lfw_u32 *expanded_count);
 
@@ -9,9 +9,45 @@
 // Opaque state table
 typedef struct lfw_state lfw_state_t;
 
-// Create state table
+// Time source for connection timeouts, in seconds. With the default
+// (now == NULL) the wall clock is used and a background thread expires
+// connections once a second; with a caller clock no thread is started
+// and expiry runs when the caller invokes lfw_state_cleanup.
+typedef struct {
+    lfw_u64 (*now)(void *ctx);
+    void     *ctx;
+} lfw_state_clock_t;
+
+// State table config
+typedef struct {
+    lfw_u32           capacity_v4; // IPv4 slots, rounded up to a power of two (0: default)
+    lfw_u32           capacity_v6; // IPv6 slots, rounded up to a power of two (0: default)
+    bool              hugepages;   // Back large tables with hugepages when available
+    lfw_state_clock_t clock;       // Time source (zeroed: wall clock)
+} lfw_state_config_t;
+
+// Probe length statistics (inserts and locked lookups; lock-free
+// lookups are not counted so they never write shared state)
+typedef struct {
+    lfw_u64 lookups;   // Number of probe sequences
+    lfw_u64 probes;    // Total control groups visited
+    lfw_u32 max_probe; // Longest probe sequence seen
+} lfw_state_probe_stats_t;
+
+// Normalized flow key and hash, computed ahead of the table probe so
+// batched callers can prefetch the slots (see lfw_state_prepare)
+typedef struct {
+    lfw_u64 hash;
+    lfw_u8  family;                                // 4, 6, or 0 if not tracked
+    lfw_u8  data[48] __attribute__((aligned(8)));  // Opaque normalized tuple
+} lfw_state_key_t;
+
+// Create state table with default sizes
 lfw_state_t *lfw_state_create(void);
 
+// Create state table with explicit sizes
+lfw_state_t *lfw_state_create_with_config(const lfw_state_config_t *config);
+
 // Destroy state table
 void lfw_state_destroy(lfw_state_t *state);
 
@@ -27,10 +63,34 @@ void lfw_state_add(
     const lfw_packet_t *packet
 );
 
-// Clean up expired connections
+// Compute the flow key of packet and prefetch its first probe group
+void lfw_state_prepare(
+    lfw_state_t *state,
+    const lfw_packet_t *packet,
+    lfw_state_key_t *key
+);
+
+// lfw_state_established with a key from lfw_state_prepare
+bool lfw_state_established_key(
+    lfw_state_t *state,
+    const lfw_packet_t *packet,
+    const lfw_state_key_t *key
+);
+
+// lfw_state_add with a key from lfw_state_prepare
+void lfw_state_add_key(
+    lfw_state_t *state,
+    const lfw_packet_t *packet,
+    const lfw_state_key_t *key
+);
+
+// Clean up connections expired as of the state clock's current time
 void lfw_state_cleanup(lfw_state_t *state);
 
 // Get number of active connections in the table
 lfw_u32 lfw_state_get_count(lfw_state_t *state);
 
+// Get probe length statistics
+void lfw_state_get_probe_stats(lfw_state_t *state, lfw_state_probe_stats_t *out);
+
 #endif
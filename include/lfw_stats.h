@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_STATS_H
+#define LFW_STATS_H
+
+#include "lfw_types.h"
+
+// Shared statistics region (lfw --stats-file): the daemon republishes its
+// counters into a small file, normally on tmpfs, that monitoring tools map
+// read-only. Sampling it takes plain memory reads, with no syscalls and no
+// signal to the daemon, so it can be polled as often as needed.
+//
+// Updates are guarded by a sequence counter: it is odd while the daemon
+// writes, and a reader retries if it changed during its copy. Fields are
+// only ever appended, with size telling a reader how much of the layout
+// the daemon wrote; version changes only if existing fields move.
+
+#define LFW_STATS_MAGIC   "LFWSTATS"
+#define LFW_STATS_VERSION 1
+
+#define LFW_STATS_MAX_RULES   256
+#define LFW_STATS_MAX_REASONS 32
+#define LFW_STATS_NAME_LEN    32
+#define LFW_STATS_TCP_STATES  8
+
+// Totals of one installed rule; reset when a reload replaces the rules map
+typedef struct {
+    lfw_u64 hits;
+    lfw_u64 bytes;
+} lfw_stats_rule_t;
+
+// Durations of a recurring daemon task
+typedef struct {
+    lfw_u64 count;    // Runs completed
+    lfw_u64 total_ns; // Sum of their durations
+    lfw_u64 last_ns;  // Duration of the latest run
+} lfw_stats_timer_t;
+
+// Region layout. All fields are in host byte order.
+typedef struct {
+    char    magic[8];         // LFW_STATS_MAGIC, not NUL-terminated
+    lfw_u32 version;          // LFW_STATS_VERSION
+    lfw_u32 size;             // sizeof(lfw_stats_t) of the writer
+    lfw_u32 pid;              // Daemon process
+    lfw_u32 interval_ms;      // Publishing interval
+    lfw_u64 seq;              // Odd while an update is in progress
+
+    lfw_u64 updated_ns;       // CLOCK_REALTIME of the last update
+    lfw_u64 conntrack_v4;     // Tracked IPv4 connections
+    lfw_u64 conntrack_v6;     // Tracked IPv6 connections
+
+    lfw_u64 telemetry_received;      // Events drained from the rings
+    lfw_u64 telemetry_rate_limited;  // Events skipped by the rate limit
+    lfw_u64 telemetry_queue_dropped; // Events dropped with every worker queue full
+    lfw_u64 kernel_submitted;        // Events the kernel wrote to the rings
+    lfw_u64 kernel_lost;             // Events lost because a ring was full
+    lfw_u64 kernel_drop_lost;        // Drop events among kernel_lost
+    lfw_u64 kernel_wakeups;          // Consumer wakeups forced by the kernel
+
+    lfw_u32 reason_count;     // Entries used in reasons and reason_names
+    lfw_u32 rule_count;       // Entries used in rules
+    lfw_u64 reasons[LFW_STATS_MAX_REASONS];                    // Verdict reason counters
+    char    reason_names[LFW_STATS_MAX_REASONS][LFW_STATS_NAME_LEN]; // NUL-terminated
+    lfw_stats_rule_t rules[LFW_STATS_MAX_RULES];               // By rule index
+
+    // Tracked TCP connections by LFW_TCP_STATE_* (none, syn_sent,
+    // syn_recv, established, fin_wait, closed); later entries unused
+    lfw_u64 conntrack_tcp_v4[LFW_STATS_TCP_STATES];
+    lfw_u64 conntrack_tcp_v6[LFW_STATS_TCP_STATES];
+
+    lfw_stats_timer_t gc_sweep;     // Conntrack GC sweeps
+    lfw_stats_timer_t fqdn_resolve; // FQDN rule resolution passes
+    lfw_stats_timer_t reload;       // Successful rule reloads (SIGHUP or FQDN change)
+    lfw_u64 reload_failures;        // Reloads that kept the old rules
+    lfw_u8  rule_actions[LFW_STATS_MAX_RULES]; // By rule index: 1 allow, 2 drop
+} lfw_stats_t;
+
+typedef struct lfw_stats_writer lfw_stats_writer_t;
+typedef struct lfw_stats_reader lfw_stats_reader_t;
+
+// Create the region at path. It is built under a temporary name and
+// renamed into place, so readers never map a half-written header.
+// Returns NULL on failure with errno set.
+lfw_stats_writer_t *lfw_stats_writer_open(const char *path, lfw_u32 interval_ms);
+
+// Copy a snapshot into the region; the header fields of snapshot are ignored
+void lfw_stats_writer_publish(lfw_stats_writer_t *writer, const lfw_stats_t *snapshot);
+
+// Unmap and remove the region
+void lfw_stats_writer_close(lfw_stats_writer_t *writer);
+
+// Map a region read-only. Returns NULL with errno set on failure, EPROTO
+// if the file is not a region of a supported version.
+lfw_stats_reader_t *lfw_stats_reader_open(const char *path);
+
+// Take a consistent snapshot. Fields beyond what the writer's layout
+// holds are zero. Returns LFW_ERR_GENERIC if the writer kept updating
+// through every retry.
+lfw_status_t lfw_stats_reader_read(lfw_stats_reader_t *reader, lfw_stats_t *snapshot);
+
+void lfw_stats_reader_close(lfw_stats_reader_t *reader);
+
+#endif
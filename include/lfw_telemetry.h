@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_TELEMETRY_H
+#define LFW_TELEMETRY_H
+
+#include <stdint.h>
+
+#include "lfw_eventlog.h"
+#include "lfw_types.h"
+
+// Telemetry consumer for the kernel events ring buffers.
+//
+// A drain thread consumes the rings in batches with a per-pass budget,
+// drop rings before allow rings. It sleeps until the kernel forces a
+// wakeup (a batch worth of data is pending) or its poll timer fires.
+// Once a poll finds the rings empty it stops polling and has the kernel
+// wake it on the next event, so an idle firewall costs no wakeups.
+// Decoded records are copied out of the ring straight away, so ring space
+// is released before any formatting. They are then either appended to the
+// binary event log or handed in batches to worker threads that format and
+// log them. With in-kernel aggregation the drain thread also flushes flows
+// that have gone quiet.
+
+// Consumer configuration
+typedef struct {
+    lfw_u32         workers;    // Formatting threads (0: default)
+    lfw_u32         rate_limit; // Events logged per second, 0 for no limit
+    lfw_u32         budget;     // Records drained per pass (0: default)
+    lfw_u32         window_ms;  // Kernel aggregation window; quiet flows are flushed (0: off)
+    lfw_eventlog_t *eventlog;   // Binary sink used instead of logging (may be NULL)
+} lfw_telemetry_config_t;
+
+// Consumer and kernel counters
+typedef struct {
+    lfw_u64 received;         // Records drained from the ring buffer
+    lfw_u64 rate_limited;     // Records skipped by the rate limit
+    lfw_u64 queue_dropped;    // Records dropped because every worker queue was full
+    lfw_u64 kernel_submitted; // Records the kernel wrote to the ring buffer
+    lfw_u64 kernel_lost;      // Records the kernel could not reserve (ring full)
+    lfw_u64 kernel_drop_lost; // Drop records among kernel_lost
+    lfw_u64 kernel_wakeups;   // Consumer wakeups forced by the kernel
+} lfw_telemetry_stats_t;
+
+// Start the drain thread and workers on the events ring buffer. The
+// eventlog, if any, stays owned by the caller and must outlive the
+// consumer.
+lfw_status_t lfw_telemetry_start(const lfw_telemetry_config_t *config);
+
+// Stop the drain thread without waiting for its poll timeout, let
+// workers finish queued records, and join them
+void lfw_telemetry_stop(void);
+
+// Offset of userspace CLOCK_MONOTONIC over the kernel event clock; false
+// until the first event has been seen
+bool lfw_telemetry_clock_offset(int64_t *offset);
+
+// Read counters; kernel counters are zero if the BPF map cannot be read
+void lfw_telemetry_get_stats(lfw_telemetry_stats_t *stats);
+
+#endif
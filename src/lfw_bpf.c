@@ -2,6 +2,7 @@
 
 #define __KERNEL__
 #include <linux/bpf.h>
+#include <linux/errno.h>
 #include <linux/pkt_cls.h>
 #include <linux/if_ether.h>
 #include <linux/ip.h>
@@ -71,6 +72,43 @@ struct {
     __uint(map_flags, BPF_F_NO_PREALLOC);
 } dst_ip6_trie SEC(".maps");
 
+// Dynamic block and allow lists, pinned so their entries outlive a reload
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, LFW_DYN_MAX_ENTRIES);
+    __type(key, struct lpm_key);
+    __type(value, struct lfw_dyn_val);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} dyn_block_v4 SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, LFW_DYN_MAX_ENTRIES);
+    __type(key, struct lpm_key);
+    __type(value, struct lfw_dyn_val);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} dyn_allow_v4 SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, LFW_DYN_MAX_ENTRIES);
+    __type(key, struct lpm6_key);
+    __type(value, struct lfw_dyn_val);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} dyn_block_v6 SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, LFW_DYN_MAX_ENTRIES);
+    __type(key, struct lpm6_key);
+    __type(value, struct lfw_dyn_val);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} dyn_allow_v6 SEC(".maps");
+
 // General config & telemetry maps
 struct {
     __uint(type, BPF_MAP_TYPE_ARRAY);
@@ -79,59 +117,397 @@ struct {
     __type(value, struct bpf_rule);
 } rules_details_map SEC(".maps");
 
+// Rule hit counters live apart from the rules, per CPU, so counting a hit
+// never bounces the cache line every packet reads to match the rule
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 256);
+    __type(key, __u32);
+    __type(value, struct lfw_rule_stats);
+} rule_stats SEC(".maps");
+
 struct {
     __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(max_entries, 3);
+    __uint(max_entries, LFW_CONFIG_MAX);
     __type(key, __u32);
     __type(value, __u32);
 } config_map SEC(".maps");
 
+// Events rings: drops and allows are kept apart so the consumer can
+// favour drops. Sizes are set by the daemon at load time.
+struct ringbuf_inner {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, LFW_EVENTS_RINGBUF_SIZE);
+};
+
 struct {
     __uint(type, BPF_MAP_TYPE_RINGBUF);
-    __uint(max_entries, 256 * 1024);
+    __uint(max_entries, LFW_EVENTS_RINGBUF_SIZE);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} events_drop_ringbuf SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, LFW_EVENTS_RINGBUF_SIZE);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} events_allow_ringbuf SEC(".maps");
+
+// Optional per-CPU rings indexed by CPU, installed by the daemon so
+// producers on different CPUs do not share a ring lock. A CPU without
+// one falls back to the shared ring of the class.
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY_OF_MAPS);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+    __array(values, struct ringbuf_inner);
+} events_drop_percpu SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY_OF_MAPS);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+    __array(values, struct ringbuf_inner);
+} events_allow_percpu SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct lfw_telemetry_stats);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} telemetry_stats SEC(".maps");
+
+// Non-zero while the consumer sleeps without a poll timer because every
+// ring was empty; events then wake it straight away
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, __u32);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} telemetry_idle SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, LFW_AGG_MAX_FLOWS);
+    __type(key, struct lfw_agg_key);
+    __type(value, struct lfw_agg_val);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} telemetry_agg SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, LFW_REASON_MAX);
+    __type(key, __u32);
+    __type(value, __u64);
     __uint(pinning, LIBBPF_PIN_BY_NAME);
-} events_ringbuf SEC(".maps");
+} reason_stats SEC(".maps");
 
-static __attribute__((always_inline)) inline void submit_telemetry_v4(__u32 log_level, __be32 src_ip, __be32 dst_ip, __be16 src_port, __be16 dst_port, __u8 proto, __u8 action, __u64 pkt_len, __u64 timestamp)
+static __attribute__((always_inline)) inline void count_reason(__u32 reason)
 {
-    if (log_level == 0) return;
-    if (log_level == 1 && action == 1) return;
+    __u64 *count = bpf_map_lookup_elem(&reason_stats, &reason);
+    if (count)
+        (*count)++;
+}
 
-    struct lfw_event *event = bpf_ringbuf_reserve(&events_ringbuf, sizeof(struct lfw_event), 0);
-    if (event) {
-        event->ip_version = 4;
-        event->src_ip.v4 = src_ip;
-        event->dst_ip.v4 = dst_ip;
-        event->src_port = src_port;
-        event->dst_port = dst_port;
-        event->proto = proto;
-        event->action = action;
-        event->pkt_len = pkt_len;
-        event->timestamp = timestamp;
-        bpf_ringbuf_submit(event, 0);
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct lfw_conntrack_stats);
+    __uint(pinning, LIBBPF_PIN_BY_NAME);
+} conntrack_stats SEC(".maps");
+
+// Conntrack occupancy bookkeeping. The TCP state gauges only follow TCP
+// entries; UDP entries reuse the state field for their own states.
+static __attribute__((always_inline)) inline void ct_count_insert(__u32 family, __u8 proto, __u8 state)
+{
+    __u32 zero = 0;
+    struct lfw_conntrack_stats *stats = bpf_map_lookup_elem(&conntrack_stats, &zero);
+    if (!stats || family >= LFW_CT_FAMILIES)
+        return;
+    stats->inserts[family]++;
+    if (proto == IPPROTO_TCP && state < LFW_TCP_STATES)
+        stats->tcp_states[family][state]++;
+}
+
+static __attribute__((always_inline)) inline void ct_count_delete(__u32 family, __u8 proto, __u8 state)
+{
+    __u32 zero = 0;
+    struct lfw_conntrack_stats *stats = bpf_map_lookup_elem(&conntrack_stats, &zero);
+    if (!stats || family >= LFW_CT_FAMILIES)
+        return;
+    stats->deletes[family]++;
+    if (proto == IPPROTO_TCP && state < LFW_TCP_STATES)
+        stats->tcp_states[family][state]--;
+}
+
+static __attribute__((always_inline)) inline void ct_count_transition(__u32 family, __u8 from, __u8 to)
+{
+    if (from == to || from >= LFW_TCP_STATES || to >= LFW_TCP_STATES || family >= LFW_CT_FAMILIES)
+        return;
+    __u32 zero = 0;
+    struct lfw_conntrack_stats *stats = bpf_map_lookup_elem(&conntrack_stats, &zero);
+    if (!stats)
+        return;
+    stats->tcp_states[family][from]--;
+    stats->tcp_states[family][to]++;
+}
+
+// State a tracked TCP connection moves to on a packet with these flags
+static __attribute__((always_inline)) inline __u8 ct_tcp_next_state(__u8 state, __u8 syn, __u8 ack, __u8 fin, __u8 rst)
+{
+    if (rst)
+        return LFW_TCP_STATE_CLOSED;
+    if (state == LFW_TCP_STATE_SYN_SENT && syn && ack)
+        return LFW_TCP_STATE_SYN_RECV;
+    if (state == LFW_TCP_STATE_SYN_RECV && ack && !syn)
+        return LFW_TCP_STATE_ESTABLISHED;
+    if (state == LFW_TCP_STATE_ESTABLISHED && fin)
+        return LFW_TCP_STATE_FIN_WAIT;
+    if (state == LFW_TCP_STATE_FIN_WAIT && (ack || fin))
+        return LFW_TCP_STATE_CLOSED;
+    return state;
+}
+
+// Advance a tracked TCP connection. Packets of one flow may be handled on
+// several CPUs at once, so the state changes by compare-and-swap and only
+// the CPU whose swap lands counts the transition. A CPU that loses takes
+// the state it lost to and tries once more.
+static __attribute__((always_inline)) inline void ct_tcp_advance(__u32 family, struct conntrack_val *val,
+                                                                __u8 syn, __u8 ack, __u8 fin, __u8 rst)
+{
+    #pragma unroll
+    for (int i = 0; i < 2; i++) {
+        __u32 old_word = *(volatile __u32 *)&val->state_word;
+        __u32 new_word = old_word;
+        __u8 from = *(__u8 *)&old_word;
+        __u8 to = ct_tcp_next_state(from, syn, ack, fin, rst);
+        if (to == from)
+            return;
+        *(__u8 *)&new_word = to;
+        if (__sync_val_compare_and_swap(&val->state_word, old_word, new_word) == old_word) {
+            ct_count_transition(family, from, to);
+            return;
+        }
     }
 }
 
-static __attribute__((always_inline)) inline void submit_telemetry_v6(__u32 log_level, const struct in6_addr *src_ip, const struct in6_addr *dst_ip, __be16 src_port, __be16 dst_port, __u8 proto, __u8 action, __u64 pkt_len, __u64 timestamp)
+// Reserve an event record in the ring of its class, counting reservations
+// that fail on a full ring. *flags is set for the submit: no wakeup until
+// a batch worth of data is pending, so a busy ring costs one consumer
+// wakeup per batch instead of per event, or straight away if the consumer
+// went idle.
+static __attribute__((always_inline)) inline struct lfw_event *telemetry_reserve(__u8 action, __u64 *flags, struct lfw_telemetry_stats **stats)
 {
-    if (log_level == 0) return;
-    if (log_level == 1 && action == 1) return;
+    __u32 zero = 0;
+    *stats = bpf_map_lookup_elem(&telemetry_stats, &zero);
+
+    __u32 cpu = bpf_get_smp_processor_id();
+    void *ring;
+    if (action == 1) {
+        ring = bpf_map_lookup_elem(&events_allow_percpu, &cpu);
+        if (!ring)
+            ring = &events_allow_ringbuf;
+    } else {
+        ring = bpf_map_lookup_elem(&events_drop_percpu, &cpu);
+        if (!ring)
+            ring = &events_drop_ringbuf;
+    }
+
+    __u32 *idle = bpf_map_lookup_elem(&telemetry_idle, &zero);
+    *flags = BPF_RB_NO_WAKEUP;
+    if ((idle && *idle) ||
+        bpf_ringbuf_query(ring, BPF_RB_AVAIL_DATA) >= bpf_ringbuf_query(ring, BPF_RB_RING_SIZE) >> LFW_EVENTS_WAKEUP_SHIFT)
+        *flags = BPF_RB_FORCE_WAKEUP;
+
+    struct lfw_event *event = bpf_ringbuf_reserve(ring, sizeof(struct lfw_event), 0);
+    if (!event && *stats) {
+        (*stats)->reserve_failed++;
+        if (action != 1)
+            (*stats)->drop_reserve_failed++;
+    }
+    return event;
+}
+
+static __attribute__((always_inline)) inline void telemetry_submit(struct lfw_event *event, __u64 flags, struct lfw_telemetry_stats *stats)
+{
+    bpf_ringbuf_submit(event, flags);
+    if (stats) {
+        stats->submitted++;
+        if (flags == BPF_RB_FORCE_WAKEUP)
+            stats->wakeups++;
+    }
+}
+
+static __attribute__((always_inline)) inline __u32 config_value(__u32 idx)
+{
+    __u32 *p_value = bpf_map_lookup_elem(&config_map, &idx);
+    return p_value ? *p_value : 0;
+}
+
+static __attribute__((always_inline)) inline int telemetry_sampled(__u32 rate)
+{
+    return rate == 1 || bpf_get_prandom_u32() % rate == 0;
+}
+
+// Packet sample rate for allowed traffic: the rule's own, else the global one
+static __attribute__((always_inline)) inline __u32 packet_sample_rate(__u32 rule_rate)
+{
+    return rule_rate ? rule_rate : config_value(LFW_CONFIG_SAMPLE_PACKETS);
+}
+
+// Allowed packets with a sample rate are reported 1 in N at any log level
+// but minimal; everything else follows the log level. On return *rate
+// holds how many packets the event stands for.
+static __attribute__((always_inline)) inline int telemetry_wanted(__u32 log_level, __u8 action, __u32 *rate)
+{
+    if (log_level == 0) return 0;
+    if (action == 1 && *rate) return telemetry_sampled(*rate);
+    *rate = 1;
+    if (log_level == 1 && action == 1) return 0;
+    return 1;
+}
+
+// Count a packet against its flow. Returns 1 when an event is due: on the
+// flow's first packet on this CPU, and on the first packet after the
+// window has passed, carrying everything counted since the last event.
+// Flows that go quiet are flushed and removed by the daemon.
+static __attribute__((always_inline)) inline int telemetry_aggregate(const struct lfw_agg_key *key, __u64 window_ns, __u64 pkt_len, __u64 now, __u32 sample_rate, __u32 *packets, __u64 *bytes, __u8 *kind)
+{
+    struct lfw_agg_val *val = bpf_map_lookup_elem(&telemetry_agg, key);
+    if (!val) {
+        struct lfw_agg_val init = { .window_start = now, .last_seen = now, .sample_rate = sample_rate };
+        bpf_map_update_elem(&telemetry_agg, key, &init, BPF_ANY);
+        *kind = LFW_EVENT_FLOW_FIRST;
+        return 1;
+    }
+
+    val->last_seen = now;
+    val->sample_rate = sample_rate;
+    if (val->window_start == 0) {
+        // Entry created by another CPU
+        val->window_start = now;
+        *kind = LFW_EVENT_FLOW_FIRST;
+        return 1;
+    }
+
+    val->packets += 1;
+    val->bytes   += pkt_len;
+    if (now - val->window_start < window_ns)
+        return 0;
+
+    *packets = val->packets > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (__u32)val->packets;
+    *bytes   = val->bytes;
+    *kind    = LFW_EVENT_FLOW_SUMMARY;
+    val->packets = 0;
+    val->bytes   = 0;
+    val->window_start = now;
+    return 1;
+}
+
+// Sampled packets are aggregated like any other, so a summary counts
+// sampled packets and keeps the sample rate
+static __attribute__((always_inline)) inline void submit_telemetry(const struct lfw_agg_key *key, __be16 src_port, __u64 pkt_len, __u64 timestamp, __u8 kind, __u32 sample_rate)
+{
+    __u32 packets = 1;
+    __u64 bytes = pkt_len;
+
+    if (kind == LFW_EVENT_PACKET) {
+        __u32 window_ms = config_value(LFW_CONFIG_TELEMETRY_WINDOW);
+        if (window_ms && !telemetry_aggregate(key, (__u64)window_ms * 1000000ULL, pkt_len, timestamp, sample_rate, &packets, &bytes, &kind))
+            return;
+    }
 
-    struct lfw_event *event = bpf_ringbuf_reserve(&events_ringbuf, sizeof(struct lfw_event), 0);
+    struct lfw_telemetry_stats *stats;
+    __u64 flags;
+    struct lfw_event *event = telemetry_reserve(key->action, &flags, &stats);
     if (event) {
-        event->ip_version = 6;
-        __builtin_memcpy(&event->src_ip.v6, src_ip, sizeof(struct in6_addr));
-        __builtin_memcpy(&event->dst_ip.v6, dst_ip, sizeof(struct in6_addr));
+        // The address unions start with the IPv4 member, so both versions copy alike
+        __builtin_memcpy(&event->src_ip.v6, &key->src_ip, sizeof(struct in6_addr));
+        __builtin_memcpy(&event->dst_ip.v6, &key->dst_ip, sizeof(struct in6_addr));
         event->src_port = src_port;
-        event->dst_port = dst_port;
-        event->proto = proto;
-        event->action = action;
-        event->pkt_len = pkt_len;
+        event->dst_port = key->dst_port;
+        event->proto = key->proto;
+        event->action = key->action;
+        event->ip_version = key->ip_version;
+        event->kind = kind;
+        event->pkt_len = bytes;
         event->timestamp = timestamp;
-        bpf_ringbuf_submit(event, 0);
+        event->packets = packets;
+        event->rule = key->rule;
+        event->sample_rate = sample_rate;
+        event->pad2 = 0;
+        telemetry_submit(event, flags, stats);
     }
 }
 
+static __attribute__((always_inline)) inline void telemetry_key_v4(struct lfw_agg_key *key, __be32 src_ip, __be32 dst_ip, __be16 dst_port, __u8 proto, __u8 action, __u32 rule)
+{
+    __builtin_memcpy(&key->src_ip, &src_ip, sizeof(src_ip));
+    __builtin_memcpy(&key->dst_ip, &dst_ip, sizeof(dst_ip));
+    key->dst_port = dst_port;
+    key->proto = proto;
+    key->action = action;
+    key->ip_version = 4;
+    key->rule = rule;
+}
+
+static __attribute__((always_inline)) inline void telemetry_key_v6(struct lfw_agg_key *key, const struct in6_addr *src_ip, const struct in6_addr *dst_ip, __be16 dst_port, __u8 proto, __u8 action, __u32 rule)
+{
+    __builtin_memcpy(&key->src_ip, src_ip, sizeof(struct in6_addr));
+    __builtin_memcpy(&key->dst_ip, dst_ip, sizeof(struct in6_addr));
+    key->dst_port = dst_port;
+    key->proto = proto;
+    key->action = action;
+    key->ip_version = 6;
+    key->rule = rule;
+}
+
+// sample_rate applies to allowed packets only (0: report per log level)
+static __attribute__((always_inline)) inline void submit_telemetry_v4(__u32 log_level, __be32 src_ip, __be32 dst_ip, __be16 src_port, __be16 dst_port, __u8 proto, __u8 action, __u32 rule, __u32 sample_rate, __u64 pkt_len, __u64 timestamp)
+{
+    if (!telemetry_wanted(log_level, action, &sample_rate)) return;
+
+    struct lfw_agg_key key = {};
+    telemetry_key_v4(&key, src_ip, dst_ip, dst_port, proto, action, rule);
+    submit_telemetry(&key, src_port, pkt_len, timestamp, LFW_EVENT_PACKET, sample_rate);
+}
+
+static __attribute__((always_inline)) inline void submit_telemetry_v6(__u32 log_level, const struct in6_addr *src_ip, const struct in6_addr *dst_ip, __be16 src_port, __be16 dst_port, __u8 proto, __u8 action, __u32 rule, __u32 sample_rate, __u64 pkt_len, __u64 timestamp)
+{
+    if (!telemetry_wanted(log_level, action, &sample_rate)) return;
+
+    struct lfw_agg_key key = {};
+    telemetry_key_v6(&key, src_ip, dst_ip, dst_port, proto, action, rule);
+    submit_telemetry(&key, src_port, pkt_len, timestamp, LFW_EVENT_PACKET, sample_rate);
+}
+
+// Report 1 in N connections as they enter conntrack
+static __attribute__((always_inline)) inline void submit_new_flow_v4(__u32 log_level, __be32 src_ip, __be32 dst_ip, __be16 src_port, __be16 dst_port, __u8 proto, __u32 rule, __u64 pkt_len, __u64 timestamp)
+{
+    if (log_level == 0) return;
+    __u32 rate = config_value(LFW_CONFIG_SAMPLE_FLOWS);
+    if (!rate || !telemetry_sampled(rate)) return;
+
+    struct lfw_agg_key key = {};
+    telemetry_key_v4(&key, src_ip, dst_ip, dst_port, proto, 1 /* ALLOW */, rule);
+    submit_telemetry(&key, src_port, pkt_len, timestamp, LFW_EVENT_FLOW_NEW, rate);
+}
+
+static __attribute__((always_inline)) inline void submit_new_flow_v6(__u32 log_level, const struct in6_addr *src_ip, const struct in6_addr *dst_ip, __be16 src_port, __be16 dst_port, __u8 proto, __u32 rule, __u64 pkt_len, __u64 timestamp)
+{
+    if (log_level == 0) return;
+    __u32 rate = config_value(LFW_CONFIG_SAMPLE_FLOWS);
+    if (!rate || !telemetry_sampled(rate)) return;
+
+    struct lfw_agg_key key = {};
+    telemetry_key_v6(&key, src_ip, dst_ip, dst_port, proto, 1 /* ALLOW */, rule);
+    submit_telemetry(&key, src_port, pkt_len, timestamp, LFW_EVENT_FLOW_NEW, rate);
+}
+
 // IPv6 Address Helper Comparison
 static inline int ip6_cmp(const struct in6_addr *a, const struct in6_addr *b)
 {
@@ -143,6 +519,46 @@ static inline int ip6_cmp(const struct in6_addr *a, const struct in6_addr *b)
     return 0;
 }
 
+// Whether an unexpired entry of a dynamic list covers the address in key,
+// whose prefixlen is overwritten. An expired entry is deleted on the spot,
+// keyed by the address and its own prefix length, and the lookup retried
+// once so a shorter entry under it still counts.
+static __attribute__((always_inline)) inline int dyn_listed(void *map, void *key, __u32 max_prefixlen, __u64 now)
+{
+    __u32 *prefixlen = key;
+
+    #pragma unroll
+    for (int i = 0; i < 2; i++) {
+        *prefixlen = max_prefixlen;
+        struct lfw_dyn_val *val = bpf_map_lookup_elem(map, key);
+        if (!val)
+            return 0;
+        if (!val->expires || now < val->expires)
+            return 1;
+        *prefixlen = val->prefixlen;
+        bpf_map_delete_elem(map, key);
+    }
+    return 0;
+}
+
+static __attribute__((always_inline)) inline int dyn_listed_v4(void *map, __be32 src_ip, __be32 dst_ip, __u64 now)
+{
+    struct lpm_key key = { .ip = src_ip };
+    if (dyn_listed(map, &key, 32, now))
+        return 1;
+    key.ip = dst_ip;
+    return dyn_listed(map, &key, 32, now);
+}
+
+static __attribute__((always_inline)) inline int dyn_listed_v6(void *map, const struct in6_addr *src_ip, const struct in6_addr *dst_ip, __u64 now)
+{
+    struct lpm6_key key = { .ip = *src_ip };
+    if (dyn_listed(map, &key, 128, now))
+        return 1;
+    key.ip = *dst_ip;
+    return dyn_listed(map, &key, 128, now);
+}
+
 static inline int is_loopback_v4(__be32 ip) {
     return (ip & bpf_htonl(0xff000000)) == bpf_htonl(0x7f000000);
 }
@@ -159,12 +575,16 @@ static inline int is_loopback_v6(const struct in6_addr *ip) {
 static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struct ethhdr *eth, void *data_end)
 {
     struct iphdr *ip = (void *)(eth + 1);
-    if ((void *)(ip + 1) > data_end)
+    if ((void *)(ip + 1) > data_end) {
+        count_reason(LFW_REASON_TRUNCATED);
         return TC_ACT_OK;
+    }
 
     __u32 ip_hdr_len = ip->ihl * 4;
-    if ((void *)((__u8 *)ip + ip_hdr_len) > data_end)
+    if ((void *)((__u8 *)ip + ip_hdr_len) > data_end) {
+        count_reason(LFW_REASON_TRUNCATED);
         return TC_ACT_OK;
+    }
 
     __be32 src_ip = ip->saddr;
     __be32 dst_ip = ip->daddr;
@@ -176,8 +596,10 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
 
     if (proto == IPPROTO_TCP) {
         struct tcphdr *tcp = (void *)((__u8 *)ip + ip_hdr_len);
-        if ((void *)(tcp + 1) > data_end)
+        if ((void *)(tcp + 1) > data_end) {
+            count_reason(LFW_REASON_TRUNCATED);
             return TC_ACT_OK;
+        }
         src_port = tcp->source;
         dst_port = tcp->dest;
         __u8 tcp_flags = ((__u8 *)tcp)[13];
@@ -187,8 +609,10 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
         tcp_rst = (tcp_flags & 0x04) != 0;
     } else if (proto == IPPROTO_UDP) {
         struct udphdr *udp = (void *)((__u8 *)ip + ip_hdr_len);
-        if ((void *)(udp + 1) > data_end)
+        if ((void *)(udp + 1) > data_end) {
+            count_reason(LFW_REASON_TRUNCATED);
             return TC_ACT_OK;
+        }
         src_port = udp->source;
         dst_port = udp->dest;
     }
@@ -211,6 +635,15 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
     __u8 conntrack_found = 0;
     __u64 now = bpf_ktime_get_ns();
     __u64 pkt_len = skb->len;
+
+    // The dynamic block list comes before conntrack, so blocking an address
+    // also cuts off its open connections
+    if (dyn_listed_v4(&dyn_block_v4, src_ip, dst_ip, now)) {
+        submit_telemetry_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, 2, LFW_EVENT_RULE_NONE, 0, pkt_len, now);
+        count_reason(LFW_REASON_DYN_BLOCK);
+        return TC_ACT_SHOT;
+    }
+
     struct conntrack_key key = {};
 
     if (src_ip < dst_ip || (src_ip == dst_ip && src_port <= dst_port)) {
@@ -246,38 +679,40 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
                 val->last_seen = now;
                 val->bytes    += pkt_len;
                 val->packets  += 1;
+                __u8 replied = 0;
 
-                if (lfw_proto == IPPROTO_TCP) {
-                    if (tcp_rst) {
-                        val->state = LFW_TCP_STATE_CLOSED;
-                    } else if (val->state == LFW_TCP_STATE_SYN_SENT && tcp_syn && tcp_ack) {
-                        val->state = LFW_TCP_STATE_SYN_RECV;
-                    } else if (val->state == LFW_TCP_STATE_SYN_RECV && tcp_ack && !tcp_syn) {
-                        val->state = LFW_TCP_STATE_ESTABLISHED;
-                    } else if (val->state == LFW_TCP_STATE_ESTABLISHED && tcp_fin) {
-                        val->state = LFW_TCP_STATE_FIN_WAIT;
-                    } else if (val->state == LFW_TCP_STATE_FIN_WAIT && (tcp_ack || tcp_fin)) {
-                        val->state = LFW_TCP_STATE_CLOSED;
-                    }
-                }
+                if (lfw_proto == IPPROTO_TCP)
+                    ct_tcp_advance(LFW_CT_IPV4, val, tcp_syn, tcp_ack, tcp_fin, tcp_rst);
 
                 if (lfw_proto == IPPROTO_UDP) {
                     if ((val->state == 0 && src_ip == key.dst_ip) ||
                         (val->state == 1 && src_ip == key.src_ip)) {
                         val->state = 2; // Replied
-                        submit_telemetry_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, val->action, pkt_len, now);
+                        replied = 1;
                         if (log_level == 3) {
                             bpf_printk("[lfw] UDP conntrack replied\n");
                         }
                     }
                 }
 
+                // A reply is reported per log level; other packets only when sampled
+                __u32 rate = log_level ? packet_sample_rate(val->sample_rate) : 0;
+                if (replied || rate)
+                    submit_telemetry_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, val->action, val->rule, rate, pkt_len, now);
+
                 __u32 act = val->action;
 
-                if (act == 1) return TC_ACT_OK;
-                else return TC_ACT_SHOT;
+                if (act == 1) {
+                    count_reason(LFW_REASON_CT_ALLOW);
+                    return TC_ACT_OK;
+                }
+                count_reason(LFW_REASON_CT_DROP);
+                return TC_ACT_SHOT;
             } else {
-                bpf_map_delete_elem(&conntrack_map, &key);
+                __u8 state = val->state;
+                if (bpf_map_delete_elem(&conntrack_map, &key) == 0)
+                    ct_count_delete(LFW_CT_IPV4, lfw_proto, state);
+                count_reason(LFW_REASON_CT_EXPIRED);
             }
         }
     }
@@ -285,18 +720,20 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
     // Out-of-state checks
     if (lfw_proto == IPPROTO_TCP && !conntrack_found && !is_loopback_v4(src_ip)) {
         if (!tcp_syn || tcp_ack || tcp_rst || tcp_fin) {
-            submit_telemetry_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, 2 /* DROP */, pkt_len, now);
+            submit_telemetry_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, 2 /* DROP */, LFW_EVENT_RULE_NONE, 0, pkt_len, now);
             if (log_level == 3) {
                 bpf_printk("[lfw] Out-of-state TCP packet dropped\n");
             }
+            count_reason(LFW_REASON_OUT_OF_STATE);
             return TC_ACT_SHOT;
         }
     }
 
-    // Rules evaluation
+    // Rules evaluation, unless the dynamic allow list admits the connection
+    __u8 dyn_allowed = dyn_listed_v4(&dyn_allow_v4, src_ip, dst_ip, now);
     struct rule_mask intersected = {};
     __u8 src_matched = 0;
-    {
+    if (!dyn_allowed) {
         struct lpm_key lpm_key = { .prefixlen = 32, .ip = src_ip };
         struct rule_mask *src_mask = bpf_map_lookup_elem(&src_ip_trie, &lpm_key);
         if (src_mask) {
@@ -323,8 +760,9 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
         }
     }
 
-    __u8 decision_action = 0;
+    __u8 decision_action = dyn_allowed;
     struct bpf_rule *matched_rule = NULL;
+    __u32 matched_idx = LFW_EVENT_RULE_NONE;
 
     #pragma clang loop unroll(disable)
     for (int i = 0; i < 4; i++) {
@@ -353,6 +791,7 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
                     if (port_match) {
                         decision_action = rule->action;
                         matched_rule = rule;
+                        matched_idx = rule_idx;
                         break;
                     }
                 }
@@ -369,16 +808,21 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
     }
 
     if (matched_rule) {
-        __sync_fetch_and_add(&matched_rule->hit_count, 1);
-        __sync_fetch_and_add(&matched_rule->byte_count, pkt_len);
+        struct lfw_rule_stats *rstats = bpf_map_lookup_elem(&rule_stats, &matched_idx);
+        if (rstats) {
+            rstats->hits++;
+            rstats->bytes += pkt_len;
+        }
     }
 
     if (log_level == 3) {
         bpf_printk("[lfw] LPM lookup: src_matched=%u, decision=%u\n", src_matched, decision_action);
     }
 
+    __u32 rule_sample_rate = matched_rule ? matched_rule->sample_rate : 0;
     if (decision_action != 0) {
-        submit_telemetry_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, decision_action, pkt_len, now);
+        __u32 rate = (decision_action == 1 && log_level) ? packet_sample_rate(rule_sample_rate) : 0;
+        submit_telemetry_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, decision_action, matched_idx, rate, pkt_len, now);
     }
 
     if (decision_action == 1 && (lfw_proto == IPPROTO_TCP || lfw_proto == IPPROTO_UDP)) {
@@ -389,15 +833,32 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
             init_state = (src_ip == key.src_ip) ? 0 : 1;
         }
         struct conntrack_val new_val = {
-            .last_seen = now,
-            .bytes     = pkt_len,
-            .packets   = 1,
-            .action    = 1,
-            .state     = init_state,
+            .last_seen   = now,
+            .bytes       = pkt_len,
+            .packets     = 1,
+            .action      = 1,
+            .state       = init_state,
+            .rule        = matched_idx,
+            .sample_rate = rule_sample_rate,
         };
-        bpf_map_update_elem(&conntrack_map, &key, &new_val, BPF_ANY);
+        // Another CPU may have added the same connection since the lookup
+        long err = bpf_map_update_elem(&conntrack_map, &key, &new_val, BPF_NOEXIST);
+        if (err == 0) {
+            count_reason(LFW_REASON_CT_NEW);
+            ct_count_insert(LFW_CT_IPV4, lfw_proto, init_state);
+        } else if (err != -EEXIST) {
+            count_reason(LFW_REASON_CT_INSERT_FAILED);
+        }
+        submit_new_flow_v4(log_level, src_ip, dst_ip, src_port, dst_port, lfw_proto, matched_idx, pkt_len, now);
     }
 
+    if (matched_rule)
+        count_reason(decision_action == 1 ? LFW_REASON_RULE_ALLOW : LFW_REASON_RULE_DROP);
+    else if (dyn_allowed)
+        count_reason(LFW_REASON_DYN_ALLOW);
+    else
+        count_reason(decision_action == 1 ? LFW_REASON_DEFAULT_ALLOW : LFW_REASON_DEFAULT_DROP);
+
     if (decision_action == 1) return TC_ACT_OK;
     else return TC_ACT_SHOT;
 }
@@ -405,8 +866,10 @@ static __attribute__((noinline)) int do_ipv4_filter(struct __sk_buff *skb, struc
 static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struct ethhdr *eth, void *data_end)
 {
     struct ipv6hdr *ip6 = (void *)(eth + 1);
-    if ((void *)(ip6 + 1) > data_end)
+    if ((void *)(ip6 + 1) > data_end) {
+        count_reason(LFW_REASON_TRUNCATED);
         return TC_ACT_OK;
+    }
 
     const struct in6_addr *saddr = &ip6->saddr;
     const struct in6_addr *daddr = &ip6->daddr;
@@ -420,12 +883,16 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
     #pragma clang loop unroll(disable)
     for (int i = 0; i < 5; i++) {
         if (proto == 0 || proto == 43 || proto == 60 || proto == 44 || proto == 51) {
-            if (ip_hdr_len > 256)
+            if (ip_hdr_len > 256) {
+                count_reason(LFW_REASON_IPV6_EXT);
                 return TC_ACT_OK;
+            }
 
             __u8 *ext = (void *)((__u8 *)ip6 + ip_hdr_len);
-            if ((void *)(ext + 2) > data_end)
+            if ((void *)(ext + 2) > data_end) {
+                count_reason(LFW_REASON_TRUNCATED);
                 return TC_ACT_OK;
+            }
 
             __u8 next_proto = ext[0];
             __u32 ext_len = 8;
@@ -435,8 +902,10 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
                 ext_len = (ext[1] + 2) * 4;
             }
 
-            if ((void *)(ext + ext_len) > data_end)
+            if ((void *)(ext + ext_len) > data_end) {
+                count_reason(LFW_REASON_TRUNCATED);
                 return TC_ACT_OK;
+            }
 
             ip_hdr_len += ext_len;
             proto = next_proto;
@@ -447,11 +916,15 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
     }
 
     if (lfw_proto == IPPROTO_TCP) {
-        if (ip_hdr_len > 256)
+        if (ip_hdr_len > 256) {
+            count_reason(LFW_REASON_IPV6_EXT);
             return TC_ACT_OK;
+        }
         struct tcphdr *tcp = (void *)((__u8 *)ip6 + ip_hdr_len);
-        if ((void *)(tcp + 1) > data_end)
+        if ((void *)(tcp + 1) > data_end) {
+            count_reason(LFW_REASON_TRUNCATED);
             return TC_ACT_OK;
+        }
         src_port = tcp->source;
         dst_port = tcp->dest;
         __u8 tcp_flags = ((__u8 *)tcp)[13];
@@ -460,11 +933,15 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
         tcp_fin = (tcp_flags & 0x01) != 0;
         tcp_rst = (tcp_flags & 0x04) != 0;
     } else if (lfw_proto == IPPROTO_UDP) {
-        if (ip_hdr_len > 256)
+        if (ip_hdr_len > 256) {
+            count_reason(LFW_REASON_IPV6_EXT);
             return TC_ACT_OK;
+        }
         struct udphdr *udp = (void *)((__u8 *)ip6 + ip_hdr_len);
-        if ((void *)(udp + 1) > data_end)
+        if ((void *)(udp + 1) > data_end) {
+            count_reason(LFW_REASON_TRUNCATED);
             return TC_ACT_OK;
+        }
         src_port = udp->source;
         dst_port = udp->dest;
     }
@@ -486,6 +963,15 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
     __u8 conntrack_found = 0;
     __u64 now = bpf_ktime_get_ns();
     __u64 pkt_len = skb->len;
+
+    // The dynamic block list comes before conntrack, so blocking an address
+    // also cuts off its open connections
+    if (dyn_listed_v6(&dyn_block_v6, saddr, daddr, now)) {
+        submit_telemetry_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, 2, LFW_EVENT_RULE_NONE, 0, pkt_len, now);
+        count_reason(LFW_REASON_DYN_BLOCK);
+        return TC_ACT_SHOT;
+    }
+
     struct conntrack_key_v6 key6 = {};
 
     int cmp = ip6_cmp(saddr, daddr);
@@ -522,38 +1008,40 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
                 val->last_seen = now;
                 val->bytes    += pkt_len;
                 val->packets  += 1;
+                __u8 replied = 0;
 
-                if (lfw_proto == IPPROTO_TCP) {
-                    if (tcp_rst) {
-                        val->state = LFW_TCP_STATE_CLOSED;
-                    } else if (val->state == LFW_TCP_STATE_SYN_SENT && tcp_syn && tcp_ack) {
-                        val->state = LFW_TCP_STATE_SYN_RECV;
-                    } else if (val->state == LFW_TCP_STATE_SYN_RECV && tcp_ack && !tcp_syn) {
-                        val->state = LFW_TCP_STATE_ESTABLISHED;
-                    } else if (val->state == LFW_TCP_STATE_ESTABLISHED && tcp_fin) {
-                        val->state = LFW_TCP_STATE_FIN_WAIT;
-                    } else if (val->state == LFW_TCP_STATE_FIN_WAIT && (tcp_ack || tcp_fin)) {
-                        val->state = LFW_TCP_STATE_CLOSED;
-                    }
-                }
+                if (lfw_proto == IPPROTO_TCP)
+                    ct_tcp_advance(LFW_CT_IPV6, val, tcp_syn, tcp_ack, tcp_fin, tcp_rst);
 
                 if (lfw_proto == IPPROTO_UDP) {
                     if ((val->state == 0 && ip6_cmp(saddr, &key6.dst_ip) == 0) ||
                         (val->state == 1 && ip6_cmp(saddr, &key6.src_ip) == 0)) {
                         val->state = 2; // LFW_UDP_STATE_REPLIED
-                        submit_telemetry_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, val->action, pkt_len, now);
+                        replied = 1;
                         if (log_level == 3) {
                             bpf_printk("[lfw] UDP conntrack replied (v6)\n");
                         }
                     }
                 }
 
+                // A reply is reported per log level; other packets only when sampled
+                __u32 rate = log_level ? packet_sample_rate(val->sample_rate) : 0;
+                if (replied || rate)
+                    submit_telemetry_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, val->action, val->rule, rate, pkt_len, now);
+
                 __u32 act = val->action;
 
-                if (act == 1) return TC_ACT_OK;
-                else return TC_ACT_SHOT;
+                if (act == 1) {
+                    count_reason(LFW_REASON_CT_ALLOW);
+                    return TC_ACT_OK;
+                }
+                count_reason(LFW_REASON_CT_DROP);
+                return TC_ACT_SHOT;
             } else {
-                bpf_map_delete_elem(&conntrack_map_v6, &key6);
+                __u8 state = val->state;
+                if (bpf_map_delete_elem(&conntrack_map_v6, &key6) == 0)
+                    ct_count_delete(LFW_CT_IPV6, lfw_proto, state);
+                count_reason(LFW_REASON_CT_EXPIRED);
             }
         }
     }
@@ -561,18 +1049,20 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
     // Out-of-state checks
     if (lfw_proto == IPPROTO_TCP && !conntrack_found && !is_loopback_v6(saddr)) {
         if (!tcp_syn || tcp_ack || tcp_rst || tcp_fin) {
-            submit_telemetry_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, 2 /* DROP */, pkt_len, now);
+            submit_telemetry_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, 2 /* DROP */, LFW_EVENT_RULE_NONE, 0, pkt_len, now);
             if (log_level == 3) {
                 bpf_printk("[lfw] Out-of-state TCP packet dropped (v6)\n");
             }
+            count_reason(LFW_REASON_OUT_OF_STATE);
             return TC_ACT_SHOT;
         }
     }
 
-    // Rules evaluation
+    // Rules evaluation, unless the dynamic allow list admits the connection
+    __u8 dyn_allowed = dyn_listed_v6(&dyn_allow_v6, saddr, daddr, now);
     struct rule_mask intersected = {};
     __u8 src_matched = 0;
-    {
+    if (!dyn_allowed) {
         struct lpm6_key lpm_key = { .prefixlen = 128 };
         __builtin_memcpy(&lpm_key.ip, saddr, sizeof(struct in6_addr));
         struct rule_mask *src_mask = bpf_map_lookup_elem(&src_ip6_trie, &lpm_key);
@@ -601,8 +1091,9 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
         }
     }
 
-    __u8 decision_action = 0;
+    __u8 decision_action = dyn_allowed;
     struct bpf_rule *matched_rule = NULL;
+    __u32 matched_idx = LFW_EVENT_RULE_NONE;
 
     #pragma clang loop unroll(disable)
     for (int i = 0; i < 4; i++) {
@@ -631,6 +1122,7 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
                     if (port_match) {
                         decision_action = rule->action;
                         matched_rule = rule;
+                        matched_idx = rule_idx;
                         break;
                     }
                 }
@@ -647,16 +1139,21 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
     }
 
     if (matched_rule) {
-        __sync_fetch_and_add(&matched_rule->hit_count, 1);
-        __sync_fetch_and_add(&matched_rule->byte_count, pkt_len);
+        struct lfw_rule_stats *rstats = bpf_map_lookup_elem(&rule_stats, &matched_idx);
+        if (rstats) {
+            rstats->hits++;
+            rstats->bytes += pkt_len;
+        }
     }
 
     if (log_level == 3) {
         bpf_printk("[lfw] LPM lookup (v6): src_matched=%u, decision=%u\n", src_matched, decision_action);
     }
 
+    __u32 rule_sample_rate = matched_rule ? matched_rule->sample_rate : 0;
     if (decision_action != 0) {
-        submit_telemetry_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, decision_action, pkt_len, now);
+        __u32 rate = (decision_action == 1 && log_level) ? packet_sample_rate(rule_sample_rate) : 0;
+        submit_telemetry_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, decision_action, matched_idx, rate, pkt_len, now);
     }
 
     if (decision_action == 1 && (lfw_proto == IPPROTO_TCP || lfw_proto == IPPROTO_UDP)) {
@@ -667,15 +1164,32 @@ static __attribute__((noinline)) int do_ipv6_filter(struct __sk_buff *skb, struc
             init_state = (ip6_cmp(saddr, &key6.src_ip) == 0) ? 0 : 1;
         }
         struct conntrack_val new_val = {
-            .last_seen = now,
-            .bytes     = pkt_len,
-            .packets   = 1,
-            .action    = 1,
-            .state     = init_state,
+            .last_seen   = now,
+            .bytes       = pkt_len,
+            .packets     = 1,
+            .action      = 1,
+            .state       = init_state,
+            .rule        = matched_idx,
+            .sample_rate = rule_sample_rate,
         };
-        bpf_map_update_elem(&conntrack_map_v6, &key6, &new_val, BPF_ANY);
+        // Another CPU may have added the same connection since the lookup
+        long err = bpf_map_update_elem(&conntrack_map_v6, &key6, &new_val, BPF_NOEXIST);
+        if (err == 0) {
+            count_reason(LFW_REASON_CT_NEW);
+            ct_count_insert(LFW_CT_IPV6, lfw_proto, init_state);
+        } else if (err != -EEXIST) {
+            count_reason(LFW_REASON_CT_INSERT_FAILED);
+        }
+        submit_new_flow_v6(log_level, saddr, daddr, src_port, dst_port, lfw_proto, matched_idx, pkt_len, now);
     }
 
+    if (matched_rule)
+        count_reason(decision_action == 1 ? LFW_REASON_RULE_ALLOW : LFW_REASON_RULE_DROP);
+    else if (dyn_allowed)
+        count_reason(LFW_REASON_DYN_ALLOW);
+    else
+        count_reason(decision_action == 1 ? LFW_REASON_DEFAULT_ALLOW : LFW_REASON_DEFAULT_DROP);
+
     if (decision_action == 1) return TC_ACT_OK;
     else return TC_ACT_SHOT;
 }
@@ -687,8 +1201,10 @@ int lfw_tc_filter(struct __sk_buff *skb)
     void *data     = (void *)(long)skb->data;
 
     struct ethhdr *eth = data;
-    if ((void *)(eth + 1) > data_end)
+    if ((void *)(eth + 1) > data_end) {
+        count_reason(LFW_REASON_TRUNCATED);
         return TC_ACT_OK;
+    }
 
     __u16 h_proto = bpf_ntohs(eth->h_proto);
 
@@ -698,6 +1214,7 @@ int lfw_tc_filter(struct __sk_buff *skb)
         return do_ipv6_filter(skb, eth, data_end);
     }
 
+    count_reason(LFW_REASON_NOT_IP);
     return TC_ACT_OK;
 }
 
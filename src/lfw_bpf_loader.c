@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include "lfw_bpf.h"
+#include "lfw_bpf_shared.h"
 #include "lfw_log.h"
 #include <bpf/libbpf.h>
 #include <bpf/bpf.h>
@@ -43,7 +44,14 @@ static int g_dst_ip_trie_fd = -1;
 static int g_src_ip6_trie_fd = -1;
 static int g_dst_ip6_trie_fd = -1;
 static int g_conntrack_map_v6_fd = -1;
-static int g_events_ringbuf_fd = -1;
+static int g_event_ring_fds[LFW_EVENTS_CLASSES] = {-1, -1};
+static int g_telemetry_stats_fd = -1;
+static int g_telemetry_agg_fd = -1;
+static int g_telemetry_idle_fd = -1;
+static int g_reason_stats_fd = -1;
+static int g_conntrack_stats_fd = -1;
+static int g_rule_stats_fd = -1;
+static int g_dyn_fds[LFW_DYN_LISTS][LFW_CT_FAMILIES] = {{-1, -1}, {-1, -1}};
 
 int lfw_bpf_get_conntrack_map_fd(void) { return g_conntrack_map_fd; }
 int lfw_bpf_get_rules_map_fd(void) { return g_rules_map_fd; }
@@ -53,7 +61,146 @@ int lfw_bpf_get_dst_ip_trie_fd(void) { return g_dst_ip_trie_fd; }
 int lfw_bpf_get_src_ip6_trie_fd(void) { return g_src_ip6_trie_fd; }
 int lfw_bpf_get_dst_ip6_trie_fd(void) { return g_dst_ip6_trie_fd; }
 int lfw_bpf_get_conntrack_map_v6_fd(void) { return g_conntrack_map_v6_fd; }
-int lfw_bpf_get_events_ringbuf_fd(void) { return g_events_ringbuf_fd; }
+int lfw_bpf_get_telemetry_stats_fd(void) { return g_telemetry_stats_fd; }
+int lfw_bpf_get_telemetry_agg_fd(void) { return g_telemetry_agg_fd; }
+int lfw_bpf_get_telemetry_idle_fd(void) { return g_telemetry_idle_fd; }
+int lfw_bpf_get_reason_stats_fd(void) { return g_reason_stats_fd; }
+int lfw_bpf_get_conntrack_stats_fd(void) { return g_conntrack_stats_fd; }
+int lfw_bpf_get_rule_stats_fd(void) { return g_rule_stats_fd; }
+
+int lfw_bpf_get_dyn_fd(lfw_u32 list, lfw_u32 family)
+{
+    if (list >= LFW_DYN_LISTS || family >= LFW_CT_FAMILIES)
+        return -1;
+    return g_dyn_fds[list][family];
+}
+
+// Dynamic list maps, indexed by LFW_DYN_* and LFW_CT_IPV4/LFW_CT_IPV6
+static const char *const g_dyn_map_names[LFW_DYN_LISTS][LFW_CT_FAMILIES] = {
+    [LFW_DYN_BLOCK] = {"dyn_block_v4", "dyn_block_v6"},
+    [LFW_DYN_ALLOW] = {"dyn_allow_v4", "dyn_allow_v6"},
+};
+
+static void find_dyn_fds(struct bpf_object *obj)
+{
+    for (int l = 0; l < LFW_DYN_LISTS; l++)
+        for (int f = 0; f < LFW_CT_FAMILIES; f++)
+            g_dyn_fds[l][f] = obj ? bpf_object__find_map_fd_by_name(obj, g_dyn_map_names[l][f]) : -1;
+}
+
+static bool dyn_fds_found(void)
+{
+    for (int l = 0; l < LFW_DYN_LISTS; l++)
+        for (int f = 0; f < LFW_CT_FAMILIES; f++)
+            if (g_dyn_fds[l][f] < 0)
+                return false;
+    return true;
+}
+
+// Events ring layout, applied to every object loaded
+static const char *const g_event_ring_names[LFW_EVENTS_CLASSES] = {"events_drop_ringbuf", "events_allow_ringbuf"};
+static const char *const g_event_percpu_names[LFW_EVENTS_CLASSES] = {"events_drop_percpu", "events_allow_percpu"};
+static lfw_u32 g_event_ring_size[LFW_EVENTS_CLASSES] = {LFW_EVENTS_RINGBUF_SIZE, LFW_EVENTS_RINGBUF_SIZE};
+static bool g_event_rings_percpu = false;
+
+// Per-CPU rings created by the daemon; the outer maps hold their own
+// references, these are kept for the telemetry consumer
+static int *g_percpu_ring_fds[LFW_EVENTS_CLASSES];
+static int g_percpu_ring_cpus = 0;
+
+void lfw_bpf_set_event_rings(lfw_u32 drop_size, lfw_u32 allow_size, bool per_cpu)
+{
+    g_event_ring_size[LFW_EVENTS_DROP] = drop_size ? drop_size : LFW_EVENTS_RINGBUF_SIZE;
+    g_event_ring_size[LFW_EVENTS_ALLOW] = allow_size ? allow_size : LFW_EVENTS_RINGBUF_SIZE;
+    g_event_rings_percpu = per_cpu;
+}
+
+int lfw_bpf_get_event_ring_fds(int event_class, int *fds, int max_fds)
+{
+    if (event_class < 0 || event_class >= LFW_EVENTS_CLASSES || !fds)
+        return 0;
+
+    int n = 0;
+    if (g_event_ring_fds[event_class] >= 0 && n < max_fds)
+        fds[n++] = g_event_ring_fds[event_class];
+    for (int cpu = 0; cpu < g_percpu_ring_cpus && n < max_fds; cpu++)
+        fds[n++] = g_percpu_ring_fds[event_class][cpu];
+    return n;
+}
+
+// Size the events rings of an object before it is loaded. The per-CPU
+// outer maps get one slot per possible CPU only when they will be used.
+static lfw_status_t size_event_rings(struct bpf_object *obj)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    if (ncpus <= 0)
+        return LFW_ERR_GENERIC;
+
+    for (int c = 0; c < LFW_EVENTS_CLASSES; c++) {
+        struct bpf_map *ring = bpf_object__find_map_by_name(obj, g_event_ring_names[c]);
+        struct bpf_map *outer = bpf_object__find_map_by_name(obj, g_event_percpu_names[c]);
+        struct bpf_map *inner = outer ? bpf_map__inner_map(outer) : NULL;
+        if (!ring || !inner)
+            return LFW_ERR_GENERIC;
+
+        if (bpf_map__set_max_entries(ring, g_event_ring_size[c]) != 0 ||
+            bpf_map__set_max_entries(inner, g_event_ring_size[c]) != 0)
+            return LFW_ERR_INVALID;
+        if (g_event_rings_percpu && bpf_map__set_max_entries(outer, (unsigned int)ncpus) != 0)
+            return LFW_ERR_INVALID;
+    }
+    return LFW_OK;
+}
+
+static void close_percpu_rings(void)
+{
+    for (int c = 0; c < LFW_EVENTS_CLASSES; c++) {
+        for (int cpu = 0; g_percpu_ring_fds[c] && cpu < g_percpu_ring_cpus; cpu++) {
+            if (g_percpu_ring_fds[c][cpu] >= 0)
+                close(g_percpu_ring_fds[c][cpu]);
+        }
+        free(g_percpu_ring_fds[c]);
+        g_percpu_ring_fds[c] = NULL;
+    }
+    g_percpu_ring_cpus = 0;
+}
+
+// Create a ring per CPU and class and install them in the outer maps.
+// They stay installed across reloads, which reuse the pinned outer maps.
+static lfw_status_t install_percpu_rings(struct bpf_object *obj)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    if (ncpus <= 0)
+        return LFW_ERR_GENERIC;
+
+    for (int c = 0; c < LFW_EVENTS_CLASSES; c++) {
+        g_percpu_ring_fds[c] = malloc((size_t)ncpus * sizeof(int));
+        if (!g_percpu_ring_fds[c]) {
+            close_percpu_rings();
+            return LFW_ERR_NO_MEMORY;
+        }
+        for (int cpu = 0; cpu < ncpus; cpu++)
+            g_percpu_ring_fds[c][cpu] = -1;
+    }
+    g_percpu_ring_cpus = ncpus;
+
+    for (int c = 0; c < LFW_EVENTS_CLASSES; c++) {
+        int outer_fd = bpf_object__find_map_fd_by_name(obj, g_event_percpu_names[c]);
+        for (__u32 cpu = 0; cpu < (__u32)ncpus; cpu++) {
+            int fd = bpf_map_create(BPF_MAP_TYPE_RINGBUF, c == LFW_EVENTS_DROP ? "lfw_drop_ring" : "lfw_allow_ring",
+                                    0, 0, g_event_ring_size[c], NULL);
+            if (fd < 0 || bpf_map_update_elem(outer_fd, &cpu, &fd, BPF_ANY) != 0) {
+                lfw_log_error("Failed to create per-CPU events ring for CPU %u: %s", cpu, strerror(errno));
+                if (fd >= 0)
+                    close(fd);
+                close_percpu_rings();
+                return LFW_ERR_GENERIC;
+            }
+            g_percpu_ring_fds[c][cpu] = fd;
+        }
+    }
+    return LFW_OK;
+}
 
 static void ensure_bpf_dir(void) {
     mkdir("/sys/fs/bpf", 0755);
@@ -63,7 +210,19 @@ static void ensure_bpf_dir(void) {
 static void clear_pinned_maps(void) {
     unlink("/sys/fs/bpf/lfw/conntrack_map");
     unlink("/sys/fs/bpf/lfw/conntrack_map_v6");
-    unlink("/sys/fs/bpf/lfw/events_ringbuf");
+    unlink("/sys/fs/bpf/lfw/events_drop_ringbuf");
+    unlink("/sys/fs/bpf/lfw/events_allow_ringbuf");
+    unlink("/sys/fs/bpf/lfw/events_drop_percpu");
+    unlink("/sys/fs/bpf/lfw/events_allow_percpu");
+    unlink("/sys/fs/bpf/lfw/telemetry_stats");
+    unlink("/sys/fs/bpf/lfw/telemetry_agg");
+    unlink("/sys/fs/bpf/lfw/telemetry_idle");
+    unlink("/sys/fs/bpf/lfw/reason_stats");
+    unlink("/sys/fs/bpf/lfw/conntrack_stats");
+    unlink("/sys/fs/bpf/lfw/dyn_block_v4");
+    unlink("/sys/fs/bpf/lfw/dyn_allow_v4");
+    unlink("/sys/fs/bpf/lfw/dyn_block_v6");
+    unlink("/sys/fs/bpf/lfw/dyn_allow_v6");
     rmdir("/sys/fs/bpf/lfw");
 }
 
@@ -75,8 +234,32 @@ static void set_map_pin_paths(struct bpf_object *obj) {
             bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/conntrack_map");
         } else if (strcmp(name, "conntrack_map_v6") == 0) {
             bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/conntrack_map_v6");
-        } else if (strcmp(name, "events_ringbuf") == 0) {
-            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/events_ringbuf");
+        } else if (strcmp(name, "events_drop_ringbuf") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/events_drop_ringbuf");
+        } else if (strcmp(name, "events_allow_ringbuf") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/events_allow_ringbuf");
+        } else if (strcmp(name, "events_drop_percpu") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/events_drop_percpu");
+        } else if (strcmp(name, "events_allow_percpu") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/events_allow_percpu");
+        } else if (strcmp(name, "telemetry_stats") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/telemetry_stats");
+        } else if (strcmp(name, "telemetry_agg") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/telemetry_agg");
+        } else if (strcmp(name, "telemetry_idle") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/telemetry_idle");
+        } else if (strcmp(name, "reason_stats") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/reason_stats");
+        } else if (strcmp(name, "conntrack_stats") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/conntrack_stats");
+        } else if (strcmp(name, "dyn_block_v4") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/dyn_block_v4");
+        } else if (strcmp(name, "dyn_allow_v4") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/dyn_allow_v4");
+        } else if (strcmp(name, "dyn_block_v6") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/dyn_block_v6");
+        } else if (strcmp(name, "dyn_allow_v6") == 0) {
+            bpf_map__set_pin_path(map, "/sys/fs/bpf/lfw/dyn_allow_v6");
         }
     }
 }
@@ -101,6 +284,13 @@ lfw_status_t lfw_bpf_init(const char *ifname, const char *bpf_obj_path)
 
     set_map_pin_paths(g_bpf_obj);
 
+    if (size_event_rings(g_bpf_obj) != LFW_OK) {
+        lfw_log_error("Failed to size events ring buffers");
+        bpf_object__close(g_bpf_obj);
+        g_bpf_obj = NULL;
+        return LFW_ERR_GENERIC;
+    }
+
     if (bpf_object__load(g_bpf_obj) != 0) {
         lfw_log_error("Failed to load BPF object file");
         bpf_object__close(g_bpf_obj);
@@ -130,17 +320,32 @@ lfw_status_t lfw_bpf_init(const char *ifname, const char *bpf_obj_path)
     g_src_ip6_trie_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "src_ip6_trie");
     g_dst_ip6_trie_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "dst_ip6_trie");
     g_conntrack_map_v6_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "conntrack_map_v6");
-    g_events_ringbuf_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "events_ringbuf");
+    for (int c = 0; c < LFW_EVENTS_CLASSES; c++)
+        g_event_ring_fds[c] = bpf_object__find_map_fd_by_name(g_bpf_obj, g_event_ring_names[c]);
+    g_telemetry_stats_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "telemetry_stats");
+    g_telemetry_agg_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "telemetry_agg");
+    g_telemetry_idle_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "telemetry_idle");
+    g_reason_stats_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "reason_stats");
+    g_conntrack_stats_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "conntrack_stats");
+    g_rule_stats_fd = bpf_object__find_map_fd_by_name(g_bpf_obj, "rule_stats");
+    find_dyn_fds(g_bpf_obj);
 
     if (g_conntrack_map_fd < 0 || g_rules_map_fd < 0 || g_config_map_fd < 0 ||
         g_src_ip_trie_fd < 0 || g_dst_ip_trie_fd < 0 ||
         g_src_ip6_trie_fd < 0 || g_dst_ip6_trie_fd < 0 || g_conntrack_map_v6_fd < 0 ||
-        g_events_ringbuf_fd < 0) {
+        g_event_ring_fds[LFW_EVENTS_DROP] < 0 || g_event_ring_fds[LFW_EVENTS_ALLOW] < 0 ||
+        g_telemetry_stats_fd < 0 || g_telemetry_agg_fd < 0 || g_telemetry_idle_fd < 0 || g_reason_stats_fd < 0 ||
+        g_conntrack_stats_fd < 0 || g_rule_stats_fd < 0 || !dyn_fds_found()) {
         lfw_log_error("Failed to find required BPF maps");
         lfw_bpf_cleanup();
         return LFW_ERR_GENERIC;
     }
 
+    if (g_event_rings_percpu && install_percpu_rings(g_bpf_obj) != LFW_OK) {
+        lfw_bpf_cleanup();
+        return LFW_ERR_GENERIC;
+    }
+
     // Set up hook for ingress
     g_hook_ingress.sz = sizeof(struct bpf_tc_hook);
     g_hook_ingress.ifindex = g_ifindex;
@@ -235,7 +440,16 @@ void lfw_bpf_cleanup(void)
     g_src_ip6_trie_fd = -1;
     g_dst_ip6_trie_fd = -1;
     g_conntrack_map_v6_fd = -1;
-    g_events_ringbuf_fd = -1;
+    g_event_ring_fds[LFW_EVENTS_DROP] = -1;
+    g_event_ring_fds[LFW_EVENTS_ALLOW] = -1;
+    g_telemetry_stats_fd = -1;
+    g_telemetry_agg_fd = -1;
+    g_telemetry_idle_fd = -1;
+    g_reason_stats_fd = -1;
+    g_conntrack_stats_fd = -1;
+    g_rule_stats_fd = -1;
+    find_dyn_fds(NULL);
+    close_percpu_rings();
 
     clear_pinned_maps();
 }
@@ -260,6 +474,13 @@ lfw_status_t lfw_bpf_reload(const char *ifname, const char *bpf_obj_path,
 
     set_map_pin_paths(new_obj);
 
+    // The pinned rings are reused, so the new object must match their sizes
+    if (size_event_rings(new_obj) != LFW_OK) {
+        lfw_log_error("Reload: Failed to size events ring buffers");
+        bpf_object__close(new_obj);
+        return LFW_ERR_GENERIC;
+    }
+
     if (bpf_object__load(new_obj) != 0) {
         lfw_log_error("Reload: Failed to load BPF object file");
         bpf_object__close(new_obj);
@@ -349,7 +570,15 @@ lfw_status_t lfw_bpf_reload(const char *ifname, const char *bpf_obj_path,
     g_src_ip6_trie_fd = src_trie6_fd;
     g_dst_ip6_trie_fd = dst_trie6_fd;
     g_conntrack_map_v6_fd = bpf_object__find_map_fd_by_name(new_obj, "conntrack_map_v6");
-    g_events_ringbuf_fd = bpf_object__find_map_fd_by_name(new_obj, "events_ringbuf");
+    for (int c = 0; c < LFW_EVENTS_CLASSES; c++)
+        g_event_ring_fds[c] = bpf_object__find_map_fd_by_name(new_obj, g_event_ring_names[c]);
+    g_telemetry_stats_fd = bpf_object__find_map_fd_by_name(new_obj, "telemetry_stats");
+    g_telemetry_agg_fd = bpf_object__find_map_fd_by_name(new_obj, "telemetry_agg");
+    g_telemetry_idle_fd = bpf_object__find_map_fd_by_name(new_obj, "telemetry_idle");
+    g_reason_stats_fd = bpf_object__find_map_fd_by_name(new_obj, "reason_stats");
+    g_conntrack_stats_fd = bpf_object__find_map_fd_by_name(new_obj, "conntrack_stats");
+    g_rule_stats_fd = bpf_object__find_map_fd_by_name(new_obj, "rule_stats");
+    find_dyn_fds(new_obj);
 
     lfw_log_info("Reload: Successfully atomically reloaded BPF program on %s", ifname);
     return LFW_OK;
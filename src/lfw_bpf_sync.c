@@ -4,12 +4,31 @@
 #include "lfw_bpf_shared.h"
 #include "lfw_log.h"
 #include <bpf/bpf.h>
+#include <bpf/libbpf.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
 
+// Telemetry aggregation window, applied to every config map synced
+static __u32 g_telemetry_window_ms = 0;
+
+// Telemetry sample rates, applied to every config map synced
+static __u32 g_sample_packets = 0;
+static __u32 g_sample_flows = 0;
+
+void lfw_bpf_set_telemetry_window(lfw_u32 window_ms)
+{
+    g_telemetry_window_ms = window_ms;
+}
+
+void lfw_bpf_set_telemetry_sampling(lfw_u32 packets, lfw_u32 flows)
+{
+    g_sample_packets = packets;
+    g_sample_flows = flows;
+}
+
 struct subnet_entry {
     lfw_u32 ip;
     lfw_u32 mask;
@@ -119,6 +138,21 @@ lfw_status_t lfw_bpf_sync_rules_to_fd(const lfw_rule_t *rules, lfw_u32 rule_coun
         return LFW_ERR_GENERIC;
     }
 
+    __u32 idx_window = LFW_CONFIG_TELEMETRY_WINDOW;
+    __u32 val_window = g_telemetry_window_ms;
+    if (bpf_map_update_elem(config_fd, &idx_window, &val_window, BPF_ANY) != 0) {
+        lfw_log_error("Failed to update config telemetry window: %s", strerror(errno));
+        return LFW_ERR_GENERIC;
+    }
+
+    __u32 idx_sample_packets = LFW_CONFIG_SAMPLE_PACKETS;
+    __u32 idx_sample_flows = LFW_CONFIG_SAMPLE_FLOWS;
+    if (bpf_map_update_elem(config_fd, &idx_sample_packets, &g_sample_packets, BPF_ANY) != 0 ||
+        bpf_map_update_elem(config_fd, &idx_sample_flows, &g_sample_flows, BPF_ANY) != 0) {
+        lfw_log_error("Failed to update config sample rates: %s", strerror(errno));
+        return LFW_ERR_GENERIC;
+    }
+
     // 3. Populate rules details map
     for (__u32 i = 0; i < 256; i++) {
         struct bpf_rule b_rule = {};
@@ -149,8 +183,7 @@ lfw_status_t lfw_bpf_sync_rules_to_fd(const lfw_rule_t *rules, lfw_u32 rule_coun
             b_rule.match_src_port = rule->match.match_src_port ? 1 : 0;
             b_rule.match_dst_port = rule->match.match_dst_port ? 1 : 0;
             b_rule.action = (rule->action == LFW_ACTION_ACCEPT) ? 1 : 2;
-            b_rule.hit_count = 0;
-            b_rule.byte_count = 0;
+            b_rule.sample_rate = rule->match.sample_rate;
         }
 
         if (bpf_map_update_elem(rules_fd, &i, &b_rule, BPF_ANY) != 0) {
@@ -554,6 +587,588 @@ static void format_rule(const struct bpf_rule *rule, char *buf, size_t buf_len)
     } else {
         offset += snprintf(buf + offset, buf_len - offset, " to any");
     }
+
+    if (rule->sample_rate) {
+        offset += snprintf(buf + offset, buf_len - offset, " sample %u", rule->sample_rate);
+    }
+}
+
+lfw_status_t lfw_bpf_read_telemetry_stats(int fd, struct lfw_telemetry_stats *stats)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    if (!stats || fd < 0 || ncpus <= 0)
+        return LFW_ERR_INVALID;
+
+    // Per-CPU lookups return one value per possible CPU
+    struct lfw_telemetry_stats *percpu = calloc((size_t)ncpus, sizeof(*percpu));
+    if (!percpu)
+        return LFW_ERR_NO_MEMORY;
+
+    __u32 zero = 0;
+    if (bpf_map_lookup_elem(fd, &zero, percpu) != 0) {
+        free(percpu);
+        return LFW_ERR_GENERIC;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < ncpus; i++) {
+        stats->submitted += percpu[i].submitted;
+        stats->reserve_failed += percpu[i].reserve_failed;
+        stats->wakeups += percpu[i].wakeups;
+        stats->drop_reserve_failed += percpu[i].drop_reserve_failed;
+    }
+
+    free(percpu);
+    return LFW_OK;
+}
+
+static const char *const g_reason_names[LFW_REASON_MAX] = {
+    [LFW_REASON_NOT_IP]           = "not_ip",
+    [LFW_REASON_TRUNCATED]        = "truncated",
+    [LFW_REASON_IPV6_EXT]         = "ipv6_ext",
+    [LFW_REASON_CT_ALLOW]         = "conntrack_allow",
+    [LFW_REASON_CT_DROP]          = "conntrack_drop",
+    [LFW_REASON_OUT_OF_STATE]     = "out_of_state",
+    [LFW_REASON_RULE_ALLOW]       = "rule_allow",
+    [LFW_REASON_RULE_DROP]        = "rule_drop",
+    [LFW_REASON_DEFAULT_ALLOW]    = "default_allow",
+    [LFW_REASON_DEFAULT_DROP]     = "default_drop",
+    [LFW_REASON_CT_NEW]           = "conntrack_new",
+    [LFW_REASON_CT_INSERT_FAILED] = "conntrack_insert_failed",
+    [LFW_REASON_CT_EXPIRED]       = "conntrack_expired",
+    [LFW_REASON_DYN_BLOCK]        = "dynamic_block",
+    [LFW_REASON_DYN_ALLOW]        = "dynamic_allow",
+};
+
+const char *lfw_bpf_reason_name(lfw_u32 reason)
+{
+    return reason < LFW_REASON_MAX ? g_reason_names[reason] : "unknown";
+}
+
+lfw_status_t lfw_bpf_read_reason_stats(int fd, lfw_u64 *counts)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    if (!counts || fd < 0 || ncpus <= 0)
+        return LFW_ERR_INVALID;
+
+    __u64 *percpu = calloc((size_t)ncpus, sizeof(*percpu));
+    if (!percpu)
+        return LFW_ERR_NO_MEMORY;
+
+    lfw_status_t st = LFW_OK;
+    for (__u32 reason = 0; reason < LFW_REASON_MAX; reason++) {
+        counts[reason] = 0;
+        if (bpf_map_lookup_elem(fd, &reason, percpu) != 0) {
+            st = LFW_ERR_GENERIC;
+            continue;
+        }
+        for (int i = 0; i < ncpus; i++)
+            counts[reason] += percpu[i];
+    }
+
+    free(percpu);
+    return st;
+}
+
+lfw_status_t lfw_bpf_read_rule_stats(lfw_u32 count, struct lfw_rule_stats *totals)
+{
+    int fd = lfw_bpf_get_rule_stats_fd();
+    int ncpus = libbpf_num_possible_cpus();
+    if (!totals || fd < 0 || ncpus <= 0)
+        return LFW_ERR_INVALID;
+
+    struct lfw_rule_stats *percpu = calloc((size_t)ncpus, sizeof(*percpu));
+    if (!percpu)
+        return LFW_ERR_NO_MEMORY;
+
+    lfw_status_t st = LFW_OK;
+    for (__u32 i = 0; i < count; i++) {
+        totals[i].hits = 0;
+        totals[i].bytes = 0;
+        if (bpf_map_lookup_elem(fd, &i, percpu) != 0) {
+            st = LFW_ERR_GENERIC;
+            continue;
+        }
+        for (int c = 0; c < ncpus; c++) {
+            totals[i].hits += percpu[c].hits;
+            totals[i].bytes += percpu[c].bytes;
+        }
+    }
+
+    free(percpu);
+    return st;
+}
+
+// Conntrack entries the daemon deleted itself (GC sweeps); the kernel
+// counters only see the filter's own inserts and deletes
+static lfw_u64 g_ct_deleted[LFW_CT_FAMILIES];
+static lfw_u64 g_ct_deleted_tcp[LFW_CT_FAMILIES][LFW_TCP_STATES];
+
+static const char *const g_tcp_state_names[LFW_TCP_STATES] = {
+    [LFW_TCP_STATE_NONE]        = "none",
+    [LFW_TCP_STATE_SYN_SENT]    = "syn_sent",
+    [LFW_TCP_STATE_SYN_RECV]    = "syn_recv",
+    [LFW_TCP_STATE_ESTABLISHED] = "established",
+    [LFW_TCP_STATE_FIN_WAIT]    = "fin_wait",
+    [LFW_TCP_STATE_CLOSED]      = "closed",
+};
+
+static void ct_count_deleted(lfw_u32 family, lfw_u8 proto, lfw_u8 state)
+{
+    if (family >= LFW_CT_FAMILIES)
+        return;
+    __atomic_fetch_add(&g_ct_deleted[family], 1, __ATOMIC_RELAXED);
+    if (proto == IPPROTO_TCP && state < LFW_TCP_STATES)
+        __atomic_fetch_add(&g_ct_deleted_tcp[family][state], 1, __ATOMIC_RELAXED);
+}
+
+// Clamp a gauge that is momentarily negative because a counter update
+// raced with the read
+static lfw_u64 gauge(int64_t value)
+{
+    return value > 0 ? (lfw_u64)value : 0;
+}
+
+lfw_status_t lfw_bpf_read_conntrack_counts(lfw_bpf_conntrack_counts_t *counts)
+{
+    int fd = lfw_bpf_get_conntrack_stats_fd();
+    int ncpus = libbpf_num_possible_cpus();
+    if (!counts || fd < 0 || ncpus <= 0)
+        return LFW_ERR_INVALID;
+
+    struct lfw_conntrack_stats *percpu = calloc((size_t)ncpus, sizeof(*percpu));
+    if (!percpu)
+        return LFW_ERR_NO_MEMORY;
+
+    __u32 zero = 0;
+    if (bpf_map_lookup_elem(fd, &zero, percpu) != 0) {
+        free(percpu);
+        return LFW_ERR_GENERIC;
+    }
+
+    for (int f = 0; f < LFW_CT_FAMILIES; f++) {
+        int64_t entries = -(int64_t)__atomic_load_n(&g_ct_deleted[f], __ATOMIC_RELAXED);
+        int64_t states[LFW_TCP_STATES];
+        for (int st = 0; st < LFW_TCP_STATES; st++)
+            states[st] = -(int64_t)__atomic_load_n(&g_ct_deleted_tcp[f][st], __ATOMIC_RELAXED);
+
+        for (int i = 0; i < ncpus; i++) {
+            entries += (int64_t)(percpu[i].inserts[f] - percpu[i].deletes[f]);
+            for (int st = 0; st < LFW_TCP_STATES; st++)
+                states[st] += percpu[i].tcp_states[f][st];
+        }
+
+        counts->entries[f] = gauge(entries);
+        for (int st = 0; st < LFW_TCP_STATES; st++)
+            counts->tcp_states[f][st] = gauge(states[st]);
+    }
+
+    free(percpu);
+    return LFW_OK;
+}
+
+// Key of either conntrack table
+typedef union {
+    struct conntrack_key    v4;
+    struct conntrack_key_v6 v6;
+} ct_key_t;
+
+// Deletions queued by a walk; keys are removed once iteration is over so
+// the walk does not restart the table's key order
+typedef struct {
+    ct_key_t *keys;
+    size_t    count;
+    size_t    cap;
+} ct_victims_t;
+
+static bool ct_victims_push(ct_victims_t *victims, const ct_key_t *key)
+{
+    if (victims->count == victims->cap) {
+        size_t cap = victims->cap ? victims->cap * 2 : 64;
+        ct_key_t *keys = realloc(victims->keys, cap * sizeof(*keys));
+        if (!keys)
+            return false;
+        victims->keys = keys;
+        victims->cap = cap;
+    }
+    victims->keys[victims->count++] = *key;
+    return true;
+}
+
+static void ct_entry_fill(lfw_bpf_conntrack_entry_t *entry, lfw_u32 family,
+                          const ct_key_t *key, const struct conntrack_val *val)
+{
+    memset(entry, 0, sizeof(*entry));
+    entry->family = family;
+    if (family == LFW_CT_IPV4) {
+        memcpy(entry->addr_a, &key->v4.src_ip, sizeof(key->v4.src_ip));
+        memcpy(entry->addr_b, &key->v4.dst_ip, sizeof(key->v4.dst_ip));
+        entry->port_a = ntohs(key->v4.src_port);
+        entry->port_b = ntohs(key->v4.dst_port);
+        entry->proto = key->v4.proto;
+    } else {
+        memcpy(entry->addr_a, &key->v6.src_ip, sizeof(key->v6.src_ip));
+        memcpy(entry->addr_b, &key->v6.dst_ip, sizeof(key->v6.dst_ip));
+        entry->port_a = ntohs(key->v6.src_port);
+        entry->port_b = ntohs(key->v6.dst_port);
+        entry->proto = key->v6.proto;
+    }
+    entry->state = val->state;
+    entry->action = val->action;
+    entry->rule = val->rule;
+    entry->last_seen_ns = val->last_seen;
+    entry->packets = val->packets;
+    entry->bytes = val->bytes;
+}
+
+bool lfw_bpf_conntrack_delete(lfw_u32 family, const void *key, lfw_bpf_conntrack_doomed_t doomed, void *ctx)
+{
+    if (family >= LFW_CT_FAMILIES || !key || !doomed)
+        return false;
+
+    int fd = family == LFW_CT_IPV4 ? lfw_bpf_get_conntrack_map_fd() : lfw_bpf_get_conntrack_map_v6_fd();
+    __u8 proto = family == LFW_CT_IPV4 ? ((const struct conntrack_key *)key)->proto
+                                       : ((const struct conntrack_key_v6 *)key)->proto;
+    struct conntrack_val val;
+    if (fd < 0)
+        return false;
+
+    if (bpf_map_lookup_and_delete_elem(fd, key, &val) != 0) {
+        if (errno == ENOENT)
+            return false; // Deleted by the filter meanwhile
+
+        // Kernels before 5.14 cannot take a value out of a hash map: check
+        // it again and delete, leaving it only that moment to change
+        if (bpf_map_lookup_elem(fd, key, &val) != 0 || !doomed(&val, ctx) || bpf_map_delete_elem(fd, key) != 0)
+            return false;
+    } else if (!doomed(&val, ctx)) {
+        // Put it back, unless the filter has already added the connection
+        // again, in which case the removed entry is gone for good
+        if (bpf_map_update_elem(fd, key, &val, BPF_NOEXIST) == 0)
+            return false;
+    }
+
+    ct_count_deleted(family, proto, val.state);
+    return true;
+}
+
+// Asks a walk's visit again about the entry its deletion removed
+typedef struct {
+    lfw_u32                   family;
+    const ct_key_t           *key;
+    lfw_bpf_conntrack_visit_t visit;
+    void                     *ctx;
+} ct_recheck_t;
+
+static bool ct_recheck(const struct conntrack_val *val, void *ctx)
+{
+    ct_recheck_t *recheck = ctx;
+    lfw_bpf_conntrack_entry_t entry;
+
+    ct_entry_fill(&entry, recheck->family, recheck->key, val);
+    return recheck->visit(&entry, recheck->ctx);
+}
+
+static lfw_status_t ct_walk_table(int fd, lfw_u32 family, lfw_bpf_conntrack_visit_t visit, void *ctx,
+                                  lfw_u64 *deleted)
+{
+    ct_victims_t victims = {0};
+    ct_key_t key, next_key;
+    struct conntrack_val val;
+    lfw_bpf_conntrack_entry_t entry;
+    lfw_status_t st = LFW_OK;
+
+    memset(&key, 0, sizeof(key));
+    memset(&next_key, 0, sizeof(next_key));
+
+    int r = bpf_map_get_next_key(fd, NULL, &next_key);
+    while (r == 0) {
+        key = next_key;
+        r = bpf_map_get_next_key(fd, &key, &next_key);
+        if (bpf_map_lookup_elem(fd, &key, &val) != 0)
+            continue; // Deleted by the filter meanwhile
+
+        ct_entry_fill(&entry, family, &key, &val);
+        if (visit(&entry, ctx) && !ct_victims_push(&victims, &key)) {
+            st = LFW_ERR_NO_MEMORY;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < victims.count; i++) {
+        ct_recheck_t recheck = {.family = family, .key = &victims.keys[i], .visit = visit, .ctx = ctx};
+        if (lfw_bpf_conntrack_delete(family, &victims.keys[i], ct_recheck, &recheck) && deleted)
+            (*deleted)++;
+    }
+
+    free(victims.keys);
+    return st;
+}
+
+lfw_status_t lfw_bpf_conntrack_walk(lfw_bpf_conntrack_visit_t visit, void *ctx, lfw_u64 *deleted)
+{
+    int fds[LFW_CT_FAMILIES] = {lfw_bpf_get_conntrack_map_fd(), lfw_bpf_get_conntrack_map_v6_fd()};
+
+    if (!visit || fds[LFW_CT_IPV4] < 0 || fds[LFW_CT_IPV6] < 0)
+        return LFW_ERR_INVALID;
+    if (deleted)
+        *deleted = 0;
+
+    for (lfw_u32 f = 0; f < LFW_CT_FAMILIES; f++) {
+        lfw_status_t st = ct_walk_table(fds[f], f, visit, ctx, deleted);
+        if (st != LFW_OK)
+            return st;
+    }
+    return LFW_OK;
+}
+
+lfw_status_t lfw_bpf_conntrack_lookup(lfw_bpf_conntrack_entry_t *entry)
+{
+    if (!entry || entry->family >= LFW_CT_FAMILIES)
+        return LFW_ERR_INVALID;
+
+    int fd = entry->family == LFW_CT_IPV4 ? lfw_bpf_get_conntrack_map_fd() : lfw_bpf_get_conntrack_map_v6_fd();
+    if (fd < 0)
+        return LFW_ERR_INVALID;
+
+    // Order the endpoints the way the filter does when it builds the key:
+    // raw network-order values, lower address first, then lower port
+    __be16 sport = htons(entry->port_a);
+    __be16 dport = htons(entry->port_b);
+    ct_key_t key;
+    memset(&key, 0, sizeof(key));
+
+    bool swap;
+    if (entry->family == LFW_CT_IPV4) {
+        __be32 saddr, daddr;
+        memcpy(&saddr, entry->addr_a, sizeof(saddr));
+        memcpy(&daddr, entry->addr_b, sizeof(daddr));
+        swap = !(saddr < daddr || (saddr == daddr && sport <= dport));
+        key.v4.src_ip = swap ? daddr : saddr;
+        key.v4.dst_ip = swap ? saddr : daddr;
+        key.v4.src_port = swap ? dport : sport;
+        key.v4.dst_port = swap ? sport : dport;
+        key.v4.proto = entry->proto;
+    } else {
+        int cmp = memcmp(entry->addr_a, entry->addr_b, 16);
+        swap = !(cmp < 0 || (cmp == 0 && sport <= dport));
+        memcpy(&key.v6.src_ip, swap ? entry->addr_b : entry->addr_a, 16);
+        memcpy(&key.v6.dst_ip, swap ? entry->addr_a : entry->addr_b, 16);
+        key.v6.src_port = swap ? dport : sport;
+        key.v6.dst_port = swap ? sport : dport;
+        key.v6.proto = entry->proto;
+    }
+
+    struct conntrack_val val;
+    if (bpf_map_lookup_elem(fd, &key, &val) != 0)
+        return LFW_ERR_GENERIC;
+
+    ct_entry_fill(entry, entry->family, &key, &val);
+    return LFW_OK;
+}
+
+// Key of either family's dynamic list maps
+typedef union {
+    struct lpm_key  v4;
+    struct lpm6_key v6;
+} dyn_key_t;
+
+// Build the map key of entry; false if its list, family or prefix is invalid
+static bool dyn_key_fill(dyn_key_t *key, const lfw_bpf_dyn_entry_t *entry)
+{
+    lfw_u32 family = entry->family;
+    lfw_u32 prefixlen = entry->prefixlen;
+    lfw_u32 bits = family == LFW_CT_IPV4 ? 32 : 128;
+    if (entry->list >= LFW_DYN_LISTS || family >= LFW_CT_FAMILIES || prefixlen > bits)
+        return false;
+
+    // The trie ignores bits past the prefix, but a listed entry reads back
+    // as stored, so keep them clear
+    memset(key, 0, sizeof(*key));
+    lfw_u8 *dst = family == LFW_CT_IPV4 ? (lfw_u8 *)&key->v4.ip : key->v6.ip.s6_addr;
+    memcpy(dst, entry->addr, bits / 8);
+    for (lfw_u32 i = prefixlen; i < bits; i++)
+        dst[i / 8] &= (lfw_u8)~(0x80u >> (i % 8));
+
+    if (family == LFW_CT_IPV4)
+        key->v4.prefixlen = prefixlen;
+    else
+        key->v6.prefixlen = prefixlen;
+    return true;
+}
+
+lfw_status_t lfw_bpf_dyn_add(const lfw_bpf_dyn_entry_t *entry)
+{
+    dyn_key_t key;
+    if (!entry || !dyn_key_fill(&key, entry))
+        return LFW_ERR_INVALID;
+    int fd = lfw_bpf_get_dyn_fd(entry->list, entry->family);
+    if (fd < 0)
+        return LFW_ERR_INVALID;
+
+    struct lfw_dyn_val val = {
+        .added = entry->added_ns,
+        .expires = entry->expires_ns,
+        .prefixlen = entry->prefixlen,
+    };
+    if (bpf_map_update_elem(fd, &key, &val, BPF_ANY) != 0)
+        return errno == ENOMEM || errno == E2BIG ? LFW_ERR_NO_MEMORY : LFW_ERR_GENERIC;
+    return LFW_OK;
+}
+
+lfw_status_t lfw_bpf_dyn_del(const lfw_bpf_dyn_entry_t *entry)
+{
+    dyn_key_t key;
+    if (!entry || !dyn_key_fill(&key, entry))
+        return LFW_ERR_INVALID;
+    int fd = lfw_bpf_get_dyn_fd(entry->list, entry->family);
+    if (fd < 0)
+        return LFW_ERR_INVALID;
+
+    if (bpf_map_delete_elem(fd, &key) != 0)
+        return LFW_ERR_GENERIC;
+    return LFW_OK;
+}
+
+bool lfw_bpf_dyn_listed(lfw_u32 list, lfw_u32 family, const lfw_u8 *addr, lfw_u64 now_ns)
+{
+    lfw_bpf_dyn_entry_t entry = {.list = list, .family = family, .prefixlen = family == LFW_CT_IPV4 ? 32 : 128};
+    dyn_key_t key;
+    struct lfw_dyn_val val;
+
+    memcpy(entry.addr, addr, family == LFW_CT_IPV4 ? 4 : 16);
+    if (!dyn_key_fill(&key, &entry))
+        return false;
+    int fd = lfw_bpf_get_dyn_fd(list, family);
+    if (fd < 0 || bpf_map_lookup_elem(fd, &key, &val) != 0)
+        return false;
+    return !val.expires || now_ns < val.expires;
+}
+
+static lfw_status_t dyn_walk_map(int fd, lfw_u32 list, lfw_u32 family, lfw_bpf_dyn_visit_t visit, void *ctx,
+                                 lfw_u64 *deleted)
+{
+    dyn_key_t key, next_key, *victims = NULL;
+    size_t count = 0, cap = 0;
+    struct lfw_dyn_val val;
+    lfw_bpf_dyn_entry_t entry;
+    lfw_status_t st = LFW_OK;
+
+    memset(&key, 0, sizeof(key));
+    memset(&next_key, 0, sizeof(next_key));
+
+    int r = bpf_map_get_next_key(fd, NULL, &next_key);
+    while (r == 0) {
+        key = next_key;
+        r = bpf_map_get_next_key(fd, &key, &next_key);
+        if (bpf_map_lookup_elem(fd, &key, &val) != 0)
+            continue; // Expired and deleted by the filter meanwhile
+
+        memset(&entry, 0, sizeof(entry));
+        entry.list = list;
+        entry.family = family;
+        if (family == LFW_CT_IPV4) {
+            entry.prefixlen = key.v4.prefixlen;
+            memcpy(entry.addr, &key.v4.ip, sizeof(key.v4.ip));
+        } else {
+            entry.prefixlen = key.v6.prefixlen;
+            memcpy(entry.addr, &key.v6.ip, sizeof(key.v6.ip));
+        }
+        entry.added_ns = val.added;
+        entry.expires_ns = val.expires;
+
+        if (!visit(&entry, ctx))
+            continue;
+        // Deletions wait for the end of the walk, as for conntrack
+        if (count == cap) {
+            size_t new_cap = cap ? cap * 2 : 64;
+            dyn_key_t *grown = realloc(victims, new_cap * sizeof(*victims));
+            if (!grown) {
+                st = LFW_ERR_NO_MEMORY;
+                break;
+            }
+            victims = grown;
+            cap = new_cap;
+        }
+        victims[count++] = key;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (bpf_map_delete_elem(fd, &victims[i]) == 0 && deleted)
+            (*deleted)++;
+    }
+
+    free(victims);
+    return st;
+}
+
+lfw_status_t lfw_bpf_dyn_walk(lfw_bpf_dyn_visit_t visit, void *ctx, lfw_u64 *deleted)
+{
+    if (!visit)
+        return LFW_ERR_INVALID;
+    if (deleted)
+        *deleted = 0;
+
+    for (lfw_u32 l = 0; l < LFW_DYN_LISTS; l++) {
+        for (lfw_u32 f = 0; f < LFW_CT_FAMILIES; f++) {
+            int fd = lfw_bpf_get_dyn_fd(l, f);
+            if (fd < 0)
+                return LFW_ERR_INVALID;
+            lfw_status_t st = dyn_walk_map(fd, l, f, visit, ctx, deleted);
+            if (st != LFW_OK)
+                return st;
+        }
+    }
+    return LFW_OK;
+}
+
+static bool dyn_expired(const lfw_bpf_dyn_entry_t *entry, void *ctx)
+{
+    lfw_u64 now_ns = *(const lfw_u64 *)ctx;
+    return entry->expires_ns && entry->expires_ns <= now_ns;
+}
+
+lfw_status_t lfw_bpf_dyn_sweep(lfw_u64 now_ns, lfw_u64 *deleted)
+{
+    return lfw_bpf_dyn_walk(dyn_expired, &now_ns, deleted);
+}
+
+typedef struct {
+    lfw_u64 entries[LFW_CT_FAMILIES];
+    lfw_u64 tcp[LFW_CT_FAMILIES][LFW_TCP_STATES];
+} ct_census_t;
+
+static bool ct_census(const lfw_bpf_conntrack_entry_t *entry, void *ctx)
+{
+    ct_census_t *census = ctx;
+    census->entries[entry->family]++;
+    if (entry->proto == IPPROTO_TCP && entry->state < LFW_TCP_STATES)
+        census->tcp[entry->family][entry->state]++;
+    return false;
+}
+
+void lfw_bpf_dump_conntrack(void)
+{
+    ct_census_t walked = {0};
+
+    if (lfw_bpf_conntrack_walk(ct_census, &walked, NULL) != LFW_OK) {
+        lfw_log_error("BPF maps not initialized for conntrack dump");
+        return;
+    }
+
+    lfw_bpf_conntrack_counts_t counts = {0};
+    lfw_bpf_read_conntrack_counts(&counts);
+
+    lfw_log_info("=== Conntrack Tables (walked / counted) ===");
+    for (int f = 0; f < LFW_CT_FAMILIES; f++) {
+        const char *family = f == LFW_CT_IPV4 ? "IPv4" : "IPv6";
+        lfw_log_info("%s entries: %llu / %llu", family,
+                     (unsigned long long)walked.entries[f], (unsigned long long)counts.entries[f]);
+        for (int st = 0; st < LFW_TCP_STATES; st++) {
+            lfw_log_info("  %s tcp %s: %llu / %llu", family, g_tcp_state_names[st],
+                         (unsigned long long)walked.tcp[f][st], (unsigned long long)counts.tcp_states[f][st]);
+        }
+    }
 }
 
 void lfw_bpf_dump_stats(const lfw_rule_t *orig_rules, lfw_u32 orig_rule_count, lfw_action_t default_action)
@@ -570,18 +1185,9 @@ void lfw_bpf_dump_stats(const lfw_rule_t *orig_rules, lfw_u32 orig_rule_count, l
         return;
     }
 
-    lfw_u32 conn_count = 0;
-    struct conntrack_key key = {}, next_key = {};
-    while (bpf_map_get_next_key(conntrack_fd, &key, &next_key) == 0) {
-        conn_count++;
-        key = next_key;
-    }
-
-    lfw_u32 conn6_count = 0;
-    struct conntrack_key_v6 key6 = {}, next_key6 = {};
-    while (bpf_map_get_next_key(conntrack_v6_fd, &key6, &next_key6) == 0) {
-        conn6_count++;
-        key6 = next_key6;
+    lfw_bpf_conntrack_counts_t ct = {0};
+    if (lfw_bpf_read_conntrack_counts(&ct) != LFW_OK) {
+        lfw_log_error("Failed to read conntrack counters");
     }
 
     __u32 idx_cnt = 1;
@@ -591,19 +1197,42 @@ void lfw_bpf_dump_stats(const lfw_rule_t *orig_rules, lfw_u32 orig_rule_count, l
     }
 
     lfw_log_info("=== eBPF/TC Firewall Statistics ===");
-    lfw_log_info("Active IPv4 Connections Count: %u", conn_count);
-    lfw_log_info("Active IPv6 Connections Count: %u", conn6_count);
+    lfw_log_info("Active IPv4 Connections Count: %llu", (unsigned long long)ct.entries[LFW_CT_IPV4]);
+    lfw_log_info("Active IPv6 Connections Count: %llu", (unsigned long long)ct.entries[LFW_CT_IPV6]);
+    for (int f = 0; f < LFW_CT_FAMILIES; f++) {
+        lfw_log_info("  %s TCP: syn_sent=%llu, syn_recv=%llu, established=%llu, fin_wait=%llu, closed=%llu",
+                     f == LFW_CT_IPV4 ? "IPv4" : "IPv6",
+                     (unsigned long long)ct.tcp_states[f][LFW_TCP_STATE_SYN_SENT],
+                     (unsigned long long)ct.tcp_states[f][LFW_TCP_STATE_SYN_RECV],
+                     (unsigned long long)ct.tcp_states[f][LFW_TCP_STATE_ESTABLISHED],
+                     (unsigned long long)ct.tcp_states[f][LFW_TCP_STATE_FIN_WAIT],
+                     (unsigned long long)ct.tcp_states[f][LFW_TCP_STATE_CLOSED]);
+    }
     lfw_log_info("Default Policy Verdict: %s",
                  default_action == LFW_ACTION_ACCEPT ? "ACCEPT" : "DROP");
     lfw_log_info("Installed Rules Count: %u", rule_count);
 
-    for (__u32 i = 0; i < rule_count && i < 256; i++) {
+    if (rule_count > 256) {
+        rule_count = 256;
+    }
+    struct lfw_rule_stats rule_totals[256];
+    lfw_bpf_read_rule_stats(rule_count, rule_totals);
+
+    for (__u32 i = 0; i < rule_count; i++) {
         struct bpf_rule b_rule = {};
         if (bpf_map_lookup_elem(rules_fd, &i, &b_rule) == 0) {
             char rule_str[256];
             format_rule(&b_rule, rule_str, sizeof(rule_str));
             lfw_log_info("  Rule #%u [%s]: hits=%lu, bytes=%lu",
-                         i + 1, rule_str, (unsigned long)b_rule.hit_count, (unsigned long)b_rule.byte_count);
+                         i + 1, rule_str, (unsigned long)rule_totals[i].hits, (unsigned long)rule_totals[i].bytes);
+        }
+    }
+
+    lfw_u64 reasons[LFW_REASON_MAX];
+    if (lfw_bpf_read_reason_stats(lfw_bpf_get_reason_stats_fd(), reasons) == LFW_OK) {
+        lfw_log_info("Verdict Reasons:");
+        for (lfw_u32 r = 0; r < LFW_REASON_MAX; r++) {
+            lfw_log_info("  %s: %llu", lfw_bpf_reason_name(r), (unsigned long long)reasons[r]);
         }
     }
 
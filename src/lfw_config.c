@@ -349,7 +349,8 @@ static lfw_status_t parse_rule_line(char *line,
     // Optional port (after protocol or directly after action)
     if (tok &&
         strcasecmp(tok, "from") != 0 &&
-        strcasecmp(tok, "to") != 0)
+        strcasecmp(tok, "to") != 0 &&
+        strcasecmp(tok, "sample") != 0)
     {
         if (parse_port_proto(tok,
                             &rule.match.protocol,
@@ -365,7 +366,7 @@ static lfw_status_t parse_rule_line(char *line,
     }
 
 
-    // Optional from/to
+    // Optional from/to and sample
     while (tok) {
 
         if (strcasecmp(tok, "from") == 0) {
@@ -375,9 +376,10 @@ static lfw_status_t parse_rule_line(char *line,
 
             if (strcasecmp(ip, "any") != 0) {
                 if (!parse_ip_cidr(ip, &rule.match.src_ip, &rule.match.src_mask)) {
-                    if (is_valid_fqdn(ip) && strlen(ip) < sizeof(rule.match.src_fqdn)) {
-                        strncpy(rule.match.src_fqdn, ip, sizeof(rule.match.src_fqdn) - 1);
-                        rule.match.has_src_fqdn = true;
+                    if (is_valid_fqdn(ip) && strlen(ip) <= LFW_FQDN_MAX_LEN) {
+                        rule.match.src_fqdn = lfw_fqdn_intern(ip);
+                        if (rule.match.src_fqdn == LFW_FQDN_NONE)
+                            return LFW_ERR_NO_MEMORY;
                     } else {
                         return LFW_ERR_INVALID;
                     }
@@ -393,9 +395,10 @@ static lfw_status_t parse_rule_line(char *line,
 
             if (strcasecmp(ip, "any") != 0) {
                 if (!parse_ip_cidr(ip, &rule.match.dst_ip, &rule.match.dst_mask)) {
-                    if (is_valid_fqdn(ip) && strlen(ip) < sizeof(rule.match.dst_fqdn)) {
-                        strncpy(rule.match.dst_fqdn, ip, sizeof(rule.match.dst_fqdn) - 1);
-                        rule.match.has_dst_fqdn = true;
+                    if (is_valid_fqdn(ip) && strlen(ip) <= LFW_FQDN_MAX_LEN) {
+                        rule.match.dst_fqdn = lfw_fqdn_intern(ip);
+                        if (rule.match.dst_fqdn == LFW_FQDN_NONE)
+                            return LFW_ERR_NO_MEMORY;
                     } else {
                         return LFW_ERR_INVALID;
                     }
@@ -404,6 +407,19 @@ static lfw_status_t parse_rule_line(char *line,
                 }
             }
         }
+        else if (strcasecmp(tok, "sample") == 0) {
+            // Telemetry sampling only covers allowed traffic
+            char *rate_str = strtok(NULL, " \t\r\n");
+            if (!rate_str || action != LFW_ACTION_ACCEPT)
+                return LFW_ERR_INVALID;
+
+            char *endptr;
+            long rate = strtol(rate_str, &endptr, 10);
+            if (*endptr != '\0' || rate <= 0 || rate > 65535)
+                return LFW_ERR_INVALID;
+
+            rule.match.sample_rate = (lfw_u16)rate;
+        }
         else {
             return LFW_ERR_INVALID;
         }
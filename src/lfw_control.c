@@ -0,0 +1,631 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_control.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// A connection with no request or reply progress for this long is closed
+#define CONTROL_IDLE_MS 10000
+
+#define HEADER_LEN sizeof(lfw_ctl_header_t)
+
+struct lfw_control_reply {
+    lfw_ctl_status_t status;
+    lfw_u8          *data;   // Room for the header, then the payload
+    size_t           len;    // Payload bytes
+    size_t           cap;    // Payload bytes allocated
+    bool             failed; // Too large or out of memory
+};
+
+// Where a request is between the loop and lfw_control_run
+typedef enum {
+    REQUEST_NONE = 0,
+    REQUEST_PENDING,  // Read in full, waiting for lfw_control_run
+    REQUEST_RUNNING,  // Being answered
+    REQUEST_ANSWERED, // Reply ready for the loop to send
+} ctl_request_state_t;
+
+typedef struct {
+    int     fd;       // -1 when the slot is free
+    lfw_u8  in[HEADER_LEN + LFW_CONTROL_MAX_REQUEST];
+    size_t  in_len;
+    lfw_u8 *out;      // Reply being written, header included
+    size_t  out_len;
+    size_t  out_off;
+    bool    closing;  // Close once the reply is written
+    bool    busy;     // A request is out of the loop's hands; loop only
+    bool    watched;  // In the epoll set
+    lfw_u64 active_ms;
+
+    // Under the control lock
+    ctl_request_state_t state;
+    lfw_control_reply_t reply; // Once answered
+} ctl_client_t;
+
+struct lfw_control {
+    int                   listen_fd;
+    int                   epoll_fd;  // Listening socket (data.ptr NULL), answer_fd (the control) and clients
+    int                   answer_fd; // Eventfd written when lfw_control_run answers a request
+    bool                  accepting; // Listening socket watched
+    char                  path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    lfw_control_handler_t handler;
+    void                 *ctx;
+    pthread_mutex_t       lock;      // Request states, between the loop and lfw_control_run
+    lfw_u32               pending;   // Requests in REQUEST_PENDING
+    ctl_client_t          clients[LFW_CONTROL_MAX_CLIENTS];
+};
+
+static lfw_u64 monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (lfw_u64)ts.tv_sec * 1000ULL + (lfw_u64)ts.tv_nsec / 1000000ULL;
+}
+
+bool lfw_control_reply_append(lfw_control_reply_t *reply, const void *data, size_t length)
+{
+    if (reply->failed)
+        return false;
+
+    if (length > LFW_CONTROL_MAX_RESPONSE - reply->len) {
+        reply->failed = true;
+        return false;
+    }
+
+    if (reply->len + length > reply->cap || !reply->data) {
+        size_t cap = reply->cap ? reply->cap : 256;
+        while (cap < reply->len + length)
+            cap *= 2;
+        lfw_u8 *grown = realloc(reply->data, HEADER_LEN + cap);
+        if (!grown) {
+            reply->failed = true;
+            return false;
+        }
+        reply->data = grown;
+        reply->cap = cap;
+    }
+
+    memcpy(reply->data + HEADER_LEN + reply->len, data, length);
+    reply->len += length;
+    return true;
+}
+
+void *lfw_control_reply_data(lfw_control_reply_t *reply)
+{
+    return reply->data ? reply->data + HEADER_LEN : NULL;
+}
+
+void lfw_control_reply_error(lfw_control_reply_t *reply, lfw_ctl_status_t status, const char *fmt, ...)
+{
+    char msg[512];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        n = 0;
+    if ((size_t)n >= sizeof(msg))
+        n = sizeof(msg) - 1;
+
+    reply->status = status;
+    reply->len = 0;
+    reply->failed = false;
+    lfw_control_reply_append(reply, msg, (size_t)n);
+}
+
+static void client_close(ctl_client_t *client)
+{
+    close(client->fd);
+    free(client->out);
+    free(client->reply.data);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+// Write what the socket takes of the pending reply
+static void client_write(ctl_client_t *client)
+{
+    while (client->out_off < client->out_len) {
+        ssize_t n = send(client->fd, client->out + client->out_off, client->out_len - client->out_off,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                client_close(client);
+            return;
+        }
+        client->out_off += (size_t)n;
+        client->active_ms = monotonic_ms();
+    }
+
+    free(client->out);
+    client->out = NULL;
+    client->out_len = 0;
+    client->out_off = 0;
+    if (client->closing)
+        client_close(client);
+}
+
+// Queue reply for the client and start writing it
+static void client_reply(ctl_client_t *client, lfw_control_reply_t *reply)
+{
+    if (reply->failed)
+        lfw_control_reply_error(reply, LFW_CTL_ERR_FAILED, "reply too large or out of memory");
+    if (!reply->data && !lfw_control_reply_append(reply, "", 0)) {
+        client_close(client);
+        return;
+    }
+
+    lfw_ctl_header_t hdr = {
+        .magic   = LFW_CONTROL_MAGIC,
+        .version = LFW_CONTROL_VERSION,
+        .code    = (lfw_u16)reply->status,
+        .length  = (lfw_u32)reply->len,
+    };
+    memcpy(reply->data, &hdr, sizeof(hdr));
+
+    client->out = reply->data;
+    client->out_len = HEADER_LEN + reply->len;
+    client->out_off = 0;
+    reply->data = NULL;
+    client_write(client);
+}
+
+static void client_fail(ctl_client_t *client, lfw_ctl_status_t status, const char *msg)
+{
+    lfw_control_reply_t reply = {0};
+    lfw_control_reply_error(&reply, status, "%s", msg);
+    client->closing = true;
+    client_reply(client, &reply);
+}
+
+// Read until a whole request is in, then hand it to lfw_control_run
+static void client_read(lfw_control_t *ctl, ctl_client_t *client)
+{
+    for (;;) {
+        lfw_ctl_header_t hdr;
+        size_t want = HEADER_LEN;
+        if (client->in_len >= HEADER_LEN) {
+            memcpy(&hdr, client->in, sizeof(hdr));
+            want += hdr.length;
+        }
+
+        if (client->in_len < want) {
+            ssize_t n = recv(client->fd, client->in + client->in_len, want - client->in_len, MSG_DONTWAIT);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            if (n <= 0) {
+                client_close(client);
+                return;
+            }
+            client->in_len += (size_t)n;
+            client->active_ms = monotonic_ms();
+            if (client->in_len < want)
+                continue;
+        }
+
+        memcpy(&hdr, client->in, sizeof(hdr));
+        if (hdr.magic != LFW_CONTROL_MAGIC || hdr.version != LFW_CONTROL_VERSION) {
+            client_fail(client, LFW_CTL_ERR_INVALID, "unsupported protocol version");
+            return;
+        }
+        if (hdr.length > LFW_CONTROL_MAX_REQUEST) {
+            client_fail(client, LFW_CTL_ERR_INVALID, "request too large");
+            return;
+        }
+        if (client->in_len < HEADER_LEN + hdr.length)
+            continue; // Header just completed; read the payload
+
+        pthread_mutex_lock(&ctl->lock);
+        client->state = REQUEST_PENDING;
+        ctl->pending++;
+        pthread_mutex_unlock(&ctl->lock);
+        client->busy = true;
+        return; // Further requests wait until this one is answered
+    }
+}
+
+static void accept_clients(lfw_control_t *ctl)
+{
+    for (int i = 0; i < LFW_CONTROL_MAX_CLIENTS; i++) {
+        ctl_client_t *client = &ctl->clients[i];
+        if (client->fd >= 0)
+            continue;
+
+        int fd = accept4(ctl->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = client};
+        if (epoll_ctl(ctl->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            return;
+        }
+        client->fd = fd;
+        client->watched = true;
+        client->active_ms = monotonic_ms();
+    }
+}
+
+// Wait for the client's next request, or for room to write its reply.
+// A client whose request is being answered is left out of the set, as a
+// hangup would otherwise be reported over and over meanwhile.
+static void client_watch(lfw_control_t *ctl, ctl_client_t *client)
+{
+    if (client->fd < 0)
+        return;
+
+    if (client->busy) {
+        if (client->watched && epoll_ctl(ctl->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL) == 0)
+            client->watched = false;
+        return;
+    }
+
+    struct epoll_event ev = {.events = client->out ? EPOLLOUT : EPOLLIN, .data.ptr = client};
+    if (epoll_ctl(ctl->epoll_fd, client->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, client->fd, &ev) != 0) {
+        client_close(client);
+        return;
+    }
+    client->watched = true;
+}
+
+// Send the replies lfw_control_run has finished
+static void collect_answers(lfw_control_t *ctl)
+{
+    lfw_control_reply_t replies[LFW_CONTROL_MAX_CLIENTS];
+    bool answered[LFW_CONTROL_MAX_CLIENTS] = {false};
+
+    pthread_mutex_lock(&ctl->lock);
+    for (int i = 0; i < LFW_CONTROL_MAX_CLIENTS; i++) {
+        ctl_client_t *client = &ctl->clients[i];
+        if (client->state != REQUEST_ANSWERED)
+            continue;
+        replies[i] = client->reply;
+        memset(&client->reply, 0, sizeof(client->reply));
+        client->state = REQUEST_NONE;
+        answered[i] = true;
+    }
+    pthread_mutex_unlock(&ctl->lock);
+
+    for (int i = 0; i < LFW_CONTROL_MAX_CLIENTS; i++) {
+        if (!answered[i])
+            continue;
+        ctl_client_t *client = &ctl->clients[i];
+        client->busy = false;
+        client->in_len = 0;
+        client->active_ms = monotonic_ms();
+        client_reply(client, &replies[i]);
+        client_watch(ctl, client);
+    }
+}
+
+// Leave further connections in the backlog while every slot is busy
+static void listen_watch(lfw_control_t *ctl)
+{
+    bool slot_free = false;
+    for (int i = 0; i < LFW_CONTROL_MAX_CLIENTS && !slot_free; i++)
+        slot_free = ctl->clients[i].fd < 0;
+    if (slot_free == ctl->accepting)
+        return;
+
+    struct epoll_event ev = {.events = slot_free ? EPOLLIN : 0, .data.ptr = NULL};
+    if (epoll_ctl(ctl->epoll_fd, EPOLL_CTL_MOD, ctl->listen_fd, &ev) == 0)
+        ctl->accepting = slot_free;
+}
+
+lfw_control_t *lfw_control_open(const char *path, lfw_control_handler_t handler, void *ctx)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (!path || path[0] != '/' || !handler || strlen(path) >= sizeof(addr.sun_path)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Replace a socket left by an earlier run, but never another file
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            errno = EEXIST;
+            return NULL;
+        }
+        unlink(path);
+    }
+
+    lfw_control_t *ctl = calloc(1, sizeof(*ctl));
+    if (!ctl)
+        return NULL;
+    for (int i = 0; i < LFW_CONTROL_MAX_CLIENTS; i++)
+        ctl->clients[i].fd = -1;
+    ctl->handler = handler;
+    ctl->ctx = ctx;
+
+    ctl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctl->epoll_fd < 0) {
+        free(ctl);
+        return NULL;
+    }
+    struct epoll_event answer_ev = {.events = EPOLLIN, .data.ptr = ctl};
+    ctl->answer_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctl->answer_fd < 0 || epoll_ctl(ctl->epoll_fd, EPOLL_CTL_ADD, ctl->answer_fd, &answer_ev) != 0) {
+        int err = errno;
+        if (ctl->answer_fd >= 0)
+            close(ctl->answer_fd);
+        close(ctl->epoll_fd);
+        free(ctl);
+        errno = err;
+        return NULL;
+    }
+    ctl->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ctl->listen_fd < 0) {
+        int err = errno;
+        close(ctl->answer_fd);
+        close(ctl->epoll_fd);
+        free(ctl);
+        errno = err;
+        return NULL;
+    }
+
+    // Only root may reload or flush: create the socket without group or
+    // other access rather than chmod it after bind
+    mode_t old_umask = umask(0077);
+    int rc = bind(ctl->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    if (rc != 0 || listen(ctl->listen_fd, LFW_CONTROL_MAX_CLIENTS) != 0 ||
+        epoll_ctl(ctl->epoll_fd, EPOLL_CTL_ADD, ctl->listen_fd, &ev) != 0) {
+        int err = errno;
+        if (rc == 0)
+            unlink(path);
+        close(ctl->listen_fd);
+        close(ctl->answer_fd);
+        close(ctl->epoll_fd);
+        free(ctl);
+        errno = err;
+        return NULL;
+    }
+    ctl->accepting = true;
+    pthread_mutex_init(&ctl->lock, NULL);
+
+    strcpy(ctl->path, path);
+    return ctl;
+}
+
+int lfw_control_fd(const lfw_control_t *ctl)
+{
+    return ctl ? ctl->epoll_fd : -1;
+}
+
+lfw_u32 lfw_control_process(lfw_control_t *ctl)
+{
+    if (!ctl)
+        return 0;
+
+    struct epoll_event events[LFW_CONTROL_MAX_CLIENTS + 2];
+    int count = epoll_wait(ctl->epoll_fd, events, LFW_CONTROL_MAX_CLIENTS + 2, 0);
+
+    bool pending_accept = false;
+    for (int i = 0; i < count; i++) {
+        ctl_client_t *client = events[i].data.ptr;
+        if (!client) {
+            pending_accept = true;
+            continue;
+        }
+        if (events[i].data.ptr == ctl) {
+            lfw_u64 answers;
+            ssize_t n = read(ctl->answer_fd, &answers, sizeof(answers));
+            (void)n;
+            continue;
+        }
+        if (client->fd < 0 || client->busy)
+            continue;
+        if (client->out)
+            client_write(client);
+        else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            client_read(ctl, client);
+        client_watch(ctl, client);
+    }
+
+    collect_answers(ctl);
+
+    // Accept last, so a new connection never takes the slot of one closed
+    // above while an event taken in this batch still names it
+    if (pending_accept)
+        accept_clients(ctl);
+
+    lfw_u64 now = monotonic_ms();
+    lfw_u64 next_expiry = 0;
+    for (int c = 0; c < LFW_CONTROL_MAX_CLIENTS; c++) {
+        ctl_client_t *client = &ctl->clients[c];
+        if (client->fd < 0 || client->busy)
+            continue;
+        if (now - client->active_ms >= CONTROL_IDLE_MS) {
+            client_close(client);
+            continue;
+        }
+        lfw_u64 left = CONTROL_IDLE_MS - (now - client->active_ms);
+        if (next_expiry == 0 || left < next_expiry)
+            next_expiry = left;
+    }
+
+    listen_watch(ctl);
+    return (lfw_u32)next_expiry;
+}
+
+bool lfw_control_pending(lfw_control_t *ctl)
+{
+    if (!ctl)
+        return false;
+
+    pthread_mutex_lock(&ctl->lock);
+    bool pending = ctl->pending > 0;
+    pthread_mutex_unlock(&ctl->lock);
+    return pending;
+}
+
+void lfw_control_run(lfw_control_t *ctl)
+{
+    if (!ctl)
+        return;
+
+    pthread_mutex_lock(&ctl->lock);
+    while (ctl->pending > 0) {
+        ctl_client_t *client = NULL;
+        for (int i = 0; i < LFW_CONTROL_MAX_CLIENTS && !client; i++) {
+            if (ctl->clients[i].state == REQUEST_PENDING)
+                client = &ctl->clients[i];
+        }
+        if (!client)
+            break;
+        client->state = REQUEST_RUNNING;
+        ctl->pending--;
+        pthread_mutex_unlock(&ctl->lock);
+
+        // The loop leaves the request buffer alone until it is answered
+        lfw_ctl_header_t hdr;
+        memcpy(&hdr, client->in, sizeof(hdr));
+        lfw_control_reply_t reply = {.status = LFW_CTL_OK};
+        ctl->handler(ctl->ctx, hdr.code, client->in + HEADER_LEN, hdr.length, &reply);
+
+        pthread_mutex_lock(&ctl->lock);
+        client->reply = reply;
+        client->state = REQUEST_ANSWERED;
+
+        lfw_u64 one = 1;
+        ssize_t n;
+        do {
+            n = write(ctl->answer_fd, &one, sizeof(one));
+        } while (n < 0 && errno == EINTR);
+    }
+    pthread_mutex_unlock(&ctl->lock);
+}
+
+void lfw_control_close(lfw_control_t *ctl)
+{
+    if (!ctl)
+        return;
+
+    for (int i = 0; i < LFW_CONTROL_MAX_CLIENTS; i++) {
+        if (ctl->clients[i].fd >= 0)
+            client_close(&ctl->clients[i]);
+    }
+    pthread_mutex_destroy(&ctl->lock);
+    close(ctl->listen_fd);
+    close(ctl->answer_fd);
+    close(ctl->epoll_fd);
+    unlink(ctl->path);
+    free(ctl);
+}
+
+static bool send_all(int fd, const void *data, size_t len)
+{
+    const lfw_u8 *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void *data, size_t len)
+{
+    lfw_u8 *p = data;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0)
+            errno = ECONNRESET;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+lfw_status_t lfw_control_call(const char *path, lfw_u16 command, const void *payload, lfw_u32 length,
+                              int timeout_ms, lfw_u16 *status, void **reply, lfw_u32 *reply_length)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+
+    if (!path || strlen(path) >= sizeof(addr.sun_path) || length > LFW_CONTROL_MAX_REQUEST ||
+        !status || !reply || !reply_length) {
+        errno = EINVAL;
+        return LFW_ERR_INVALID;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return LFW_ERR_GENERIC;
+
+    struct timeval tv = {.tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    lfw_ctl_header_t hdr = {
+        .magic   = LFW_CONTROL_MAGIC,
+        .version = LFW_CONTROL_VERSION,
+        .code    = command,
+        .length  = length,
+    };
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || !send_all(fd, &hdr, sizeof(hdr)) ||
+        (length && !send_all(fd, payload, length)) || !recv_all(fd, &hdr, sizeof(hdr))) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return LFW_ERR_GENERIC;
+    }
+
+    if (hdr.magic != LFW_CONTROL_MAGIC || hdr.version != LFW_CONTROL_VERSION ||
+        hdr.length > LFW_CONTROL_MAX_RESPONSE) {
+        close(fd);
+        errno = EPROTO;
+        return LFW_ERR_GENERIC;
+    }
+
+    lfw_u8 *data = malloc((size_t)hdr.length + 1);
+    if (!data) {
+        close(fd);
+        errno = ENOMEM;
+        return LFW_ERR_NO_MEMORY;
+    }
+    if (!recv_all(fd, data, hdr.length)) {
+        int err = errno;
+        free(data);
+        close(fd);
+        errno = err;
+        return LFW_ERR_GENERIC;
+    }
+    data[hdr.length] = '\0';
+    close(fd);
+
+    *status = hdr.code;
+    *reply = data;
+    *reply_length = hdr.length;
+    return LFW_OK;
+}
@@ -2,6 +2,7 @@
 
 #include "lfw_engine.h"
 #include "lfw_state.h"
+#include "lfw_matcher.h"
 #include "lfw_config.h"
 #include "lfw_log.h"
 #include <stdio.h>
@@ -17,6 +18,81 @@ static inline lfw_verdict_t action_to_verdict(lfw_action_t action)
     return LFW_VERDICT_DROP; // fail closed
 }
 
+// Rules prefetched when a batch takes the ruleset snapshot
+#define LFW_ENGINE_PREFETCH_RULES 8
+
+// Counter updates gathered across consecutive hits on the same rule
+typedef struct {
+    lfw_rule_t *rule;
+    lfw_u64     hits;
+    lfw_u64     bytes;
+} rule_hits_t;
+
+static void rule_hits_flush(rule_hits_t *rh)
+{
+    if (!rh->rule)
+        return;
+
+    // Atomically increment hits and byte count
+    __sync_fetch_and_add(&rh->rule->hit_count, rh->hits);
+    __sync_fetch_and_add(&rh->rule->byte_count, rh->bytes);
+
+    rh->rule = NULL;
+    rh->hits = 0;
+    rh->bytes = 0;
+}
+
+static inline void rule_hits_add(rule_hits_t *rh, lfw_rule_t *rule, lfw_u32 length)
+{
+    if (rh->rule != rule) {
+        rule_hits_flush(rh);
+        rh->rule = rule;
+    }
+    rh->hits++;
+    rh->bytes += length;
+}
+
+// Resolve a packet that is not part of an established flow.
+// Caller holds rules_lock for reading and flushes rh before releasing it.
+static lfw_verdict_t evaluate_rules(lfw_engine_t *engine,
+                                    lfw_packet_t *packet,
+                                    const lfw_state_key_t *key,
+                                    rule_hits_t *rh)
+{
+    lfw_verdict_t verdict = action_to_verdict(engine->config.default_action);
+    lfw_u32 index = LFW_RULE_INDEX_NONE;
+
+    if (engine->ruleset.matcher) {
+        lfw_u32 i = lfw_matcher_first(engine->ruleset.matcher, packet);
+        if (i != LFW_MATCHER_NONE)
+            index = i;
+    } else {
+        // Evaluate rules in order
+        for (lfw_u32 i = 0; i < engine->ruleset.rule_count; i++) {
+            if (lfw_rule_match(&engine->ruleset.rules[i], packet)) {
+                index = i;
+                break;
+            }
+        }
+    }
+
+    packet->rule_index = index;
+    if (index != LFW_RULE_INDEX_NONE) {
+        lfw_rule_t *rule = (lfw_rule_t *)&engine->ruleset.rules[index];
+        verdict = action_to_verdict(rule->action);
+        rule_hits_add(rh, rule, packet->length);
+    }
+
+    // If accepting, add to state table (state_add handles TCP/UDP check)
+    if (verdict == LFW_VERDICT_ACCEPT &&
+        engine->connection_state)
+    {
+        lfw_state_add_key(engine->connection_state, packet, key);
+    }
+
+    return verdict;
+}
+
 lfw_verdict_t lfw_engine_evaluate(
     lfw_engine_t *engine,
     lfw_packet_t *packet)
@@ -24,59 +100,101 @@ lfw_verdict_t lfw_engine_evaluate(
     if (!engine || !packet)
         return LFW_VERDICT_DROP;
 
+    lfw_state_key_t key = {0};
+
     // Initialize established flag
     packet->is_established = false;
+    packet->rule_index = LFW_RULE_INDEX_NONE;
 
     // If state tracking enabled, allow established flows
     if (engine->connection_state) {
-        if (lfw_state_established(engine->connection_state, packet)) {
+        lfw_state_prepare(engine->connection_state, packet, &key);
+        if (lfw_state_established_key(engine->connection_state, packet, &key)) {
             packet->is_established = true;
             return LFW_VERDICT_ACCEPT;
         }
     }
 
-    lfw_verdict_t verdict = LFW_VERDICT_DROP;
-    bool matched = false;
+    rule_hits_t rh = {0};
 
     pthread_rwlock_rdlock(&engine->rules_lock);
+    lfw_verdict_t verdict = evaluate_rules(engine, packet, &key, &rh);
+    rule_hits_flush(&rh);
+    pthread_rwlock_unlock(&engine->rules_lock);
 
-    // Evaluate rules in order
-    for (lfw_u32 i = 0; i < engine->ruleset.rule_count; i++) {
-        lfw_rule_t *rule = (lfw_rule_t *)&engine->ruleset.rules[i];
+    return verdict;
+}
 
-        if (!lfw_rule_match(rule, packet))
-            continue;
+// One batch: hash every flow and prefetch its slot, then resolve the
+// packets in order under a single ruleset snapshot
+static void evaluate_chunk(lfw_engine_t *engine,
+                           lfw_packet_t *packets,
+                           lfw_u32 count,
+                           lfw_verdict_t *verdicts)
+{
+    lfw_state_key_t keys[LFW_ENGINE_BATCH_MAX];
+    lfw_state_t *state = engine->connection_state;
+
+    for (lfw_u32 i = 0; i < count; i++) {
+        packets[i].is_established = false;
+        packets[i].rule_index = LFW_RULE_INDEX_NONE;
+        keys[i].family = 0;
+        if (state)
+            lfw_state_prepare(state, &packets[i], &keys[i]);
+    }
 
-        verdict = action_to_verdict(rule->action);
-        matched = true;
+    rule_hits_t rh = {0};
 
-        // Atomically increment hits and byte count
-        __sync_fetch_and_add(&rule->hit_count, 1);
-        __sync_fetch_and_add(&rule->byte_count, packet->length);
+    pthread_rwlock_rdlock(&engine->rules_lock);
 
-        // If accepting, add to state table (state_add handles TCP/UDP check)
-        if (verdict == LFW_VERDICT_ACCEPT &&
-            engine->connection_state)
-        {
-            lfw_state_add(engine->connection_state, packet);
+    lfw_u32 prefetch = engine->ruleset.rule_count;
+    if (prefetch > LFW_ENGINE_PREFETCH_RULES)
+        prefetch = LFW_ENGINE_PREFETCH_RULES;
+    for (lfw_u32 r = 0; r < prefetch; r++)
+        __builtin_prefetch(&engine->ruleset.rules[r], 0, 3);
+
+    // Resolve in order so a flow accepted earlier in the batch is already
+    // established for its later packets, exactly as with lfw_engine_evaluate
+    for (lfw_u32 i = 0; i < count; i++) {
+        if (state && lfw_state_established_key(state, &packets[i], &keys[i])) {
+            packets[i].is_established = true;
+            verdicts[i] = LFW_VERDICT_ACCEPT;
+            continue;
         }
 
-        break;
+        verdicts[i] = evaluate_rules(engine, &packets[i], &keys[i], &rh);
     }
 
-    if (!matched) {
-        verdict = action_to_verdict(engine->config.default_action);
+    rule_hits_flush(&rh);
+    pthread_rwlock_unlock(&engine->rules_lock);
+}
 
-        if (verdict == LFW_VERDICT_ACCEPT &&
-            engine->connection_state)
-        {
-            lfw_state_add(engine->connection_state, packet);
-        }
+lfw_status_t lfw_engine_evaluate_batch(
+    lfw_engine_t *engine,
+    lfw_packet_t *packets,
+    lfw_u32 count,
+    lfw_verdict_t *verdicts)
+{
+    if (!engine || (count && (!packets || !verdicts)))
+        return LFW_ERR_INVALID;
+
+    for (lfw_u32 off = 0; off < count; off += LFW_ENGINE_BATCH_MAX) {
+        lfw_u32 n = count - off;
+        if (n > LFW_ENGINE_BATCH_MAX)
+            n = LFW_ENGINE_BATCH_MAX;
+
+        evaluate_chunk(engine, packets + off, n, verdicts + off);
     }
 
-    pthread_rwlock_unlock(&engine->rules_lock);
+    return LFW_OK;
+}
 
-    return verdict;
+void lfw_engine_tick(lfw_engine_t *engine)
+{
+    if (!engine || !engine->connection_state)
+        return;
+
+    lfw_state_cleanup(engine->connection_state);
 }
 
 lfw_status_t lfw_engine_reload_rules(lfw_engine_t *engine)
@@ -110,18 +228,26 @@ lfw_status_t lfw_engine_reload_rules(lfw_engine_t *engine)
         new_rule_count = expanded_count;
     }
 
+    // Falls back to the scalar rule walk if the index cannot be built
+    lfw_matcher_t *new_matcher = lfw_matcher_create(new_rules, new_rule_count);
+
     pthread_rwlock_wrlock(&engine->rules_lock);
 
     if (engine->ruleset.rules) {
         lfw_config_free_rules((lfw_rule_t *)engine->ruleset.rules);
     }
 
+    lfw_matcher_t *old_matcher = engine->ruleset.matcher;
+
     engine->ruleset.rules = new_rules;
     engine->ruleset.rule_count = new_rule_count;
+    engine->ruleset.matcher = new_matcher;
     engine->config.default_action = new_default_action;
 
     pthread_rwlock_unlock(&engine->rules_lock);
 
+    lfw_matcher_destroy(old_matcher);
+
     return LFW_OK;
 }
 
@@ -251,9 +377,19 @@ void lfw_engine_dump_stats(const lfw_engine_t *engine)
 
     lfw_log_info("=== Firewall Statistics ===");
     lfw_log_info("Active Connections Table Count: %u", conn_count);
+
+    if (engine->connection_state) {
+        lfw_state_probe_stats_t ps;
+        lfw_state_get_probe_stats(engine->connection_state, &ps);
+        lfw_log_info("Connections Table Probes: lookups=%lu, avg=%.2f, max=%u",
+               (unsigned long)ps.lookups,
+               ps.lookups ? (double)ps.probes / (double)ps.lookups : 0.0,
+               ps.max_probe);
+    }
     lfw_log_info("Default Policy Verdict: %s",
            engine->config.default_action == LFW_ACTION_ACCEPT ? "ACCEPT" : "DROP");
     lfw_log_info("Installed Rules Count: %u", engine->ruleset.rule_count);
+    lfw_log_info("Rule Matcher: %s", lfw_matcher_isa(engine->ruleset.matcher));
 
     for (lfw_u32 i = 0; i < engine->ruleset.rule_count; i++) {
         const lfw_rule_t *rule = &engine->ruleset.rules[i];
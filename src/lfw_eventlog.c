@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_eventlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lfw_log.h"
+
+#define EVENTLOG_DEFAULT_MAX_BYTES (64ULL << 20)
+#define EVENTLOG_DEFAULT_MAX_FILES 4
+#define EVENTLOG_DEFAULT_FLUSH_MS  1000
+#define EVENTLOG_MAX_FILES         999
+
+// Records are written in batches of up to this many bytes
+#define EVENTLOG_BUF_SIZE (1UL << 20)
+
+#define RECORD_SIZE sizeof(struct lfw_event)
+
+struct lfw_eventlog {
+    char    path[PATH_MAX];
+    lfw_u64 max_bytes;
+    lfw_u32 max_files;
+    lfw_u64 flush_ns;
+
+    int     fd;          // Active file, -1 after a failed rotation
+    lfw_u64 file_bytes;  // Size of the active file
+
+    lfw_u8 *buf;
+    size_t  len;
+    lfw_u64 buffered_at; // When the oldest buffered record arrived
+
+    bool    failing;     // A write failed and has been logged
+    lfw_eventlog_stats_t stats;
+};
+
+static lfw_u64 clock_ns(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (lfw_u64)ts.tv_sec * 1000000000ULL + (lfw_u64)ts.tv_nsec;
+}
+
+static bool write_all(int fd, const lfw_u8 *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Report the first error of a run of failures; later ones are only counted
+static void report(lfw_eventlog_t *log, const char *what, const char *path, int err)
+{
+    if (!log->failing)
+        lfw_log_error("event log: %s %s: %s", what, path, strerror(err));
+    log->failing = true;
+}
+
+// Create (truncate) the active file and write its header
+static bool open_active(lfw_eventlog_t *log)
+{
+    log->fd = open(log->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (log->fd < 0) {
+        report(log, "cannot create", log->path, errno);
+        return false;
+    }
+
+    lfw_eventlog_header_t hdr = {
+        .version          = LFW_EVENTLOG_VERSION,
+        .record_size      = RECORD_SIZE,
+        .mono_to_epoch_ns = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC),
+    };
+    memcpy(hdr.magic, LFW_EVENTLOG_MAGIC, sizeof(hdr.magic));
+
+    if (!write_all(log->fd, (const lfw_u8 *)&hdr, sizeof(hdr))) {
+        report(log, "cannot write", log->path, errno);
+        close(log->fd);
+        log->fd = -1;
+        return false;
+    }
+
+    log->file_bytes = sizeof(hdr);
+    return true;
+}
+
+// Shift <path>.i to <path>.i+1, dropping the oldest, then move the active
+// file to <path>.1. rename() replaces the target, so no unlink is needed.
+static void shift_files(lfw_eventlog_t *log)
+{
+    char from[PATH_MAX + 16];
+    char to[PATH_MAX + 16];
+
+    for (lfw_u32 i = log->max_files - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%u", log->path, i);
+        snprintf(to, sizeof(to), "%s.%u", log->path, i + 1);
+        if (rename(from, to) != 0 && errno != ENOENT)
+            report(log, "cannot rotate", from, errno);
+    }
+
+    snprintf(to, sizeof(to), "%s.1", log->path);
+    if (rename(log->path, to) != 0 && errno != ENOENT)
+        report(log, "cannot rotate", log->path, errno);
+}
+
+static bool rotate(lfw_eventlog_t *log)
+{
+    if (log->fd >= 0) {
+        close(log->fd);
+        log->fd = -1;
+    }
+    shift_files(log);
+    log->stats.rotations++;
+    return open_active(log);
+}
+
+// Write the buffer out, rotating whenever the active file is full. Files
+// are split on record boundaries so each one decodes on its own.
+static lfw_status_t write_buffer(lfw_eventlog_t *log)
+{
+    size_t off = 0;
+
+    while (off < log->len) {
+        if ((log->fd < 0 || log->file_bytes + RECORD_SIZE > log->max_bytes) && !rotate(log))
+            break;
+
+        size_t room = (size_t)((log->max_bytes - log->file_bytes) / RECORD_SIZE) * RECORD_SIZE;
+        size_t n = log->len - off;
+        if (n > room)
+            n = room;
+
+        if (!write_all(log->fd, log->buf + off, n)) {
+            report(log, "cannot write", log->path, errno);
+            break;
+        }
+
+        off += n;
+        log->file_bytes += n;
+        log->stats.records += n / RECORD_SIZE;
+    }
+
+    bool ok = off == log->len;
+    if (ok)
+        log->failing = false;
+    else
+        log->stats.lost += (log->len - off) / RECORD_SIZE;
+
+    // A failed batch is dropped rather than retried, so a full disk costs
+    // records but never stalls the telemetry consumer
+    log->len = 0;
+    return ok ? LFW_OK : LFW_ERR_GENERIC;
+}
+
+lfw_eventlog_t *lfw_eventlog_open(const lfw_eventlog_config_t *config)
+{
+    if (!config || !config->path || !config->path[0])
+        return NULL;
+
+    lfw_eventlog_t *log = calloc(1, sizeof(*log));
+    if (!log)
+        return NULL;
+
+    if (strlen(config->path) >= sizeof(log->path)) {
+        lfw_log_error("event log: path too long: %s", config->path);
+        free(log);
+        return NULL;
+    }
+    strcpy(log->path, config->path);
+
+    log->max_bytes = config->max_bytes ? config->max_bytes : EVENTLOG_DEFAULT_MAX_BYTES;
+    log->max_files = config->max_files ? config->max_files : EVENTLOG_DEFAULT_MAX_FILES;
+    log->flush_ns  = (lfw_u64)(config->flush_ms ? config->flush_ms : EVENTLOG_DEFAULT_FLUSH_MS) * 1000000ULL;
+
+    if (log->max_bytes < sizeof(lfw_eventlog_header_t) + RECORD_SIZE ||
+        log->max_files > EVENTLOG_MAX_FILES) {
+        lfw_log_error("event log: invalid size limits");
+        free(log);
+        return NULL;
+    }
+
+    log->buf = malloc(EVENTLOG_BUF_SIZE);
+    if (!log->buf) {
+        free(log);
+        return NULL;
+    }
+
+    // Never append to a file left by an earlier run: it may have been
+    // written with a different record layout
+    log->fd = -1;
+    if (access(log->path, F_OK) == 0)
+        shift_files(log);
+
+    if (!open_active(log)) {
+        free(log->buf);
+        free(log);
+        return NULL;
+    }
+
+    return log;
+}
+
+lfw_status_t lfw_eventlog_append(lfw_eventlog_t *log, const struct lfw_event *events, lfw_u32 count)
+{
+    if (!log || (count && !events))
+        return LFW_ERR_INVALID;
+
+    lfw_status_t st = LFW_OK;
+    const lfw_u8 *src = (const lfw_u8 *)events;
+    size_t left = (size_t)count * RECORD_SIZE;
+
+    while (left > 0) {
+        if (log->len + RECORD_SIZE > EVENTLOG_BUF_SIZE && write_buffer(log) != LFW_OK)
+            st = LFW_ERR_GENERIC;
+        if (log->len == 0)
+            log->buffered_at = clock_ns(CLOCK_MONOTONIC);
+
+        size_t n = (EVENTLOG_BUF_SIZE - log->len) / RECORD_SIZE * RECORD_SIZE;
+        if (n > left)
+            n = left;
+        memcpy(log->buf + log->len, src, n);
+        log->len += n;
+        src += n;
+        left -= n;
+    }
+
+    return st;
+}
+
+lfw_status_t lfw_eventlog_flush(lfw_eventlog_t *log, bool force)
+{
+    if (!log)
+        return LFW_ERR_INVALID;
+    if (log->len == 0)
+        return LFW_OK;
+    if (!force && clock_ns(CLOCK_MONOTONIC) - log->buffered_at < log->flush_ns)
+        return LFW_OK;
+
+    return write_buffer(log);
+}
+
+void lfw_eventlog_get_stats(const lfw_eventlog_t *log, lfw_eventlog_stats_t *stats)
+{
+    if (!log || !stats)
+        return;
+    *stats = log->stats;
+}
+
+void lfw_eventlog_close(lfw_eventlog_t *log)
+{
+    if (!log)
+        return;
+
+    lfw_eventlog_flush(log, true);
+    if (log->fd >= 0)
+        close(log->fd);
+    free(log->buf);
+    free(log);
+}
@@ -2,26 +2,104 @@
 
 #include "lfw_log.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 #include <syslog.h>
 #include <arpa/inet.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 static lfw_log_target_t g_log_target = LFW_LOG_CONSOLE;
 static lfw_loglevel_t g_log_level = LFW_LOG_OPTIMAL;
+static FILE *g_log_file = NULL;
 
-void lfw_log_init(lfw_log_target_t target)
+// ------------------------------
+// Records
+// ------------------------------
+
+// Rings are made of fixed-size cells. A packet record takes one cell,
+// a text record as many consecutive cells as its message needs.
+#define LOG_CELL 64
+#define LOG_TEXT_MAX 1000
+#define LOG_RECORD_MAX ((8 + LOG_TEXT_MAX + 1 + LOG_CELL - 1) / LOG_CELL * LOG_CELL)
+
+#define LOG_DEFAULT_CELLS    4096
+#define LOG_MIN_CELLS        (LOG_RECORD_MAX / LOG_CELL * 4)
+#define LOG_DEFAULT_FLUSH_MS 50
+
+// Writer output is staged and written in chunks of this size
+#define LOG_OUT_BUF (64 * 1024)
+
+typedef enum {
+    LOG_SEV_PACKET = 0,
+    LOG_SEV_INFO,
+    LOG_SEV_ERROR,
+    LOG_SEV_DEBUG
+} log_sev_t;
+
+typedef enum {
+    LOG_REC_PACKET = 1,
+    LOG_REC_TEXT
+} log_kind_t;
+
+typedef struct {
+    lfw_u8  kind;      // log_kind_t
+    lfw_u8  sev;       // log_sev_t
+    lfw_u16 cells;     // cells taken, this one included
+    lfw_u16 text_len;  // LOG_REC_TEXT: message bytes following the header
+    lfw_u16 reserved;
+} log_hdr_t;
+
+// Packet verdict in binary form; addresses are formatted by the writer
+typedef struct {
+    log_hdr_t hdr;
+    lfw_u8    verdict;
+    lfw_u8    direction;
+    lfw_u8    protocol;
+    lfw_u8    tcp_flags;
+    lfw_u8    ip_version;
+    lfw_u8    conn;       // 0, or 'N' new / 'E' established
+    lfw_u16   sport;      // host byte order, 0 unless TCP/UDP
+    lfw_u16   dport;
+    lfw_u8    src[16];
+    lfw_u8    dst[16];
+} log_packet_rec_t;
+
+_Static_assert(sizeof(log_packet_rec_t) <= LOG_CELL, "packet records take one ring cell");
+
+static void packet_record(const lfw_packet_t *pkt, lfw_verdict_t verdict, log_packet_rec_t *r)
 {
-    g_log_target = target;
-    if (g_log_target == LFW_LOG_SYSLOG) {
-        openlog("lfw", LOG_PID | LOG_NDELAY, LOG_DAEMON);
+    r->hdr.kind = LOG_REC_PACKET;
+    r->hdr.sev = LOG_SEV_PACKET;
+    r->hdr.cells = 1;
+    r->hdr.text_len = 0;
+    r->hdr.reserved = 0;
+    r->verdict = (lfw_u8)verdict;
+    r->direction = (lfw_u8)pkt->direction;
+    r->protocol = (lfw_u8)pkt->protocol;
+    r->tcp_flags = pkt->tcp_flags;
+    r->ip_version = pkt->ip.src.ip_version;
+
+    r->conn = 0;
+    if (pkt->is_established)
+        r->conn = 'E';
+    else if (pkt->is_new_connection)
+        r->conn = 'N';
+
+    r->sport = 0;
+    r->dport = 0;
+    if (pkt->protocol == LFW_PROTO_TCP || pkt->protocol == LFW_PROTO_UDP) {
+        r->sport = ntohs(pkt->l4.src_port.port);
+        r->dport = ntohs(pkt->l4.dst_port.port);
     }
-}
 
-void lfw_log_close(void)
-{
-    if (g_log_target == LFW_LOG_SYSLOG) {
-        closelog();
+    if (r->ip_version == 4) {
+        memcpy(r->src, &pkt->ip.src.v4.addr, 4);
+        memcpy(r->dst, &pkt->ip.dst.v4.addr, 4);
+    } else {
+        memcpy(r->src, pkt->ip.src.v6.addr, 16);
+        memcpy(r->dst, pkt->ip.dst.v6.addr, 16);
     }
 }
 
@@ -37,82 +115,622 @@ static void format_tcp_flags(lfw_u8 flags, char *buf, size_t buf_len)
     buf[idx] = '\0';
 }
 
-void lfw_log_packet(const lfw_packet_t *pkt, lfw_verdict_t verdict)
+static void format_packet(const log_packet_rec_t *r, char *buf, size_t buf_len)
 {
-    if (!pkt)
-        return;
-
     char src_ip[48];
     char dst_ip[48];
+    int af = r->ip_version == 4 ? AF_INET : AF_INET6;
+
+    if (!inet_ntop(af, r->src, src_ip, sizeof(src_ip))) {
+        snprintf(src_ip, sizeof(src_ip), "invalid");
+    }
+    if (!inet_ntop(af, r->dst, dst_ip, sizeof(dst_ip))) {
+        snprintf(dst_ip, sizeof(dst_ip), "invalid");
+    }
+
+    const char *proto = "any";
+    if (r->protocol == LFW_PROTO_TCP)  proto = "tcp";
+    else if (r->protocol == LFW_PROTO_UDP)  proto = "udp";
+    else if (r->protocol == LFW_PROTO_ICMP) proto = "icmp";
+    else if (r->protocol == LFW_PROTO_IGMP) proto = "igmp";
+    else if (r->protocol == LFW_PROTO_ICMPV6) proto = "icmpv6";
+    else if (r->protocol == LFW_PROTO_ESP) proto = "esp";
+    else if (r->protocol == LFW_PROTO_AH) proto = "ah";
+
+    const char *dir = "unknown";
+    if (r->direction == LFW_DIR_INBOUND)  dir = "in";
+    if (r->direction == LFW_DIR_OUTBOUND) dir = "out";
+
+    const char *verdict_str = (r->verdict == LFW_VERDICT_ACCEPT) ? "ALLOW" : "DENY";
+
+    char flag_buf[16] = "";
+    if (r->protocol == LFW_PROTO_TCP) {
+        char flags_str[8];
+        format_tcp_flags(r->tcp_flags, flags_str, sizeof(flags_str));
+        snprintf(flag_buf, sizeof(flag_buf), " [%s]", flags_str);
+    }
+
+    const char *state_str = "";
+    if (r->conn == 'E') {
+        state_str = " (EST)";
+    } else if (r->conn == 'N') {
+        state_str = " (NEW)";
+    }
+
+    snprintf(buf, buf_len, "%-5s %-3s %-4s %15s:%-5u -> %15s:%-5u%s%s",
+             verdict_str, dir, proto, src_ip, r->sport, dst_ip, r->dport, flag_buf, state_str);
+}
+
+// ------------------------------
+// Targets
+// ------------------------------
+
+static int sev_priority(log_sev_t sev)
+{
+    switch (sev) {
+    case LOG_SEV_ERROR: return LOG_ERR;
+    case LOG_SEV_DEBUG: return LOG_DEBUG;
+    default:            return LOG_INFO;
+    }
+}
+
+static const char *sev_prefix(log_sev_t sev)
+{
+    switch (sev) {
+    case LOG_SEV_INFO:  return "INFO: ";
+    case LOG_SEV_ERROR: return "ERROR: ";
+    case LOG_SEV_DEBUG: return "DEBUG: ";
+    default:            return "";
+    }
+}
+
+static FILE *sev_stream(log_sev_t sev)
+{
+    if (g_log_target == LFW_LOG_FILE)
+        return g_log_file;
+    return sev == LOG_SEV_ERROR ? stderr : stdout;
+}
+
+// Write one line to the target from the calling thread
+static void emit_line(log_sev_t sev, const char *line)
+{
+    if (g_log_target == LFW_LOG_SYSLOG) {
+        syslog(sev_priority(sev), "%s", line);
+    } else {
+        fprintf(sev_stream(sev), "[lfw] %s%s\n", sev_prefix(sev), line);
+    }
+}
+
+// ------------------------------
+// Asynchronous pipeline
+// ------------------------------
+
+// Single-producer single-consumer ring owned by one logging thread.
+// Positions count cells and wrap naturally at 2^32.
+typedef struct log_ring {
+    lfw_u32          tail __attribute__((aligned(64))); // written by the owner
+    lfw_u64          dropped;                           // written by the owner
+    lfw_u32          head __attribute__((aligned(64))); // written by the writer
+    lfw_u64          dropped_seen;                      // written by the writer
+    bool             kicked;  // owner woke the writer since its last pass
+    bool             dead;    // owner thread exited
+    bool             retired; // drained after its owner exited, by the writer
+    lfw_u32          mask;
+    lfw_u8          *cells;
+    struct log_ring *next;
+} log_ring_t;
+
+// Writer staging buffer for one stdio stream
+typedef struct {
+    FILE  *stream;
+    size_t len;
+    char   buf[LOG_OUT_BUF];
+} log_out_t;
+
+static struct {
+    bool             running;
+    bool             stop;
+    lfw_u32          gen;         // bumped per start, invalidates thread rings
+    lfw_u32          ring_cells;
+    lfw_u32          flush_ms;
+    bool             idle;        // writer sleeps until a push wakes it
+    bool             poked;       // a push or flush woke the writer
+    pthread_t        thread;
+    pthread_mutex_t  lock;        // rings list, counters, stop; never held for output
+    pthread_cond_t   wake;
+    pthread_cond_t   drained;
+    pthread_key_t    key;
+    log_ring_t      *rings;
+    lfw_u64          started;     // writer passes begun
+    lfw_u64          passes;      // completed writer passes
+    lfw_u64          dropped;     // drops accounted by the writer
+    log_out_t        out[2];      // [0] info/debug/packets, [1] errors
+} g_async = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread log_ring_t *t_ring;
+static __thread lfw_u32 t_ring_gen;
+
+static void ring_release(void *arg)
+{
+    log_ring_t *r = (log_ring_t *)arg;
+    __atomic_store_n(&r->dead, true, __ATOMIC_RELEASE);
+}
+
+static void ring_free(log_ring_t *r)
+{
+    free(r->cells);
+    free(r);
+}
+
+// The calling thread's ring, created and registered on first use
+static log_ring_t *thread_ring(void)
+{
+    lfw_u32 gen = __atomic_load_n(&g_async.gen, __ATOMIC_ACQUIRE);
+    if (t_ring && t_ring_gen == gen)
+        return t_ring;
+
+    log_ring_t *r = aligned_alloc(64, sizeof(*r));
+    if (!r)
+        return NULL;
+    memset(r, 0, sizeof(*r));
+    r->mask = g_async.ring_cells - 1;
+    r->cells = aligned_alloc(64, (size_t)g_async.ring_cells * LOG_CELL);
+    if (!r->cells) {
+        free(r);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&g_async.lock);
+    r->next = g_async.rings;
+    g_async.rings = r;
+    pthread_mutex_unlock(&g_async.lock);
+    pthread_setspecific(g_async.key, r);
+
+    t_ring = r;
+    t_ring_gen = gen;
+    return r;
+}
+
+static void ring_copy_in(log_ring_t *r, lfw_u32 pos, const void *src, size_t len)
+{
+    size_t size = (size_t)(r->mask + 1) * LOG_CELL;
+    size_t off = (size_t)(pos & r->mask) * LOG_CELL;
+    size_t first = len < size - off ? len : size - off;
+
+    memcpy(r->cells + off, src, first);
+    memcpy(r->cells, (const lfw_u8 *)src + first, len - first);
+}
+
+static void ring_copy_out(const log_ring_t *r, lfw_u32 pos, void *dst, size_t len)
+{
+    size_t size = (size_t)(r->mask + 1) * LOG_CELL;
+    size_t off = (size_t)(pos & r->mask) * LOG_CELL;
+    size_t first = len < size - off ? len : size - off;
+
+    memcpy(dst, r->cells + off, first);
+    memcpy((lfw_u8 *)dst + first, r->cells, len - first);
+}
+
+// Queue a record of len bytes on the calling thread's ring. Returns false
+// when logging is synchronous, or when the ring is full and the record
+// must not be lost (errors), so the caller writes it directly.
+static bool async_push(const void *rec, size_t len, bool droppable)
+{
+    if (!__atomic_load_n(&g_async.running, __ATOMIC_ACQUIRE))
+        return false;
+
+    log_ring_t *r = thread_ring();
+    if (!r)
+        return false;
+
+    lfw_u32 cells = (lfw_u32)((len + LOG_CELL - 1) / LOG_CELL);
+    lfw_u32 tail = r->tail;
+    lfw_u32 used = tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    if (used + cells > r->mask + 1) {
+        if (!droppable)
+            return false;
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    ring_copy_in(r, tail, rec, len);
+    __atomic_store_n(&r->tail, tail + cells, __ATOMIC_RELEASE);
+
+    // The writer found every ring empty and sleeps without a timeout. The
+    // fences pair with the writer's, so either it sees this record on its
+    // last look or this push sees it idle.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&g_async.idle, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&g_async.lock);
+        g_async.poked = true;
+        pthread_cond_signal(&g_async.wake);
+        pthread_mutex_unlock(&g_async.lock);
+        return true;
+    }
+
+    // Wake the writer early once the ring is half full, at most once per
+    // pass; otherwise it drains on its own interval
+    if (used + cells > (r->mask + 1) / 2 &&
+        !__atomic_load_n(&r->kicked, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&r->kicked, true, __ATOMIC_RELAXED);
+        pthread_cond_signal(&g_async.wake);
+    }
+
+    return true;
+}
+
+static void out_flush(log_out_t *o)
+{
+    if (o->len) {
+        fwrite(o->buf, 1, o->len, o->stream);
+        o->len = 0;
+    }
+    fflush(o->stream);
+}
+
+static void out_line(log_sev_t sev, const char *line)
+{
+    if (g_log_target == LFW_LOG_SYSLOG) {
+        syslog(sev_priority(sev), "%s", line);
+        return;
+    }
 
-    if (pkt->ip.src.ip_version == 4) {
-        struct in_addr src_addr = { .s_addr = pkt->ip.src.v4.addr };
-        struct in_addr dst_addr = { .s_addr = pkt->ip.dst.v4.addr };
+    log_out_t *o = &g_async.out[sev == LOG_SEV_ERROR && g_log_target == LFW_LOG_CONSOLE];
+    o->stream = sev_stream(sev);
 
-        if (!inet_ntop(AF_INET, &src_addr, src_ip, sizeof(src_ip))) {
-            snprintf(src_ip, sizeof(src_ip), "invalid");
+    for (;;) {
+        size_t room = sizeof(o->buf) - o->len;
+        int n = snprintf(o->buf + o->len, room, "[lfw] %s%s\n", sev_prefix(sev), line);
+        if (n < 0)
+            return;
+        if ((size_t)n < room) {
+            o->len += (size_t)n;
+            return;
         }
-        if (!inet_ntop(AF_INET, &dst_addr, dst_ip, sizeof(dst_ip))) {
-            snprintf(dst_ip, sizeof(dst_ip), "invalid");
+        if (o->len == 0) {
+            // Longer than the whole buffer: write it as is
+            fprintf(o->stream, "[lfw] %s%s\n", sev_prefix(sev), line);
+            return;
         }
-    } else {
-        struct in6_addr src_addr;
-        struct in6_addr dst_addr;
-        memcpy(&src_addr, pkt->ip.src.v6.addr, 16);
-        memcpy(&dst_addr, pkt->ip.dst.v6.addr, 16);
+        out_flush(o);
+    }
+}
+
+// Returns whether the ring held any record
+static bool drain_ring(log_ring_t *r)
+{
+    lfw_u8 rec[LOG_RECORD_MAX] __attribute__((aligned(8)));
+    char line[256];
+    lfw_u32 tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+    lfw_u32 head = r->head;
+    bool any = head != tail;
+
+    while (head != tail) {
+        ring_copy_out(r, head, rec, LOG_CELL);
+        const log_hdr_t *hdr = (const log_hdr_t *)rec;
+        lfw_u32 cells = hdr->cells;
+
+        if (cells > 1)
+            ring_copy_out(r, head + 1, rec + LOG_CELL, (size_t)(cells - 1) * LOG_CELL);
+
+        if (hdr->kind == LOG_REC_PACKET) {
+            format_packet((const log_packet_rec_t *)rec, line, sizeof(line));
+            out_line(LOG_SEV_PACKET, line);
+        } else {
+            char *text = (char *)rec + sizeof(log_hdr_t);
+            text[hdr->text_len] = '\0';
+            out_line((log_sev_t)hdr->sev, text);
+        }
+
+        head += cells;
+    }
+
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->kicked, false, __ATOMIC_RELAXED);
+    return any;
+}
+
+// One pass over every ring. g_async.lock is only taken to find the rings,
+// retire dead ones and account drops, never while output is written, so
+// registering threads and flush callers do not wait on a slow target.
+// Returns whether any ring held a record.
+static bool drain_all(void)
+{
+    pthread_mutex_lock(&g_async.lock);
+    g_async.started++;
+    log_ring_t *rings = g_async.rings;
+    pthread_mutex_unlock(&g_async.lock);
+
+    // New rings are only pushed on the front and only this thread unlinks,
+    // so the list from the snapshot on stays put
+    bool any = false;
+    for (log_ring_t *r = rings; r; r = r->next) {
+        bool dead = __atomic_load_n(&r->dead, __ATOMIC_ACQUIRE);
+        any |= drain_ring(r);
+        r->retired = dead;
+    }
+
+    pthread_mutex_lock(&g_async.lock);
+    lfw_u64 dropped_before = g_async.dropped;
+    log_ring_t **pp = &g_async.rings;
+    while (*pp) {
+        log_ring_t *r = *pp;
+        lfw_u64 dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        g_async.dropped += dropped - r->dropped_seen;
+        r->dropped_seen = dropped;
 
-        if (!inet_ntop(AF_INET6, &src_addr, src_ip, sizeof(src_ip))) {
-            snprintf(src_ip, sizeof(src_ip), "invalid");
+        if (r->retired) {
+            *pp = r->next;
+            ring_free(r);
+        } else {
+            pp = &r->next;
         }
-        if (!inet_ntop(AF_INET6, &dst_addr, dst_ip, sizeof(dst_ip))) {
-            snprintf(dst_ip, sizeof(dst_ip), "invalid");
+    }
+    lfw_u64 dropped_total = g_async.dropped;
+    pthread_mutex_unlock(&g_async.lock);
+
+    if (dropped_total != dropped_before) {
+        char line[96];
+        snprintf(line, sizeof(line), "log rings full, dropped %llu records (%llu total)",
+                 (unsigned long long)(dropped_total - dropped_before),
+                 (unsigned long long)dropped_total);
+        out_line(LOG_SEV_ERROR, line);
+    }
+
+    if (g_log_target != LFW_LOG_SYSLOG) {
+        for (int i = 0; i < 2; i++) {
+            if (g_async.out[i].stream)
+                out_flush(&g_async.out[i]);
         }
     }
 
-    const char *proto = "any";
-    if (pkt->protocol == LFW_PROTO_TCP)  proto = "tcp";
-    else if (pkt->protocol == LFW_PROTO_UDP)  proto = "udp";
-    else if (pkt->protocol == LFW_PROTO_ICMP) proto = "icmp";
-    else if (pkt->protocol == LFW_PROTO_IGMP) proto = "igmp";
-    else if (pkt->protocol == LFW_PROTO_ICMPV6) proto = "icmpv6";
-    else if (pkt->protocol == LFW_PROTO_ESP) proto = "esp";
-    else if (pkt->protocol == LFW_PROTO_AH) proto = "ah";
+    pthread_mutex_lock(&g_async.lock);
+    g_async.passes++;
+    pthread_cond_broadcast(&g_async.drained);
+    pthread_mutex_unlock(&g_async.lock);
+    return any;
+}
 
-    const char *dir = "unknown";
-    if (pkt->direction == LFW_DIR_INBOUND)  dir = "in";
-    if (pkt->direction == LFW_DIR_OUTBOUND) dir = "out";
+static void *log_writer_loop(void *arg)
+{
+    (void)arg;
 
-    const char *verdict_str = (verdict == LFW_VERDICT_ACCEPT) ? "ALLOW" : "DENY";
+    pthread_mutex_lock(&g_async.lock);
+    for (;;) {
+        bool stop = g_async.stop;
+        g_async.poked = false;
+        pthread_mutex_unlock(&g_async.lock);
 
-    unsigned short sport = 0;
-    unsigned short dport = 0;
+        bool drained = drain_all();
+        if (stop)
+            break;
 
-    if (pkt->protocol == LFW_PROTO_TCP || pkt->protocol == LFW_PROTO_UDP) {
-        sport = ntohs(pkt->l4.src_port.port);
-        dport = ntohs(pkt->l4.dst_port.port);
+        bool idle = !drained;
+        if (idle) {
+            // Nothing was logged for a whole interval: take one last look
+            // at the rings now that pushes can see the flag
+            __atomic_store_n(&g_async.idle, true, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            idle = !drain_all();
+        }
+
+        pthread_mutex_lock(&g_async.lock);
+        if (idle) {
+            // Sleep until a push, a flush or the stop wakes us; poked
+            // catches one that came after the last look
+            while (!g_async.poked && !g_async.stop)
+                pthread_cond_wait(&g_async.wake, &g_async.lock);
+            __atomic_store_n(&g_async.idle, false, __ATOMIC_RELAXED);
+            continue;
+        }
+        __atomic_store_n(&g_async.idle, false, __ATOMIC_RELAXED);
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += g_async.flush_ms / 1000;
+        ts.tv_nsec += (long)(g_async.flush_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        if (!g_async.poked && !g_async.stop)
+            pthread_cond_timedwait(&g_async.wake, &g_async.lock, &ts);
     }
 
-    char flag_buf[16] = "";
-    if (pkt->protocol == LFW_PROTO_TCP) {
-        char flags_str[8];
-        format_tcp_flags(pkt->tcp_flags, flags_str, sizeof(flags_str));
-        snprintf(flag_buf, sizeof(flag_buf), " [%s]", flags_str);
+    return NULL;
+}
+
+lfw_status_t lfw_log_start_async(const lfw_log_async_config_t *config)
+{
+    if (g_async.running)
+        return LFW_ERR_INVALID;
+
+    lfw_u32 cells = (config && config->ring_cells) ? config->ring_cells : LOG_DEFAULT_CELLS;
+    if (cells < LOG_MIN_CELLS)
+        cells = LOG_MIN_CELLS;
+    if (cells > (1u << 24))
+        cells = 1u << 24;
+    lfw_u32 pow2 = 1;
+    while (pow2 < cells)
+        pow2 <<= 1;
+
+    g_async.ring_cells = pow2;
+    g_async.flush_ms = (config && config->flush_ms) ? config->flush_ms : LOG_DEFAULT_FLUSH_MS;
+    g_async.stop = false;
+    g_async.rings = NULL;
+    g_async.poked = false;
+    g_async.started = 0;
+    g_async.passes = 0;
+    g_async.dropped = 0;
+    memset(g_async.out, 0, sizeof(g_async.out));
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_async.wake, &attr);
+    pthread_cond_init(&g_async.drained, NULL);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_key_create(&g_async.key, ring_release) != 0) {
+        pthread_cond_destroy(&g_async.wake);
+        pthread_cond_destroy(&g_async.drained);
+        return LFW_ERR_GENERIC;
     }
 
-    const char *state_str = "";
-    if (pkt->is_established) {
-        state_str = " (EST)";
-    } else if (pkt->is_new_connection) {
-        state_str = " (NEW)";
+    __atomic_add_fetch(&g_async.gen, 1, __ATOMIC_RELEASE);
+
+    if (pthread_create(&g_async.thread, NULL, log_writer_loop, NULL) != 0) {
+        pthread_key_delete(g_async.key);
+        pthread_cond_destroy(&g_async.wake);
+        pthread_cond_destroy(&g_async.drained);
+        return LFW_ERR_GENERIC;
+    }
+
+    __atomic_store_n(&g_async.running, true, __ATOMIC_RELEASE);
+    return LFW_OK;
+}
+
+static void log_stop_async(void)
+{
+    if (!g_async.running)
+        return;
+
+    pthread_mutex_lock(&g_async.lock);
+    g_async.stop = true;
+    pthread_cond_signal(&g_async.wake);
+    pthread_mutex_unlock(&g_async.lock);
+    pthread_join(g_async.thread, NULL);
+
+    __atomic_store_n(&g_async.running, false, __ATOMIC_RELEASE);
+    pthread_key_delete(g_async.key);
+
+    while (g_async.rings) {
+        log_ring_t *r = g_async.rings;
+        g_async.rings = r->next;
+        ring_free(r);
+    }
+
+    pthread_cond_destroy(&g_async.wake);
+    pthread_cond_destroy(&g_async.drained);
+}
+
+void lfw_log_flush(void)
+{
+    if (!__atomic_load_n(&g_async.running, __ATOMIC_ACQUIRE))
+        return;
+
+    // Passes complete in the order they start, and one that starts after
+    // this call sees everything queued before it
+    pthread_mutex_lock(&g_async.lock);
+    lfw_u64 target = g_async.started + 1;
+    g_async.poked = true;
+    pthread_cond_signal(&g_async.wake);
+    while (g_async.passes < target)
+        pthread_cond_wait(&g_async.drained, &g_async.lock);
+    pthread_mutex_unlock(&g_async.lock);
+}
+
+lfw_u64 lfw_log_get_dropped(void)
+{
+    pthread_mutex_lock(&g_async.lock);
+    lfw_u64 dropped = g_async.dropped;
+    for (log_ring_t *r = g_async.rings; r; r = r->next)
+        dropped += __atomic_load_n(&r->dropped, __ATOMIC_RELAXED) - r->dropped_seen;
+    pthread_mutex_unlock(&g_async.lock);
+    return dropped;
+}
+
+// ------------------------------
+// Public API
+// ------------------------------
+
+void lfw_log_init(lfw_log_target_t target)
+{
+    g_log_target = target;
+    if (g_log_target == LFW_LOG_SYSLOG) {
+        openlog("lfw", LOG_PID | LOG_NDELAY, LOG_DAEMON);
     }
+}
+
+lfw_status_t lfw_log_init_file(const char *path)
+{
+    if (!path)
+        return LFW_ERR_INVALID;
+
+    FILE *f = fopen(path, "ae");
+    if (!f)
+        return LFW_ERR_GENERIC;
+
+    // Line buffered so synchronous logging reaches the file promptly; the
+    // async writer hands over whole batches per write
+    setvbuf(f, NULL, _IOLBF, 0);
+    g_log_file = f;
+    g_log_target = LFW_LOG_FILE;
+    return LFW_OK;
+}
+
+void lfw_log_close(void)
+{
+    log_stop_async();
 
     if (g_log_target == LFW_LOG_SYSLOG) {
-        syslog(LOG_INFO, "%-5s %-3s %-4s %15s:%-5u -> %15s:%-5u%s%s",
-               verdict_str, dir, proto, src_ip, sport, dst_ip, dport, flag_buf, state_str);
+        closelog();
+    } else if (g_log_target == LFW_LOG_FILE) {
+        fclose(g_log_file);
+        g_log_file = NULL;
+        g_log_target = LFW_LOG_CONSOLE;
     } else {
-        printf("[lfw] %-5s %-3s %-4s %15s:%-5u -> %15s:%-5u%s%s\n",
-               verdict_str, dir, proto, src_ip, sport, dst_ip, dport, flag_buf, state_str);
+        fflush(stdout);
+    }
+}
+
+void lfw_log_packet(const lfw_packet_t *pkt, lfw_verdict_t verdict)
+{
+    if (!pkt)
+        return;
+
+    log_packet_rec_t rec;
+    packet_record(pkt, verdict, &rec);
+
+    if (async_push(&rec, sizeof(rec), true))
+        return;
+
+    char line[256];
+    format_packet(&rec, line, sizeof(line));
+    emit_line(LOG_SEV_PACKET, line);
+}
+
+static void log_text(log_sev_t sev, const char *fmt, va_list args)
+{
+    if (__atomic_load_n(&g_async.running, __ATOMIC_RELAXED)) {
+        lfw_u8 rec[LOG_RECORD_MAX] __attribute__((aligned(8)));
+        log_hdr_t *hdr = (log_hdr_t *)rec;
+        char *text = (char *)rec + sizeof(*hdr);
+
+        int n = vsnprintf(text, LOG_TEXT_MAX + 1, fmt, args);
+        if (n < 0)
+            return;
+        if (n > LOG_TEXT_MAX)
+            n = LOG_TEXT_MAX;
+
+        size_t len = sizeof(*hdr) + (size_t)n + 1;
+        hdr->kind = LOG_REC_TEXT;
+        hdr->sev = (lfw_u8)sev;
+        hdr->cells = (lfw_u16)((len + LOG_CELL - 1) / LOG_CELL);
+        hdr->text_len = (lfw_u16)n;
+        hdr->reserved = 0;
+
+        if (async_push(rec, len, sev != LOG_SEV_ERROR))
+            return;
+
+        emit_line(sev, text);
+        return;
     }
+
+    char line[LOG_TEXT_MAX + 1];
+    vsnprintf(line, sizeof(line), fmt, args);
+    emit_line(sev, line);
 }
 
 void lfw_log_info(const char *fmt, ...)
@@ -121,13 +739,7 @@ void lfw_log_info(const char *fmt, ...)
         return;
     va_list args;
     va_start(args, fmt);
-    if (g_log_target == LFW_LOG_SYSLOG) {
-        vsyslog(LOG_INFO, fmt, args);
-    } else {
-        printf("[lfw] INFO: ");
-        vprintf(fmt, args);
-        printf("\n");
-    }
+    log_text(LOG_SEV_INFO, fmt, args);
     va_end(args);
 }
 
@@ -135,13 +747,7 @@ void lfw_log_error(const char *fmt, ...)
 {
     va_list args;
     va_start(args, fmt);
-    if (g_log_target == LFW_LOG_SYSLOG) {
-        vsyslog(LOG_ERR, fmt, args);
-    } else {
-        fprintf(stderr, "[lfw] ERROR: ");
-        vfprintf(stderr, fmt, args);
-        fprintf(stderr, "\n");
-    }
+    log_text(LOG_SEV_ERROR, fmt, args);
     va_end(args);
 }
 
@@ -151,13 +757,7 @@ void lfw_log_debug(const char *fmt, ...)
         return;
     va_list args;
     va_start(args, fmt);
-    if (g_log_target == LFW_LOG_SYSLOG) {
-        vsyslog(LOG_DEBUG, fmt, args);
-    } else {
-        printf("[lfw] DEBUG: ");
-        vprintf(fmt, args);
-        printf("\n");
-    }
+    log_text(LOG_SEV_DEBUG, fmt, args);
     va_end(args);
 }
 
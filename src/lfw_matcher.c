@@ -0,0 +1,375 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_matcher.h"
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LFW_MATCHER_X86 1
+#include <immintrin.h>
+#endif
+
+// Lane arrays are padded to the widest vector (16 x 32-bit)
+#define LFW_MATCHER_LANES 16
+
+// Version lane of padding rules; never equal to a packet version
+#define LANE_VERSION_PAD 0xFFu
+
+// Packet fields broadcast against the rule lanes
+typedef struct {
+    lfw_u32       version;
+    lfw_u32       proto;
+    lfw_u32       src4;      // network byte order
+    lfw_u32       dst4;
+    lfw_u32       sport;     // host byte order
+    lfw_u32       dport;
+    bool          ports;     // port ranges apply (TCP/UDP)
+    const lfw_u8 *src6;
+    const lfw_u8 *dst6;
+} match_key_t;
+
+typedef lfw_u32 (*match_fn_t)(const lfw_matcher_t *m, const match_key_t *k);
+
+// All per-rule fields are 32-bit lanes so one compare covers the same
+// rules for every field. Addresses are stored pre-masked; a rule that
+// does not match on an address has an all-zero mask and value.
+struct lfw_matcher {
+    lfw_u32     rule_count;
+    lfw_u32     lanes;
+    lfw_u32    *version;    // 0: any
+    lfw_u32    *proto;      // 0: any
+    lfw_u32    *src4;
+    lfw_u32    *src4_mask;
+    lfw_u32    *dst4;
+    lfw_u32    *dst4_mask;
+    lfw_u32    *sport_min;  // 0-65535 when ports are not matched
+    lfw_u32    *sport_max;
+    lfw_u32    *dport_min;
+    lfw_u32    *dport_max;
+    lfw_u8    (*src6)[16];
+    lfw_u8    (*src6_mask)[16];
+    lfw_u8    (*dst6)[16];
+    lfw_u8    (*dst6_mask)[16];
+    lfw_u8     *ip_any;     // No address match at all
+    match_fn_t  match;
+    const char *isa;
+    void       *mem;
+};
+
+// ------------------------------
+// Per-rule checks
+// ------------------------------
+
+static inline bool match_ip6(const lfw_u8 *addr, const lfw_u8 *mask, const lfw_u8 *value)
+{
+#if defined(__SSE2__)
+    __m128i a = _mm_loadu_si128((const __m128i *)addr);
+    __m128i m = _mm_load_si128((const __m128i *)mask);
+    __m128i v = _mm_load_si128((const __m128i *)value);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(a, m), v)) == 0xFFFF;
+#else
+    lfw_u64 a[2], m[2], v[2];
+    memcpy(a, addr, 16);
+    memcpy(m, mask, 16);
+    memcpy(v, value, 16);
+    return (a[0] & m[0]) == v[0] && (a[1] & m[1]) == v[1];
+#endif
+}
+
+// Address check of a non-IPv4 packet against rule i
+static inline bool lane_match_addr(const lfw_matcher_t *m, lfw_u32 i, const match_key_t *k)
+{
+    if (k->version != 6)
+        return m->ip_any[i];
+
+    return match_ip6(k->src6, m->src6_mask[i], m->src6[i]) &&
+           match_ip6(k->dst6, m->dst6_mask[i], m->dst6[i]);
+}
+
+// ------------------------------
+// Scalar fallback
+// ------------------------------
+
+static lfw_u32 match_scalar(const lfw_matcher_t *m, const match_key_t *k)
+{
+    for (lfw_u32 i = 0; i < m->rule_count; i++) {
+        if (m->version[i] != 0 && m->version[i] != k->version)
+            continue;
+
+        if (m->proto[i] != 0 && m->proto[i] != k->proto)
+            continue;
+
+        if (k->ports &&
+            (k->sport < m->sport_min[i] || k->sport > m->sport_max[i] ||
+             k->dport < m->dport_min[i] || k->dport > m->dport_max[i]))
+            continue;
+
+        if (k->version == 4) {
+            if ((k->src4 & m->src4_mask[i]) != m->src4[i] ||
+                (k->dst4 & m->dst4_mask[i]) != m->dst4[i])
+                continue;
+        } else if (!lane_match_addr(m, i, k)) {
+            continue;
+        }
+
+        return i;
+    }
+
+    return LFW_MATCHER_NONE;
+}
+
+// ------------------------------
+// AVX2 / AVX-512
+// ------------------------------
+
+#ifdef LFW_MATCHER_X86
+
+// 8 rules per step; movemask gives the candidates in rule order
+__attribute__((target("avx2")))
+static lfw_u32 match_avx2(const lfw_matcher_t *m, const match_key_t *k)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i ver   = _mm256_set1_epi32((int)k->version);
+    const __m256i proto = _mm256_set1_epi32((int)k->proto);
+    const __m256i sport = _mm256_set1_epi32((int)k->sport);
+    const __m256i dport = _mm256_set1_epi32((int)k->dport);
+    const __m256i src4  = _mm256_set1_epi32((int)k->src4);
+    const __m256i dst4  = _mm256_set1_epi32((int)k->dst4);
+
+#define LOAD8(arr) _mm256_load_si256((const __m256i *)((arr) + base))
+
+    for (lfw_u32 base = 0; base < m->rule_count; base += 8) {
+        __m256i r, ok;
+
+        r  = LOAD8(m->version);
+        ok = _mm256_or_si256(_mm256_cmpeq_epi32(r, zero), _mm256_cmpeq_epi32(r, ver));
+
+        r  = LOAD8(m->proto);
+        ok = _mm256_and_si256(ok, _mm256_or_si256(_mm256_cmpeq_epi32(r, zero),
+                                                  _mm256_cmpeq_epi32(r, proto)));
+
+        if (k->ports) {
+            // Ports fit in 16 bits, so signed 32-bit compares are exact
+            ok = _mm256_andnot_si256(_mm256_cmpgt_epi32(LOAD8(m->sport_min), sport), ok);
+            ok = _mm256_andnot_si256(_mm256_cmpgt_epi32(sport, LOAD8(m->sport_max)), ok);
+            ok = _mm256_andnot_si256(_mm256_cmpgt_epi32(LOAD8(m->dport_min), dport), ok);
+            ok = _mm256_andnot_si256(_mm256_cmpgt_epi32(dport, LOAD8(m->dport_max)), ok);
+        }
+
+        if (k->version == 4) {
+            ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(
+                     _mm256_and_si256(src4, LOAD8(m->src4_mask)), LOAD8(m->src4)));
+            ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(
+                     _mm256_and_si256(dst4, LOAD8(m->dst4_mask)), LOAD8(m->dst4)));
+        }
+
+        lfw_u32 bits = (lfw_u32)_mm256_movemask_ps(_mm256_castsi256_ps(ok));
+        for (; bits; bits &= bits - 1) {
+            lfw_u32 i = base + (lfw_u32)__builtin_ctz(bits);
+            if (k->version == 4 || lane_match_addr(m, i, k))
+                return i;
+        }
+    }
+
+#undef LOAD8
+
+    return LFW_MATCHER_NONE;
+}
+
+// 16 rules per step using compare-into-mask
+__attribute__((target("avx512f")))
+static lfw_u32 match_avx512(const lfw_matcher_t *m, const match_key_t *k)
+{
+    const __m512i zero  = _mm512_setzero_si512();
+    const __m512i ver   = _mm512_set1_epi32((int)k->version);
+    const __m512i proto = _mm512_set1_epi32((int)k->proto);
+    const __m512i sport = _mm512_set1_epi32((int)k->sport);
+    const __m512i dport = _mm512_set1_epi32((int)k->dport);
+    const __m512i src4  = _mm512_set1_epi32((int)k->src4);
+    const __m512i dst4  = _mm512_set1_epi32((int)k->dst4);
+
+#define LOAD16(arr) _mm512_load_si512((const void *)((arr) + base))
+
+    for (lfw_u32 base = 0; base < m->rule_count; base += 16) {
+        __m512i r;
+        __mmask16 ok;
+
+        r  = LOAD16(m->version);
+        ok = _mm512_cmpeq_epi32_mask(r, zero) | _mm512_cmpeq_epi32_mask(r, ver);
+
+        r  = LOAD16(m->proto);
+        ok &= _mm512_cmpeq_epi32_mask(r, zero) | _mm512_cmpeq_epi32_mask(r, proto);
+
+        if (k->ports) {
+            ok = _mm512_mask_cmple_epu32_mask(ok, LOAD16(m->sport_min), sport);
+            ok = _mm512_mask_cmple_epu32_mask(ok, sport, LOAD16(m->sport_max));
+            ok = _mm512_mask_cmple_epu32_mask(ok, LOAD16(m->dport_min), dport);
+            ok = _mm512_mask_cmple_epu32_mask(ok, dport, LOAD16(m->dport_max));
+        }
+
+        if (k->version == 4) {
+            ok = _mm512_mask_cmpeq_epi32_mask(ok,
+                     _mm512_and_si512(src4, LOAD16(m->src4_mask)), LOAD16(m->src4));
+            ok = _mm512_mask_cmpeq_epi32_mask(ok,
+                     _mm512_and_si512(dst4, LOAD16(m->dst4_mask)), LOAD16(m->dst4));
+        }
+
+        for (lfw_u32 bits = ok; bits; bits &= bits - 1) {
+            lfw_u32 i = base + (lfw_u32)__builtin_ctz(bits);
+            if (k->version == 4 || lane_match_addr(m, i, k))
+                return i;
+        }
+    }
+
+#undef LOAD16
+
+    return LFW_MATCHER_NONE;
+}
+
+#endif
+
+static void select_isa(lfw_matcher_t *m)
+{
+    m->match = match_scalar;
+    m->isa = "scalar";
+
+#ifdef LFW_MATCHER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        m->match = match_avx512;
+        m->isa = "avx512";
+    } else if (__builtin_cpu_supports("avx2")) {
+        m->match = match_avx2;
+        m->isa = "avx2";
+    }
+#endif
+}
+
+// ------------------------------
+// Public API
+// ------------------------------
+
+lfw_matcher_t *lfw_matcher_create(const lfw_rule_t *rules, lfw_u32 rule_count)
+{
+    if (!rules && rule_count)
+        return NULL;
+
+    lfw_matcher_t *m = calloc(1, sizeof(*m));
+    if (!m)
+        return NULL;
+
+    lfw_u32 lanes = (rule_count + LFW_MATCHER_LANES - 1) & ~(lfw_u32)(LFW_MATCHER_LANES - 1);
+    if (lanes == 0)
+        lanes = LFW_MATCHER_LANES;
+
+    // 10 u32 lane arrays, 4 address arrays and the ip_any bytes; each
+    // array size is a multiple of 64 bytes so every array stays aligned
+    size_t u32_size = (size_t)lanes * sizeof(lfw_u32);
+    size_t ip6_size = (size_t)lanes * 16;
+    size_t size = 10 * u32_size + 4 * ip6_size + lanes;
+
+    lfw_u8 *p = aligned_alloc(64, (size + 63) & ~(size_t)63);
+    if (!p) {
+        free(m);
+        return NULL;
+    }
+    memset(p, 0, size);
+
+    m->mem        = p;
+    m->rule_count = rule_count;
+    m->lanes      = lanes;
+    m->version    = (lfw_u32 *)p; p += u32_size;
+    m->proto      = (lfw_u32 *)p; p += u32_size;
+    m->src4       = (lfw_u32 *)p; p += u32_size;
+    m->src4_mask  = (lfw_u32 *)p; p += u32_size;
+    m->dst4       = (lfw_u32 *)p; p += u32_size;
+    m->dst4_mask  = (lfw_u32 *)p; p += u32_size;
+    m->sport_min  = (lfw_u32 *)p; p += u32_size;
+    m->sport_max  = (lfw_u32 *)p; p += u32_size;
+    m->dport_min  = (lfw_u32 *)p; p += u32_size;
+    m->dport_max  = (lfw_u32 *)p; p += u32_size;
+    m->src6       = (lfw_u8 (*)[16])p; p += ip6_size;
+    m->src6_mask  = (lfw_u8 (*)[16])p; p += ip6_size;
+    m->dst6       = (lfw_u8 (*)[16])p; p += ip6_size;
+    m->dst6_mask  = (lfw_u8 (*)[16])p; p += ip6_size;
+    m->ip_any     = p;
+
+    for (lfw_u32 i = 0; i < lanes; i++) {
+        if (i >= rule_count) {
+            m->version[i] = LANE_VERSION_PAD;
+            continue;
+        }
+
+        const lfw_rule_match_t *r = &rules[i].match;
+
+        m->version[i] = r->ip_version;
+        m->proto[i]   = (lfw_u32)r->protocol;
+
+        // The address unions are read through both views exactly as
+        // lfw_rule_match does, whatever the rule's own family
+        if (r->match_src_ip) {
+            m->src4_mask[i] = r->src_mask.v4.addr;
+            m->src4[i]      = r->src_ip.v4.addr & r->src_mask.v4.addr;
+            for (int b = 0; b < 16; b++) {
+                m->src6_mask[i][b] = r->src_mask.v6.addr[b];
+                m->src6[i][b]      = r->src_ip.v6.addr[b] & r->src_mask.v6.addr[b];
+            }
+        }
+
+        if (r->match_dst_ip) {
+            m->dst4_mask[i] = r->dst_mask.v4.addr;
+            m->dst4[i]      = r->dst_ip.v4.addr & r->dst_mask.v4.addr;
+            for (int b = 0; b < 16; b++) {
+                m->dst6_mask[i][b] = r->dst_mask.v6.addr[b];
+                m->dst6[i][b]      = r->dst_ip.v6.addr[b] & r->dst_mask.v6.addr[b];
+            }
+        }
+
+        m->ip_any[i] = !r->match_src_ip && !r->match_dst_ip;
+
+        m->sport_min[i] = r->match_src_port ? r->src_port.min : 0;
+        m->sport_max[i] = r->match_src_port ? r->src_port.max : 0xFFFF;
+        m->dport_min[i] = r->match_dst_port ? r->dst_port.min : 0;
+        m->dport_max[i] = r->match_dst_port ? r->dst_port.max : 0xFFFF;
+    }
+
+    select_isa(m);
+
+    return m;
+}
+
+void lfw_matcher_destroy(lfw_matcher_t *matcher)
+{
+    if (!matcher)
+        return;
+
+    free(matcher->mem);
+    free(matcher);
+}
+
+lfw_u32 lfw_matcher_first(const lfw_matcher_t *matcher, const lfw_packet_t *packet)
+{
+    if (!matcher || !packet)
+        return LFW_MATCHER_NONE;
+
+    match_key_t k = {
+        .version = packet->ip.src.ip_version,
+        .proto   = (lfw_u32)packet->protocol,
+        .src4    = packet->ip.src.v4.addr,
+        .dst4    = packet->ip.dst.v4.addr,
+        .sport   = ntohs(packet->l4.src_port.port),
+        .dport   = ntohs(packet->l4.dst_port.port),
+        .ports   = packet->protocol == LFW_PROTO_TCP ||
+                   packet->protocol == LFW_PROTO_UDP,
+        .src6    = packet->ip.src.v6.addr,
+        .dst6    = packet->ip.dst.v6.addr
+    };
+
+    return matcher->match(matcher, &k);
+}
+
+const char *lfw_matcher_isa(const lfw_matcher_t *matcher)
+{
+    return matcher ? matcher->isa : "none";
+}
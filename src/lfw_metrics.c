@@ -0,0 +1,400 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_metrics.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "lfw_bpf_shared.h"
+#include "lfw_log.h"
+
+#define METRICS_BACKLOG     16
+#define METRICS_REQUEST_MAX 4096
+
+// A client that stalls mid-request or mid-response is dropped after this
+#define METRICS_IO_TIMEOUT_SEC 2
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+// Response body, grown as metrics are appended
+typedef struct {
+    char  *data;
+    size_t len;
+    size_t cap;
+    bool   failed; // Out of memory; the response is abandoned
+} metrics_buf_t;
+
+static struct {
+    bool            started;
+    int             listen_fd;
+    int             stop_pipe[2];
+    char            unix_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    pthread_t       thread;
+
+    pthread_mutex_t lock;     // Guards snapshot and have_snapshot
+    lfw_stats_t     snapshot;
+    bool            have_snapshot;
+
+    lfw_stats_t     served;   // Server thread's copy, rendered outside the lock
+} g_metrics = {.listen_fd = -1, .stop_pipe = {-1, -1}};
+
+__attribute__((format(printf, 2, 3)))
+static void buf_printf(metrics_buf_t *buf, const char *fmt, ...)
+{
+    if (buf->failed)
+        return;
+
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            buf->failed = true;
+            return;
+        }
+        if ((size_t)n < buf->cap - buf->len) {
+            buf->len += (size_t)n;
+            return;
+        }
+
+        size_t cap = buf->cap * 2 > buf->len + (size_t)n + 1 ? buf->cap * 2 : buf->len + (size_t)n + 1;
+        char *data = realloc(buf->data, cap);
+        if (!data) {
+            buf->failed = true;
+            return;
+        }
+        buf->data = data;
+        buf->cap = cap;
+    }
+}
+
+static void family(metrics_buf_t *buf, const char *name, const char *type, const char *help)
+{
+    buf_printf(buf, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void counter(metrics_buf_t *buf, const char *name, const char *help, lfw_u64 value)
+{
+    family(buf, name, "counter", help);
+    buf_printf(buf, "%s_total %llu\n", name, (unsigned long long)value);
+}
+
+// A timer becomes a summary of its runs plus a gauge of the latest one
+static void timer(metrics_buf_t *buf, const char *name, const char *help, const lfw_stats_timer_t *t)
+{
+    family(buf, name, "summary", help);
+    buf_printf(buf, "%s_count %llu\n%s_sum %.9f\n", name, (unsigned long long)t->count,
+               name, (double)t->total_ns / 1e9);
+    buf_printf(buf, "# TYPE %s_last gauge\n# HELP %s_last Duration of the latest run.\n%s_last %.9f\n",
+               name, name, name, (double)t->last_ns / 1e9);
+}
+
+static void render(const lfw_stats_t *s, metrics_buf_t *buf)
+{
+    static const char *const tcp_states[] = {"none", "syn_sent", "syn_recv", "established", "fin_wait", "closed"};
+    lfw_u32 reasons = s->reason_count < LFW_STATS_MAX_REASONS ? s->reason_count : LFW_STATS_MAX_REASONS;
+    lfw_u32 rules = s->rule_count < LFW_STATS_MAX_RULES ? s->rule_count : LFW_STATS_MAX_RULES;
+
+    family(buf, "lfw_stats_updated_timestamp_seconds", "gauge", "When the served statistics were collected.");
+    buf_printf(buf, "lfw_stats_updated_timestamp_seconds %.3f\n", (double)s->updated_ns / 1e9);
+
+    family(buf, "lfw_verdict_reasons", "counter", "Packets by filter exit path, and conntrack events.");
+    for (lfw_u32 i = 0; i < reasons; i++)
+        buf_printf(buf, "lfw_verdict_reasons_total{reason=\"%.*s\"} %llu\n",
+                   LFW_STATS_NAME_LEN, s->reason_names[i], (unsigned long long)s->reasons[i]);
+
+    family(buf, "lfw_rule_hits", "counter", "Packets decided by each rule, numbered from 1.");
+    for (lfw_u32 i = 0; i < rules; i++)
+        buf_printf(buf, "lfw_rule_hits_total{rule=\"%u\",action=\"%s\"} %llu\n", i + 1,
+                   s->rule_actions[i] == 1 ? "allow" : "drop", (unsigned long long)s->rules[i].hits);
+    family(buf, "lfw_rule_bytes", "counter", "Bytes of the packets decided by each rule.");
+    for (lfw_u32 i = 0; i < rules; i++)
+        buf_printf(buf, "lfw_rule_bytes_total{rule=\"%u\",action=\"%s\"} %llu\n", i + 1,
+                   s->rule_actions[i] == 1 ? "allow" : "drop", (unsigned long long)s->rules[i].bytes);
+
+    family(buf, "lfw_conntrack_entries", "gauge", "Tracked connections.");
+    buf_printf(buf, "lfw_conntrack_entries{family=\"ipv4\"} %llu\n", (unsigned long long)s->conntrack_v4);
+    buf_printf(buf, "lfw_conntrack_entries{family=\"ipv6\"} %llu\n", (unsigned long long)s->conntrack_v6);
+    family(buf, "lfw_conntrack_tcp_entries", "gauge", "Tracked TCP connections by state.");
+    for (size_t st = 1; st < sizeof(tcp_states) / sizeof(tcp_states[0]); st++) {
+        buf_printf(buf, "lfw_conntrack_tcp_entries{family=\"ipv4\",state=\"%s\"} %llu\n",
+                   tcp_states[st], (unsigned long long)s->conntrack_tcp_v4[st]);
+        buf_printf(buf, "lfw_conntrack_tcp_entries{family=\"ipv6\",state=\"%s\"} %llu\n",
+                   tcp_states[st], (unsigned long long)s->conntrack_tcp_v6[st]);
+    }
+
+    counter(buf, "lfw_ringbuf_events_submitted", "Telemetry events the filter wrote to the rings.", s->kernel_submitted);
+    family(buf, "lfw_ringbuf_events_lost", "counter", "Telemetry events lost because their ring was full.");
+    buf_printf(buf, "lfw_ringbuf_events_lost_total{class=\"drop\"} %llu\n", (unsigned long long)s->kernel_drop_lost);
+    buf_printf(buf, "lfw_ringbuf_events_lost_total{class=\"allow\"} %llu\n",
+               (unsigned long long)(s->kernel_lost - s->kernel_drop_lost));
+    counter(buf, "lfw_ringbuf_wakeups", "Consumer wakeups forced by the filter.", s->kernel_wakeups);
+    counter(buf, "lfw_telemetry_events_received", "Telemetry events drained from the rings.", s->telemetry_received);
+    counter(buf, "lfw_telemetry_events_rate_limited", "Telemetry events skipped by the rate limit.", s->telemetry_rate_limited);
+    counter(buf, "lfw_telemetry_events_queue_dropped", "Telemetry events dropped with every worker queue full.",
+            s->telemetry_queue_dropped);
+
+    timer(buf, "lfw_gc_sweep_duration_seconds", "Conntrack GC sweep duration.", &s->gc_sweep);
+    timer(buf, "lfw_fqdn_resolve_duration_seconds", "FQDN rule resolution duration.", &s->fqdn_resolve);
+    timer(buf, "lfw_reload_duration_seconds", "Successful rule reload duration.", &s->reload);
+    counter(buf, "lfw_reload_failures", "Rule reloads that kept the old rules.", s->reload_failures);
+
+    buf_printf(buf, "# EOF\n");
+}
+
+static bool send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void respond(int fd, const char *status, const char *type, const char *body, size_t len, bool head)
+{
+    char hdr[256];
+    int n = snprintf(hdr, sizeof(hdr),
+                     "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                     status, type, len);
+    if (send_all(fd, hdr, (size_t)n) && !head)
+        send_all(fd, body, len);
+}
+
+// Answer one request and let the caller close the connection
+static void serve(int fd, metrics_buf_t *buf)
+{
+    struct timeval tv = {.tv_sec = METRICS_IO_TIMEOUT_SEC};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    // Only the request line matters; the rest of the request is not read
+    char req[METRICS_REQUEST_MAX];
+    size_t len = 0;
+    while (len < sizeof(req) - 1 && !memchr(req, '\n', len)) {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        len += (size_t)n;
+    }
+    req[len] = '\0';
+
+    static const char text[] = "text/plain; charset=utf-8";
+    bool head = strncmp(req, "HEAD ", 5) == 0;
+    if (!head && strncmp(req, "GET ", 4) != 0) {
+        respond(fd, "405 Method Not Allowed", text, "method not allowed\n", 19, false);
+        return;
+    }
+
+    const char *path = req + (head ? 5 : 4);
+    size_t path_len = strcspn(path, " ?\r\n");
+    if (!(path_len == 8 && strncmp(path, "/metrics", 8) == 0) && !(path_len == 1 && path[0] == '/')) {
+        respond(fd, "404 Not Found", text, "not found\n", 10, head);
+        return;
+    }
+
+    pthread_mutex_lock(&g_metrics.lock);
+    bool ready = g_metrics.have_snapshot;
+    if (ready)
+        g_metrics.served = g_metrics.snapshot;
+    pthread_mutex_unlock(&g_metrics.lock);
+
+    if (!ready) {
+        respond(fd, "503 Service Unavailable", text, "no statistics yet\n", 18, head);
+        return;
+    }
+
+    buf->len = 0;
+    buf->failed = false;
+    render(&g_metrics.served, buf);
+    if (buf->failed) {
+        respond(fd, "500 Internal Server Error", text, "out of memory\n", 14, head);
+        return;
+    }
+    respond(fd, "200 OK", METRICS_CONTENT_TYPE, buf->data, buf->len, head);
+}
+
+static void *serve_loop(void *arg)
+{
+    (void)arg;
+    metrics_buf_t buf = {0};
+    struct pollfd fds[2] = {
+        {.fd = g_metrics.listen_fd, .events = POLLIN},
+        {.fd = g_metrics.stop_pipe[0], .events = POLLIN},
+    };
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            lfw_log_error("metrics: poll failed: %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        int conn = accept4(g_metrics.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0)
+            continue;
+        serve(conn, &buf);
+        close(conn);
+    }
+
+    free(buf.data);
+    return NULL;
+}
+
+static int listen_unix(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        lfw_log_error("metrics: socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Replace a socket left by an earlier run, but never another file
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            lfw_log_error("metrics: %s exists and is not a socket", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        lfw_log_error("metrics: cannot bind %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    strcpy(g_metrics.unix_path, path);
+    return fd;
+}
+
+static int listen_tcp(const char *port_str)
+{
+    char *end = NULL;
+    unsigned long port = strtoul(port_str, &end, 10);
+    if (!end || *end != '\0' || port == 0 || port > 65535) {
+        lfw_log_error("metrics: invalid listen address %s (absolute socket path or port)", port_str);
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons((uint16_t)port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        lfw_log_error("metrics: cannot bind 127.0.0.1:%lu: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void release(void)
+{
+    if (g_metrics.listen_fd >= 0)
+        close(g_metrics.listen_fd);
+    for (int i = 0; i < 2; i++) {
+        if (g_metrics.stop_pipe[i] >= 0)
+            close(g_metrics.stop_pipe[i]);
+        g_metrics.stop_pipe[i] = -1;
+    }
+    if (g_metrics.unix_path[0])
+        unlink(g_metrics.unix_path);
+    g_metrics.listen_fd = -1;
+    g_metrics.unix_path[0] = '\0';
+}
+
+lfw_status_t lfw_metrics_start(const char *listen_addr)
+{
+    if (g_metrics.started || !listen_addr || !listen_addr[0])
+        return LFW_ERR_INVALID;
+
+    g_metrics.listen_fd = listen_addr[0] == '/' ? listen_unix(listen_addr) : listen_tcp(listen_addr);
+    if (g_metrics.listen_fd < 0) {
+        release();
+        return LFW_ERR_GENERIC;
+    }
+
+    if (listen(g_metrics.listen_fd, METRICS_BACKLOG) != 0 || pipe2(g_metrics.stop_pipe, O_CLOEXEC) != 0) {
+        lfw_log_error("metrics: cannot listen on %s: %s", listen_addr, strerror(errno));
+        release();
+        return LFW_ERR_GENERIC;
+    }
+
+    pthread_mutex_init(&g_metrics.lock, NULL);
+    g_metrics.have_snapshot = false;
+    if (pthread_create(&g_metrics.thread, NULL, serve_loop, NULL) != 0) {
+        pthread_mutex_destroy(&g_metrics.lock);
+        release();
+        return LFW_ERR_GENERIC;
+    }
+
+    g_metrics.started = true;
+    return LFW_OK;
+}
+
+void lfw_metrics_update(const lfw_stats_t *snapshot)
+{
+    if (!g_metrics.started || !snapshot)
+        return;
+
+    pthread_mutex_lock(&g_metrics.lock);
+    g_metrics.snapshot = *snapshot;
+    g_metrics.have_snapshot = true;
+    pthread_mutex_unlock(&g_metrics.lock);
+}
+
+void lfw_metrics_stop(void)
+{
+    if (!g_metrics.started)
+        return;
+
+    // A scrape in progress is finished first; its timeouts bound the wait
+    ssize_t n;
+    do {
+        n = write(g_metrics.stop_pipe[1], "x", 1);
+    } while (n < 0 && errno == EINTR);
+    pthread_join(g_metrics.thread, NULL);
+
+    pthread_mutex_destroy(&g_metrics.lock);
+    release();
+    g_metrics.started = false;
+}
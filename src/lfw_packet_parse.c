@@ -5,138 +5,301 @@
 #define IPV4_MIN_HEADER_LEN 20
 #define IPV6_MIN_HEADER_LEN 40
 
-lfw_status_t lfw_parse_packet(const uint8_t *data,
-                              size_t len,
-                              lfw_direction_t direction,
-                              lfw_packet_t *out_packet)
+#define ETH_HEADER_LEN  14
+#define SLL_HEADER_LEN  16
+#define SLL2_HEADER_LEN 20
+#define VLAN_TAG_LEN    4
+
+// 802.1Q inside 802.1ad (QinQ) is the deepest stacking decoded
+#define LFW_MAX_VLAN_TAGS 2
+
+// Frames prefetched ahead of the one being decoded in a batch
+#define LFW_PARSE_PREFETCH 4
+
+#define ETHERTYPE_IPV4  0x0800
+#define ETHERTYPE_IPV6  0x86DD
+#define ETHERTYPE_8021Q 0x8100
+#define ETHERTYPE_8021AD 0x88A8
+#define ETHERTYPE_QINQ_OLD 0x9100
+
+static inline lfw_u16 read_be16(const uint8_t *p)
 {
-    if (!data || !out_packet)
-        return LFW_ERR_INVALID;
+    return (lfw_u16)(((lfw_u16)p[0] << 8) | p[1]);
+}
 
-    if (len < 1)
-        return LFW_ERR_INVALID;
+static inline bool is_vlan_ethertype(lfw_u16 type)
+{
+    return type == ETHERTYPE_8021Q || type == ETHERTYPE_8021AD || type == ETHERTYPE_QINQ_OLD;
+}
 
-    uint8_t version = data[0] >> 4;
-    memset(out_packet, 0, sizeof(*out_packet));
-    out_packet->direction = direction;
-    out_packet->length = (lfw_u32)len;
+// Locate the IP header behind the link-layer header
+static lfw_status_t parse_l2(lfw_link_t link,
+                             const uint8_t *frame,
+                             size_t len,
+                             lfw_packet_view_t *view)
+{
+    size_t off;
+    lfw_u16 type;
 
-    if (version == 4) {
-        if (len < IPV4_MIN_HEADER_LEN)
+    view->vlan_id = 0;
+
+    switch (link) {
+    case LFW_LINK_RAW:
+        view->l3_offset = 0;
+        return LFW_OK;
+    case LFW_LINK_ETHERNET:
+        if (len < ETH_HEADER_LEN)
+            return LFW_ERR_INVALID;
+        type = read_be16(frame + 12);
+        off = ETH_HEADER_LEN;
+        break;
+    case LFW_LINK_LINUX_SLL:
+        if (len < SLL_HEADER_LEN)
+            return LFW_ERR_INVALID;
+        type = read_be16(frame + 14);
+        off = SLL_HEADER_LEN;
+        break;
+    case LFW_LINK_LINUX_SLL2:
+        if (len < SLL2_HEADER_LEN)
             return LFW_ERR_INVALID;
+        type = read_be16(frame);
+        off = SLL2_HEADER_LEN;
+        break;
+    default:
+        return LFW_ERR_NOT_SUPPORTED;
+    }
+
+    // VLAN tags: 2 bytes TCI followed by the inner ethertype
+    for (int i = 0; i < LFW_MAX_VLAN_TAGS && is_vlan_ethertype(type); i++) {
+        if (len < off + VLAN_TAG_LEN)
+            return LFW_ERR_INVALID;
+        if (i == 0)
+            view->vlan_id = read_be16(frame + off) & 0x0FFF;
+        type = read_be16(frame + off + 2);
+        off += VLAN_TAG_LEN;
+    }
+
+    if (type != ETHERTYPE_IPV4 && type != ETHERTYPE_IPV6)
+        return LFW_ERR_NOT_SUPPORTED;
+
+    view->l3_offset = (lfw_u16)off;
+    return LFW_OK;
+}
+
+// Ports and TCP flags; the ports are copied as-is so they stay in network order
+static lfw_status_t parse_l4(const uint8_t *data,
+                             size_t len,
+                             size_t ip_header_len,
+                             lfw_packet_view_t *view)
+{
+    view->l4_offset = 0;
+    view->src_port = 0;
+    view->dst_port = 0;
+    view->tcp_flags = 0;
+
+    if (view->protocol != LFW_PROTO_TCP && view->protocol != LFW_PROTO_UDP)
+        return LFW_OK;
+
+    if (len < ip_header_len + 4)
+        return LFW_ERR_INVALID;
 
-        uint8_t ihl = data[0] & 0x0F;
-        size_t ip_header_len = ihl * 4;
+    memcpy(&view->src_port, &data[ip_header_len], 2);
+    memcpy(&view->dst_port, &data[ip_header_len + 2], 2);
 
-        if (ip_header_len < IPV4_MIN_HEADER_LEN || ip_header_len > len)
+    if (view->protocol == LFW_PROTO_TCP) {
+        if (len < ip_header_len + 14)
             return LFW_ERR_INVALID;
 
-        out_packet->is_v6 = false;
-        out_packet->ip.src.ip_version = 4;
-        memcpy(&out_packet->ip.src.v4.addr, &data[12], 4);
-        out_packet->ip.dst.ip_version = 4;
-        memcpy(&out_packet->ip.dst.v4.addr, &data[16], 4);
+        view->tcp_flags = data[ip_header_len + 13];
+    }
 
-        uint8_t proto = data[9];
-        out_packet->protocol = (lfw_proto_t)proto;
+    view->l4_offset = (lfw_u16)(view->l3_offset + ip_header_len);
+    return LFW_OK;
+}
 
-        if (out_packet->protocol == LFW_PROTO_TCP || out_packet->protocol == LFW_PROTO_UDP) {
-            if (len < ip_header_len + 4)
-                return LFW_ERR_INVALID;
+static lfw_status_t parse_ipv4(const uint8_t *data, size_t len, lfw_packet_view_t *view)
+{
+    if (len < IPV4_MIN_HEADER_LEN)
+        return LFW_ERR_INVALID;
 
-            out_packet->l4.src_port.port = htons(((lfw_u16)data[ip_header_len] << 8) |
-                                                 ((lfw_u16)data[ip_header_len + 1]));
-            out_packet->l4.dst_port.port = htons(((lfw_u16)data[ip_header_len + 2] << 8) |
-                                                 ((lfw_u16)data[ip_header_len + 3]));
-
-            if (out_packet->protocol == LFW_PROTO_TCP) {
-                if (len < ip_header_len + 14)
-                    return LFW_ERR_INVALID;
-
-                uint8_t tcp_flags = data[ip_header_len + 13];
-                out_packet->tcp_flags = tcp_flags;
-                bool syn = (tcp_flags & 0x02) != 0;
-                bool ack = (tcp_flags & 0x10) != 0;
-                out_packet->is_new_connection = syn && !ack;
-            } else {
-                out_packet->is_new_connection = true;
-            }
+    size_t ip_header_len = (size_t)(data[0] & 0x0F) * 4;
+
+    if (ip_header_len < IPV4_MIN_HEADER_LEN || ip_header_len > len)
+        return LFW_ERR_INVALID;
+
+    memcpy(&view->src_v4, &data[12], 4);
+    memcpy(&view->dst_v4, &data[16], 4);
+    view->protocol = data[9];
+
+    return parse_l4(data, len, ip_header_len, view);
+}
+
+static lfw_status_t parse_ipv6(const uint8_t *data, size_t len, lfw_packet_view_t *view)
+{
+    if (len < IPV6_MIN_HEADER_LEN)
+        return LFW_ERR_INVALID;
+
+    uint8_t proto = data[6];
+    size_t ip_header_len = IPV6_MIN_HEADER_LEN;
+
+    // Skip IPv6 Extension Headers
+    for (int i = 0; i < 6; i++) {
+        if (proto == 0 || proto == 43 || proto == 60) {
+            // Hop-by-Hop, Routing, Destination Options
+            if (len < ip_header_len + 2)
+                return LFW_ERR_INVALID;
+            size_t ext_len = (data[ip_header_len + 1] + 1) * 8;
+            if (len < ip_header_len + ext_len)
+                return LFW_ERR_INVALID;
+            proto = data[ip_header_len];
+            ip_header_len += ext_len;
+        } else if (proto == 44) {
+            // Fragment Header (8 bytes)
+            if (len < ip_header_len + 8)
+                return LFW_ERR_INVALID;
+            proto = data[ip_header_len];
+            ip_header_len += 8;
+        } else if (proto == 51) {
+            // Authentication Header (AH)
+            if (len < ip_header_len + 2)
+                return LFW_ERR_INVALID;
+            size_t ext_len = (data[ip_header_len + 1] + 2) * 4;
+            if (len < ip_header_len + ext_len)
+                return LFW_ERR_INVALID;
+            proto = data[ip_header_len];
+            ip_header_len += ext_len;
         } else {
-            out_packet->is_new_connection = false;
+            break;
         }
-    } else if (version == 6) {
-        if (len < IPV6_MIN_HEADER_LEN)
-            return LFW_ERR_INVALID;
+    }
 
-        out_packet->is_v6 = true;
-        out_packet->ip.src.ip_version = 6;
-        memcpy(out_packet->ip.src.v6.addr, &data[8], 16);
-        out_packet->ip.dst.ip_version = 6;
-        memcpy(out_packet->ip.dst.v6.addr, &data[24], 16);
-
-        uint8_t proto = data[6];
-        size_t ip_header_len = IPV6_MIN_HEADER_LEN;
-
-        // Skip IPv6 Extension Headers
-        for (int i = 0; i < 6; i++) {
-            if (proto == 0 || proto == 43 || proto == 60) {
-                // Hop-by-Hop, Routing, Destination Options
-                if (len < ip_header_len + 2)
-                    return LFW_ERR_INVALID;
-                size_t ext_len = (data[ip_header_len + 1] + 1) * 8;
-                if (len < ip_header_len + ext_len)
-                    return LFW_ERR_INVALID;
-                proto = data[ip_header_len];
-                ip_header_len += ext_len;
-            } else if (proto == 44) {
-                // Fragment Header (8 bytes)
-                if (len < ip_header_len + 8)
-                    return LFW_ERR_INVALID;
-                proto = data[ip_header_len];
-                ip_header_len += 8;
-            } else if (proto == 51) {
-                // Authentication Header (AH)
-                if (len < ip_header_len + 2)
-                    return LFW_ERR_INVALID;
-                size_t ext_len = (data[ip_header_len + 1] + 2) * 4;
-                if (len < ip_header_len + ext_len)
-                    return LFW_ERR_INVALID;
-                proto = data[ip_header_len];
-                ip_header_len += ext_len;
-            } else {
-                break;
-            }
-        }
+    view->src_v4 = 0;
+    view->dst_v4 = 0;
+    view->protocol = proto;
 
-        out_packet->protocol = (lfw_proto_t)proto;
+    return parse_l4(data, len, ip_header_len, view);
+}
 
-        if (out_packet->protocol == LFW_PROTO_TCP || out_packet->protocol == LFW_PROTO_UDP) {
-            if (len < ip_header_len + 4)
-                return LFW_ERR_INVALID;
+lfw_status_t lfw_parse_view(lfw_link_t link,
+                            const uint8_t *frame,
+                            size_t len,
+                            lfw_packet_view_t *out_view)
+{
+    if (!frame || !out_view)
+        return LFW_ERR_INVALID;
 
-            out_packet->l4.src_port.port = htons(((lfw_u16)data[ip_header_len] << 8) |
-                                                 ((lfw_u16)data[ip_header_len + 1]));
-            out_packet->l4.dst_port.port = htons(((lfw_u16)data[ip_header_len + 2] << 8) |
-                                                 ((lfw_u16)data[ip_header_len + 3]));
-
-            if (out_packet->protocol == LFW_PROTO_TCP) {
-                if (len < ip_header_len + 14)
-                    return LFW_ERR_INVALID;
-
-                uint8_t tcp_flags = data[ip_header_len + 13];
-                out_packet->tcp_flags = tcp_flags;
-                bool syn = (tcp_flags & 0x02) != 0;
-                bool ack = (tcp_flags & 0x10) != 0;
-                out_packet->is_new_connection = syn && !ack;
-            } else {
-                out_packet->is_new_connection = true;
-            }
-        } else {
-            out_packet->is_new_connection = false;
+    out_view->ip_version = 0;
+    out_view->frame = frame;
+    out_view->frame_len = (lfw_u32)len;
+
+    lfw_status_t st = parse_l2(link, frame, len, out_view);
+    if (st != LFW_OK)
+        return st;
+
+    const uint8_t *data = frame + out_view->l3_offset;
+    len -= out_view->l3_offset;
+
+    if (len < 1)
+        return LFW_ERR_INVALID;
+
+    uint8_t version = data[0] >> 4;
+
+    if (version == 4)
+        st = parse_ipv4(data, len, out_view);
+    else if (version == 6)
+        st = parse_ipv6(data, len, out_view);
+    else
+        st = LFW_ERR_INVALID;
+
+    if (st != LFW_OK)
+        return st;
+
+    out_view->ip_version = version;
+    return LFW_OK;
+}
+
+lfw_u32 lfw_parse_view_batch(lfw_link_t link,
+                             const uint8_t *const *frames,
+                             const lfw_u32 *lens,
+                             lfw_u32 count,
+                             lfw_packet_view_t *out_views)
+{
+    if (!frames || !lens || !out_views)
+        return 0;
+
+    lfw_u32 parsed = 0;
+
+    for (lfw_u32 i = 0; i < count; i++) {
+        // L2 through L4 headers of a typical frame span two cache lines
+        if (i + LFW_PARSE_PREFETCH < count) {
+            __builtin_prefetch(frames[i + LFW_PARSE_PREFETCH], 0, 3);
+            __builtin_prefetch(frames[i + LFW_PARSE_PREFETCH] + 64, 0, 3);
         }
+
+        if (lfw_parse_view(link, frames[i], lens[i], &out_views[i]) == LFW_OK)
+            parsed++;
+    }
+
+    return parsed;
+}
+
+void lfw_packet_from_view(const lfw_packet_view_t *view,
+                          lfw_direction_t direction,
+                          lfw_packet_t *out_packet)
+{
+    out_packet->direction = direction;
+    out_packet->protocol = (lfw_proto_t)view->protocol;
+    out_packet->ip.src.ip_version = view->ip_version;
+    out_packet->ip.dst.ip_version = view->ip_version;
+
+    if (view->ip_version == 4) {
+        out_packet->ip.src.v4.addr = view->src_v4;
+        out_packet->ip.dst.v4.addr = view->dst_v4;
     } else {
-        return LFW_ERR_INVALID;
+        memcpy(out_packet->ip.src.v6.addr, lfw_view_src_ip(view), 16);
+        memcpy(out_packet->ip.dst.v6.addr, lfw_view_dst_ip(view), 16);
+    }
+
+    out_packet->l4.src_port.port = view->src_port;
+    out_packet->l4.dst_port.port = view->dst_port;
+    out_packet->tcp_flags = view->tcp_flags;
+
+    if (view->protocol == LFW_PROTO_TCP) {
+        bool syn = (view->tcp_flags & 0x02) != 0;
+        bool ack = (view->tcp_flags & 0x10) != 0;
+        out_packet->is_new_connection = syn && !ack;
+    } else {
+        out_packet->is_new_connection = view->protocol == LFW_PROTO_UDP;
     }
 
+    out_packet->is_established = false;
+    out_packet->rule_index = LFW_RULE_INDEX_NONE;
+    out_packet->length = view->frame_len - view->l3_offset;
+    out_packet->is_v6 = view->ip_version == 6;
+}
+
+lfw_status_t lfw_parse_frame(lfw_link_t link,
+                             const uint8_t *frame,
+                             size_t len,
+                             lfw_direction_t direction,
+                             lfw_packet_t *out_packet)
+{
+    if (!out_packet)
+        return LFW_ERR_INVALID;
+
+    lfw_packet_view_t view;
+    lfw_status_t st = lfw_parse_view(link, frame, len, &view);
+    if (st != LFW_OK)
+        return st;
+
+    lfw_packet_from_view(&view, direction, out_packet);
     return LFW_OK;
 }
+
+lfw_status_t lfw_parse_packet(const uint8_t *data,
+                              size_t len,
+                              lfw_direction_t direction,
+                              lfw_packet_t *out_packet)
+{
+    return lfw_parse_frame(LFW_LINK_RAW, data, len, direction, out_packet);
+}
@@ -0,0 +1,388 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_reactor.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// Events taken from the epoll set per wait
+#define REACTOR_EVENTS 16
+
+typedef enum {
+    SOURCE_FD,
+    SOURCE_TIMER,
+    SOURCE_SIGNAL,
+    SOURCE_WAKE, // Eventfd written by lfw_reactor_stop
+} source_kind_t;
+
+// Everything in the epoll set; its epoll data points here. A source
+// removed during dispatch is only marked dead, as events already taken
+// from the set may still name it, and freed after the batch.
+struct lfw_reactor_timer {
+    source_kind_t kind;
+    int           fd;
+    bool          dead;
+    union {
+        lfw_reactor_fd_cb_t     fd;
+        lfw_reactor_timer_cb_t  timer;
+        lfw_reactor_signal_cb_t signal;
+    } cb;
+    void                     *ctx;
+    struct lfw_reactor_timer *next;
+};
+
+typedef struct lfw_reactor_timer reactor_source_t;
+
+struct lfw_reactor {
+    int               epoll_fd;
+    reactor_source_t *sources;
+    reactor_source_t *wake;
+    bool              stopping;
+    bool              dispatching; // Defer frees of removed sources
+
+    // Worker pool
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;   // A task was queued or the pool is closing
+    lfw_reactor_task_t *head;
+    lfw_reactor_task_t *tail;
+    bool                closing;
+    pthread_t           threads[LFW_REACTOR_MAX_WORKERS];
+    lfw_u32             thread_count;
+};
+
+static void task_append(lfw_reactor_t *r, lfw_reactor_task_t *task)
+{
+    task->next = NULL;
+    if (r->tail)
+        r->tail->next = task;
+    else
+        r->head = task;
+    r->tail = task;
+    pthread_cond_signal(&r->cond);
+}
+
+static void *worker_loop(void *arg)
+{
+    lfw_reactor_t *r = arg;
+
+    pthread_mutex_lock(&r->lock);
+    for (;;) {
+        while (!r->head && !r->closing)
+            pthread_cond_wait(&r->cond, &r->lock);
+        if (r->closing)
+            break;
+
+        lfw_reactor_task_t *task = r->head;
+        r->head = task->next;
+        if (!r->head)
+            r->tail = NULL;
+        task->queued = false;
+        task->running = true;
+        pthread_mutex_unlock(&r->lock);
+
+        task->fn(task->ctx);
+
+        // Queued again while it ran
+        pthread_mutex_lock(&r->lock);
+        task->running = false;
+        if (task->queued && !r->closing)
+            task_append(r, task);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+static reactor_source_t *source_add(lfw_reactor_t *r, source_kind_t kind, int fd, lfw_u32 events)
+{
+    reactor_source_t *src = calloc(1, sizeof(*src));
+    if (!src)
+        return NULL;
+    src->kind = kind;
+    src->fd = fd;
+
+    struct epoll_event ev = {.events = events, .data.ptr = src};
+    if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        int err = errno;
+        free(src);
+        errno = err;
+        return NULL;
+    }
+    src->next = r->sources;
+    r->sources = src;
+    return src;
+}
+
+// Close what the reactor owns of a source and free it
+static void source_free(reactor_source_t *src)
+{
+    if (src->kind != SOURCE_FD)
+        close(src->fd);
+    free(src);
+}
+
+// Free sources marked dead
+static void sources_reap(lfw_reactor_t *r)
+{
+    reactor_source_t **link = &r->sources;
+    while (*link) {
+        reactor_source_t *src = *link;
+        if (src->dead) {
+            *link = src->next;
+            source_free(src);
+        } else {
+            link = &src->next;
+        }
+    }
+}
+
+lfw_reactor_t *lfw_reactor_create(lfw_u32 workers)
+{
+    if (workers == 0 || workers > LFW_REACTOR_MAX_WORKERS) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    lfw_reactor_t *r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+
+    r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epoll_fd < 0) {
+        int err = errno;
+        lfw_reactor_destroy(r);
+        errno = err;
+        return NULL;
+    }
+
+    int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0 || !(r->wake = source_add(r, SOURCE_WAKE, wake_fd, EPOLLIN))) {
+        int err = errno;
+        if (wake_fd >= 0)
+            close(wake_fd);
+        lfw_reactor_destroy(r);
+        errno = err;
+        return NULL;
+    }
+
+    for (lfw_u32 i = 0; i < workers; i++) {
+        int err = pthread_create(&r->threads[i], NULL, worker_loop, r);
+        if (err != 0) {
+            lfw_reactor_destroy(r);
+            errno = err;
+            return NULL;
+        }
+        r->thread_count++;
+    }
+    return r;
+}
+
+lfw_status_t lfw_reactor_add_fd(lfw_reactor_t *r, int fd, lfw_u32 events, lfw_reactor_fd_cb_t cb, void *ctx)
+{
+    if (!r || fd < 0 || !cb)
+        return LFW_ERR_INVALID;
+
+    reactor_source_t *src = source_add(r, SOURCE_FD, fd, events);
+    if (!src)
+        return errno == ENOMEM ? LFW_ERR_NO_MEMORY : LFW_ERR_GENERIC;
+    src->cb.fd = cb;
+    src->ctx = ctx;
+    return LFW_OK;
+}
+
+void lfw_reactor_del_fd(lfw_reactor_t *r, int fd)
+{
+    if (!r)
+        return;
+
+    for (reactor_source_t *src = r->sources; src; src = src->next) {
+        if (src->kind != SOURCE_FD || src->fd != fd || src->dead)
+            continue;
+        epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        src->dead = true;
+        break;
+    }
+    if (!r->dispatching)
+        sources_reap(r);
+}
+
+lfw_reactor_timer_t *lfw_reactor_timer_add(lfw_reactor_t *r, lfw_reactor_timer_cb_t cb, void *ctx)
+{
+    if (!r || !cb) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    reactor_source_t *src = source_add(r, SOURCE_TIMER, fd, EPOLLIN);
+    if (!src) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    src->cb.timer = cb;
+    src->ctx = ctx;
+    return src;
+}
+
+static struct timespec ms_to_timespec(lfw_u32 ms)
+{
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L};
+    return ts;
+}
+
+lfw_status_t lfw_reactor_timer_set(lfw_reactor_timer_t *timer, lfw_u32 first_ms, lfw_u32 interval_ms)
+{
+    if (!timer)
+        return LFW_ERR_INVALID;
+
+    struct itimerspec spec = {
+        .it_value    = ms_to_timespec(first_ms),
+        .it_interval = ms_to_timespec(first_ms ? interval_ms : 0),
+    };
+    return timerfd_settime(timer->fd, 0, &spec, NULL) == 0 ? LFW_OK : LFW_ERR_GENERIC;
+}
+
+lfw_status_t lfw_reactor_add_signals(lfw_reactor_t *r, const sigset_t *signals, lfw_reactor_signal_cb_t cb,
+                                     void *ctx)
+{
+    if (!r || !signals || !cb)
+        return LFW_ERR_INVALID;
+
+    int fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+        return LFW_ERR_GENERIC;
+    reactor_source_t *src = source_add(r, SOURCE_SIGNAL, fd, EPOLLIN);
+    if (!src) {
+        close(fd);
+        return LFW_ERR_GENERIC;
+    }
+    src->cb.signal = cb;
+    src->ctx = ctx;
+    return LFW_OK;
+}
+
+bool lfw_reactor_queue(lfw_reactor_t *r, lfw_reactor_task_t *task)
+{
+    if (!r || !task || !task->fn)
+        return false;
+
+    pthread_mutex_lock(&r->lock);
+    bool queued = !task->queued && !r->closing;
+    if (queued) {
+        task->queued = true;
+        if (!task->running)
+            task_append(r, task);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return queued;
+}
+
+static void dispatch(reactor_source_t *src, lfw_u32 events)
+{
+    switch (src->kind) {
+    case SOURCE_FD:
+        src->cb.fd(src->ctx, events);
+        break;
+    case SOURCE_TIMER: {
+        // Expirations missed while busy collapse into one callback
+        lfw_u64 expirations;
+        if (read(src->fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations))
+            src->cb.timer(src->ctx);
+        break;
+    }
+    case SOURCE_SIGNAL: {
+        struct signalfd_siginfo info;
+        while (read(src->fd, &info, sizeof(info)) == (ssize_t)sizeof(info))
+            src->cb.signal(src->ctx, (int)info.ssi_signo);
+        break;
+    }
+    case SOURCE_WAKE: {
+        // Only resets the counter: lfw_reactor_run checks the stop flag
+        lfw_u64 count;
+        ssize_t n = read(src->fd, &count, sizeof(count));
+        (void)n;
+        break;
+    }
+    }
+}
+
+lfw_status_t lfw_reactor_run(lfw_reactor_t *r)
+{
+    if (!r)
+        return LFW_ERR_INVALID;
+
+    while (!__atomic_load_n(&r->stopping, __ATOMIC_ACQUIRE)) {
+        struct epoll_event events[REACTOR_EVENTS];
+        int n = epoll_wait(r->epoll_fd, events, REACTOR_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return LFW_ERR_GENERIC;
+        }
+
+        r->dispatching = true;
+        for (int i = 0; i < n && !__atomic_load_n(&r->stopping, __ATOMIC_ACQUIRE); i++) {
+            reactor_source_t *src = events[i].data.ptr;
+            if (!src->dead)
+                dispatch(src, events[i].events);
+        }
+        r->dispatching = false;
+        sources_reap(r);
+    }
+    return LFW_OK;
+}
+
+void lfw_reactor_stop(lfw_reactor_t *r)
+{
+    if (!r)
+        return;
+
+    lfw_u64 one = 1;
+    ssize_t n;
+    __atomic_store_n(&r->stopping, true, __ATOMIC_RELEASE);
+    do {
+        n = write(r->wake->fd, &one, sizeof(one));
+    } while (n < 0 && errno == EINTR);
+}
+
+void lfw_reactor_destroy(lfw_reactor_t *r)
+{
+    if (!r)
+        return;
+
+    pthread_mutex_lock(&r->lock);
+    r->closing = true;
+    for (lfw_reactor_task_t *task = r->head; task; task = task->next)
+        task->queued = false;
+    r->head = NULL;
+    r->tail = NULL;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+
+    // Running tasks finish first
+    for (lfw_u32 i = 0; i < r->thread_count; i++)
+        pthread_join(r->threads[i], NULL);
+
+    while (r->sources) {
+        reactor_source_t *src = r->sources;
+        r->sources = src->next;
+        source_free(src);
+    }
+    if (r->epoll_fd >= 0)
+        close(r->epoll_fd);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+}
@@ -121,7 +121,75 @@ bool lfw_rule_match(const lfw_rule_t *rule,
 #include <netdb.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
+#include <pthread.h>
+
+// ------------------------------
+// FQDN string table
+// ------------------------------
+
+// Append-only: names are only needed to resolve rules, and ids stay
+// valid across reloads so expanded rules can be compared bytewise.
+static struct {
+    pthread_mutex_t lock;
+    char          **names;  // names[id - 1]
+    lfw_u32         count;
+    lfw_u32         cap;
+} g_fqdn = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+lfw_u32 lfw_fqdn_intern(const char *name)
+{
+    if (!name || *name == '\0')
+        return LFW_FQDN_NONE;
+
+    lfw_u32 id = LFW_FQDN_NONE;
+
+    pthread_mutex_lock(&g_fqdn.lock);
+
+    for (lfw_u32 i = 0; i < g_fqdn.count; i++) {
+        if (strcasecmp(g_fqdn.names[i], name) == 0) {
+            id = i + 1;
+            goto out;
+        }
+    }
+
+    if (g_fqdn.count == g_fqdn.cap) {
+        lfw_u32 cap = g_fqdn.cap ? g_fqdn.cap * 2 : 16;
+        char **tmp = realloc(g_fqdn.names, cap * sizeof(char *));
+        if (!tmp)
+            goto out;
+        g_fqdn.names = tmp;
+        g_fqdn.cap = cap;
+    }
+
+    char *copy = strdup(name);
+    if (!copy)
+        goto out;
+
+    g_fqdn.names[g_fqdn.count++] = copy;
+    id = g_fqdn.count;
+
+out:
+    pthread_mutex_unlock(&g_fqdn.lock);
+    return id;
+}
+
+const char *lfw_fqdn_name(lfw_u32 id)
+{
+    const char *name = NULL;
+
+    pthread_mutex_lock(&g_fqdn.lock);
+    if (id != LFW_FQDN_NONE && id <= g_fqdn.count)
+        name = g_fqdn.names[id - 1];
+    pthread_mutex_unlock(&g_fqdn.lock);
+
+    return name;
+}
+
+// ------------------------------
+// FQDN expansion
+// ------------------------------
 
 struct resolved_ip {
     lfw_ip_t ip;
@@ -196,20 +264,22 @@ lfw_status_t lfw_rules_expand_fqdn(const lfw_rule_t *raw_rules, lfw_u32 raw_coun
 
         struct resolved_ip *src_ips = NULL;
         int src_count = 0;
-        if (raw->match.has_src_fqdn) {
-            src_count = resolve_domain(raw->match.src_fqdn, &src_ips);
+        if (raw->match.src_fqdn != LFW_FQDN_NONE) {
+            const char *name = lfw_fqdn_name(raw->match.src_fqdn);
+            src_count = name ? resolve_domain(name, &src_ips) : 0;
             if (src_count == 0) {
-                fprintf(stderr, "[lfw] Warning: failed to resolve FQDN '%s'\n", raw->match.src_fqdn);
+                fprintf(stderr, "[lfw] Warning: failed to resolve FQDN '%s'\n", name ? name : "?");
                 continue;
             }
         }
 
         struct resolved_ip *dst_ips = NULL;
         int dst_count = 0;
-        if (raw->match.has_dst_fqdn) {
-            dst_count = resolve_domain(raw->match.dst_fqdn, &dst_ips);
+        if (raw->match.dst_fqdn != LFW_FQDN_NONE) {
+            const char *name = lfw_fqdn_name(raw->match.dst_fqdn);
+            dst_count = name ? resolve_domain(name, &dst_ips) : 0;
             if (dst_count == 0) {
-                fprintf(stderr, "[lfw] Warning: failed to resolve FQDN '%s'\n", raw->match.dst_fqdn);
+                fprintf(stderr, "[lfw] Warning: failed to resolve FQDN '%s'\n", name ? name : "?");
                 free(src_ips);
                 continue;
             }
@@ -222,12 +292,12 @@ lfw_status_t lfw_rules_expand_fqdn(const lfw_rule_t *raw_rules, lfw_u32 raw_coun
             for (int d = 0; d < loop_dst; d++) {
                 lfw_rule_t rule = *raw;
 
-                if (raw->match.has_src_fqdn) {
+                if (raw->match.src_fqdn != LFW_FQDN_NONE) {
                     rule.match.src_ip = src_ips[s].ip;
                     rule.match.src_mask = src_ips[s].mask;
                     rule.match.match_src_ip = true;
                 }
-                if (raw->match.has_dst_fqdn) {
+                if (raw->match.dst_fqdn != LFW_FQDN_NONE) {
                     rule.match.dst_ip = dst_ips[d].ip;
                     rule.match.dst_mask = dst_ips[d].mask;
                     rule.match.match_dst_ip = true;
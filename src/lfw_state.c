@@ -6,34 +6,142 @@
 #include <time.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
 
-// Table size (must be power of two for better distribution)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() do { } while (0)
+#endif
+
+// Default table size per address family (rounded up to a power of two)
 #define LFW_STATE_TABLE_SIZE 65536
 
-// Timeouts (seconds)
-#define LFW_TCP_TIMEOUT 300
-#define LFW_UDP_TIMEOUT 60
+// Control bytes are probed one group at a time
+#define LFW_GROUP_WIDTH 16
+
+// Tables larger than this are candidates for hugepage backing
+#define LFW_HUGEPAGE_SIZE (2UL * 1024 * 1024)
+
+// Timeouts (seconds, matching the kernel BPF conntrack)
+#define LFW_TCP_TIMEOUT_SYN_SENT    20
+#define LFW_TCP_TIMEOUT_SYN_RECV    20
+#define LFW_TCP_TIMEOUT_ESTABLISHED 300
+#define LFW_TCP_TIMEOUT_FIN_WAIT    30
+#define LFW_TCP_TIMEOUT_CLOSED      10
+#define LFW_UDP_TIMEOUT             60
+
+// Lock-free lookup attempts before falling back to the mutex
+#define LFW_SEQ_RETRIES 8
+
+// Reader counter slots; threads are spread over them round-robin
+#define LFW_READER_SLOTS 64
 
+// Timer wheel: one bucket per second, span must exceed the longest timeout
+#define LFW_WHEEL_SLOTS 512
+#define LFW_WHEEL_NIL   0xFFFFFFFFu
+
+// Control byte values: full slots hold the low 7 hash bits (0x00-0x7F)
+#define CTRL_EMPTY   ((lfw_u8)0x80)
+#define CTRL_DELETED ((lfw_u8)0xFE)
+
+// TCP connection state (same transitions as the kernel BPF conntrack)
 typedef enum {
-    SLOT_EMPTY = 0,
-    SLOT_OCCUPIED,
-    SLOT_TOMBSTONE
-} slot_state_t;
+    CONN_TCP_NONE = 0,
+    CONN_TCP_SYN_SENT,
+    CONN_TCP_SYN_RECV,
+    CONN_TCP_ESTABLISHED,
+    CONN_TCP_FIN_WAIT,
+    CONN_TCP_CLOSED
+} conn_tcp_state_t;
+
+// Per-entry metadata shared by both address families
+typedef struct {
+    lfw_u32 last_seen;
+    lfw_u16 wheel_bucket;
+    lfw_u8  protocol;
+    lfw_u8  tcp_state;
+} conn_meta_t;
+
+// IPv4 flow: 20 bytes
+typedef struct {
+    conn_meta_t m;
+    lfw_u32     src_ip;
+    lfw_u32     dst_ip;
+    lfw_u16     src_port;
+    lfw_u16     dst_port;
+} conn_v4_t;
+
+// IPv6 flow: 44 bytes
+typedef struct {
+    conn_meta_t m;
+    lfw_u8      src_ip[16];
+    lfw_u8      dst_ip[16];
+    lfw_u16     src_port;
+    lfw_u16     dst_port;
+} conn_v6_t;
+
+#define CONN_V4_KEY_LEN (sizeof(conn_v4_t) - sizeof(conn_meta_t))
+#define CONN_V6_KEY_LEN (sizeof(conn_v6_t) - sizeof(conn_meta_t))
+
+_Static_assert(sizeof(conn_v6_t) <= sizeof(((lfw_state_key_t *)0)->data),
+               "lfw_state_key_t too small for an IPv6 flow");
 
+// Timer wheel links, kept apart from the entries so lookups stay compact
+typedef struct {
+    lfw_u32 next;
+    lfw_u32 prev;
+} conn_link_t;
+
+// Swiss-table style open addressing table for one address family.
+// The leading fields are read by lock-free lookups; writer-only state
+// starts on its own cache line.
+typedef struct {
+    lfw_u8      *ctrl;      // cap + LFW_GROUP_WIDTH bytes, tail mirrors the head
+    lfw_u8      *entries;   // cap * entry_size bytes
+    conn_link_t *links;     // cap links
+    void        *mem;
+    size_t       mem_size;
+    size_t       entry_size;
+    size_t       key_len;
+    lfw_u32      cap;
+    lfw_u32      mask;
+    lfw_u32      count __attribute__((aligned(64)));
+    lfw_u32      tombstones;
+    lfw_u32      wheel[LFW_WHEEL_SLOTS];
+} conn_table_t;
+
+// Table mapping replaced by a rebuild, unmapped once no reader can use it
+typedef struct retired_mem {
+    struct retired_mem *next;
+    void               *mem;
+    size_t              size;
+    lfw_u64             epoch; // Reader epoch when it was retired
+} retired_mem_t;
+
+// Lock-free lookups in progress, by the parity of the reader epoch they
+// started in. One cache line per slot keeps threads from sharing one.
 typedef struct {
-    lfw_ip_t src_ip;
-    lfw_ip_t dst_ip;
-    lfw_u16  src_port;
-    lfw_u16  dst_port;
-    lfw_u8   protocol;
-    lfw_u8   state;
-    lfw_u64  last_seen;
-} lfw_conn_entry_t;
+    lfw_u32 active[2];
+} __attribute__((aligned(64))) reader_slot_t;
 
 struct lfw_state {
-    lfw_conn_entry_t *slots;
-    lfw_u32           cap;
-    lfw_u32           count;
+    conn_table_t      v4;
+    conn_table_t      v6;
+    lfw_u64           seed[2];
+    bool              hugepages;
+    lfw_u32           seq __attribute__((aligned(64)));
+    lfw_state_probe_stats_t probe_stats;
+    lfw_u64           wheel_now;
+    lfw_state_clock_t clock;
+    retired_mem_t    *retired;
+    lfw_u64           reader_epoch;
+    reader_slot_t     readers[LFW_READER_SLOTS];
     pthread_mutex_t   lock;
     pthread_t         cleanup_thread;
     volatile bool     cleanup_running;
@@ -43,100 +151,745 @@ struct lfw_state {
 // Utility
 // ------------------------------
 
-static lfw_u64 now_sec(void)
+static lfw_u64 wall_sec(void)
 {
     return (lfw_u64)time(NULL);
 }
 
-static void entry_set_empty(lfw_conn_entry_t *e)
+// Connection time: the configured clock, or the wall clock
+static lfw_u64 now_sec(const lfw_state_t *s)
+{
+    if (s->clock.now)
+        return s->clock.now(s->clock.ctx);
+    return wall_sec();
+}
+
+static inline conn_meta_t *table_entry(const conn_table_t *t, lfw_u32 idx)
+{
+    return (conn_meta_t *)(t->entries + (size_t)idx * t->entry_size);
+}
+
+static inline const lfw_u8 *entry_key(const conn_meta_t *m)
 {
-    e->state = SLOT_EMPTY;
+    return (const lfw_u8 *)(m + 1);
 }
 
-// Normalize connection tuple for bidirectional matching
-static void normalize_key(const lfw_packet_t *pkt, lfw_conn_entry_t *e)
+// Normalize IPv4 tuple for bidirectional matching
+static void normalize_key_v4(const lfw_packet_t *pkt, conn_v4_t *e)
 {
-    lfw_ip_t a_ip   = pkt->ip.src;
-    lfw_ip_t b_ip   = pkt->ip.dst;
+    lfw_u32 a_ip   = pkt->ip.src.v4.addr;
+    lfw_u32 b_ip   = pkt->ip.dst.v4.addr;
     lfw_u16 a_port = pkt->l4.src_port.port;
     lfw_u16 b_port = pkt->l4.dst_port.port;
 
-    bool swap = false;
-    if (a_ip.ip_version == 4) {
-        if (a_ip.v4.addr > b_ip.v4.addr || (a_ip.v4.addr == b_ip.v4.addr && a_port > b_port)) {
-            swap = true;
-        }
+    if (a_ip > b_ip || (a_ip == b_ip && a_port > b_port)) {
+        e->src_ip   = b_ip;
+        e->dst_ip   = a_ip;
+        e->src_port = b_port;
+        e->dst_port = a_port;
     } else {
-        int cmp = memcmp(a_ip.v6.addr, b_ip.v6.addr, 16);
-        if (cmp > 0 || (cmp == 0 && a_port > b_port)) {
-            swap = true;
-        }
-    }
-
-    if (!swap) {
         e->src_ip   = a_ip;
         e->dst_ip   = b_ip;
         e->src_port = a_port;
         e->dst_port = b_port;
-    } else {
-        e->src_ip   = b_ip;
-        e->dst_ip   = a_ip;
+    }
+
+    e->m.protocol = (lfw_u8)pkt->protocol;
+}
+
+// Normalize IPv6 tuple for bidirectional matching
+static void normalize_key_v6(const lfw_packet_t *pkt, conn_v6_t *e)
+{
+    const lfw_u8 *a_ip = pkt->ip.src.v6.addr;
+    const lfw_u8 *b_ip = pkt->ip.dst.v6.addr;
+    lfw_u16 a_port = pkt->l4.src_port.port;
+    lfw_u16 b_port = pkt->l4.dst_port.port;
+
+    int cmp = memcmp(a_ip, b_ip, 16);
+    if (cmp > 0 || (cmp == 0 && a_port > b_port)) {
+        memcpy(e->src_ip, b_ip, 16);
+        memcpy(e->dst_ip, a_ip, 16);
         e->src_port = b_port;
         e->dst_port = a_port;
+    } else {
+        memcpy(e->src_ip, a_ip, 16);
+        memcpy(e->dst_ip, b_ip, 16);
+        e->src_port = a_port;
+        e->dst_port = b_port;
     }
 
-    e->protocol = (lfw_u8)pkt->protocol;
+    e->m.protocol = (lfw_u8)pkt->protocol;
 }
 
-static lfw_u32 hash_entry(const lfw_conn_entry_t *e)
+#define SIP_ROTL(x, b) (lfw_u64)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0, v1, v2, v3)                                   \
+    do {                                                            \
+        v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32); \
+        v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;                  \
+        v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;                  \
+        v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32); \
+    } while (0)
+
+// SipHash-2-4 keyed with the per-table seed
+static lfw_u64 siphash24(const lfw_u8 *in, size_t len, const lfw_u64 key[2])
 {
-    lfw_u32 h = 0;
-    if (e->src_ip.ip_version == 4) {
-        h = e->src_ip.v4.addr ^ e->dst_ip.v4.addr;
-    } else {
-        for (int i = 0; i < 4; i++) {
-            h ^= ((lfw_u32*)e->src_ip.v6.addr)[i] ^ ((lfw_u32*)e->dst_ip.v6.addr)[i];
-        }
+    lfw_u64 v0 = 0x736f6d6570736575ULL ^ key[0];
+    lfw_u64 v1 = 0x646f72616e646f6dULL ^ key[1];
+    lfw_u64 v2 = 0x6c7967656e657261ULL ^ key[0];
+    lfw_u64 v3 = 0x7465646279746573ULL ^ key[1];
+    lfw_u64 b  = (lfw_u64)len << 56;
+    const lfw_u8 *end = in + (len & ~(size_t)7);
+
+    for (; in != end; in += 8) {
+        lfw_u64 m;
+        memcpy(&m, in, 8);
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
     }
-    h ^= ((lfw_u32)e->src_port << 16) | e->dst_port;
-    h ^= ((lfw_u32)e->protocol << 24);
-    return h;
+
+    switch (len & 7) {
+    case 7: b |= (lfw_u64)in[6] << 48; /* fall through */
+    case 6: b |= (lfw_u64)in[5] << 40; /* fall through */
+    case 5: b |= (lfw_u64)in[4] << 32; /* fall through */
+    case 4: b |= (lfw_u64)in[3] << 24; /* fall through */
+    case 3: b |= (lfw_u64)in[2] << 16; /* fall through */
+    case 2: b |= (lfw_u64)in[1] << 8;  /* fall through */
+    case 1: b |= (lfw_u64)in[0];       break;
+    case 0: break;
+    }
+
+    v3 ^= b;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+
+    v2 ^= 0xff;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+
+    return v0 ^ v1 ^ v2 ^ v3;
 }
 
-static bool entry_equal(const lfw_conn_entry_t *a,
-                        const lfw_conn_entry_t *b)
+// Hash the normalized tuple (key bytes are packed, no padding leaks in)
+static lfw_u64 hash_entry(const lfw_state_t *s, const conn_table_t *t, const conn_meta_t *e)
 {
-    if (a->src_ip.ip_version != b->src_ip.ip_version ||
-        a->src_port != b->src_port ||
-        a->dst_port != b->dst_port ||
-        a->protocol != b->protocol)
-    {
-        return false;
+    lfw_u8 buf[CONN_V6_KEY_LEN + 1];
+
+    memcpy(buf, entry_key(e), t->key_len);
+    buf[t->key_len] = e->protocol;
+
+    return siphash24(buf, t->key_len + 1, s->seed);
+}
+
+static void seed_init(lfw_u64 seed[2])
+{
+    if (getrandom(seed, 2 * sizeof(lfw_u64), GRND_NONBLOCK) == (ssize_t)(2 * sizeof(lfw_u64)))
+        return;
+
+    // Fallback when the entropy pool is not ready yet (early boot)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    seed[0] = ((lfw_u64)ts.tv_sec << 32) ^ (lfw_u64)ts.tv_nsec ^ (lfw_u64)getpid();
+    seed[1] = (lfw_u64)(uintptr_t)seed ^ ((lfw_u64)time(NULL) << 17);
+}
+
+// Record probe length of one lookup/insert (caller holds lock)
+static void probe_record(lfw_state_t *s, lfw_u32 probes)
+{
+    s->probe_stats.lookups++;
+    s->probe_stats.probes += probes;
+    if (probes > s->probe_stats.max_probe)
+        s->probe_stats.max_probe = probes;
+}
+
+// ------------------------------
+// Sequence lock
+// ------------------------------
+
+// Writers hold the mutex and keep the sequence odd while modifying tables.
+// Readers retry when the sequence was odd or changed under them.
+static inline void seq_write_begin(lfw_state_t *s)
+{
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seq_write_end(lfw_state_t *s)
+{
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Sequentially consistent so that, after reader_enter, it pairs with the
+// fence in readers_quiescent
+static inline lfw_u32 seq_read_begin(const lfw_state_t *s)
+{
+    return __atomic_load_n(&s->seq, __ATOMIC_SEQ_CST);
+}
+
+static inline bool seq_read_retry(const lfw_state_t *s, lfw_u32 seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (seq & 1) || __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != seq;
+}
+
+// ------------------------------
+// Reader tracking
+// ------------------------------
+
+static lfw_u32 g_reader_slot_next;
+static __thread lfw_u32 t_reader_slot; // Slot + 1, 0 until assigned
+
+// Count a lock-free reader in. Either readers_quiescent sees the count, or
+// the reader's seq_read_begin follows the reclaimer's fence and the reader
+// finds the tables installed before the retired one was queued.
+static inline lfw_u32 *reader_enter(lfw_state_t *s)
+{
+    if (!t_reader_slot)
+        t_reader_slot = __atomic_fetch_add(&g_reader_slot_next, 1, __ATOMIC_RELAXED) % LFW_READER_SLOTS + 1;
+
+    lfw_u32 parity = (lfw_u32)__atomic_load_n(&s->reader_epoch, __ATOMIC_RELAXED) & 1;
+    lfw_u32 *active = &s->readers[t_reader_slot - 1].active[parity];
+    __atomic_fetch_add(active, 1, __ATOMIC_SEQ_CST);
+    return active;
+}
+
+static inline void reader_exit(lfw_u32 *active)
+{
+    __atomic_fetch_sub(active, 1, __ATOMIC_RELEASE);
+}
+
+// True if no reader counted under parity is left
+static bool readers_quiescent(const lfw_state_t *s, lfw_u32 parity)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (lfw_u32 i = 0; i < LFW_READER_SLOTS; i++) {
+        if (__atomic_load_n(&s->readers[i].active[parity], __ATOMIC_ACQUIRE))
+            return false;
     }
+    return true;
+}
 
-    if (a->src_ip.ip_version == 4) {
-        return a->src_ip.v4.addr == b->src_ip.v4.addr &&
-               a->dst_ip.v4.addr == b->dst_ip.v4.addr;
-    } else {
-        return memcmp(a->src_ip.v6.addr, b->src_ip.v6.addr, 16) == 0 &&
-               memcmp(a->dst_ip.v6.addr, b->dst_ip.v6.addr, 16) == 0;
+static bool entry_equal(const conn_table_t *t, const conn_meta_t *a,
+                        const conn_meta_t *b)
+{
+    if (a->protocol != b->protocol)
+        return false;
+
+    // Constant sizes let the compiler inline the compare
+    if (t->key_len == CONN_V4_KEY_LEN)
+        return memcmp(entry_key(a), entry_key(b), CONN_V4_KEY_LEN) == 0;
+
+    return memcmp(entry_key(a), entry_key(b), CONN_V6_KEY_LEN) == 0;
+}
+
+static lfw_u64 entry_timeout(const conn_meta_t *e)
+{
+    if (e->protocol == LFW_PROTO_UDP)
+        return LFW_UDP_TIMEOUT;
+
+    switch (e->tcp_state) {
+    case CONN_TCP_SYN_SENT: return LFW_TCP_TIMEOUT_SYN_SENT;
+    case CONN_TCP_SYN_RECV: return LFW_TCP_TIMEOUT_SYN_RECV;
+    case CONN_TCP_FIN_WAIT: return LFW_TCP_TIMEOUT_FIN_WAIT;
+    case CONN_TCP_CLOSED:   return LFW_TCP_TIMEOUT_CLOSED;
+    default:                return LFW_TCP_TIMEOUT_ESTABLISHED;
     }
 }
 
-static bool entry_expired(const lfw_conn_entry_t *e, lfw_u64 now)
+static bool entry_expired(const conn_meta_t *e, lfw_u64 now)
 {
     if (now <= e->last_seen)
         return false;
 
-    if (e->protocol == LFW_PROTO_TCP)
-        return (now - e->last_seen) > LFW_TCP_TIMEOUT;
+    return (now - e->last_seen) > entry_timeout(e);
+}
 
-    if (e->protocol == LFW_PROTO_UDP)
-        return (now - e->last_seen) > LFW_UDP_TIMEOUT;
+// Advance TCP state from packet flags, returns true if the state changed
+static bool entry_update_tcp(conn_meta_t *e, lfw_u8 flags)
+{
+    if (e->protocol != LFW_PROTO_TCP)
+        return false;
+
+    bool syn = (flags & 0x02) != 0;
+    bool ack = (flags & 0x10) != 0;
+    bool fin = (flags & 0x01) != 0;
+    bool rst = (flags & 0x04) != 0;
+    lfw_u8 old = e->tcp_state;
+
+    if (rst)
+        e->tcp_state = CONN_TCP_CLOSED;
+    else if (old == CONN_TCP_SYN_SENT && syn && ack)
+        e->tcp_state = CONN_TCP_SYN_RECV;
+    else if (old == CONN_TCP_SYN_RECV && ack && !syn)
+        e->tcp_state = CONN_TCP_ESTABLISHED;
+    else if (old == CONN_TCP_ESTABLISHED && fin)
+        e->tcp_state = CONN_TCP_FIN_WAIT;
+    else if (old == CONN_TCP_FIN_WAIT && (ack || fin))
+        e->tcp_state = CONN_TCP_CLOSED;
+
+    return e->tcp_state != old;
+}
+
+// ------------------------------
+// Control byte groups
+// ------------------------------
+
+#if defined(__SSE2__)
+
+static inline lfw_u32 group_match(const lfw_u8 *g, lfw_u8 tag)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+    return (lfw_u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+}
+
+// EMPTY and DELETED are the only control bytes with the top bit set
+static inline lfw_u32 group_match_free(const lfw_u8 *g)
+{
+    return (lfw_u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+}
+
+#else
+
+static inline lfw_u32 group_match(const lfw_u8 *g, lfw_u8 tag)
+{
+    lfw_u32 bits = 0;
+    for (int i = 0; i < LFW_GROUP_WIDTH; i++)
+        bits |= (lfw_u32)(g[i] == tag) << i;
+    return bits;
+}
+
+static inline lfw_u32 group_match_free(const lfw_u8 *g)
+{
+    lfw_u32 bits = 0;
+    for (int i = 0; i < LFW_GROUP_WIDTH; i++)
+        bits |= (lfw_u32)(g[i] >> 7) << i;
+    return bits;
+}
+
+#endif
+
+static inline lfw_u32 group_match_empty(const lfw_u8 *g)
+{
+    return group_match(g, CTRL_EMPTY);
+}
+
+// Write a control byte, mirroring the first group past the end so that
+// a group load starting anywhere in the table never needs to wrap
+static inline void set_ctrl(conn_table_t *t, lfw_u32 idx, lfw_u8 v)
+{
+    t->ctrl[idx] = v;
+    if (idx < LFW_GROUP_WIDTH)
+        t->ctrl[t->cap + idx] = v;
+}
+
+static inline lfw_u8 hash_tag(lfw_u64 h)
+{
+    return (lfw_u8)(h & 0x7F);
+}
+
+// ------------------------------
+// Table storage
+// ------------------------------
+
+static lfw_u32 round_pow2(lfw_u32 v)
+{
+    lfw_u32 p = LFW_GROUP_WIDTH;
+    while (p < v && p < 0x80000000u)
+        p <<= 1;
+    return p;
+}
+
+static void wheel_reset(conn_table_t *t)
+{
+    for (lfw_u32 b = 0; b < LFW_WHEEL_SLOTS; b++)
+        t->wheel[b] = LFW_WHEEL_NIL;
+}
+
+// Allocate control bytes, entries and links as one mapping. Large tables
+// try explicit hugepages first and fall back to transparent hugepages.
+static bool table_init(conn_table_t *t, lfw_u32 cap, size_t entry_size, bool hugepages)
+{
+    size_t ctrl_size  = ((size_t)cap + LFW_GROUP_WIDTH + 63) & ~(size_t)63;
+    size_t entry_sz   = (((size_t)cap * entry_size) + 63) & ~(size_t)63;
+    size_t links_size = (size_t)cap * sizeof(conn_link_t);
+    size_t total      = ctrl_size + entry_sz + links_size;
+    void *mem = MAP_FAILED;
+
+    memset(t, 0, sizeof(*t));
+
+    if (hugepages && total >= LFW_HUGEPAGE_SIZE) {
+        size_t huge_total = (total + LFW_HUGEPAGE_SIZE - 1) & ~(LFW_HUGEPAGE_SIZE - 1);
+        mem = mmap(NULL, huge_total, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED)
+            total = huge_total;
+    }
+
+    if (mem == MAP_FAILED) {
+        mem = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            return false;
+        if (hugepages && total >= LFW_HUGEPAGE_SIZE)
+            madvise(mem, total, MADV_HUGEPAGE);
+    }
+
+    t->mem        = mem;
+    t->mem_size   = total;
+    t->ctrl       = (lfw_u8 *)mem;
+    t->entries    = (lfw_u8 *)mem + ctrl_size;
+    t->links      = (conn_link_t *)((lfw_u8 *)mem + ctrl_size + entry_sz);
+    t->entry_size = entry_size;
+    t->key_len    = entry_size - sizeof(conn_meta_t);
+    t->cap        = cap;
+    t->mask       = cap - 1;
+
+    memset(t->ctrl, CTRL_EMPTY, (size_t)cap + LFW_GROUP_WIDTH);
+    wheel_reset(t);
+    return true;
+}
+
+static void table_free(conn_table_t *t)
+{
+    if (t->mem)
+        munmap(t->mem, t->mem_size);
+    t->mem = NULL;
+}
+
+// Defer unmapping a replaced table until no lock-free reader can still
+// be probing it (see retired_reclaim)
+static void table_retire(lfw_state_t *s, conn_table_t *t)
+{
+    retired_mem_t *r = malloc(sizeof(*r));
+    if (!r) {
+        // Cannot track it, leak rather than risk a reader fault
+        t->mem = NULL;
+        return;
+    }
+
+    r->mem   = t->mem;
+    r->size  = t->mem_size;
+    r->epoch = s->reader_epoch;
+    r->next  = s->retired;
+    s->retired = r;
+    t->mem = NULL;
+}
+
+// Unmap retired tables once every reader that could have loaded their
+// pointers has left. The reader epoch only advances when no reader is
+// counted under the parity it advances to, so new readers move to a
+// drained parity while older ones finish under the other. Two advances
+// after a retirement, both parities have been seen empty since, however
+// long a reader was descheduled. Caller holds the lock, after
+// seq_write_end.
+static void retired_reclaim(lfw_state_t *s, bool all)
+{
+    if (!s->retired)
+        return;
+
+    for (int i = 0; i < 2 && !all; i++) {
+        lfw_u64 epoch = s->reader_epoch;
+        if (!readers_quiescent(s, (lfw_u32)(epoch + 1) & 1))
+            break;
+        __atomic_store_n(&s->reader_epoch, epoch + 1, __ATOMIC_RELAXED);
+    }
+
+    retired_mem_t **pp = &s->retired;
+    while (*pp) {
+        retired_mem_t *r = *pp;
+        if (all || r->epoch + 2 <= s->reader_epoch) {
+            *pp = r->next;
+            munmap(r->mem, r->size);
+            free(r);
+        } else {
+            pp = &r->next;
+        }
+    }
+}
+
+// Find the slot holding key, or LFW_WHEEL_NIL. Sets *free_idx (when not
+// NULL) to the first EMPTY/DELETED slot on the probe path and *probes to
+// the number of groups visited.
+static lfw_u32 table_find(const conn_table_t *t, const conn_meta_t *key,
+                          lfw_u64 h, lfw_u32 *free_idx, lfw_u32 *probes)
+{
+    lfw_u8 tag = hash_tag(h);
+    lfw_u32 pos = (lfw_u32)(h >> 7) & t->mask;
+    lfw_u32 groups = t->cap / LFW_GROUP_WIDTH;
+
+    if (free_idx)
+        *free_idx = LFW_WHEEL_NIL;
+
+    // Triangular probing over groups visits every group once
+    for (lfw_u32 n = 1; n <= groups; n++) {
+        const lfw_u8 *g = t->ctrl + pos;
+
+        for (lfw_u32 bits = group_match(g, tag); bits; bits &= bits - 1) {
+            lfw_u32 idx = (pos + (lfw_u32)__builtin_ctz(bits)) & t->mask;
+            if (entry_equal(t, table_entry(t, idx), key)) {
+                *probes = n;
+                return idx;
+            }
+        }
+
+        if (free_idx && *free_idx == LFW_WHEEL_NIL) {
+            lfw_u32 free_bits = group_match_free(g);
+            if (free_bits)
+                *free_idx = (pos + (lfw_u32)__builtin_ctz(free_bits)) & t->mask;
+        }
+
+        if (group_match_empty(g)) {
+            *probes = n;
+            return LFW_WHEEL_NIL;
+        }
+
+        pos = (pos + n * LFW_GROUP_WIDTH) & t->mask;
+    }
+
+    *probes = groups;
+    return LFW_WHEEL_NIL;
+}
+
+// ------------------------------
+// Timer wheel
+// ------------------------------
+
+// Link slot into the bucket of the first tick at which it would be expired.
+// Refreshing last_seen does not move the entry: the bucket is revisited
+// when it fires and the entry is rescheduled if it is still alive.
+static void wheel_link(conn_table_t *t, lfw_u32 idx)
+{
+    conn_meta_t *e = table_entry(t, idx);
+    conn_link_t *l = &t->links[idx];
+    lfw_u64 tick = (lfw_u64)e->last_seen + entry_timeout(e) + 1;
+    lfw_u16 b = (lfw_u16)(tick & (LFW_WHEEL_SLOTS - 1));
+
+    e->wheel_bucket = b;
+    l->prev = LFW_WHEEL_NIL;
+    l->next = t->wheel[b];
+    if (l->next != LFW_WHEEL_NIL)
+        t->links[l->next].prev = idx;
+    t->wheel[b] = idx;
+}
+
+static void wheel_unlink(conn_table_t *t, lfw_u32 idx)
+{
+    conn_link_t *l = &t->links[idx];
+
+    if (l->prev != LFW_WHEEL_NIL)
+        t->links[l->prev].next = l->next;
+    else
+        t->wheel[table_entry(t, idx)->wheel_bucket] = l->next;
+
+    if (l->next != LFW_WHEEL_NIL)
+        t->links[l->next].prev = l->prev;
+
+    l->next = LFW_WHEEL_NIL;
+    l->prev = LFW_WHEEL_NIL;
+}
+
+// Fire one bucket: expire dead entries, reschedule refreshed ones
+static void wheel_fire(conn_table_t *t, lfw_u32 b, lfw_u64 now)
+{
+    lfw_u32 idx = t->wheel[b];
+    t->wheel[b] = LFW_WHEEL_NIL;
+
+    while (idx != LFW_WHEEL_NIL) {
+        lfw_u32 next = t->links[idx].next;
+
+        if (entry_expired(table_entry(t, idx), now)) {
+            set_ctrl(t, idx, CTRL_DELETED);
+            t->links[idx].next = LFW_WHEEL_NIL;
+            t->links[idx].prev = LFW_WHEEL_NIL;
+            t->count--;
+            t->tombstones++;
+        } else {
+            wheel_link(t, idx);
+        }
+
+        idx = next;
+    }
+}
+
+// Rehash all live entries into a fresh table to drop tombstones
+static void table_rebuild(lfw_state_t *s, conn_table_t *t)
+{
+    conn_table_t fresh;
+    if (!table_init(&fresh, t->cap, t->entry_size, s->hugepages))
+        return;
+
+    for (lfw_u32 i = 0; i < t->cap; i++) {
+        if (t->ctrl[i] & 0x80)
+            continue;
+
+        const conn_meta_t *e = table_entry(t, i);
+        lfw_u64 h = hash_entry(s, t, e);
+        lfw_u32 pos = (lfw_u32)(h >> 7) & fresh.mask;
+
+        for (lfw_u32 n = 1; ; n++) {
+            lfw_u32 bits = group_match_empty(fresh.ctrl + pos);
+            if (bits) {
+                lfw_u32 idx = (pos + (lfw_u32)__builtin_ctz(bits)) & fresh.mask;
+                memcpy(table_entry(&fresh, idx), e, t->entry_size);
+                set_ctrl(&fresh, idx, hash_tag(h));
+                wheel_link(&fresh, idx);
+                fresh.count++;
+                break;
+            }
+            pos = (pos + n * LFW_GROUP_WIDTH) & fresh.mask;
+        }
+    }
+
+    table_retire(s, t);
+    *t = fresh;
+}
+
+// ------------------------------
+// Shared lookup/insert paths
+// ------------------------------
+
+// Locked lookup, also used when a hit has to change the TCP state
+static bool table_established(lfw_state_t *s, conn_table_t *t,
+                              const conn_meta_t *key, lfw_u64 h,
+                              lfw_u8 tcp_flags, lfw_u64 now)
+{
+    lfw_u32 probes;
+    lfw_u32 idx = table_find(t, key, h, NULL, &probes);
+    probe_record(s, probes);
+    if (idx == LFW_WHEEL_NIL)
+        return false;
+
+    conn_meta_t *slot = table_entry(t, idx);
 
+    // Expired but not yet reaped by the timer wheel
+    if (entry_expired(slot, now))
+        return false;
+
+    slot->last_seen = (lfw_u32)now;
+    if (entry_update_tcp(slot, tcp_flags)) {
+        wheel_unlink(t, idx);
+        wheel_link(t, idx);
+    }
     return true;
 }
 
+typedef enum {
+    LOOKUP_MISS = 0,
+    LOOKUP_HIT,
+    LOOKUP_LOCKED  // Needs the locked path (contention or TCP state change)
+} lookup_result_t;
+
+// Lock-free lookup under the sequence lock, counted as a reader so the
+// mapping it probes stays mapped. A hit only writes last_seen, and only
+// when the one-second value changes. A racing store that lands on a slot
+// reused or retired meanwhile merely extends that entry's life by less
+// than a second, so it is left unsynchronized.
+static lookup_result_t table_lookup_fast(lfw_state_t *s, const conn_table_t *t,
+                                         const conn_meta_t *key, lfw_u64 h,
+                                         lfw_u8 tcp_flags, lfw_u64 now)
+{
+    lfw_u32 *active = reader_enter(s);
+    lookup_result_t res = LOOKUP_LOCKED;
+
+    for (int attempt = 0; attempt < LFW_SEQ_RETRIES; attempt++) {
+        lfw_u32 seq = seq_read_begin(s);
+        if (seq & 1) {
+            cpu_relax();
+            continue;
+        }
+
+        lfw_u32 probes;
+        lfw_u32 idx = table_find(t, key, h, NULL, &probes);
+        conn_meta_t *slot = NULL;
+        conn_meta_t meta;
+
+        if (idx != LFW_WHEEL_NIL) {
+            slot = table_entry(t, idx);
+            memcpy(&meta, slot, sizeof(meta));
+        }
+
+        if (seq_read_retry(s, seq))
+            continue;
+
+        if (!slot || entry_expired(&meta, now)) {
+            res = LOOKUP_MISS;
+        } else if (!entry_update_tcp(&meta, tcp_flags)) {
+            if (meta.last_seen != (lfw_u32)now)
+                __atomic_store_n(&slot->last_seen, (lfw_u32)now, __ATOMIC_RELAXED);
+            res = LOOKUP_HIT;
+        }
+        break;
+    }
+
+    reader_exit(active);
+    return res;
+}
+
+static void table_add(lfw_state_t *s, conn_table_t *t,
+                      conn_meta_t *key, lfw_u64 h, lfw_u8 tcp_flags)
+{
+    lfw_u32 max_load = t->cap - t->cap / 8;
+
+    // Too many tombstones left on the probe paths: compact first. A table
+    // full of live entries gains nothing from it.
+    if (t->count < max_load && t->count + t->tombstones >= max_load)
+        table_rebuild(s, t);
+
+    lfw_u32 free_idx;
+    lfw_u32 probes;
+    lfw_u32 idx = table_find(t, key, h, &free_idx, &probes);
+    probe_record(s, probes);
+
+    if (idx != LFW_WHEEL_NIL) {
+        conn_meta_t *slot = table_entry(t, idx);
+
+        // Expired but not yet reaped: start over as a fresh insert would,
+        // so the verdict does not depend on when the wheel last fired
+        if (entry_expired(slot, key->last_seen)) {
+            wheel_unlink(t, idx);
+            memcpy(slot, key, t->entry_size);
+            wheel_link(t, idx);
+            return;
+        }
+
+        slot->last_seen = key->last_seen;
+        if (entry_update_tcp(slot, tcp_flags)) {
+            wheel_unlink(t, idx);
+            wheel_link(t, idx);
+        }
+        return;
+    }
+
+    // Full: tracked flows above still refresh, new ones are not tracked
+    if (free_idx == LFW_WHEEL_NIL || t->count >= max_load)
+        return;
+
+    if (t->ctrl[free_idx] == CTRL_DELETED)
+        t->tombstones--;
+
+    memcpy(table_entry(t, free_idx), key, t->entry_size);
+    set_ctrl(t, free_idx, hash_tag(h));
+    wheel_link(t, free_idx);
+    t->count++;
+}
+
+static void table_cleanup(lfw_state_t *s, conn_table_t *t, lfw_u64 from, lfw_u64 now)
+{
+    for (lfw_u64 tick = from; tick <= now; tick++) {
+        wheel_fire(t, (lfw_u32)(tick & (LFW_WHEEL_SLOTS - 1)), now);
+    }
+
+    // Rebuild hash table if tombstones exceed 25% of capacity to keep probe sequences short
+    if (t->tombstones > t->cap / 4) {
+        table_rebuild(s, t);
+    }
+}
+
 // ------------------------------
 // Public API
 // ------------------------------
@@ -145,9 +898,7 @@ static void *state_cleanup_loop(void *arg)
 {
     lfw_state_t *state = (lfw_state_t *)arg;
     while (state->cleanup_running) {
-        for (int i = 0; i < 10 && state->cleanup_running; i++) {
-            usleep(1000000);
-        }
+        usleep(1000000);
         if (!state->cleanup_running)
             break;
         lfw_state_cleanup(state);
@@ -157,30 +908,63 @@ static void *state_cleanup_loop(void *arg)
 
 lfw_state_t *lfw_state_create(void)
 {
-    lfw_state_t *s = malloc(sizeof(*s));
+    lfw_state_config_t config = {
+        .capacity_v4 = LFW_STATE_TABLE_SIZE,
+        .capacity_v6 = LFW_STATE_TABLE_SIZE,
+        .hugepages   = false
+    };
+
+    return lfw_state_create_with_config(&config);
+}
+
+lfw_state_t *lfw_state_create_with_config(const lfw_state_config_t *config)
+{
+    if (!config)
+        return NULL;
+
+    lfw_state_t *s = aligned_alloc(64, sizeof(*s));
     if (!s)
         return NULL;
 
-    s->cap   = LFW_STATE_TABLE_SIZE;
-    s->count = 0;
-    s->slots = calloc(s->cap, sizeof(lfw_conn_entry_t));
-    if (!s->slots) {
+    lfw_u32 cap_v4 = round_pow2(config->capacity_v4 ? config->capacity_v4 : LFW_STATE_TABLE_SIZE);
+    lfw_u32 cap_v6 = round_pow2(config->capacity_v6 ? config->capacity_v6 : LFW_STATE_TABLE_SIZE);
+
+    s->hugepages = config->hugepages;
+    s->seq = 0;
+    s->retired = NULL;
+    s->reader_epoch = 0;
+    memset(s->readers, 0, sizeof(s->readers));
+    memset(&s->probe_stats, 0, sizeof(s->probe_stats));
+    seed_init(s->seed);
+    s->clock = config->clock;
+    s->wheel_now = now_sec(s);
+
+    if (!table_init(&s->v4, cap_v4, sizeof(conn_v4_t), s->hugepages)) {
         free(s);
         return NULL;
     }
 
-    for (lfw_u32 i = 0; i < s->cap; i++)
-        entry_set_empty(&s->slots[i]);
+    if (!table_init(&s->v6, cap_v6, sizeof(conn_v6_t), s->hugepages)) {
+        table_free(&s->v4);
+        free(s);
+        return NULL;
+    }
 
     if (pthread_mutex_init(&s->lock, NULL) != 0) {
-        free(s->slots);
+        table_free(&s->v6);
+        table_free(&s->v4);
         free(s);
         return NULL;
     }
 
-    s->cleanup_running = true;
-    if (pthread_create(&s->cleanup_thread, NULL, state_cleanup_loop, s) != 0) {
-        s->cleanup_running = false;
+    // A caller-supplied clock is advanced by the caller, which also
+    // drives expiry; sleeping in real time would not follow it
+    s->cleanup_running = false;
+    if (!s->clock.now) {
+        s->cleanup_running = true;
+        if (pthread_create(&s->cleanup_thread, NULL, state_cleanup_loop, s) != 0) {
+            s->cleanup_running = false;
+        }
     }
 
     return s;
@@ -197,113 +981,140 @@ void lfw_state_destroy(lfw_state_t *state)
     }
 
     pthread_mutex_destroy(&state->lock);
-    free(state->slots);
+    retired_reclaim(state, true);
+    table_free(&state->v6);
+    table_free(&state->v4);
     free(state);
 }
 
-bool lfw_state_established(lfw_state_t *state,
-                            const lfw_packet_t *packet)
+// Normalize and hash the flow tuple; family stays 0 for untracked protocols
+static void state_key_init(const lfw_state_t *state, const lfw_packet_t *packet,
+                           lfw_state_key_t *key)
 {
-    if (!state || !packet)
-        return false;
+    key->family = 0;
+    key->hash = 0;
 
     if (packet->protocol != LFW_PROTO_TCP &&
         packet->protocol != LFW_PROTO_UDP)
-        return false;
+        return;
 
-    lfw_conn_entry_t key = {0};
-    normalize_key(packet, &key);
+    if (packet->ip.src.ip_version == 4) {
+        conn_v4_t *e = (conn_v4_t *)key->data;
+        memset(e, 0, sizeof(*e));
+        normalize_key_v4(packet, e);
+        key->family = 4;
+        key->hash = hash_entry(state, &state->v4, &e->m);
+    } else {
+        conn_v6_t *e = (conn_v6_t *)key->data;
+        memset(e, 0, sizeof(*e));
+        normalize_key_v6(packet, e);
+        key->family = 6;
+        key->hash = hash_entry(state, &state->v6, &e->m);
+    }
+}
 
-    lfw_u32 idx = hash_entry(&key) % state->cap;
-    lfw_u64 now = now_sec();
+static inline conn_table_t *key_table(lfw_state_t *state, const lfw_state_key_t *key)
+{
+    return key->family == 4 ? &state->v4 : &state->v6;
+}
 
-    pthread_mutex_lock(&state->lock);
+void lfw_state_prepare(lfw_state_t *state,
+                       const lfw_packet_t *packet,
+                       lfw_state_key_t *key)
+{
+    if (!state || !packet || !key)
+        return;
+
+    state_key_init(state, packet, key);
+    if (!key->family)
+        return;
 
-    for (lfw_u32 i = 0; i < state->cap; i++) {
-        lfw_conn_entry_t *slot = &state->slots[idx];
+    // Prefetch never faults, so a mapping retired meanwhile is harmless
+    const conn_table_t *t = key_table(state, key);
+    lfw_u32 pos = (lfw_u32)(key->hash >> 7) & t->mask;
+    __builtin_prefetch(t->ctrl + pos, 0, 3);
+    __builtin_prefetch(t->entries + (size_t)pos * t->entry_size, 1, 3);
+}
 
-        if (slot->state == SLOT_EMPTY) {
-            pthread_mutex_unlock(&state->lock);
-            return false;
-        }
+bool lfw_state_established_key(lfw_state_t *state,
+                                const lfw_packet_t *packet,
+                                const lfw_state_key_t *key)
+{
+    if (!state || !packet || !key || !key->family)
+        return false;
 
-        if (slot->state == SLOT_OCCUPIED) {
-            if (entry_expired(slot, now)) {
-                slot->state = SLOT_TOMBSTONE;
-                state->count--;
-            } else if (entry_equal(slot, &key)) {
-                slot->last_seen = now;
-                pthread_mutex_unlock(&state->lock);
-                return true;
-            }
-        }
+    lfw_u64 now = now_sec(state);
+    conn_table_t *t = key_table(state, key);
+    const conn_meta_t *m = (const conn_meta_t *)key->data;
 
-        idx = (idx + 1) % state->cap;
-    }
+    lookup_result_t res = table_lookup_fast(state, t, m, key->hash, packet->tcp_flags, now);
+    if (res != LOOKUP_LOCKED)
+        return res == LOOKUP_HIT;
 
+    pthread_mutex_lock(&state->lock);
+    seq_write_begin(state);
+    bool found = table_established(state, t, m, key->hash, packet->tcp_flags, now);
+    seq_write_end(state);
     pthread_mutex_unlock(&state->lock);
-    return false;
+
+    return found;
 }
 
-void lfw_state_add(lfw_state_t *state,
-                    const lfw_packet_t *packet)
+bool lfw_state_established(lfw_state_t *state,
+                            const lfw_packet_t *packet)
 {
     if (!state || !packet)
-        return;
-
-    if (packet->protocol != LFW_PROTO_TCP &&
-        packet->protocol != LFW_PROTO_UDP)
-        return;
+        return false;
 
-    lfw_conn_entry_t key = {0};
-    normalize_key(packet, &key);
-    key.last_seen = now_sec();
-    key.state = SLOT_OCCUPIED;
+    lfw_state_key_t key;
+    state_key_init(state, packet, &key);
 
-    pthread_mutex_lock(&state->lock);
+    return lfw_state_established_key(state, packet, &key);
+}
 
-    if (state->count >= state->cap) {
-        pthread_mutex_unlock(&state->lock);
-        return;
-    }
+// Initial TCP state; a connection picked up mid-stream is treated as established
+static lfw_u8 initial_tcp_state(const lfw_packet_t *packet)
+{
+    if (packet->protocol != LFW_PROTO_TCP)
+        return CONN_TCP_NONE;
 
-    lfw_u32 idx = hash_entry(&key) % state->cap;
-    int first_tombstone_idx = -1;
+    bool syn = (packet->tcp_flags & 0x02) != 0;
+    bool ack = (packet->tcp_flags & 0x10) != 0;
+    return (syn && !ack) ? CONN_TCP_SYN_SENT : CONN_TCP_ESTABLISHED;
+}
 
-    for (lfw_u32 i = 0; i < state->cap; i++) {
-        lfw_conn_entry_t *slot = &state->slots[idx];
+void lfw_state_add_key(lfw_state_t *state,
+                       const lfw_packet_t *packet,
+                       const lfw_state_key_t *key)
+{
+    if (!state || !packet || !key || !key->family)
+        return;
 
-        if (slot->state == SLOT_EMPTY) {
-            int insert_idx = (first_tombstone_idx != -1) ? first_tombstone_idx : (int)idx;
-            state->slots[insert_idx] = key;
-            state->count++;
-            pthread_mutex_unlock(&state->lock);
-            return;
-        }
+    conn_table_t *t = key_table(state, key);
+    lfw_u8 entry[sizeof(conn_v6_t)] __attribute__((aligned(8)));
+    conn_meta_t *m = (conn_meta_t *)entry;
 
-        if (slot->state == SLOT_TOMBSTONE) {
-            if (first_tombstone_idx == -1) {
-                first_tombstone_idx = (int)idx;
-            }
-        }
+    memcpy(entry, key->data, t->entry_size);
+    m->last_seen = (lfw_u32)now_sec(state);
+    m->tcp_state = initial_tcp_state(packet);
 
-        if (slot->state == SLOT_OCCUPIED) {
-            if (entry_equal(slot, &key)) {
-                slot->last_seen = key.last_seen;
-                pthread_mutex_unlock(&state->lock);
-                return;
-            }
-        }
+    pthread_mutex_lock(&state->lock);
+    seq_write_begin(state);
+    table_add(state, t, m, key->hash, packet->tcp_flags);
+    seq_write_end(state);
+    pthread_mutex_unlock(&state->lock);
+}
 
-        idx = (idx + 1) % state->cap;
-    }
+void lfw_state_add(lfw_state_t *state,
+                    const lfw_packet_t *packet)
+{
+    if (!state || !packet)
+        return;
 
-    if (first_tombstone_idx != -1) {
-        state->slots[first_tombstone_idx] = key;
-        state->count++;
-    }
+    lfw_state_key_t key;
+    state_key_init(state, packet, &key);
 
-    pthread_mutex_unlock(&state->lock);
+    lfw_state_add_key(state, packet, &key);
 }
 
 void lfw_state_cleanup(lfw_state_t *state)
@@ -311,50 +1122,25 @@ void lfw_state_cleanup(lfw_state_t *state)
     if (!state)
         return;
 
-    lfw_u64 now = now_sec();
+    lfw_u64 now = now_sec(state);
 
     pthread_mutex_lock(&state->lock);
 
-    lfw_u32 tombstones = 0;
-    for (lfw_u32 i = 0; i < state->cap; i++) {
-        lfw_conn_entry_t *slot = &state->slots[i];
-        if (slot->state == SLOT_OCCUPIED) {
-            if (entry_expired(slot, now)) {
-                slot->state = SLOT_TOMBSTONE;
-                state->count--;
-            }
-        }
-        if (slot->state == SLOT_TOMBSTONE) {
-            tombstones++;
-        }
+    // Fire every bucket between the last processed tick and now. After a
+    // long stall one full revolution visits every linked entry.
+    if (now > state->wheel_now) {
+        lfw_u64 ticks = now - state->wheel_now;
+        if (ticks > LFW_WHEEL_SLOTS)
+            ticks = LFW_WHEEL_SLOTS;
+
+        seq_write_begin(state);
+        table_cleanup(state, &state->v4, now - ticks + 1, now);
+        table_cleanup(state, &state->v6, now - ticks + 1, now);
+        seq_write_end(state);
+        state->wheel_now = now;
     }
 
-    // Rebuild hash table if tombstones exceed 25% of capacity to prevent linear probing degradation
-    if (tombstones > state->cap / 4) {
-        lfw_conn_entry_t *new_slots = calloc(state->cap, sizeof(lfw_conn_entry_t));
-        if (new_slots) {
-            for (lfw_u32 i = 0; i < state->cap; i++) {
-                entry_set_empty(&new_slots[i]);
-            }
-
-            lfw_u32 new_count = 0;
-            for (lfw_u32 i = 0; i < state->cap; i++) {
-                if (state->slots[i].state == SLOT_OCCUPIED) {
-                    lfw_conn_entry_t entry = state->slots[i];
-                    lfw_u32 idx = hash_entry(&entry) % state->cap;
-                    while (new_slots[idx].state == SLOT_OCCUPIED) {
-                        idx = (idx + 1) % state->cap;
-                    }
-                    new_slots[idx] = entry;
-                    new_count++;
-                }
-            }
-
-            free(state->slots);
-            state->slots = new_slots;
-            state->count = new_count;
-        }
-    }
+    retired_reclaim(state, false);
 
     pthread_mutex_unlock(&state->lock);
 }
@@ -365,7 +1151,21 @@ lfw_u32 lfw_state_get_count(lfw_state_t *state)
         return 0;
 
     pthread_mutex_lock(&state->lock);
-    lfw_u32 count = state->count;
+    lfw_u32 count = state->v4.count + state->v6.count;
     pthread_mutex_unlock(&state->lock);
     return count;
 }
+
+void lfw_state_get_probe_stats(lfw_state_t *state, lfw_state_probe_stats_t *out)
+{
+    if (!out)
+        return;
+
+    memset(out, 0, sizeof(*out));
+    if (!state)
+        return;
+
+    pthread_mutex_lock(&state->lock);
+    *out = state->probe_stats;
+    pthread_mutex_unlock(&state->lock);
+}
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_stats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A reader gives up after this many copies torn by concurrent updates
+#define STATS_READ_RETRIES 1000
+
+// Everything from here on is rewritten by each update
+#define STATS_BODY offsetof(lfw_stats_t, updated_ns)
+
+struct lfw_stats_writer {
+    char         path[PATH_MAX];
+    lfw_stats_t *region;
+};
+
+struct lfw_stats_reader {
+    const lfw_stats_t *region;
+    size_t             map_size;
+    size_t             copy;   // Bytes of the layout both sides know
+};
+
+lfw_stats_writer_t *lfw_stats_writer_open(const char *path, lfw_u32 interval_ms)
+{
+    char tmp[PATH_MAX + 8];
+
+    if (!path || !path[0] || strlen(path) >= PATH_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    lfw_stats_writer_t *writer = calloc(1, sizeof(*writer));
+    if (!writer)
+        return NULL;
+    strcpy(writer->path, path);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(writer);
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(lfw_stats_t)) != 0) {
+        int err = errno;
+        close(fd);
+        unlink(tmp);
+        free(writer);
+        errno = err;
+        return NULL;
+    }
+
+    void *map = mmap(NULL, sizeof(lfw_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        unlink(tmp);
+        free(writer);
+        errno = err;
+        return NULL;
+    }
+    writer->region = map;
+
+    // The file starts zeroed, so the sequence counter is even and every
+    // counter reads as zero until the first update
+    memcpy(writer->region->magic, LFW_STATS_MAGIC, sizeof(writer->region->magic));
+    writer->region->version     = LFW_STATS_VERSION;
+    writer->region->size        = sizeof(lfw_stats_t);
+    writer->region->pid         = (lfw_u32)getpid();
+    writer->region->interval_ms = interval_ms;
+
+    if (rename(tmp, path) != 0) {
+        err = errno;
+        munmap(map, sizeof(lfw_stats_t));
+        unlink(tmp);
+        free(writer);
+        errno = err;
+        return NULL;
+    }
+
+    return writer;
+}
+
+void lfw_stats_writer_publish(lfw_stats_writer_t *writer, const lfw_stats_t *snapshot)
+{
+    if (!writer || !snapshot)
+        return;
+
+    lfw_stats_t *region = writer->region;
+    lfw_u64 seq = region->seq;
+
+    __atomic_store_n(&region->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((char *)region + STATS_BODY, (const char *)snapshot + STATS_BODY, sizeof(*region) - STATS_BODY);
+    __atomic_store_n(&region->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void lfw_stats_writer_close(lfw_stats_writer_t *writer)
+{
+    if (!writer)
+        return;
+
+    munmap(writer->region, sizeof(lfw_stats_t));
+    unlink(writer->path);
+    free(writer);
+}
+
+lfw_stats_reader_t *lfw_stats_reader_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    if (st.st_size < (off_t)STATS_BODY) {
+        close(fd);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    size_t map_size = (size_t)st.st_size;
+    void *map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = err;
+        return NULL;
+    }
+
+    const lfw_stats_t *region = map;
+    if (memcmp(region->magic, LFW_STATS_MAGIC, sizeof(region->magic)) != 0 ||
+        region->version != LFW_STATS_VERSION || region->size < STATS_BODY) {
+        munmap(map, map_size);
+        errno = EPROTO;
+        return NULL;
+    }
+
+    lfw_stats_reader_t *reader = calloc(1, sizeof(*reader));
+    if (!reader) {
+        munmap(map, map_size);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    reader->region   = region;
+    reader->map_size = map_size;
+    reader->copy     = region->size < map_size ? region->size : map_size;
+    if (reader->copy > sizeof(lfw_stats_t))
+        reader->copy = sizeof(lfw_stats_t);
+    return reader;
+}
+
+lfw_status_t lfw_stats_reader_read(lfw_stats_reader_t *reader, lfw_stats_t *snapshot)
+{
+    if (!reader || !snapshot)
+        return LFW_ERR_INVALID;
+
+    for (int i = 0; i < STATS_READ_RETRIES; i++) {
+        lfw_u64 begin = __atomic_load_n(&reader->region->seq, __ATOMIC_ACQUIRE);
+        if (begin & 1) {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(snapshot, reader->region, reader->copy);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&reader->region->seq, __ATOMIC_RELAXED) == begin) {
+            memset((char *)snapshot + reader->copy, 0, sizeof(*snapshot) - reader->copy);
+            return LFW_OK;
+        }
+    }
+
+    return LFW_ERR_GENERIC;
+}
+
+void lfw_stats_reader_close(lfw_stats_reader_t *reader)
+{
+    if (!reader)
+        return;
+
+    munmap((void *)reader->region, reader->map_size);
+    free(reader);
+}
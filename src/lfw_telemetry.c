@@ -0,0 +1,768 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_telemetry.h"
+
+#include <arpa/inet.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lfw_bpf.h"
+#include "lfw_bpf_shared.h"
+#include "lfw_log.h"
+
+#define TELEMETRY_DEFAULT_WORKERS 1
+#define TELEMETRY_MAX_WORKERS     16
+#define TELEMETRY_DEFAULT_BUDGET  1024
+
+// Longest a record submitted without a wakeup waits to be drained
+#define TELEMETRY_POLL_MS 100
+
+// Poll timeout once every ring was found empty and the kernel wakes the
+// consumer on the next event instead. It bounds the delay of an event
+// that raced the switch, and paces the flow sweep with aggregation on.
+#define TELEMETRY_IDLE_MS  10000
+#define TELEMETRY_SWEEP_MS 1000
+
+// Records per worker batch, and batches queued per worker
+#define TELEMETRY_BATCH       64
+#define TELEMETRY_QUEUE_DEPTH 64
+
+// Interval of loss reports in seconds
+#define TELEMETRY_REPORT_SEC 10
+
+// Returned by the sample callback to end a pass once the budget is spent;
+// libbpf stops consuming and passes it back from ring_buffer__consume
+#define BUDGET_SPENT (-EAGAIN)
+
+typedef struct {
+    lfw_u32          count;
+    struct lfw_event events[TELEMETRY_BATCH];
+} telemetry_batch_t;
+
+typedef struct {
+    pthread_t          thread;
+    pthread_mutex_t    lock;
+    pthread_cond_t     cond;   // Queue became non-empty or closed
+    telemetry_batch_t *ring;
+    lfw_u32            head;
+    lfw_u32            tail;
+    bool               closed;
+} telemetry_worker_t;
+
+// One events ring with its own consumer, so rings can be drained in any order
+typedef struct {
+    int                 fd;  // Own duplicate: the rings are pinned and outlive the object
+    struct ring_buffer *rb;
+} telemetry_ring_t;
+
+// Counters of one drain pass, published when the pass ends
+typedef struct {
+    lfw_u64 received;
+    lfw_u64 rate_limited;
+    lfw_u64 queue_dropped;
+} telemetry_pass_t;
+
+static struct {
+    lfw_telemetry_config_t config;
+    bool                   started;
+    bool                   running;
+
+    // Rings of each class, drop rings first; ring_next is where the next
+    // pass over a class starts, so per-CPU rings are served in turn
+    telemetry_ring_t   *rings;
+    lfw_u32             ring_count[LFW_EVENTS_CLASSES];
+    lfw_u32             ring_next[LFW_EVENTS_CLASSES];
+    int                 epoll_fd;
+    int                 stop_fd;     // eventfd in the epoll set, written by lfw_telemetry_stop
+
+    int                 stats_fd;    // Own duplicates, like the ring fds
+    int                 agg_fd;
+    int                 idle_fd;
+    bool                idle;        // Set in telemetry_idle
+    struct lfw_agg_val *agg_values;  // One per possible CPU
+    int                 agg_cpus;
+    pthread_t           drain_thread;
+
+    telemetry_worker_t *workers;
+    lfw_u32             worker_count;
+    lfw_u32             next_worker;
+    telemetry_batch_t   pending;     // Batch being filled by the drain thread
+
+    // Drain thread state
+    telemetry_pass_t pass;
+    lfw_u32          pass_records;
+    lfw_u64          pass_sec;
+    lfw_u64          pass_timestamp; // Newest event timestamp of the pass
+    lfw_u64          rate_sec;
+    lfw_u32          rate_count;
+
+    // Totals, read by other threads
+    lfw_u64 received;
+    lfw_u64 rate_limited;
+    lfw_u64 queue_dropped;
+    int64_t clock_offset;
+    bool    clock_offset_valid;
+} g_tel = {.epoll_fd = -1, .stop_fd = -1, .stats_fd = -1, .agg_fd = -1, .idle_fd = -1};
+
+static lfw_u64 clock_ns(clockid_t id)
+{
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (lfw_u64)ts.tv_sec * 1000000000ULL + (lfw_u64)ts.tv_nsec;
+}
+
+static void log_event(const struct lfw_event *event)
+{
+    char src_ip_str[INET6_ADDRSTRLEN];
+    char dst_ip_str[INET6_ADDRSTRLEN];
+
+    if (event->ip_version == 4) {
+        inet_ntop(AF_INET, &event->src_ip.v4, src_ip_str, sizeof(src_ip_str));
+        inet_ntop(AF_INET, &event->dst_ip.v4, dst_ip_str, sizeof(dst_ip_str));
+    } else {
+        inet_ntop(AF_INET6, &event->src_ip.v6, src_ip_str, sizeof(src_ip_str));
+        inet_ntop(AF_INET6, &event->dst_ip.v6, dst_ip_str, sizeof(dst_ip_str));
+    }
+
+    char proto_buf[16];
+    const char *proto = proto_buf;
+    if (event->proto == 6)
+        proto = "tcp";
+    else if (event->proto == 17)
+        proto = "udp";
+    else if (event->proto == 1)
+        proto = "icmp";
+    else if (event->proto == 2)
+        proto = "igmp";
+    else if (event->proto == 58)
+        proto = "icmpv6";
+    else if (event->proto == 50)
+        proto = "esp";
+    else if (event->proto == 51)
+        proto = "ah";
+    else
+        snprintf(proto_buf, sizeof(proto_buf), "%u", event->proto);
+
+    const char *action = (event->action == 1) ? "ALLOW" : "DROP";
+
+    // Deciding rule (numbered from 1 as in the statistics dump), what an
+    // aggregated or new-flow event covers, and the rate it was sampled at
+    char extra[128] = "";
+    int n = 0;
+    if (event->rule != LFW_EVENT_RULE_NONE)
+        n += snprintf(extra + n, sizeof(extra) - (size_t)n, ", \"rule\": %u", event->rule + 1);
+    if (event->kind != LFW_EVENT_PACKET) {
+        const char *flow = event->kind == LFW_EVENT_FLOW_FIRST ? "first" :
+                           event->kind == LFW_EVENT_FLOW_NEW   ? "new" : "summary";
+        n += snprintf(extra + n, sizeof(extra) - (size_t)n, ", \"flow\": \"%s\", \"packets\": %u",
+                      flow, event->packets);
+    }
+    if (event->sample_rate > 1)
+        snprintf(extra + n, sizeof(extra) - (size_t)n, ", \"sample\": %u", event->sample_rate);
+
+    // Print telemetry log line as structured JSON
+    lfw_log_info("{\"timestamp\": %llu, \"action\": \"%s\", \"proto\": \"%s\", "
+                 "\"src\": \"%s:%u\", \"dst\": \"%s:%u\", \"len\": %llu%s}",
+                 (unsigned long long)event->timestamp, action, proto, src_ip_str,
+                 ntohs(event->src_port), dst_ip_str, ntohs(event->dst_port),
+                 (unsigned long long)event->pkt_len, extra);
+}
+
+static void *worker_loop(void *arg)
+{
+    telemetry_worker_t *w = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->head == w->tail && !w->closed)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->head == w->tail) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        // The slot stays ours until head moves past it
+        telemetry_batch_t *b = &w->ring[w->head % TELEMETRY_QUEUE_DEPTH];
+        pthread_mutex_unlock(&w->lock);
+
+        for (lfw_u32 i = 0; i < b->count; i++)
+            log_event(&b->events[i]);
+
+        pthread_mutex_lock(&w->lock);
+        w->head++;
+        pthread_mutex_unlock(&w->lock);
+    }
+    return NULL;
+}
+
+// Hand the pending batch to the next worker with queue space. The drain
+// thread never waits for a worker: with every queue full the batch is
+// dropped and counted, so a slow logger cannot back up the kernel ring.
+static void publish_pending(void)
+{
+    telemetry_batch_t *p = &g_tel.pending;
+    if (p->count == 0)
+        return;
+
+    for (lfw_u32 n = 0; n < g_tel.worker_count; n++) {
+        lfw_u32 idx = (g_tel.next_worker + n) % g_tel.worker_count;
+        telemetry_worker_t *w = &g_tel.workers[idx];
+
+        pthread_mutex_lock(&w->lock);
+        if (w->tail - w->head < TELEMETRY_QUEUE_DEPTH) {
+            telemetry_batch_t *slot = &w->ring[w->tail % TELEMETRY_QUEUE_DEPTH];
+            slot->count = p->count;
+            memcpy(slot->events, p->events, p->count * sizeof(struct lfw_event));
+            w->tail++;
+            pthread_cond_signal(&w->cond);
+            pthread_mutex_unlock(&w->lock);
+
+            g_tel.next_worker = (idx + 1) % g_tel.worker_count;
+            p->count = 0;
+            return;
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    g_tel.pass.queue_dropped += p->count;
+    p->count = 0;
+}
+
+static bool rate_allow(void)
+{
+    lfw_u32 limit = g_tel.config.rate_limit;
+    if (limit == 0)
+        return true;
+
+    if (g_tel.pass_sec != g_tel.rate_sec) {
+        g_tel.rate_sec = g_tel.pass_sec;
+        g_tel.rate_count = 0;
+    }
+    if (g_tel.rate_count >= limit) {
+        g_tel.pass.rate_limited++;
+        return false;
+    }
+    g_tel.rate_count++;
+    return true;
+}
+
+// Route a decoded event to the binary sink or to the workers
+static void deliver(const struct lfw_event *event)
+{
+    // The binary sink keeps every event: no rate limit, and formatting
+    // is left to lfw-eventdump
+    if (g_tel.config.eventlog) {
+        lfw_eventlog_append(g_tel.config.eventlog, event, 1);
+    } else if (rate_allow()) {
+        g_tel.pending.events[g_tel.pending.count++] = *event;
+        if (g_tel.pending.count == TELEMETRY_BATCH)
+            publish_pending();
+    }
+}
+
+// Decode stage: runs on the drain thread for every ring record
+static int decode_event(void *ctx, void *data, size_t data_sz)
+{
+    (void)ctx;
+
+    if (data_sz >= sizeof(struct lfw_event)) {
+        const struct lfw_event *event = data;
+        g_tel.pass.received++;
+        g_tel.pass_timestamp = event->timestamp;
+        deliver(event);
+    }
+
+    return ++g_tel.pass_records >= g_tel.config.budget ? BUDGET_SPENT : 0;
+}
+
+// Whether the flow in g_tel.agg_values has seen no packet for a whole
+// window on any CPU
+static bool agg_quiet(lfw_u64 now, lfw_u64 window_ns)
+{
+    for (int cpu = 0; cpu < g_tel.agg_cpus; cpu++) {
+        if (g_tel.agg_values[cpu].last_seen + window_ns > now)
+            return false;
+    }
+    return true;
+}
+
+// Emit the counts in g_tel.agg_values as the flow's last summary
+static void agg_report(const struct lfw_agg_key *key)
+{
+    lfw_u64 packets = 0, bytes = 0, last_seen = 0;
+    lfw_u32 sample_rate = 1;
+    for (int cpu = 0; cpu < g_tel.agg_cpus; cpu++) {
+        const struct lfw_agg_val *v = &g_tel.agg_values[cpu];
+        packets += v->packets;
+        bytes += v->bytes;
+        if (v->last_seen > last_seen)
+            last_seen = v->last_seen;
+        if (v->sample_rate > sample_rate)
+            sample_rate = v->sample_rate;
+    }
+    if (packets == 0)
+        return;
+
+    struct lfw_event event = {
+        .src_port    = 0,
+        .dst_port    = key->dst_port,
+        .proto       = key->proto,
+        .action      = key->action,
+        .ip_version  = key->ip_version,
+        .kind        = LFW_EVENT_FLOW_SUMMARY,
+        .pkt_len     = bytes,
+        .timestamp   = last_seen,
+        .packets     = packets > 0xFFFFFFFFULL ? 0xFFFFFFFFu : (lfw_u32)packets,
+        .rule        = key->rule,
+        .sample_rate = sample_rate,
+    };
+    memcpy(&event.src_ip.v6, &key->src_ip, sizeof(key->src_ip));
+    memcpy(&event.dst_ip.v6, &key->dst_ip, sizeof(key->dst_ip));
+    deliver(&event);
+}
+
+// Flush aggregated flows that have been quiet on every CPU for a whole
+// window: the kernel only reports a flow when its packets arrive, so the
+// counts of a flow's last window are emitted here and the flow is removed.
+// The summary carries the counts taken out with the entry, packets that
+// arrived since the check included; later ones start the flow afresh.
+static void sweep_flows(void)
+{
+    lfw_u64 window_ns = (lfw_u64)g_tel.config.window_ms * 1000000ULL;
+    lfw_u64 now = clock_ns(CLOCK_MONOTONIC);
+
+    g_tel.pass_sec = clock_ns(CLOCK_BOOTTIME) / 1000000000ULL;
+    memset(&g_tel.pass, 0, sizeof(g_tel.pass));
+
+    struct lfw_agg_key key, next_key;
+    int has_more = bpf_map_get_next_key(g_tel.agg_fd, NULL, &next_key) == 0;
+    while (has_more) {
+        key = next_key;
+        has_more = bpf_map_get_next_key(g_tel.agg_fd, &key, &next_key) == 0;
+
+        if (bpf_map_lookup_elem(g_tel.agg_fd, &key, g_tel.agg_values) != 0 || !agg_quiet(now, window_ns))
+            continue;
+
+        if (bpf_map_lookup_and_delete_elem(g_tel.agg_fd, &key, g_tel.agg_values) != 0) {
+            if (errno == ENOENT)
+                continue; // Evicted meanwhile
+
+            // Kernels before 5.14 cannot take a value out of a per-CPU
+            // hash map: check it again and delete, so only packets in that
+            // moment go unreported
+            if (bpf_map_lookup_elem(g_tel.agg_fd, &key, g_tel.agg_values) != 0 || !agg_quiet(now, window_ns) ||
+                bpf_map_delete_elem(g_tel.agg_fd, &key) != 0)
+                continue;
+        }
+
+        agg_report(&key);
+    }
+
+    publish_pending();
+    __atomic_fetch_add(&g_tel.rate_limited, g_tel.pass.rate_limited, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_tel.queue_dropped, g_tel.pass.queue_dropped, __ATOMIC_RELAXED);
+}
+
+// Consume the rings of one class, starting where the last pass stopped
+static int drain_class(int event_class)
+{
+    lfw_u32 count = g_tel.ring_count[event_class];
+    telemetry_ring_t *rings = g_tel.rings + (event_class == LFW_EVENTS_ALLOW ? g_tel.ring_count[LFW_EVENTS_DROP] : 0);
+
+    for (lfw_u32 n = 0; n < count; n++) {
+        lfw_u32 idx = (g_tel.ring_next[event_class] + n) % count;
+        int err = ring_buffer__consume(rings[idx].rb);
+        if (err < 0) {
+            // Resume after this ring so a busy CPU cannot starve the others
+            g_tel.ring_next[event_class] = (idx + 1) % count;
+            return err;
+        }
+    }
+    return 0;
+}
+
+// Drain up to budget records; BUDGET_SPENT if more may be pending. Drop
+// rings come first and allow rings only get the budget they leave, so
+// drop events keep flowing through an allow flood.
+static int drain_pass(void)
+{
+    g_tel.pass_records = 0;
+    g_tel.pass_sec = clock_ns(CLOCK_BOOTTIME) / 1000000000ULL;
+    memset(&g_tel.pass, 0, sizeof(g_tel.pass));
+
+    int err = drain_class(LFW_EVENTS_DROP);
+    if (err == 0)
+        err = drain_class(LFW_EVENTS_ALLOW);
+    publish_pending();
+
+    if (g_tel.pass.received) {
+        // Calibrate clock offset between userspace CLOCK_MONOTONIC and kernel bpf_ktime_get_ns()
+        int64_t offset = (int64_t)clock_ns(CLOCK_MONOTONIC) - (int64_t)g_tel.pass_timestamp;
+        __atomic_store_n(&g_tel.clock_offset, offset, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_tel.clock_offset_valid, true, __ATOMIC_RELEASE);
+    }
+
+    __atomic_fetch_add(&g_tel.received, g_tel.pass.received, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_tel.rate_limited, g_tel.pass.rate_limited, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_tel.queue_dropped, g_tel.pass.queue_dropped, __ATOMIC_RELAXED);
+    return err;
+}
+
+// Log events lost since the last report, in the kernel or in worker queues
+static void report_losses(lfw_telemetry_stats_t *last)
+{
+    lfw_telemetry_stats_t now;
+    lfw_telemetry_get_stats(&now);
+
+    lfw_u64 kernel = now.kernel_lost - last->kernel_lost;
+    lfw_u64 drops = now.kernel_drop_lost - last->kernel_drop_lost;
+    lfw_u64 queued = now.queue_dropped - last->queue_dropped;
+    if (kernel || queued) {
+        lfw_log_error("telemetry: lost %llu events in the kernel (ring buffer full, %llu of them drops) and "
+                      "%llu in worker queues in the last %d seconds",
+                      (unsigned long long)kernel, (unsigned long long)drops,
+                      (unsigned long long)queued, TELEMETRY_REPORT_SEC);
+    }
+    *last = now;
+}
+
+// Tell the kernel whether to wake the consumer on every event
+static void set_idle(bool idle)
+{
+    lfw_u32 zero = 0;
+    lfw_u32 value = idle;
+    if (g_tel.idle_fd >= 0 && bpf_map_update_elem(g_tel.idle_fd, &zero, &value, BPF_ANY) == 0)
+        g_tel.idle = idle;
+}
+
+// Drain passes until the rings are empty or the consumer stops; returns
+// the records received, or a negative error
+static long drain_all(void)
+{
+    long received = 0;
+    int err;
+    do {
+        err = drain_pass();
+        received += (long)g_tel.pass.received;
+    } while (err == BUDGET_SPENT && __atomic_load_n(&g_tel.running, __ATOMIC_RELAXED));
+
+    if (err < 0 && err != BUDGET_SPENT) {
+        lfw_log_error("Error consuming ring buffer: %d", err);
+        return err;
+    }
+    return received;
+}
+
+static void *drain_loop(void *arg)
+{
+    (void)arg;
+    lfw_telemetry_stats_t reported;
+    lfw_telemetry_get_stats(&reported);
+    lfw_u64 next_report = clock_ns(CLOCK_MONOTONIC) / 1000000000ULL + TELEMETRY_REPORT_SEC;
+    lfw_u64 next_sweep = 0;
+    int timeout = TELEMETRY_POLL_MS;
+
+    while (__atomic_load_n(&g_tel.running, __ATOMIC_RELAXED)) {
+        // Woken when the kernel forces a wakeup on any ring, otherwise by
+        // the timeout: records submitted without a wakeup never make a
+        // ring ready. Every pass looks at all rings, so which one woke us
+        // does not matter.
+        struct epoll_event ev;
+        if (epoll_wait(g_tel.epoll_fd, &ev, 1, timeout) < 0 && errno != EINTR) {
+            lfw_log_error("Error polling ring buffer: %s", strerror(errno));
+            break;
+        }
+        if (!__atomic_load_n(&g_tel.running, __ATOMIC_RELAXED))
+            break;
+
+        long received = drain_all();
+        if (received < 0)
+            break;
+
+        if (received > 0 && g_tel.idle) {
+            // Back to batched wakeups while events flow
+            set_idle(false);
+        } else if (received == 0 && !g_tel.idle) {
+            // Nothing came in for a whole poll interval: sleep until the
+            // kernel wakes us rather than polling empty rings. An event
+            // submitted before the kernel saw the flag is caught by the
+            // pass after it, or in the rarest race by the idle timeout.
+            set_idle(true);
+            received = drain_all();
+            if (received < 0)
+                break;
+            if (received > 0)
+                set_idle(false);
+        }
+        if (g_tel.idle)
+            timeout = g_tel.agg_fd >= 0 ? TELEMETRY_SWEEP_MS : TELEMETRY_IDLE_MS;
+        else
+            timeout = TELEMETRY_POLL_MS;
+
+        if (g_tel.config.eventlog)
+            lfw_eventlog_flush(g_tel.config.eventlog, false);
+
+        lfw_u64 sec = clock_ns(CLOCK_MONOTONIC) / 1000000000ULL;
+        if (g_tel.agg_fd >= 0 && sec >= next_sweep) {
+            sweep_flows();
+            next_sweep = sec + 1;
+        }
+        if (sec >= next_report) {
+            report_losses(&reported);
+            next_report = sec + TELEMETRY_REPORT_SEC;
+        }
+    }
+
+    if (g_tel.idle)
+        set_idle(false);
+    return NULL;
+}
+
+// Take a consumer on every events ring, drop rings first, and watch them
+// all from one epoll set
+static lfw_status_t open_rings(void)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    if (ncpus <= 0)
+        return LFW_ERR_GENERIC;
+
+    int max_fds = ncpus + 1;
+    int *fds = calloc((size_t)max_fds, sizeof(int));
+    g_tel.rings = calloc((size_t)max_fds * LFW_EVENTS_CLASSES, sizeof(*g_tel.rings));
+    g_tel.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    g_tel.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!fds || !g_tel.rings || g_tel.epoll_fd < 0 || g_tel.stop_fd < 0) {
+        free(fds);
+        return LFW_ERR_NO_MEMORY;
+    }
+    struct epoll_event stop_ev = {.events = EPOLLIN};
+    if (epoll_ctl(g_tel.epoll_fd, EPOLL_CTL_ADD, g_tel.stop_fd, &stop_ev) != 0) {
+        free(fds);
+        return LFW_ERR_GENERIC;
+    }
+
+    lfw_u32 total = 0;
+    for (int c = 0; c < LFW_EVENTS_CLASSES; c++) {
+        int n = lfw_bpf_get_event_ring_fds(c, fds, max_fds);
+        bool ok = n > 0;
+        for (int i = 0; ok && i < n; i++) {
+            telemetry_ring_t *ring = &g_tel.rings[total];
+            ring->fd = fcntl(fds[i], F_DUPFD_CLOEXEC, 0);
+            if (ring->fd < 0) {
+                ok = false;
+                break;
+            }
+            // Counted as soon as the fd is ours, so release() closes it
+            g_tel.ring_count[c]++;
+            total++;
+
+            struct epoll_event ev = {.events = EPOLLIN};
+            ring->rb = ring_buffer__new(ring->fd, decode_event, NULL, NULL);
+            ok = ring->rb && epoll_ctl(g_tel.epoll_fd, EPOLL_CTL_ADD, ring->fd, &ev) == 0;
+        }
+        if (!ok) {
+            lfw_log_error("Failed to initialize %s events ring buffers",
+                          c == LFW_EVENTS_DROP ? "drop" : "allow");
+            free(fds);
+            return LFW_ERR_GENERIC;
+        }
+    }
+
+    free(fds);
+    return LFW_OK;
+}
+
+static void stop_workers(void)
+{
+    for (lfw_u32 i = 0; i < g_tel.worker_count; i++) {
+        telemetry_worker_t *w = &g_tel.workers[i];
+        pthread_mutex_lock(&w->lock);
+        w->closed = true;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        free(w->ring);
+    }
+
+    free(g_tel.workers);
+    g_tel.workers = NULL;
+    g_tel.worker_count = 0;
+}
+
+static void release(void)
+{
+    stop_workers();
+    lfw_u32 rings = g_tel.ring_count[LFW_EVENTS_DROP] + g_tel.ring_count[LFW_EVENTS_ALLOW];
+    for (lfw_u32 i = 0; g_tel.rings && i < rings; i++) {
+        if (g_tel.rings[i].rb)
+            ring_buffer__free(g_tel.rings[i].rb);
+        if (g_tel.rings[i].fd >= 0)
+            close(g_tel.rings[i].fd);
+    }
+    free(g_tel.rings);
+    g_tel.rings = NULL;
+    memset(g_tel.ring_count, 0, sizeof(g_tel.ring_count));
+    memset(g_tel.ring_next, 0, sizeof(g_tel.ring_next));
+    if (g_tel.epoll_fd >= 0) {
+        close(g_tel.epoll_fd);
+        g_tel.epoll_fd = -1;
+    }
+    if (g_tel.stop_fd >= 0) {
+        close(g_tel.stop_fd);
+        g_tel.stop_fd = -1;
+    }
+    if (g_tel.stats_fd >= 0) {
+        close(g_tel.stats_fd);
+        g_tel.stats_fd = -1;
+    }
+    if (g_tel.agg_fd >= 0) {
+        close(g_tel.agg_fd);
+        g_tel.agg_fd = -1;
+    }
+    if (g_tel.idle_fd >= 0) {
+        close(g_tel.idle_fd);
+        g_tel.idle_fd = -1;
+    }
+    g_tel.idle = false;
+    free(g_tel.agg_values);
+    g_tel.agg_values = NULL;
+}
+
+lfw_status_t lfw_telemetry_start(const lfw_telemetry_config_t *config)
+{
+    if (g_tel.started)
+        return LFW_ERR_INVALID;
+
+    lfw_telemetry_config_t cfg = {0};
+    if (config)
+        cfg = *config;
+    if (cfg.workers == 0)
+        cfg.workers = TELEMETRY_DEFAULT_WORKERS;
+    if (cfg.budget == 0)
+        cfg.budget = TELEMETRY_DEFAULT_BUDGET;
+    if (cfg.workers > TELEMETRY_MAX_WORKERS)
+        return LFW_ERR_INVALID;
+
+    memset(&g_tel.pending, 0, sizeof(g_tel.pending));
+    g_tel.config = cfg;
+    g_tel.next_worker = 0;
+
+    lfw_status_t st = open_rings();
+    if (st != LFW_OK) {
+        release();
+        return st;
+    }
+    g_tel.stats_fd = fcntl(lfw_bpf_get_telemetry_stats_fd(), F_DUPFD_CLOEXEC, 0);
+    // Without it the consumer just keeps polling
+    g_tel.idle_fd = fcntl(lfw_bpf_get_telemetry_idle_fd(), F_DUPFD_CLOEXEC, 0);
+
+    if (cfg.window_ms) {
+        g_tel.agg_cpus = libbpf_num_possible_cpus();
+        if (g_tel.agg_cpus > 0)
+            g_tel.agg_values = calloc((size_t)g_tel.agg_cpus, sizeof(*g_tel.agg_values));
+        if (g_tel.agg_values)
+            g_tel.agg_fd = fcntl(lfw_bpf_get_telemetry_agg_fd(), F_DUPFD_CLOEXEC, 0);
+        if (g_tel.agg_fd < 0) {
+            lfw_log_error("Failed to access the telemetry aggregation map");
+            release();
+            return LFW_ERR_GENERIC;
+        }
+    }
+
+    // Events written to the binary sink need no formatting workers
+    lfw_u32 workers = cfg.eventlog ? 0 : cfg.workers;
+    if (workers) {
+        g_tel.workers = calloc(workers, sizeof(*g_tel.workers));
+        if (!g_tel.workers) {
+            release();
+            return LFW_ERR_NO_MEMORY;
+        }
+    }
+    for (lfw_u32 i = 0; i < workers; i++) {
+        telemetry_worker_t *w = &g_tel.workers[i];
+        w->ring = calloc(TELEMETRY_QUEUE_DEPTH, sizeof(*w->ring));
+        if (!w->ring) {
+            release();
+            return LFW_ERR_NO_MEMORY;
+        }
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->cond, NULL);
+        if (pthread_create(&w->thread, NULL, worker_loop, w) != 0) {
+            pthread_cond_destroy(&w->cond);
+            pthread_mutex_destroy(&w->lock);
+            free(w->ring);
+            release();
+            lfw_log_error("failed to spawn telemetry worker");
+            return LFW_ERR_GENERIC;
+        }
+        g_tel.worker_count++;
+    }
+
+    __atomic_store_n(&g_tel.running, true, __ATOMIC_RELAXED);
+    if (pthread_create(&g_tel.drain_thread, NULL, drain_loop, NULL) != 0) {
+        release();
+        lfw_log_error("failed to spawn telemetry thread");
+        return LFW_ERR_GENERIC;
+    }
+
+    g_tel.started = true;
+    return LFW_OK;
+}
+
+void lfw_telemetry_stop(void)
+{
+    if (!g_tel.started)
+        return;
+
+    // Wake the drain thread rather than wait out its poll timeout
+    lfw_u64 one = 1;
+    ssize_t n;
+    __atomic_store_n(&g_tel.running, false, __ATOMIC_RELAXED);
+    do {
+        n = write(g_tel.stop_fd, &one, sizeof(one));
+    } while (n < 0 && errno == EINTR);
+    pthread_join(g_tel.drain_thread, NULL);
+
+    // Workers finish what is queued before they exit
+    release();
+    g_tel.started = false;
+}
+
+bool lfw_telemetry_clock_offset(int64_t *offset)
+{
+    if (!offset || !__atomic_load_n(&g_tel.clock_offset_valid, __ATOMIC_ACQUIRE))
+        return false;
+    *offset = __atomic_load_n(&g_tel.clock_offset, __ATOMIC_RELAXED);
+    return true;
+}
+
+void lfw_telemetry_get_stats(lfw_telemetry_stats_t *stats)
+{
+    if (!stats)
+        return;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->received = __atomic_load_n(&g_tel.received, __ATOMIC_RELAXED);
+    stats->rate_limited = __atomic_load_n(&g_tel.rate_limited, __ATOMIC_RELAXED);
+    stats->queue_dropped = __atomic_load_n(&g_tel.queue_dropped, __ATOMIC_RELAXED);
+
+    struct lfw_telemetry_stats kernel;
+    if (g_tel.stats_fd >= 0 && lfw_bpf_read_telemetry_stats(g_tel.stats_fd, &kernel) == LFW_OK) {
+        stats->kernel_submitted = kernel.submitted;
+        stats->kernel_lost = kernel.reserve_failed;
+        stats->kernel_drop_lost = kernel.drop_reserve_failed;
+        stats->kernel_wakeups = kernel.wakeups;
+    }
+}
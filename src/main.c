@@ -9,14 +9,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "lfw_bpf.h"
 #include "lfw_bpf_shared.h"
 #include "lfw_config.h"
+#include "lfw_control.h"
+#include "lfw_eventlog.h"
 #include "lfw_log.h"
+#include "lfw_metrics.h"
+#include "lfw_reactor.h"
 #include "lfw_rules.h"
+#include "lfw_stats.h"
+#include "lfw_telemetry.h"
 
 // Timeouts in nanoseconds (matching kernel BPF)
 #define TCP_TIMEOUT_SYN_SENT_NS (20ULL * 1000000000ULL)
@@ -26,9 +34,16 @@
 #define TCP_TIMEOUT_CLOSED_NS (10ULL * 1000000000ULL)
 #define UDP_TIMEOUT_NS (60ULL * 1000000000ULL)
 
-static volatile sig_atomic_t g_running = 1;
-static volatile sig_atomic_t g_reload_requested = 0;
-static volatile sig_atomic_t g_dump_requested = 0;
+// Intervals of the recurring tasks
+#define GC_INTERVAL_MS (10 * 1000)
+#define FQDN_INTERVAL_MS (60 * 1000)
+
+// Quiet time after a change to the rules file before it is reloaded, so
+// an editor's several writes make one reload
+#define RULES_SETTLE_MS 500
+
+// Pool threads for the recurring tasks and signalled reloads
+#define REACTOR_WORKERS 2
 
 static lfw_rule_t *g_raw_rules = NULL;
 static lfw_u32 g_raw_rule_count = 0;
@@ -41,348 +56,1018 @@ static char g_ifname[32] = {0};
 static bool g_cli_loglevel_override = false;
 static lfw_loglevel_t g_cli_loglevel = LFW_LOG_OPTIMAL;
 
-static pthread_t g_gc_thread;
-static bool g_gc_running = false;
-
-static pthread_t g_fqdn_thread;
-static bool g_fqdn_running = false;
+// Event loop of the main thread; GC, FQDN refresh, stats publishing and
+// signalled reloads run on its worker pool
+static lfw_reactor_t *g_reactor = NULL;
 
-static pthread_t g_telemetry_thread;
-static bool g_telemetry_running = false;
+// BPF object reloads are built from
+static const char *g_bpf_obj_path = NULL;
 
-static volatile int64_t g_clock_offset = 0;
-static volatile bool g_clock_offset_initialized = false;
+// Control socket (--control): the main loop reads requests and sends
+// replies, the pool answers them. The timer drops
+// idle clients and is only armed while one is connected.
+static lfw_control_t *g_control = NULL;
+static lfw_reactor_timer_t *g_control_timer = NULL;
 
-static int handle_event(void *ctx, void *data, size_t data_sz) {
-  (void)ctx;
-  if (data_sz < sizeof(struct lfw_event))
-    return 0;
-
-  // Telemetry rate limiting (max 100 log messages per second to avoid syslog bottleneck)
-  static __u64 last_log_time = 0;
-  static __u32 log_count_this_sec = 0;
-  struct timespec ts;
-  if (clock_gettime(CLOCK_BOOTTIME, &ts) == 0) {
-    __u64 now = (__u64)ts.tv_sec;
-    if (now != last_log_time) {
-      last_log_time = now;
-      log_count_this_sec = 0;
-    }
-    if (log_count_this_sec >= 100) {
-      return 0; // Skip logging to prevent CPU starvation
-    }
-    log_count_this_sec++;
-  }
+// Rules file watch (--watch-rules): inotify on the file's directory, so a
+// file replaced by rename is seen as well as one written in place
+static int g_rules_watch_fd = -1;
+static const char *g_rules_name = NULL;
+static lfw_reactor_timer_t *g_rules_settle_timer = NULL;
 
-  struct lfw_event *event = (struct lfw_event *)data;
+// Binary telemetry sink (--event-log), written by the telemetry drain thread
+static lfw_eventlog_t *g_eventlog = NULL;
 
-  // Calibrate clock offset between userspace CLOCK_MONOTONIC and kernel bpf_ktime_get_ns()
-  struct timespec offset_ts;
-  if (clock_gettime(CLOCK_MONOTONIC, &offset_ts) == 0) {
-    int64_t userspace_now = (int64_t)offset_ts.tv_sec * 1000000000LL + offset_ts.tv_nsec;
-    g_clock_offset = userspace_now - (int64_t)event->timestamp;
-    g_clock_offset_initialized = true;
-  }
+// Shared statistics region (--stats-file), refreshed by the stats task
+static lfw_stats_writer_t *g_stats_writer = NULL;
+static lfw_u32 g_stats_interval_ms = 1000;
+static lfw_stats_t g_stats_snapshot;
 
-  char src_ip_str[64];
-  char dst_ip_str[64];
+// OpenMetrics exporter (--metrics), fed by the stats task
+static bool g_metrics_running = false;
 
-  if (event->ip_version == 4) {
-    struct in_addr src_in = {.s_addr = event->src_ip.v4};
-    struct in_addr dst_in = {.s_addr = event->dst_ip.v4};
-    inet_ntop(AF_INET, &src_in, src_ip_str, sizeof(src_ip_str));
-    inet_ntop(AF_INET, &dst_in, dst_ip_str, sizeof(dst_ip_str));
-  } else {
-    struct in6_addr src_in6;
-    struct in6_addr dst_in6;
-    memcpy(&src_in6, &event->src_ip.v6, 16);
-    memcpy(&dst_in6, &event->dst_ip.v6, 16);
-    inet_ntop(AF_INET6, &src_in6, src_ip_str, sizeof(src_ip_str));
-    inet_ntop(AF_INET6, &dst_in6, dst_ip_str, sizeof(dst_ip_str));
-  }
-
-  char proto_buf[16];
-  const char *proto = proto_buf;
-  if (event->proto == 6)
-    proto = "tcp";
-  else if (event->proto == 17)
-    proto = "udp";
-  else if (event->proto == 1)
-    proto = "icmp";
-  else if (event->proto == 2)
-    proto = "igmp";
-  else if (event->proto == 58)
-    proto = "icmpv6";
-  else if (event->proto == 50)
-    proto = "esp";
-  else if (event->proto == 51)
-    proto = "ah";
-  else
-    snprintf(proto_buf, sizeof(proto_buf), "%u", event->proto);
-
-  const char *action = (event->action == 1) ? "ALLOW" : "DROP";
-
-  // Print telemetry log line as structured JSON
-  lfw_log_info("{\"timestamp\": %llu, \"action\": \"%s\", \"proto\": \"%s\", "
-               "\"src\": \"%s:%u\", \"dst\": \"%s:%u\", \"len\": %llu}",
-               (unsigned long long)event->timestamp, action, proto, src_ip_str,
-               ntohs(event->src_port), dst_ip_str, ntohs(event->dst_port),
-               (unsigned long long)event->pkt_len);
+// Durations of recurring tasks, exported with the other statistics
+static lfw_stats_timer_t g_gc_timer;
+static lfw_stats_timer_t g_fqdn_timer;
+static lfw_stats_timer_t g_reload_timer;
+static lfw_u64 g_reload_failures = 0;
 
-  return 0;
+static lfw_u64 monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (lfw_u64)ts.tv_sec * 1000000000ULL + (lfw_u64)ts.tv_nsec;
 }
 
-static void *telemetry_loop(void *arg) {
-  (void)arg;
-  int ringbuf_fd = lfw_bpf_get_events_ringbuf_fd();
-  if (ringbuf_fd < 0) {
-    lfw_log_error("Failed to get Ring Buffer FD");
-    return NULL;
-  }
+// Account one run of a task that started at start_ns
+static void timer_record(lfw_stats_timer_t *timer, lfw_u64 start_ns) {
+  lfw_u64 elapsed = monotonic_ns() - start_ns;
+  __atomic_add_fetch(&timer->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&timer->total_ns, elapsed, __ATOMIC_RELAXED);
+  __atomic_store_n(&timer->last_ns, elapsed, __ATOMIC_RELAXED);
+}
 
-  struct ring_buffer *rb =
-      ring_buffer__new(ringbuf_fd, handle_event, NULL, NULL);
-  if (!rb) {
-    lfw_log_error("Failed to initialize ring buffer");
-    return NULL;
-  }
+static void timer_load(const lfw_stats_timer_t *timer, lfw_stats_timer_t *out) {
+  out->count = __atomic_load_n(&timer->count, __ATOMIC_RELAXED);
+  out->total_ns = __atomic_load_n(&timer->total_ns, __ATOMIC_RELAXED);
+  out->last_ns = __atomic_load_n(&timer->last_ns, __ATOMIC_RELAXED);
+}
 
-  while (g_running) {
-    int err = ring_buffer__poll(rb, 100);
-    if (err < 0 && err != -EINTR) {
-      lfw_log_error("Error polling ring buffer: %d", err);
-      break;
-    }
+// Whether a conntrack entry of protocol proto has expired by now (kernel clock)
+static bool ct_expired(__u8 proto, const struct conntrack_val *val, int64_t now) {
+  __u64 timeout = UDP_TIMEOUT_NS;
+  if (proto == IPPROTO_TCP) { // TCP
+    if (val->state == LFW_TCP_STATE_SYN_SENT)
+      timeout = TCP_TIMEOUT_SYN_SENT_NS;
+    else if (val->state == LFW_TCP_STATE_SYN_RECV)
+      timeout = TCP_TIMEOUT_SYN_RECV_NS;
+    else if (val->state == LFW_TCP_STATE_FIN_WAIT)
+      timeout = TCP_TIMEOUT_FIN_WAIT_NS;
+    else if (val->state == LFW_TCP_STATE_CLOSED)
+      timeout = TCP_TIMEOUT_CLOSED_NS;
+    else
+      timeout = TCP_TIMEOUT_ESTABLISHED_NS;
   }
+  return now > (int64_t)val->last_seen && now - (int64_t)val->last_seen > (int64_t)timeout;
+}
 
-  ring_buffer__free(rb);
-  return NULL;
+// What gc_still_expired judges a victim by
+typedef struct {
+  __u8 proto;
+  int64_t now;
+} gc_recheck_t;
+
+// A packet may have refreshed the entry since the sweep read it, or the
+// filter replaced it with a new connection: delete it only if still expired
+static bool gc_still_expired(const struct conntrack_val *val, void *ctx) {
+  const gc_recheck_t *recheck = ctx;
+  return ct_expired(recheck->proto, val, recheck->now);
 }
 
-static void handle_signal(int sig) {
-  if (sig == SIGINT || sig == SIGTERM) {
-    g_running = 0;
-  } else if (sig == SIGHUP) {
-    g_reload_requested = 1;
-  } else if (sig == SIGUSR1) {
-    g_dump_requested = 1;
+// Delete expired conntrack and dynamic list entries; runs on the pool
+static void conntrack_gc(void *ctx) {
+  (void)ctx;
+  int64_t offset = 0;
+  if (!lfw_telemetry_clock_offset(&offset)) {
+    return; // Wait until telemetry calibrates the clock offset
   }
-}
 
-static void *conntrack_gc_loop(void *arg) {
-  (void)arg;
-  while (g_running) {
-    for (int i = 0; i < 10 && g_running; i++) {
-      sleep(1);
-    }
-    if (!g_running)
-      break;
+  struct timespec ts;
+  __u64 now_u = 0;
 
-    if (!g_clock_offset_initialized) {
-      continue; // Wait until telemetry calibrates the clock offset
-    }
-    int64_t offset = g_clock_offset;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    now_u = (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  } else {
+    return;
+  }
 
-    struct timespec ts;
-    __u64 now_u = 0;
+  int64_t adjusted_now = (int64_t)now_u - offset;
 
-    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
-      now_u = (__u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
-    } else {
-      continue;
-    }
+  lfw_log_debug("GC loop: Starting connection tracking sweep...");
 
-    int64_t adjusted_now = (int64_t)now_u - offset;
-
-    lfw_log_debug("GC loop: Starting connection tracking sweep...");
-
-    lfw_bpf_lock();
-
-    // IPv4 GC
-    int fd = lfw_bpf_get_conntrack_map_fd();
-    if (fd >= 0) {
-      struct conntrack_key *delete_keys = NULL;
-      size_t delete_count = 0;
-      size_t delete_cap = 0;
-
-      struct conntrack_key key = {}, next_key = {};
-      struct conntrack_val val = {};
-      int has_more = bpf_map_get_next_key(fd, NULL, &next_key) == 0;
-      while (has_more) {
-        key = next_key;
-        has_more = bpf_map_get_next_key(fd, &key, &next_key) == 0;
-
-        if (bpf_map_lookup_elem(fd, &key, &val) == 0) {
-          __u64 timeout = UDP_TIMEOUT_NS;
-          if (key.proto == IPPROTO_TCP) { // TCP
-            if (val.state == LFW_TCP_STATE_SYN_SENT)
-              timeout = TCP_TIMEOUT_SYN_SENT_NS;
-            else if (val.state == LFW_TCP_STATE_SYN_RECV)
-              timeout = TCP_TIMEOUT_SYN_RECV_NS;
-            else if (val.state == LFW_TCP_STATE_FIN_WAIT)
-              timeout = TCP_TIMEOUT_FIN_WAIT_NS;
-            else if (val.state == LFW_TCP_STATE_CLOSED)
-              timeout = TCP_TIMEOUT_CLOSED_NS;
-            else
-              timeout = TCP_TIMEOUT_ESTABLISHED_NS;
-          }
-          if (adjusted_now > (int64_t)val.last_seen && adjusted_now - (int64_t)val.last_seen > (int64_t)timeout) {
-            if (delete_count >= delete_cap) {
-              size_t new_cap = delete_cap == 0 ? 256 : delete_cap * 2;
-              struct conntrack_key *tmp = realloc(delete_keys, new_cap * sizeof(struct conntrack_key));
-              if (tmp) {
-                delete_keys = tmp;
-                delete_cap = new_cap;
-              } else {
-                break;
-              }
+  lfw_bpf_lock();
+  lfw_u64 sweep_start = monotonic_ns();
+
+  // IPv4 GC
+  int fd = lfw_bpf_get_conntrack_map_fd();
+  if (fd >= 0) {
+    struct conntrack_key *delete_keys = NULL;
+    size_t delete_count = 0;
+    size_t delete_cap = 0;
+
+    struct conntrack_key key = {}, next_key = {};
+    struct conntrack_val val = {};
+    int has_more = bpf_map_get_next_key(fd, NULL, &next_key) == 0;
+    while (has_more) {
+      key = next_key;
+      has_more = bpf_map_get_next_key(fd, &key, &next_key) == 0;
+
+      if (bpf_map_lookup_elem(fd, &key, &val) == 0) {
+        if (ct_expired(key.proto, &val, adjusted_now)) {
+          if (delete_count >= delete_cap) {
+            size_t new_cap = delete_cap == 0 ? 256 : delete_cap * 2;
+            struct conntrack_key *tmp = realloc(delete_keys, new_cap * sizeof(struct conntrack_key));
+            if (tmp) {
+              delete_keys = tmp;
+              delete_cap = new_cap;
+            } else {
+              break;
             }
-            delete_keys[delete_count++] = key;
           }
+          delete_keys[delete_count++] = key;
         }
       }
+    }
 
-      for (size_t i = 0; i < delete_count; i++) {
-        bpf_map_delete_elem(fd, &delete_keys[i]);
+    size_t swept = 0;
+    for (size_t i = 0; i < delete_count; i++) {
+      gc_recheck_t recheck = {.proto = delete_keys[i].proto, .now = adjusted_now};
+      if (lfw_bpf_conntrack_delete(LFW_CT_IPV4, &delete_keys[i], gc_still_expired, &recheck)) {
+        swept++;
       }
-      lfw_log_debug("GC loop (v4): Swept %zu expired connections", delete_count);
-      free(delete_keys);
-    }
-
-    // IPv6 GC
-    int fd_v6 = lfw_bpf_get_conntrack_map_v6_fd();
-    if (fd_v6 >= 0) {
-      struct conntrack_key_v6 *delete_keys_v6 = NULL;
-      size_t delete_count_v6 = 0;
-      size_t delete_cap_v6 = 0;
-
-      struct conntrack_key_v6 key = {}, next_key = {};
-      struct conntrack_val val = {};
-      int has_more = bpf_map_get_next_key(fd_v6, NULL, &next_key) == 0;
-      while (has_more) {
-        key = next_key;
-        has_more = bpf_map_get_next_key(fd_v6, &key, &next_key) == 0;
-
-        if (bpf_map_lookup_elem(fd_v6, &key, &val) == 0) {
-          __u64 timeout = UDP_TIMEOUT_NS;
-          if (key.proto == IPPROTO_TCP) { // TCP
-            if (val.state == LFW_TCP_STATE_SYN_SENT)
-              timeout = TCP_TIMEOUT_SYN_SENT_NS;
-            else if (val.state == LFW_TCP_STATE_SYN_RECV)
-              timeout = TCP_TIMEOUT_SYN_RECV_NS;
-            else if (val.state == LFW_TCP_STATE_FIN_WAIT)
-              timeout = TCP_TIMEOUT_FIN_WAIT_NS;
-            else if (val.state == LFW_TCP_STATE_CLOSED)
-              timeout = TCP_TIMEOUT_CLOSED_NS;
-            else
-              timeout = TCP_TIMEOUT_ESTABLISHED_NS;
-          }
-          if (adjusted_now > (int64_t)val.last_seen && adjusted_now - (int64_t)val.last_seen > (int64_t)timeout) {
-            if (delete_count_v6 >= delete_cap_v6) {
-              size_t new_cap = delete_cap_v6 == 0 ? 256 : delete_cap_v6 * 2;
-              struct conntrack_key_v6 *tmp = realloc(delete_keys_v6, new_cap * sizeof(struct conntrack_key_v6));
-              if (tmp) {
-                delete_keys_v6 = tmp;
-                delete_cap_v6 = new_cap;
-              } else {
-                break;
-              }
+    }
+    lfw_log_debug("GC loop (v4): Swept %zu expired connections", swept);
+    free(delete_keys);
+  }
+
+  // IPv6 GC
+  int fd_v6 = lfw_bpf_get_conntrack_map_v6_fd();
+  if (fd_v6 >= 0) {
+    struct conntrack_key_v6 *delete_keys_v6 = NULL;
+    size_t delete_count_v6 = 0;
+    size_t delete_cap_v6 = 0;
+
+    struct conntrack_key_v6 key = {}, next_key = {};
+    struct conntrack_val val = {};
+    int has_more = bpf_map_get_next_key(fd_v6, NULL, &next_key) == 0;
+    while (has_more) {
+      key = next_key;
+      has_more = bpf_map_get_next_key(fd_v6, &key, &next_key) == 0;
+
+      if (bpf_map_lookup_elem(fd_v6, &key, &val) == 0) {
+        if (ct_expired(key.proto, &val, adjusted_now)) {
+          if (delete_count_v6 >= delete_cap_v6) {
+            size_t new_cap = delete_cap_v6 == 0 ? 256 : delete_cap_v6 * 2;
+            struct conntrack_key_v6 *tmp = realloc(delete_keys_v6, new_cap * sizeof(struct conntrack_key_v6));
+            if (tmp) {
+              delete_keys_v6 = tmp;
+              delete_cap_v6 = new_cap;
+            } else {
+              break;
             }
-            delete_keys_v6[delete_count_v6++] = key;
           }
+          delete_keys_v6[delete_count_v6++] = key;
         }
       }
+    }
 
-      for (size_t i = 0; i < delete_count_v6; i++) {
-        bpf_map_delete_elem(fd_v6, &delete_keys_v6[i]);
+    size_t swept = 0;
+    for (size_t i = 0; i < delete_count_v6; i++) {
+      gc_recheck_t recheck = {.proto = delete_keys_v6[i].proto, .now = adjusted_now};
+      if (lfw_bpf_conntrack_delete(LFW_CT_IPV6, &delete_keys_v6[i], gc_still_expired, &recheck)) {
+        swept++;
       }
-      lfw_log_debug("GC loop (v6): Swept %zu expired connections", delete_count_v6);
-      free(delete_keys_v6);
     }
+    lfw_log_debug("GC loop (v6): Swept %zu expired connections", swept);
+    free(delete_keys_v6);
+  }
 
-    lfw_bpf_unlock();
+  // Expired dynamic list entries no packet has hit since
+  lfw_u64 dyn_swept = 0;
+  if (lfw_bpf_dyn_sweep((lfw_u64)adjusted_now, &dyn_swept) == LFW_OK) {
+    lfw_log_debug("GC loop: Swept %llu expired dynamic list entries", (unsigned long long)dyn_swept);
   }
-  return NULL;
+
+  timer_record(&g_gc_timer, sweep_start);
+  lfw_bpf_unlock();
 }
 
-static void *fqdn_resolver_loop(void *arg) {
-  (void)arg;
-  const char *bpf_obj_path = "build/lfw_bpf.o";
-  if (access(bpf_obj_path, F_OK) != 0) {
-    bpf_obj_path = "/usr/local/share/lfw/lfw_bpf.o";
+// Resolve the FQDN rules again and reload if an address changed; runs on
+// the pool
+static void fqdn_refresh(void *ctx) {
+  (void)ctx;
+  lfw_bpf_lock();
+  if (!g_raw_rules || g_raw_rule_count == 0) {
+    lfw_bpf_unlock();
+    return;
+  }
+
+  lfw_rule_t *new_concrete_rules = NULL;
+  lfw_u32 new_concrete_count = 0;
+  lfw_u64 resolve_start = monotonic_ns();
+  lfw_status_t st = lfw_rules_expand_fqdn(g_raw_rules, g_raw_rule_count, &new_concrete_rules, &new_concrete_count);
+  timer_record(&g_fqdn_timer, resolve_start);
+  if (st != LFW_OK) {
+    lfw_bpf_unlock();
+    return;
   }
 
-  while (g_running) {
-    for (int i = 0; i < 60 && g_running; i++) {
-      sleep(1);
+  bool changed = false;
+  if (new_concrete_count != g_rule_count) {
+    changed = true;
+  } else {
+    for (lfw_u32 i = 0; i < g_rule_count; i++) {
+      if (memcmp(&g_rules[i].match, &new_concrete_rules[i].match, sizeof(lfw_rule_match_t)) != 0 ||
+          g_rules[i].action != new_concrete_rules[i].action) {
+        changed = true;
+        break;
+      }
     }
-    if (!g_running)
-      break;
+  }
 
-    lfw_bpf_lock();
-    if (!g_raw_rules || g_raw_rule_count == 0) {
-      lfw_bpf_unlock();
-      continue;
+  if (changed) {
+    lfw_log_info("FQDN resolved IPs changed, reloading BPF maps...");
+    lfw_loglevel_t active_loglevel = g_cli_loglevel_override ? g_cli_loglevel : LFW_LOG_OPTIMAL;
+    lfw_u64 reload_start = monotonic_ns();
+    if (lfw_bpf_reload(g_ifname, g_bpf_obj_path, new_concrete_rules, new_concrete_count, g_default_action, active_loglevel) == LFW_OK) {
+      timer_record(&g_reload_timer, reload_start);
+      lfw_config_free_rules(g_rules);
+      g_rules = new_concrete_rules;
+      g_rule_count = new_concrete_count;
+      lfw_log_info("FQDN rules atomically reloaded");
+    } else {
+      __atomic_add_fetch(&g_reload_failures, 1, __ATOMIC_RELAXED);
+      lfw_config_free_rules(new_concrete_rules);
+      lfw_log_error("Failed to reload BPF maps with updated FQDN IPs");
+    }
+  } else {
+    lfw_config_free_rules(new_concrete_rules);
+  }
+  lfw_bpf_unlock();
+}
+
+// Fill a stats snapshot. Only the kernel counter reads hold the BPF lock,
+// and none of them walks a map.
+static void collect_stats(lfw_stats_t *snapshot) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  snapshot->updated_ns = (lfw_u64)ts.tv_sec * 1000000000ULL + (lfw_u64)ts.tv_nsec;
+
+  lfw_telemetry_stats_t tstats;
+  lfw_telemetry_get_stats(&tstats);
+  snapshot->telemetry_received = tstats.received;
+  snapshot->telemetry_rate_limited = tstats.rate_limited;
+  snapshot->telemetry_queue_dropped = tstats.queue_dropped;
+  snapshot->kernel_submitted = tstats.kernel_submitted;
+  snapshot->kernel_lost = tstats.kernel_lost;
+  snapshot->kernel_drop_lost = tstats.kernel_drop_lost;
+  snapshot->kernel_wakeups = tstats.kernel_wakeups;
+
+  timer_load(&g_gc_timer, &snapshot->gc_sweep);
+  timer_load(&g_fqdn_timer, &snapshot->fqdn_resolve);
+  timer_load(&g_reload_timer, &snapshot->reload);
+  snapshot->reload_failures = __atomic_load_n(&g_reload_failures, __ATOMIC_RELAXED);
+
+  lfw_u64 reasons[LFW_REASON_MAX];
+  struct lfw_rule_stats rule_totals[LFW_STATS_MAX_RULES];
+  memset(snapshot->rules, 0, sizeof(snapshot->rules));
+
+  lfw_bpf_lock();
+  lfw_bpf_conntrack_counts_t ct;
+  if (lfw_bpf_read_conntrack_counts(&ct) == LFW_OK) {
+    snapshot->conntrack_v4 = ct.entries[LFW_CT_IPV4];
+    snapshot->conntrack_v6 = ct.entries[LFW_CT_IPV6];
+    for (int st = 0; st < LFW_TCP_STATES && st < LFW_STATS_TCP_STATES; st++) {
+      snapshot->conntrack_tcp_v4[st] = ct.tcp_states[LFW_CT_IPV4][st];
+      snapshot->conntrack_tcp_v6[st] = ct.tcp_states[LFW_CT_IPV6][st];
     }
+  }
+  if (lfw_bpf_read_reason_stats(lfw_bpf_get_reason_stats_fd(), reasons) == LFW_OK) {
+    memcpy(snapshot->reasons, reasons, snapshot->reason_count * sizeof(reasons[0]));
+  }
 
-    lfw_rule_t *new_concrete_rules = NULL;
-    lfw_u32 new_concrete_count = 0;
-    lfw_status_t st = lfw_rules_expand_fqdn(g_raw_rules, g_raw_rule_count, &new_concrete_rules, &new_concrete_count);
-    if (st != LFW_OK) {
-      lfw_bpf_unlock();
-      continue;
+  snapshot->rule_count = g_rule_count < LFW_STATS_MAX_RULES ? g_rule_count : LFW_STATS_MAX_RULES;
+  for (lfw_u32 i = 0; i < snapshot->rule_count; i++) {
+    snapshot->rule_actions[i] = g_rules[i].action == LFW_ACTION_ACCEPT ? 1 : 2;
+  }
+  if (lfw_bpf_read_rule_stats(snapshot->rule_count, rule_totals) == LFW_OK) {
+    for (lfw_u32 i = 0; i < snapshot->rule_count; i++) {
+      snapshot->rules[i].hits = rule_totals[i].hits;
+      snapshot->rules[i].bytes = rule_totals[i].bytes;
     }
+  }
+  lfw_bpf_unlock();
+}
+
+// Zero a snapshot and fill its fixed fields
+static void init_stats(lfw_stats_t *snapshot) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  memcpy(snapshot->magic, LFW_STATS_MAGIC, sizeof(snapshot->magic));
+  snapshot->version = LFW_STATS_VERSION;
+  snapshot->size = sizeof(*snapshot);
+  snapshot->pid = (lfw_u32)getpid();
+  snapshot->interval_ms = g_stats_interval_ms;
+
+  snapshot->reason_count = LFW_REASON_MAX < LFW_STATS_MAX_REASONS ? LFW_REASON_MAX : LFW_STATS_MAX_REASONS;
+  for (lfw_u32 r = 0; r < snapshot->reason_count; r++) {
+    snprintf(snapshot->reason_names[r], LFW_STATS_NAME_LEN, "%s", lfw_bpf_reason_name(r));
+  }
+}
+
+// Publish a snapshot to the stats file and the metrics exporter; runs on
+// the pool
+static void stats_publish(void *ctx) {
+  (void)ctx;
+  collect_stats(&g_stats_snapshot);
+  if (g_stats_writer) {
+    lfw_stats_writer_publish(g_stats_writer, &g_stats_snapshot);
+  }
+  lfw_metrics_update(&g_stats_snapshot);
+}
+
+// Reread the rules file and install its rules. On failure the running
+// rules stay in place and err says why.
+static lfw_status_t reload_config(char *err, size_t err_len) {
+  lfw_u64 reload_start = monotonic_ns();
+  lfw_rule_t *new_rules = NULL;
+  lfw_u32 new_rule_count = 0;
+  lfw_action_t new_default_action = LFW_ACTION_DROP;
+  lfw_loglevel_t new_loglevel = LFW_LOG_OPTIMAL;
+
+  lfw_status_t st = lfw_config_load_file(
+      g_config_path, &new_default_action, &new_rules, &new_rule_count, &new_loglevel);
+  if (st != LFW_OK) {
+    __atomic_add_fetch(&g_reload_failures, 1, __ATOMIC_RELAXED);
+    lfw_log_error("Failed to reload rules configuration file: %s",
+                  g_config_path);
+    snprintf(err, err_len, "cannot load rules file %s", g_config_path);
+    return st;
+  }
 
-    bool changed = false;
-    if (new_concrete_count != g_rule_count) {
-      changed = true;
+  lfw_bpf_lock();
+  lfw_rule_t *expanded_rules = NULL;
+  lfw_u32 expanded_count = 0;
+  st = lfw_rules_expand_fqdn(new_rules, new_rule_count, &expanded_rules, &expanded_count);
+  if (st == LFW_OK) {
+    lfw_loglevel_t active_loglevel = g_cli_loglevel_override ? g_cli_loglevel : new_loglevel;
+    st = lfw_bpf_reload(g_ifname, g_bpf_obj_path, expanded_rules, expanded_count, new_default_action, active_loglevel);
+    if (st == LFW_OK) {
+      lfw_config_free_rules(g_raw_rules);
+      g_raw_rules = new_rules;
+      g_raw_rule_count = new_rule_count;
+
+      lfw_config_free_rules(g_rules);
+      g_rules = expanded_rules;
+      g_rule_count = expanded_count;
+
+      g_default_action = new_default_action;
+      if (!g_cli_loglevel_override) {
+        lfw_log_set_level(new_loglevel);
+      }
+      timer_record(&g_reload_timer, reload_start);
+      lfw_log_info("Rules configuration reloaded successfully");
     } else {
-      for (lfw_u32 i = 0; i < g_rule_count; i++) {
-        if (memcmp(&g_rules[i].match, &new_concrete_rules[i].match, sizeof(lfw_rule_match_t)) != 0 ||
-            g_rules[i].action != new_concrete_rules[i].action) {
-          changed = true;
-          break;
-        }
+      lfw_config_free_rules(expanded_rules);
+      lfw_config_free_rules(new_rules);
+      lfw_log_error("Failed to reload and sync new rules to BPF");
+      snprintf(err, err_len, "cannot install the new rules in the BPF maps");
+    }
+  } else {
+    lfw_config_free_rules(new_rules);
+    lfw_log_error("Failed to expand FQDN rules during reload");
+    snprintf(err, err_len, "cannot expand the FQDN rules");
+  }
+  lfw_bpf_unlock();
+
+  if (st != LFW_OK) {
+    __atomic_add_fetch(&g_reload_failures, 1, __ATOMIC_RELAXED);
+  }
+  return st;
+}
+
+static void control_reload(lfw_control_reply_t *reply) {
+  char err[320];
+  lfw_u64 start = monotonic_ns();
+  if (reload_config(err, sizeof(err)) != LFW_OK) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_FAILED, "reload failed, previous rules kept: %s", err);
+    return;
+  }
+
+  lfw_ctl_reload_t result = {.duration_ns = monotonic_ns() - start};
+  lfw_bpf_lock();
+  result.rule_count = g_rule_count;
+  result.default_action = g_default_action;
+  lfw_bpf_unlock();
+  lfw_control_reply_append(reply, &result, sizeof(result));
+}
+
+static void control_stats(lfw_control_reply_t *reply) {
+  lfw_stats_t snapshot;
+  init_stats(&snapshot);
+  collect_stats(&snapshot);
+  lfw_control_reply_append(reply, &snapshot, sizeof(snapshot));
+}
+
+static bool prefix_match(const lfw_u8 *a, const lfw_u8 *b, lfw_u32 bits) {
+  lfw_u32 bytes = bits / 8;
+  if (memcmp(a, b, bytes) != 0) {
+    return false;
+  }
+  if (bits % 8 == 0) {
+    return true;
+  }
+  lfw_u8 mask = (lfw_u8)(0xFF << (8 - bits % 8));
+  return (a[bytes] & mask) == (b[bytes] & mask);
+}
+
+static bool ct_filter_match(const lfw_ctl_ct_filter_t *filter, const lfw_bpf_conntrack_entry_t *entry) {
+  if (filter->family && (filter->family == 4 ? LFW_CT_IPV4 : LFW_CT_IPV6) != entry->family) {
+    return false;
+  }
+  if (filter->proto && filter->proto != entry->proto) {
+    return false;
+  }
+  if (filter->state != LFW_CTL_STATE_ANY && (entry->proto != IPPROTO_TCP || filter->state != entry->state)) {
+    return false;
+  }
+  if (filter->port && filter->port != entry->port_a && filter->port != entry->port_b) {
+    return false;
+  }
+  if (filter->prefix && !prefix_match(filter->addr, entry->addr_a, filter->prefix) &&
+      !prefix_match(filter->addr, entry->addr_b, filter->prefix)) {
+    return false;
+  }
+  return true;
+}
+
+// Now on the filter's clock, by the telemetry calibration; the two clocks
+// agree until it has run
+static lfw_u64 kernel_now_ns(void) {
+  int64_t offset = 0;
+  lfw_telemetry_clock_offset(&offset);
+  return monotonic_ns() - (lfw_u64)offset;
+}
+
+// State of a conntrack list or flush request during the table walk
+typedef struct {
+  lfw_ctl_ct_filter_t filter;
+  lfw_control_reply_t *reply;
+  bool flush;
+  lfw_u32 matched;
+  lfw_u32 listed;
+  lfw_u64 now_ns; // Kernel clock, for idle times
+} ct_query_t;
+
+static bool ct_query_visit(const lfw_bpf_conntrack_entry_t *entry, void *ctx) {
+  ct_query_t *query = ctx;
+  if (!ct_filter_match(&query->filter, entry)) {
+    return false;
+  }
+  query->matched++;
+  if (query->flush) {
+    return true;
+  }
+  if (query->listed >= query->filter.limit) {
+    return false;
+  }
+
+  lfw_ctl_ct_entry_t out = {
+      .family = entry->family == LFW_CT_IPV4 ? 4 : 6,
+      .proto = entry->proto,
+      .state = entry->state,
+      .action = (lfw_u8)entry->action,
+      .port_a = entry->port_a,
+      .port_b = entry->port_b,
+      .rule = entry->rule == LFW_EVENT_RULE_NONE ? LFW_CTL_RULE_NONE : entry->rule,
+      .packets = entry->packets,
+      .bytes = entry->bytes,
+  };
+  memcpy(out.addr_a, entry->addr_a, sizeof(out.addr_a));
+  memcpy(out.addr_b, entry->addr_b, sizeof(out.addr_b));
+  lfw_u64 idle_ms = query->now_ns > entry->last_seen_ns ? (query->now_ns - entry->last_seen_ns) / 1000000ULL : 0;
+  out.idle_ms = idle_ms > UINT32_MAX ? UINT32_MAX : (lfw_u32)idle_ms;
+
+  if (lfw_control_reply_append(query->reply, &out, sizeof(out))) {
+    query->listed++;
+  }
+  return false;
+}
+
+static void control_conntrack(const void *payload, lfw_u32 length, bool flush, lfw_control_reply_t *reply) {
+  ct_query_t query = {.reply = reply, .flush = flush};
+  if (length != sizeof(query.filter)) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "malformed conntrack filter");
+    return;
+  }
+  memcpy(&query.filter, payload, sizeof(query.filter));
+
+  const lfw_ctl_ct_filter_t *f = &query.filter;
+  if ((f->family != 0 && f->family != 4 && f->family != 6) || (f->prefix && !f->family) ||
+      f->prefix > (f->family == 6 ? 128 : 32) || f->limit > LFW_CTL_LIST_MAX) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "invalid conntrack filter");
+    return;
+  }
+  if (!query.filter.limit) {
+    query.filter.limit = LFW_CTL_LIST_DEFAULT;
+  }
+
+  query.now_ns = kernel_now_ns();
+
+  // The list header goes first and is completed after the walk
+  lfw_ctl_ct_list_t list = {0};
+  if (!flush) {
+    lfw_control_reply_append(reply, &list, sizeof(list));
+  }
+
+  lfw_u64 deleted = 0;
+  lfw_bpf_lock();
+  lfw_status_t st = lfw_bpf_conntrack_walk(ct_query_visit, &query, flush ? &deleted : NULL);
+  lfw_bpf_unlock();
+
+  if (st != LFW_OK) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_FAILED, "cannot walk the conntrack tables");
+    return;
+  }
+
+  if (flush) {
+    lfw_ctl_ct_flush_t result = {.deleted = deleted};
+    lfw_control_reply_append(reply, &result, sizeof(result));
+    lfw_log_info("control: flushed %llu conntrack entries", (unsigned long long)deleted);
+    return;
+  }
+  list.matched = query.matched;
+  list.count = query.listed;
+  void *data = lfw_control_reply_data(reply);
+  if (data) {
+    memcpy(data, &list, sizeof(list));
+  }
+}
+
+static void control_match(const void *payload, lfw_u32 length, lfw_control_reply_t *reply) {
+  lfw_ctl_match_t req;
+  if (length != sizeof(req)) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "malformed match request");
+    return;
+  }
+  memcpy(&req, payload, sizeof(req));
+  if (req.family != 4 && req.family != 6) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "invalid address family %u", req.family);
+    return;
+  }
+
+  // The filter decides a new connection by its first matching rule, as
+  // lfw_rule_match does over the installed rules
+  lfw_packet_t packet = {
+      .direction = LFW_DIR_INBOUND,
+      .protocol = (lfw_proto_t)req.proto,
+      .is_new_connection = true,
+      .rule_index = LFW_RULE_INDEX_NONE,
+      .is_v6 = req.family == 6,
+  };
+  packet.ip.src.ip_version = req.family;
+  packet.ip.dst.ip_version = req.family;
+  if (req.family == 4) {
+    memcpy(&packet.ip.src.v4.addr, req.src, sizeof(packet.ip.src.v4.addr));
+    memcpy(&packet.ip.dst.v4.addr, req.dst, sizeof(packet.ip.dst.v4.addr));
+  } else {
+    memcpy(packet.ip.src.v6.addr, req.src, sizeof(packet.ip.src.v6.addr));
+    memcpy(packet.ip.dst.v6.addr, req.dst, sizeof(packet.ip.dst.v6.addr));
+  }
+  packet.l4.src_port.port = htons(req.src_port);
+  packet.l4.dst_port.port = htons(req.dst_port);
+
+  lfw_ctl_match_result_t result = {.rule = LFW_CTL_RULE_NONE, .dynamic = LFW_CTL_DYN_ANY};
+  lfw_bpf_conntrack_entry_t entry = {
+      .family = req.family == 4 ? LFW_CT_IPV4 : LFW_CT_IPV6,
+      .proto = req.proto,
+      .port_a = req.src_port,
+      .port_b = req.dst_port,
+  };
+  memcpy(entry.addr_a, req.src, sizeof(entry.addr_a));
+  memcpy(entry.addr_b, req.dst, sizeof(entry.addr_b));
+
+  lfw_bpf_lock();
+  result.action = (lfw_u8)g_default_action;
+  for (lfw_u32 i = 0; i < g_rule_count; i++) {
+    if (lfw_rule_match(&g_rules[i], &packet)) {
+      result.rule = i;
+      result.action = (lfw_u8)g_rules[i].action;
+      break;
+    }
+  }
+  // Only TCP and UDP connections are tracked
+  if ((req.proto == IPPROTO_TCP || req.proto == IPPROTO_UDP) && lfw_bpf_conntrack_lookup(&entry) == LFW_OK) {
+    result.tracked = 1;
+    result.tracked_action = (lfw_u8)entry.action;
+    result.tracked_state = entry.state;
+  }
+  // A block of either address comes before all else, an allow before the rules
+  lfw_u64 now_ns = kernel_now_ns();
+  if (lfw_bpf_dyn_listed(LFW_DYN_BLOCK, entry.family, req.src, now_ns) ||
+      lfw_bpf_dyn_listed(LFW_DYN_BLOCK, entry.family, req.dst, now_ns)) {
+    result.dynamic = LFW_CTL_DYN_BLOCK;
+  } else if (lfw_bpf_dyn_listed(LFW_DYN_ALLOW, entry.family, req.src, now_ns) ||
+             lfw_bpf_dyn_listed(LFW_DYN_ALLOW, entry.family, req.dst, now_ns)) {
+    result.dynamic = LFW_CTL_DYN_ALLOW;
+  }
+  lfw_bpf_unlock();
+
+  lfw_control_reply_append(reply, &result, sizeof(result));
+}
+
+// Convert a dynamic list entry of a request; false if it is invalid
+static bool dyn_entry_parse(const void *payload, lfw_u32 index, lfw_u64 now_ns, lfw_bpf_dyn_entry_t *entry) {
+  lfw_ctl_dyn_entry_t in;
+  memcpy(&in, (const lfw_u8 *)payload + (size_t)index * sizeof(in), sizeof(in));
+  if ((in.list != LFW_CTL_DYN_BLOCK && in.list != LFW_CTL_DYN_ALLOW) || (in.family != 4 && in.family != 6) ||
+      in.prefix == 0 || in.prefix > (in.family == 6 ? 128 : 32)) {
+    return false;
+  }
+
+  memset(entry, 0, sizeof(*entry));
+  entry->list = in.list == LFW_CTL_DYN_BLOCK ? LFW_DYN_BLOCK : LFW_DYN_ALLOW;
+  entry->family = in.family == 4 ? LFW_CT_IPV4 : LFW_CT_IPV6;
+  entry->prefixlen = in.prefix;
+  memcpy(entry->addr, in.addr, sizeof(entry->addr));
+  entry->added_ns = now_ns;
+  entry->expires_ns = in.ttl_s ? now_ns + (lfw_u64)in.ttl_s * 1000000000ULL : 0;
+  return true;
+}
+
+static void control_dyn_edit(const void *payload, lfw_u32 length, bool add, lfw_control_reply_t *reply) {
+  if (length == 0 || length % sizeof(lfw_ctl_dyn_entry_t)) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "malformed dynamic list entries");
+    return;
+  }
+  lfw_u32 count = length / sizeof(lfw_ctl_dyn_entry_t);
+  lfw_u64 now_ns = kernel_now_ns();
+  lfw_bpf_dyn_entry_t entry;
+
+  // A bad entry rejects the whole batch before any of it is applied
+  for (lfw_u32 i = 0; i < count; i++) {
+    if (!dyn_entry_parse(payload, i, now_ns, &entry)) {
+      lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "invalid dynamic list entry %u", i + 1);
+      return;
+    }
+  }
+
+  lfw_ctl_dyn_result_t result = {0};
+  lfw_status_t st = LFW_OK;
+  lfw_bpf_lock();
+  for (lfw_u32 i = 0; i < count; i++) {
+    dyn_entry_parse(payload, i, now_ns, &entry);
+    if (!add) {
+      if (lfw_bpf_dyn_del(&entry) == LFW_OK) {
+        result.applied++;
       }
+      continue;
+    }
+    st = lfw_bpf_dyn_add(&entry);
+    if (st != LFW_OK) {
+      break;
     }
+    result.applied++;
+  }
+  lfw_bpf_unlock();
 
-    if (changed) {
-      lfw_log_info("FQDN resolved IPs changed, reloading BPF maps...");
-      lfw_loglevel_t active_loglevel = g_cli_loglevel_override ? g_cli_loglevel : LFW_LOG_OPTIMAL;
-      if (lfw_bpf_reload(g_ifname, bpf_obj_path, new_concrete_rules, new_concrete_count, g_default_action, active_loglevel) == LFW_OK) {
-        lfw_config_free_rules(g_rules);
-        g_rules = new_concrete_rules;
-        g_rule_count = new_concrete_count;
-        lfw_log_info("FQDN rules atomically reloaded");
-      } else {
-        lfw_config_free_rules(new_concrete_rules);
-        lfw_log_error("Failed to reload BPF maps with updated FQDN IPs");
+  if (st != LFW_OK) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_FAILED, "%s after adding %u of %u entries",
+                            st == LFW_ERR_NO_MEMORY ? "dynamic list full" : "cannot update the dynamic lists",
+                            result.applied, count);
+    return;
+  }
+  lfw_log_debug("control: %s %u of %u dynamic list entries", add ? "added" : "deleted", result.applied, count);
+  lfw_control_reply_append(reply, &result, sizeof(result));
+}
+
+// State of a dynamic list or flush request during the walk
+typedef struct {
+  lfw_ctl_dyn_filter_t filter;
+  lfw_control_reply_t *reply;
+  bool flush;
+  lfw_u32 matched;
+  lfw_u32 listed;
+  lfw_u64 now_ns;
+} dyn_query_t;
+
+static bool dyn_query_visit(const lfw_bpf_dyn_entry_t *entry, void *ctx) {
+  dyn_query_t *query = ctx;
+  lfw_u8 list = entry->list == LFW_DYN_BLOCK ? LFW_CTL_DYN_BLOCK : LFW_CTL_DYN_ALLOW;
+  lfw_u8 family = entry->family == LFW_CT_IPV4 ? 4 : 6;
+  if ((query->filter.list != LFW_CTL_DYN_ANY && query->filter.list != list) ||
+      (query->filter.family && query->filter.family != family)) {
+    return false;
+  }
+  if (query->flush) {
+    query->matched++;
+    return true;
+  }
+  // Expired entries wait for the filter or the GC sweep to delete them
+  if (entry->expires_ns && entry->expires_ns <= query->now_ns) {
+    return false;
+  }
+  query->matched++;
+  if (query->listed >= query->filter.limit) {
+    return false;
+  }
+
+  lfw_ctl_dyn_entry_t out = {
+      .list = list,
+      .family = family,
+      .prefix = (lfw_u8)entry->prefixlen,
+  };
+  memcpy(out.addr, entry->addr, sizeof(out.addr));
+  if (entry->expires_ns) {
+    lfw_u64 left_s = (entry->expires_ns - query->now_ns + 999999999ULL) / 1000000000ULL;
+    out.ttl_s = left_s > UINT32_MAX ? UINT32_MAX : (lfw_u32)left_s;
+  }
+
+  if (lfw_control_reply_append(query->reply, &out, sizeof(out))) {
+    query->listed++;
+  }
+  return false;
+}
+
+static void control_dyn_query(const void *payload, lfw_u32 length, bool flush, lfw_control_reply_t *reply) {
+  dyn_query_t query = {.reply = reply, .flush = flush};
+  if (length != sizeof(query.filter)) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "malformed dynamic list filter");
+    return;
+  }
+  memcpy(&query.filter, payload, sizeof(query.filter));
+
+  const lfw_ctl_dyn_filter_t *f = &query.filter;
+  if ((f->list != LFW_CTL_DYN_BLOCK && f->list != LFW_CTL_DYN_ALLOW && f->list != LFW_CTL_DYN_ANY) ||
+      (f->family != 0 && f->family != 4 && f->family != 6) || f->limit > LFW_CTL_LIST_MAX) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_INVALID, "invalid dynamic list filter");
+    return;
+  }
+  if (!query.filter.limit) {
+    query.filter.limit = LFW_CTL_LIST_DEFAULT;
+  }
+  query.now_ns = kernel_now_ns();
+
+  // The list header goes first and is completed after the walk
+  lfw_ctl_dyn_list_t list = {0};
+  if (!flush) {
+    lfw_control_reply_append(reply, &list, sizeof(list));
+  }
+
+  lfw_u64 deleted = 0;
+  lfw_bpf_lock();
+  lfw_status_t st = lfw_bpf_dyn_walk(dyn_query_visit, &query, flush ? &deleted : NULL);
+  lfw_bpf_unlock();
+
+  if (st != LFW_OK) {
+    lfw_control_reply_error(reply, LFW_CTL_ERR_FAILED, "cannot walk the dynamic lists");
+    return;
+  }
+
+  if (flush) {
+    lfw_ctl_dyn_result_t result = {.applied = (lfw_u32)deleted};
+    lfw_control_reply_append(reply, &result, sizeof(result));
+    lfw_log_info("control: flushed %llu dynamic list entries", (unsigned long long)deleted);
+    return;
+  }
+  list.matched = query.matched;
+  list.count = query.listed;
+  void *data = lfw_control_reply_data(reply);
+  if (data) {
+    memcpy(data, &list, sizeof(list));
+  }
+}
+
+static void control_handle(void *ctx, lfw_u16 command, const void *payload, lfw_u32 length,
+                           lfw_control_reply_t *reply) {
+  (void)ctx;
+  switch (command) {
+  case LFW_CTL_RELOAD:
+    control_reload(reply);
+    break;
+  case LFW_CTL_STATS:
+    control_stats(reply);
+    break;
+  case LFW_CTL_CONNTRACK_LIST:
+  case LFW_CTL_CONNTRACK_FLUSH:
+    control_conntrack(payload, length, command == LFW_CTL_CONNTRACK_FLUSH, reply);
+    break;
+  case LFW_CTL_MATCH:
+    control_match(payload, length, reply);
+    break;
+  case LFW_CTL_DYN_ADD:
+  case LFW_CTL_DYN_DEL:
+    control_dyn_edit(payload, length, command == LFW_CTL_DYN_ADD, reply);
+    break;
+  case LFW_CTL_DYN_LIST:
+  case LFW_CTL_DYN_FLUSH:
+    control_dyn_query(payload, length, command == LFW_CTL_DYN_FLUSH, reply);
+    break;
+  default:
+    lfw_control_reply_error(reply, LFW_CTL_ERR_UNSUPPORTED, "unknown command %u", command);
+    break;
+  }
+}
+
+// Reload on the pool for SIGHUP and --watch-rules, which wait for no
+// answer; the reactor runs it once more if asked again meanwhile
+static void reload_task(void *ctx) {
+  (void)ctx;
+  char err[320];
+  reload_config(err, sizeof(err));
+}
+
+// Answer control requests on the pool; the main loop sends the replies
+static void control_task(void *ctx) {
+  (void)ctx;
+  lfw_control_run(g_control);
+}
+
+// SIGUSR1: rule hit counters and telemetry totals
+static void dump_stats_task(void *ctx) {
+  (void)ctx;
+  lfw_bpf_lock();
+  lfw_bpf_dump_stats(g_rules, g_rule_count, g_default_action);
+  lfw_bpf_unlock();
+
+  lfw_telemetry_stats_t tstats;
+  lfw_telemetry_get_stats(&tstats);
+  lfw_log_info("Telemetry: received=%llu, rate_limited=%llu, queue_dropped=%llu, "
+               "kernel submitted=%llu, kernel lost=%llu (drops %llu), wakeups=%llu",
+               (unsigned long long)tstats.received, (unsigned long long)tstats.rate_limited,
+               (unsigned long long)tstats.queue_dropped, (unsigned long long)tstats.kernel_submitted,
+               (unsigned long long)tstats.kernel_lost, (unsigned long long)tstats.kernel_drop_lost,
+               (unsigned long long)tstats.kernel_wakeups);
+}
+
+// SIGUSR2: walk the conntrack tables, one syscall per entry
+static void dump_conntrack_task(void *ctx) {
+  (void)ctx;
+  lfw_bpf_lock();
+  lfw_bpf_dump_conntrack();
+  lfw_bpf_unlock();
+}
+
+static lfw_reactor_task_t g_gc_task = LFW_REACTOR_TASK(conntrack_gc, NULL);
+static lfw_reactor_task_t g_fqdn_task = LFW_REACTOR_TASK(fqdn_refresh, NULL);
+static lfw_reactor_task_t g_stats_task = LFW_REACTOR_TASK(stats_publish, NULL);
+static lfw_reactor_task_t g_reload_task = LFW_REACTOR_TASK(reload_task, NULL);
+static lfw_reactor_task_t g_control_task = LFW_REACTOR_TASK(control_task, NULL);
+static lfw_reactor_task_t g_dump_stats_task = LFW_REACTOR_TASK(dump_stats_task, NULL);
+static lfw_reactor_task_t g_dump_conntrack_task = LFW_REACTOR_TASK(dump_conntrack_task, NULL);
+
+// Timer callback queueing the task in ctx
+static void queue_task(void *ctx) {
+  lfw_reactor_queue(g_reactor, ctx);
+}
+
+static void handle_signal(void *ctx, int sig) {
+  (void)ctx;
+  if (sig == SIGINT || sig == SIGTERM) {
+    lfw_reactor_stop(g_reactor);
+  } else if (sig == SIGHUP) {
+    lfw_reactor_queue(g_reactor, &g_reload_task);
+  } else if (sig == SIGUSR1) {
+    lfw_reactor_queue(g_reactor, &g_dump_stats_task);
+  } else if (sig == SIGUSR2) {
+    lfw_reactor_queue(g_reactor, &g_dump_conntrack_task);
+  }
+}
+
+// Serve the control socket and pass the requests read to the pool, then
+// time the next idle check, if any client is left to check
+static void serve_control(void *ctx) {
+  (void)ctx;
+  lfw_reactor_timer_set(g_control_timer, lfw_control_process(g_control), 0);
+  if (lfw_control_pending(g_control)) {
+    lfw_reactor_queue(g_reactor, &g_control_task);
+  }
+}
+
+static void control_ready(void *ctx, lfw_u32 events) {
+  (void)events;
+  serve_control(ctx);
+}
+
+// Reload once the rules file has been left alone for a while
+static void rules_watch_ready(void *ctx, lfw_u32 events) {
+  (void)ctx;
+  (void)events;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+  ssize_t n;
+  while ((n = read(g_rules_watch_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n;) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      if ((ev->mask & IN_Q_OVERFLOW) || (ev->len && strcmp(ev->name, g_rules_name) == 0)) {
+        changed = true;
       }
-    } else {
-      lfw_config_free_rules(new_concrete_rules);
+      p += sizeof(*ev) + ev->len;
     }
-    lfw_bpf_unlock();
   }
-  return NULL;
+  if (changed) {
+    lfw_reactor_timer_set(g_rules_settle_timer, RULES_SETTLE_MS, 0);
+  }
+}
+
+static void rules_settled(void *ctx) {
+  (void)ctx;
+  lfw_log_info("rules file %s changed, reloading", g_config_path);
+  lfw_reactor_queue(g_reactor, &g_reload_task);
+}
+
+// Watch the directory of the rules file for the file being written or
+// renamed into place
+static lfw_status_t watch_rules_file(void) {
+  static char dir[sizeof(g_config_path)];
+  const char *slash = strrchr(g_config_path, '/');
+  if (!slash) {
+    strcpy(dir, ".");
+    g_rules_name = g_config_path;
+  } else if (slash == g_config_path) {
+    strcpy(dir, "/");
+    g_rules_name = slash + 1;
+  } else {
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - g_config_path), g_config_path);
+    g_rules_name = slash + 1;
+  }
+
+  g_rules_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (g_rules_watch_fd < 0 || inotify_add_watch(g_rules_watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    return LFW_ERR_GENERIC;
+  }
+  g_rules_settle_timer = lfw_reactor_timer_add(g_reactor, rules_settled, NULL);
+  if (!g_rules_settle_timer ||
+      lfw_reactor_add_fd(g_reactor, g_rules_watch_fd, EPOLLIN, rules_watch_ready, NULL) != LFW_OK) {
+    return LFW_ERR_GENERIC;
+  }
+  return LFW_OK;
+}
+
+// Queue task every interval_ms
+static lfw_status_t schedule_task(lfw_reactor_task_t *task, lfw_u32 interval_ms) {
+  lfw_reactor_timer_t *timer = lfw_reactor_timer_add(g_reactor, queue_task, task);
+  if (!timer) {
+    return LFW_ERR_GENERIC;
+  }
+  return lfw_reactor_timer_set(timer, interval_ms, interval_ms);
 }
 
 static void cleanup(void) {
   lfw_log_info("cleaning up BPF subsystem...");
-  g_running = 0;
 
-  if (g_telemetry_running) {
-    pthread_join(g_telemetry_thread, NULL);
-    g_telemetry_running = false;
+  // Pool tasks use everything below, so they finish first; one that has
+  // not started is dropped
+  if (g_reactor) {
+    lfw_reactor_destroy(g_reactor);
+    g_reactor = NULL;
+    g_control_timer = NULL;
+    g_rules_settle_timer = NULL;
+  }
+  if (g_control) {
+    lfw_control_close(g_control);
+    g_control = NULL;
+  }
+  if (g_rules_watch_fd >= 0) {
+    close(g_rules_watch_fd);
+    g_rules_watch_fd = -1;
   }
 
-  if (g_gc_running) {
-    pthread_join(g_gc_thread, NULL);
-    g_gc_running = false;
+  if (g_metrics_running) {
+    lfw_metrics_stop();
+    g_metrics_running = false;
+  }
+  if (g_stats_writer) {
+    lfw_stats_writer_close(g_stats_writer);
+    g_stats_writer = NULL;
   }
 
-  if (g_fqdn_running) {
-    pthread_join(g_fqdn_thread, NULL);
-    g_fqdn_running = false;
+  lfw_telemetry_stats_t tstats;
+  lfw_telemetry_get_stats(&tstats);
+  lfw_telemetry_stop();
+  if (tstats.kernel_lost || tstats.queue_dropped) {
+    lfw_log_info("telemetry: %llu events received, %llu lost in the kernel, %llu dropped in worker queues",
+                 (unsigned long long)tstats.received, (unsigned long long)tstats.kernel_lost,
+                 (unsigned long long)tstats.queue_dropped);
+  }
+
+  if (g_eventlog) {
+    lfw_eventlog_stats_t stats;
+    lfw_eventlog_flush(g_eventlog, true);
+    lfw_eventlog_get_stats(g_eventlog, &stats);
+    lfw_log_info("event log: %llu records written, %llu lost, %llu rotations",
+                 (unsigned long long)stats.records, (unsigned long long)stats.lost,
+                 (unsigned long long)stats.rotations);
+    lfw_eventlog_close(g_eventlog);
+    g_eventlog = NULL;
   }
 
   lfw_bpf_lock();
@@ -400,6 +1085,39 @@ static void cleanup(void) {
   lfw_log_close();
 }
 
+// Value of a "--name value" or "--name=value" option at argv[*i], or NULL
+// if argv[*i] is another argument. *missing is set when the value is absent.
+static const char *option_value(int argc, char **argv, int *i, const char *name, bool *missing) {
+  size_t len = strlen(name);
+  if (strncmp(argv[*i], name, len) != 0) {
+    return NULL;
+  }
+  if (argv[*i][len] == '=') {
+    return argv[*i] + len + 1;
+  }
+  if (argv[*i][len] != '\0') {
+    return NULL;
+  }
+  if (*i + 1 >= argc) {
+    *missing = true;
+    return NULL;
+  }
+  return argv[++*i];
+}
+
+// Parse an events ring size in KiB: a power of two, at least a page
+static bool parse_ring_size(const char *option, const char *str, lfw_u32 *bytes) {
+  unsigned long page_kib = (unsigned long)sysconf(_SC_PAGESIZE) / 1024;
+  char *end = NULL;
+  unsigned long kib = strtoul(str, &end, 10);
+  if (!end || *end != '\0' || kib < page_kib || kib > (1UL << 20) || (kib & (kib - 1)) != 0) {
+    fprintf(stderr, "Invalid %s: %s (KiB, a power of two from %lu to 1048576)\n", option, str, page_kib);
+    return false;
+  }
+  *bytes = (lfw_u32)(kib * 1024);
+  return true;
+}
+
 int main(int argc, char **argv) {
   // Root privilege check
   if (geteuid() != 0) {
@@ -410,18 +1128,63 @@ int main(int argc, char **argv) {
   const char *ifname = NULL;
   const char *rules_path = NULL;
   const char *cli_loglevel_str = NULL;
+  const char *event_log_size_str = NULL;
+  const char *event_log_files_str = NULL;
+  const char *telemetry_workers_str = NULL;
+  const char *telemetry_rate_str = NULL;
+  const char *telemetry_window_str = NULL;
+  const char *sample_packets_str = NULL;
+  const char *sample_flows_str = NULL;
+  const char *drop_ring_size_str = NULL;
+  const char *allow_ring_size_str = NULL;
+  bool percpu_rings = false;
+  bool watch_rules = false;
+  const char *stats_file = NULL;
+  const char *stats_interval_str = NULL;
+  const char *metrics_listen = NULL;
+  const char *control_path = NULL;
+  lfw_eventlog_config_t event_log = {0};
 
   for (int i = 1; i < argc; i++) {
-    if (strcmp(argv[i], "--log-level") == 0) {
-      if (i + 1 < argc) {
-        cli_loglevel_str = argv[i + 1];
-        i++;
-      } else {
-        fprintf(stderr, "Error: --log-level requires an argument\n");
-        return 1;
-      }
-    } else if (strncmp(argv[i], "--log-level=", 12) == 0) {
-      cli_loglevel_str = argv[i] + 12;
+    const char *value = NULL;
+    bool missing = false;
+    if ((value = option_value(argc, argv, &i, "--log-level", &missing))) {
+      cli_loglevel_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--event-log", &missing))) {
+      event_log.path = value;
+    } else if ((value = option_value(argc, argv, &i, "--event-log-size", &missing))) {
+      event_log_size_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--event-log-files", &missing))) {
+      event_log_files_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--telemetry-workers", &missing))) {
+      telemetry_workers_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--telemetry-rate", &missing))) {
+      telemetry_rate_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--telemetry-window", &missing))) {
+      telemetry_window_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--sample-packets", &missing))) {
+      sample_packets_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--sample-flows", &missing))) {
+      sample_flows_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--drop-ring-size", &missing))) {
+      drop_ring_size_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--allow-ring-size", &missing))) {
+      allow_ring_size_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--stats-file", &missing))) {
+      stats_file = value;
+    } else if ((value = option_value(argc, argv, &i, "--stats-interval", &missing))) {
+      stats_interval_str = value;
+    } else if ((value = option_value(argc, argv, &i, "--metrics", &missing))) {
+      metrics_listen = value;
+    } else if ((value = option_value(argc, argv, &i, "--control", &missing))) {
+      control_path = value;
+    } else if (strcmp(argv[i], "--percpu-rings") == 0) {
+      percpu_rings = true;
+    } else if (strcmp(argv[i], "--watch-rules") == 0) {
+      watch_rules = true;
+    } else if (missing) {
+      fprintf(stderr, "Error: %s requires an argument\n", argv[i]);
+      return 1;
     } else if (argv[i][0] == '-') {
       fprintf(stderr, "Unknown option: %s\n", argv[i]);
       return 1;
@@ -438,10 +1201,121 @@ int main(int argc, char **argv) {
   }
 
   if (!ifname) {
-    fprintf(stderr, "Usage: %s <interface> [rules_file_path] [--log-level minimal|optimal|max|super_max]\n", argv[0]);
+    fprintf(stderr, "Usage: %s <interface> [rules_file_path] [--log-level minimal|optimal|max|super_max]\n"
+                    "       [--event-log <path> [--event-log-size <MiB>] [--event-log-files <n>]]\n"
+                    "       [--telemetry-workers <n>] [--telemetry-rate <events/s>] [--telemetry-window <ms>]\n"
+                    "       [--sample-packets <n>] [--sample-flows <n>]\n"
+                    "       [--drop-ring-size <KiB>] [--allow-ring-size <KiB>] [--percpu-rings]\n"
+                    "       [--stats-file <path>] [--metrics <socket path|port>] [--stats-interval <ms>]\n"
+                    "       [--control <socket path>] [--watch-rules]\n", argv[0]);
     return 1;
   }
 
+  if (event_log_size_str) {
+    char *end = NULL;
+    unsigned long long mib = strtoull(event_log_size_str, &end, 10);
+    if (!end || *end != '\0' || mib == 0 || mib > (1ULL << 20)) {
+      fprintf(stderr, "Invalid --event-log-size: %s (MiB)\n", event_log_size_str);
+      return 1;
+    }
+    event_log.max_bytes = (lfw_u64)mib << 20;
+  }
+  if (event_log_files_str) {
+    char *end = NULL;
+    unsigned long files = strtoul(event_log_files_str, &end, 10);
+    if (!end || *end != '\0' || files == 0 || files > 999) {
+      fprintf(stderr, "Invalid --event-log-files: %s (1-999)\n", event_log_files_str);
+      return 1;
+    }
+    event_log.max_files = (lfw_u32)files;
+  }
+  // Syslog telemetry is capped at 100 events per second by default
+  lfw_telemetry_config_t telemetry = {.rate_limit = 100};
+  if (telemetry_workers_str) {
+    char *end = NULL;
+    unsigned long workers = strtoul(telemetry_workers_str, &end, 10);
+    if (!end || *end != '\0' || workers == 0 || workers > 16) {
+      fprintf(stderr, "Invalid --telemetry-workers: %s (1-16)\n", telemetry_workers_str);
+      return 1;
+    }
+    telemetry.workers = (lfw_u32)workers;
+  }
+  if (telemetry_rate_str) {
+    char *end = NULL;
+    unsigned long rate = strtoul(telemetry_rate_str, &end, 10);
+    if (!end || *end != '\0' || rate > UINT32_MAX) {
+      fprintf(stderr, "Invalid --telemetry-rate: %s (events per second, 0 for no limit)\n", telemetry_rate_str);
+      return 1;
+    }
+    telemetry.rate_limit = (lfw_u32)rate;
+  }
+  if (telemetry_window_str) {
+    char *end = NULL;
+    unsigned long window = strtoul(telemetry_window_str, &end, 10);
+    if (!end || *end != '\0' || window > 3600000) {
+      fprintf(stderr, "Invalid --telemetry-window: %s (ms, 0 for per-packet events)\n", telemetry_window_str);
+      return 1;
+    }
+    telemetry.window_ms = (lfw_u32)window;
+    lfw_bpf_set_telemetry_window(telemetry.window_ms);
+  }
+  unsigned long sample_packets = 0;
+  unsigned long sample_flows = 0;
+  if (sample_packets_str) {
+    char *end = NULL;
+    sample_packets = strtoul(sample_packets_str, &end, 10);
+    if (!end || *end != '\0' || sample_packets > UINT32_MAX) {
+      fprintf(stderr, "Invalid --sample-packets: %s (report 1 in n, 0 for off)\n", sample_packets_str);
+      return 1;
+    }
+  }
+  if (sample_flows_str) {
+    char *end = NULL;
+    sample_flows = strtoul(sample_flows_str, &end, 10);
+    if (!end || *end != '\0' || sample_flows > UINT32_MAX) {
+      fprintf(stderr, "Invalid --sample-flows: %s (report 1 in n, 0 for off)\n", sample_flows_str);
+      return 1;
+    }
+  }
+  lfw_bpf_set_telemetry_sampling((lfw_u32)sample_packets, (lfw_u32)sample_flows);
+
+  lfw_u32 drop_ring_size = 0;
+  lfw_u32 allow_ring_size = 0;
+  if ((drop_ring_size_str && !parse_ring_size("--drop-ring-size", drop_ring_size_str, &drop_ring_size)) ||
+      (allow_ring_size_str && !parse_ring_size("--allow-ring-size", allow_ring_size_str, &allow_ring_size))) {
+    return 1;
+  }
+  lfw_bpf_set_event_rings(drop_ring_size, allow_ring_size, percpu_rings);
+  if ((event_log_size_str || event_log_files_str) && !event_log.path) {
+    fprintf(stderr, "Error: --event-log-size and --event-log-files require --event-log\n");
+    return 1;
+  }
+  if (stats_interval_str) {
+    char *end = NULL;
+    unsigned long interval = strtoul(stats_interval_str, &end, 10);
+    if (!end || *end != '\0' || interval < 100 || interval > 60000) {
+      fprintf(stderr, "Invalid --stats-interval: %s (ms, 100-60000)\n", stats_interval_str);
+      return 1;
+    }
+    if (!stats_file && !metrics_listen) {
+      fprintf(stderr, "Error: --stats-interval requires --stats-file or --metrics\n");
+      return 1;
+    }
+    g_stats_interval_ms = (lfw_u32)interval;
+  }
+  if (control_path && control_path[0] != '/') {
+    fprintf(stderr, "Invalid --control: %s (absolute socket path)\n", control_path);
+    return 1;
+  }
+  if (metrics_listen && metrics_listen[0] != '/') {
+    char *end = NULL;
+    unsigned long port = strtoul(metrics_listen, &end, 10);
+    if (!end || *end != '\0' || port == 0 || port > 65535) {
+      fprintf(stderr, "Invalid --metrics: %s (absolute socket path or TCP port)\n", metrics_listen);
+      return 1;
+    }
+  }
+
   if (rules_path) {
     strncpy(g_config_path, rules_path, sizeof(g_config_path) - 1);
   }
@@ -464,22 +1338,37 @@ int main(int argc, char **argv) {
     g_cli_loglevel = cli_level;
   }
 
+  // Signals are read from a signalfd by the event loop. Block them before
+  // any thread starts, so every thread inherits the mask and none of them
+  // is picked to take a signal itself.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  sigaddset(&signals, SIGUSR1);
+  sigaddset(&signals, SIGUSR2);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
   lfw_log_init(LFW_LOG_SYSLOG);
   if (g_cli_loglevel_override) {
     lfw_log_set_level(g_cli_loglevel);
   }
 
-  // Register signal handlers
-  struct sigaction sa = {};
-  sa.sa_handler = handle_signal;
-  sigemptyset(&sa.sa_mask);
-  sigaction(SIGINT, &sa, NULL);
-  sigaction(SIGTERM, &sa, NULL);
-  sigaction(SIGHUP, &sa, NULL);
-  sigaction(SIGUSR1, &sa, NULL);
+  // Telemetry and GC threads log through per-thread rings drained by a
+  // background writer, so a slow syslog never stalls them
+  if (lfw_log_start_async(NULL) != LFW_OK) {
+    lfw_log_error("failed to start async logging, logging synchronously");
+  }
 
   atexit(cleanup);
 
+  g_reactor = lfw_reactor_create(REACTOR_WORKERS);
+  if (!g_reactor || lfw_reactor_add_signals(g_reactor, &signals, handle_signal, NULL) != LFW_OK) {
+    lfw_log_error("failed to set up the event loop: %s", strerror(errno));
+    return 1;
+  }
+
   if (ifname) {
     strncpy(g_ifname, ifname, sizeof(g_ifname) - 1);
   }
@@ -510,17 +1399,26 @@ int main(int argc, char **argv) {
   if (access(bpf_obj_path, F_OK) != 0) {
     bpf_obj_path = "/usr/local/share/lfw/lfw_bpf.o";
   }
+  g_bpf_obj_path = bpf_obj_path;
   st = lfw_bpf_init(ifname, bpf_obj_path);
   if (st != LFW_OK) {
     lfw_log_error("failed to initialize BPF on interface %s", ifname);
     return 1;
   }
 
-  // Spawn telemetry thread
-  if (pthread_create(&g_telemetry_thread, NULL, telemetry_loop, NULL) == 0) {
-    g_telemetry_running = true;
-  } else {
-    lfw_log_error("failed to spawn telemetry thread");
+  if (event_log.path) {
+    g_eventlog = lfw_eventlog_open(&event_log);
+    if (!g_eventlog) {
+      lfw_log_error("failed to open event log %s", event_log.path);
+      return 1;
+    }
+    lfw_log_info("telemetry events are written to %s", event_log.path);
+  }
+
+  // Start the telemetry drain thread and its formatting workers
+  telemetry.eventlog = g_eventlog;
+  if (lfw_telemetry_start(&telemetry) != LFW_OK) {
+    lfw_log_error("failed to start telemetry consumer");
     return 1;
   }
 
@@ -531,84 +1429,73 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  // 4. Spawn connection tracking garbage collector thread
-  if (pthread_create(&g_gc_thread, NULL, conntrack_gc_loop, NULL) == 0) {
-    g_gc_running = true;
-  } else {
-    lfw_log_error("failed to spawn conntrack GC thread");
-    return 1;
+  if (stats_file) {
+    g_stats_writer = lfw_stats_writer_open(stats_file, g_stats_interval_ms);
+    if (!g_stats_writer) {
+      lfw_log_error("failed to create stats file %s: %s", stats_file, strerror(errno));
+      return 1;
+    }
+    lfw_log_info("statistics are published to %s every %u ms", stats_file, g_stats_interval_ms);
+  }
+  if (metrics_listen) {
+    if (lfw_metrics_start(metrics_listen) != LFW_OK) {
+      lfw_log_error("failed to start metrics exporter on %s", metrics_listen);
+      return 1;
+    }
+    g_metrics_running = true;
+    lfw_log_info("metrics are served on %s", metrics_listen);
+  }
+  if (stats_file || metrics_listen) {
+    init_stats(&g_stats_snapshot);
+    if (schedule_task(&g_stats_task, g_stats_interval_ms) != LFW_OK) {
+      lfw_log_error("failed to schedule statistics publishing");
+      return 1;
+    }
+    lfw_reactor_queue(g_reactor, &g_stats_task);
   }
 
-  // Spawn FQDN re-resolution thread
-  if (pthread_create(&g_fqdn_thread, NULL, fqdn_resolver_loop, NULL) == 0) {
-    g_fqdn_running = true;
-  } else {
-    lfw_log_error("failed to spawn FQDN resolver thread");
+  // 4. Schedule connection tracking garbage collection and FQDN re-resolution
+  if (schedule_task(&g_gc_task, GC_INTERVAL_MS) != LFW_OK) {
+    lfw_log_error("failed to schedule conntrack GC");
+    return 1;
+  }
+  if (schedule_task(&g_fqdn_task, FQDN_INTERVAL_MS) != LFW_OK) {
+    lfw_log_error("failed to schedule FQDN re-resolution");
     return 1;
   }
 
+  if (control_path) {
+    g_control = lfw_control_open(control_path, control_handle, NULL);
+    if (!g_control) {
+      lfw_log_error("failed to open control socket %s: %s", control_path, strerror(errno));
+      return 1;
+    }
+    g_control_timer = lfw_reactor_timer_add(g_reactor, serve_control, NULL);
+    if (!g_control_timer ||
+        lfw_reactor_add_fd(g_reactor, lfw_control_fd(g_control), EPOLLIN, control_ready, NULL) != LFW_OK) {
+      lfw_log_error("failed to serve control socket %s", control_path);
+      return 1;
+    }
+    lfw_log_info("control socket listening on %s", control_path);
+  }
+  if (watch_rules) {
+    if (watch_rules_file() != LFW_OK) {
+      lfw_log_error("failed to watch rules file %s: %s", g_config_path, strerror(errno));
+      return 1;
+    }
+    lfw_log_info("rules file %s is reloaded when it changes", g_config_path);
+  }
+
   lfw_log_info("daemon starting on interface %s", ifname);
   lfw_log_info("config: %s, rules: %u, default: %s", g_config_path,
                g_rule_count,
                g_default_action == LFW_ACTION_ACCEPT ? "ACCEPT" : "DROP");
 
-  // Main event loop
-  while (g_running) {
-    if (g_reload_requested) {
-      g_reload_requested = 0;
-      lfw_rule_t *new_rules = NULL;
-      lfw_u32 new_rule_count = 0;
-      lfw_action_t new_default_action = LFW_ACTION_DROP;
-      lfw_loglevel_t new_loglevel = LFW_LOG_OPTIMAL;
-
-      lfw_status_t reload_st = lfw_config_load_file(
-          g_config_path, &new_default_action, &new_rules, &new_rule_count, &new_loglevel);
-
-      if (reload_st == LFW_OK) {
-        lfw_bpf_lock();
-        lfw_rule_t *expanded_rules = NULL;
-        lfw_u32 expanded_count = 0;
-        lfw_status_t exp_status = lfw_rules_expand_fqdn(new_rules, new_rule_count, &expanded_rules, &expanded_count);
-        if (exp_status == LFW_OK) {
-          lfw_loglevel_t active_loglevel = g_cli_loglevel_override ? g_cli_loglevel : new_loglevel;
-          if (lfw_bpf_reload(g_ifname, bpf_obj_path, expanded_rules, expanded_count, new_default_action, active_loglevel) == LFW_OK) {
-            lfw_config_free_rules(g_raw_rules);
-            g_raw_rules = new_rules;
-            g_raw_rule_count = new_rule_count;
-
-            lfw_config_free_rules(g_rules);
-            g_rules = expanded_rules;
-            g_rule_count = expanded_count;
-
-            g_default_action = new_default_action;
-            if (!g_cli_loglevel_override) {
-              lfw_log_set_level(new_loglevel);
-            }
-            lfw_log_info("Rules configuration reloaded successfully");
-          } else {
-            lfw_config_free_rules(expanded_rules);
-            lfw_config_free_rules(new_rules);
-            lfw_log_error("Failed to reload and sync new rules to BPF");
-          }
-        } else {
-          lfw_config_free_rules(new_rules);
-          lfw_log_error("Failed to expand FQDN rules during reload");
-        }
-        lfw_bpf_unlock();
-      } else {
-        lfw_log_error("Failed to reload rules configuration file: %s",
-                      g_config_path);
-      }
-    }
-
-    if (g_dump_requested) {
-      g_dump_requested = 0;
-      lfw_bpf_lock();
-      lfw_bpf_dump_stats(g_rules, g_rule_count, g_default_action);
-      lfw_bpf_unlock();
-    }
-
-    pause();
+  // Main event loop: signals, the control socket, the rules file watch and
+  // the task timers. Nothing wakes it while the firewall is left alone.
+  if (lfw_reactor_run(g_reactor) != LFW_OK) {
+    lfw_log_error("event loop failed: %s", strerror(errno));
+    return 1;
   }
 
   lfw_log_info("shutdown complete");
@@ -0,0 +1,656 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef LFW_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef LFW_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Mapped files are read ahead and released one window at a time */
+#define CAPTURE_WINDOW (64UL << 20)
+
+/* Initial decompression buffer; grows to fit the largest record */
+#define CAPTURE_CHUNK (4UL << 20)
+
+/* Compressed input read per zstd refill */
+#define CAPTURE_ZSTD_IN (1UL << 20)
+
+/* Records larger than this are treated as corruption */
+#define CAPTURE_MAX_RECORD (64UL << 20)
+
+#define PCAP_MAGIC_USEC     0xA1B2C3D4u
+#define PCAP_MAGIC_NSEC     0xA1B23C4Du
+#define PCAPNG_SHB          0x0A0D0D0Au
+#define PCAPNG_BYTE_ORDER   0x1A2B3C4Du
+#define PCAPNG_IDB          0x00000001u
+#define PCAPNG_OPB          0x00000002u
+#define PCAPNG_SPB          0x00000003u
+#define PCAPNG_EPB          0x00000006u
+#define PCAPNG_OPT_TSRESOL  9
+
+#define LINKTYPE_ETHERNET    1
+#define LINKTYPE_RAW         101
+#define LINKTYPE_LINUX_SLL   113
+#define LINKTYPE_IPV4        228
+#define LINKTYPE_IPV6        229
+#define LINKTYPE_LINUX_SLL2  276
+
+typedef enum {
+    SRC_MMAP = 0,
+    SRC_READ,
+    SRC_GZIP,
+    SRC_ZSTD
+} capture_src_t;
+
+/* pcapng interface: link type and timestamp units */
+typedef struct {
+    lfw_u32 linktype;
+    bool    ts_pow2;   /* units of 2^-ts_exp s, else 10^-ts_exp s */
+    lfw_u8  ts_exp;
+} capture_if_t;
+
+struct lfw_capture {
+    int            fd;
+    capture_src_t  src;
+    bool           pcapng;
+    bool           swapped;     /* file byte order differs from ours */
+    bool           nsec;        /* pcap: nanosecond timestamps */
+    lfw_u32        linktype;    /* pcap: single link type */
+
+    /* Readable bytes are buf[pos, end) */
+    const uint8_t *buf;
+    size_t         pos;
+    size_t         end;
+
+    /* SRC_MMAP */
+    uint8_t       *map;
+    size_t         map_size;
+    size_t         window_end;
+
+    /* Streaming sources */
+    uint8_t       *chunk;
+    size_t         chunk_cap;
+    bool           eof;
+    bool           failed;
+#ifdef LFW_HAVE_ZLIB
+    gzFile         gz;
+#endif
+#ifdef LFW_HAVE_ZSTD
+    ZSTD_DStream  *zs;
+    uint8_t       *zin_buf;
+    ZSTD_inBuffer  zin;
+    size_t         zlast;      /* last ZSTD_decompressStream hint, 0 at frame end */
+#endif
+
+    /* pcapng interfaces of the current section */
+    capture_if_t  *ifs;
+    lfw_u32        if_count;
+    lfw_u32        if_cap;
+
+    char           format[32];
+    char           err[128];
+};
+
+/* ------------------------------
+ * Byte order
+ * ------------------------------ */
+
+static inline lfw_u16 rd16(const lfw_capture_t *c, const uint8_t *p)
+{
+    lfw_u16 v;
+    memcpy(&v, p, 2);
+    return c->swapped ? __builtin_bswap16(v) : v;
+}
+
+static inline lfw_u32 rd32(const lfw_capture_t *c, const uint8_t *p)
+{
+    lfw_u32 v;
+    memcpy(&v, p, 4);
+    return c->swapped ? __builtin_bswap32(v) : v;
+}
+
+static int fail(lfw_capture_t *c, const char *msg)
+{
+    snprintf(c->err, sizeof(c->err), "%s", msg);
+    c->failed = true;
+    return -1;
+}
+
+/* ------------------------------
+ * Sources
+ * ------------------------------ */
+
+/* Fill dst with up to n decompressed bytes: >0 bytes, 0 at EOF, -1 on error */
+static ssize_t src_fill(lfw_capture_t *c, uint8_t *dst, size_t n)
+{
+    switch (c->src) {
+    case SRC_READ:
+        for (;;) {
+            ssize_t r = read(c->fd, dst, n);
+            if (r >= 0 || errno != EINTR) {
+                if (r < 0)
+                    snprintf(c->err, sizeof(c->err), "read: %s", strerror(errno));
+                return r;
+            }
+        }
+#ifdef LFW_HAVE_ZLIB
+    case SRC_GZIP: {
+        int r = gzread(c->gz, dst, n > (1U << 30) ? (1U << 30) : (unsigned)n);
+        if (r < 0) {
+            int zerr;
+            snprintf(c->err, sizeof(c->err), "gzip: %s", gzerror(c->gz, &zerr));
+        }
+        return r;
+    }
+#endif
+#ifdef LFW_HAVE_ZSTD
+    case SRC_ZSTD: {
+        ZSTD_outBuffer out = { dst, n, 0 };
+        while (out.pos == 0) {
+            if (c->zin.pos == c->zin.size) {
+                ssize_t r = read(c->fd, c->zin_buf, CAPTURE_ZSTD_IN);
+                if (r < 0 && errno == EINTR)
+                    continue;
+                if (r < 0) {
+                    snprintf(c->err, sizeof(c->err), "read: %s", strerror(errno));
+                    return -1;
+                }
+                if (r == 0) {
+                    if (c->zlast != 0) {
+                        snprintf(c->err, sizeof(c->err), "zstd: truncated stream");
+                        return -1;
+                    }
+                    return 0;
+                }
+                c->zin.size = (size_t)r;
+                c->zin.pos = 0;
+            }
+            c->zlast = ZSTD_decompressStream(c->zs, &out, &c->zin);
+            if (ZSTD_isError(c->zlast)) {
+                snprintf(c->err, sizeof(c->err), "zstd: %s", ZSTD_getErrorName(c->zlast));
+                return -1;
+            }
+        }
+        return (ssize_t)out.pos;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* Make at least need bytes readable at pos, keeping the unread tail */
+static bool src_refill(lfw_capture_t *c, size_t need)
+{
+    if (c->src == SRC_MMAP || c->eof || c->failed)
+        return false;
+
+    size_t avail = c->end - c->pos;
+
+    if (need > c->chunk_cap) {
+        size_t cap = c->chunk_cap * 2 > need ? c->chunk_cap * 2 : need;
+        uint8_t *tmp = realloc(c->chunk, cap);
+        if (!tmp) {
+            fail(c, "out of memory");
+            return false;
+        }
+        c->chunk = tmp;
+        c->chunk_cap = cap;
+    }
+
+    memmove(c->chunk, c->chunk + c->pos, avail);
+    c->buf = c->chunk;
+    c->pos = 0;
+    c->end = avail;
+
+    /* Fill the whole buffer so reads stay large */
+    while (c->end < need) {
+        ssize_t r = src_fill(c, c->chunk + c->end, c->chunk_cap - c->end);
+        if (r < 0) {
+            c->failed = true;
+            return false;
+        }
+        if (r == 0) {
+            c->eof = true;
+            return false;
+        }
+        c->end += (size_t)r;
+    }
+
+    return true;
+}
+
+/* Pointer to n readable bytes at pos, or NULL at EOF/error */
+static inline const uint8_t *cap_peek(lfw_capture_t *c, size_t n)
+{
+    if (c->end - c->pos >= n || src_refill(c, n))
+        return c->buf + c->pos;
+    return NULL;
+}
+
+/* Read ahead the next window and drop the one fully consumed */
+static void map_advance(lfw_capture_t *c)
+{
+    while (c->pos >= c->window_end && c->window_end < c->map_size) {
+        size_t ahead = c->window_end + CAPTURE_WINDOW;
+
+        if (ahead < c->map_size) {
+            size_t len = c->map_size - ahead;
+            madvise(c->map + ahead, len < CAPTURE_WINDOW ? len : CAPTURE_WINDOW, MADV_WILLNEED);
+        }
+        if (c->window_end >= CAPTURE_WINDOW)
+            madvise(c->map + c->window_end - CAPTURE_WINDOW, CAPTURE_WINDOW, MADV_DONTNEED);
+
+        c->window_end += CAPTURE_WINDOW;
+    }
+}
+
+/* ------------------------------
+ * Link types and timestamps
+ * ------------------------------ */
+
+bool lfw_capture_link(lfw_u32 linktype, lfw_link_t *link)
+{
+    switch (linktype) {
+    case LINKTYPE_ETHERNET:
+        *link = LFW_LINK_ETHERNET;
+        return true;
+    case LINKTYPE_LINUX_SLL:
+        *link = LFW_LINK_LINUX_SLL;
+        return true;
+    case LINKTYPE_LINUX_SLL2:
+        *link = LFW_LINK_LINUX_SLL2;
+        return true;
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+    case LINKTYPE_IPV6:
+    case 12: /* DLT_RAW as written by some libpcap builds */
+    case 14: /* DLT_RAW on OpenBSD */
+        *link = LFW_LINK_RAW;
+        return true;
+    default:
+        *link = LFW_LINK_ETHERNET;
+        return false;
+    }
+}
+
+static lfw_u64 pow10_u64(lfw_u8 e)
+{
+    lfw_u64 v = 1;
+    while (e--)
+        v *= 10;
+    return v;
+}
+
+static lfw_u64 pcapng_ts_ns(const capture_if_t *i, lfw_u64 ts)
+{
+    if (i->ts_pow2)
+        return (lfw_u64)(((unsigned __int128)ts * 1000000000u) >> i->ts_exp);
+    if (i->ts_exp <= 9)
+        return ts * pow10_u64((lfw_u8)(9 - i->ts_exp));
+    return ts / pow10_u64((lfw_u8)(i->ts_exp - 9));
+}
+
+static void fill_frame(lfw_capture_frame_t *f,
+                       const uint8_t *data, lfw_u32 caplen, lfw_u32 len,
+                       lfw_u64 ts_ns, lfw_u32 linktype)
+{
+    f->data = data;
+    f->caplen = caplen;
+    f->len = len;
+    f->ts_ns = ts_ns;
+    f->linktype = linktype;
+    f->link_known = lfw_capture_link(linktype, &f->link);
+}
+
+/* ------------------------------
+ * pcap
+ * ------------------------------ */
+
+static int pcap_next_record(lfw_capture_t *c, lfw_capture_frame_t *f)
+{
+    const uint8_t *p = cap_peek(c, 16);
+    if (!p) {
+        if (c->failed)
+            return -1;
+        return c->pos == c->end ? 0 : fail(c, "truncated record header");
+    }
+
+    lfw_u32 sec    = rd32(c, p);
+    lfw_u32 frac   = rd32(c, p + 4);
+    lfw_u32 caplen = rd32(c, p + 8);
+    lfw_u32 len    = rd32(c, p + 12);
+
+    if (caplen > CAPTURE_MAX_RECORD)
+        return fail(c, "record too large");
+
+    p = cap_peek(c, 16 + (size_t)caplen);
+    if (!p)
+        return c->failed ? -1 : fail(c, "truncated record");
+
+    lfw_u64 ts = (lfw_u64)sec * 1000000000u + (lfw_u64)frac * (c->nsec ? 1u : 1000u);
+    fill_frame(f, p + 16, caplen, len, ts, c->linktype);
+
+    c->pos += 16 + (size_t)caplen;
+    return 1;
+}
+
+/* ------------------------------
+ * pcapng
+ * ------------------------------ */
+
+static int pcapng_add_if(lfw_capture_t *c, const uint8_t *body, lfw_u32 body_len)
+{
+    if (body_len < 8)
+        return fail(c, "short interface block");
+
+    if (c->if_count == c->if_cap) {
+        lfw_u32 cap = c->if_cap ? c->if_cap * 2 : 4;
+        capture_if_t *tmp = realloc(c->ifs, cap * sizeof(*tmp));
+        if (!tmp)
+            return fail(c, "out of memory");
+        c->ifs = tmp;
+        c->if_cap = cap;
+    }
+
+    capture_if_t *i = &c->ifs[c->if_count++];
+    i->linktype = rd16(c, body);
+    i->ts_pow2 = false;
+    i->ts_exp = 6;
+
+    /* Options: code, length, value padded to 32 bits */
+    lfw_u32 off = 8;
+    while (off + 4 <= body_len) {
+        lfw_u16 code = rd16(c, body + off);
+        lfw_u16 olen = rd16(c, body + off + 2);
+        if (code == 0 || off + 4 + olen > body_len)
+            break;
+        if (code == PCAPNG_OPT_TSRESOL && olen >= 1) {
+            lfw_u8 res = body[off + 4];
+            i->ts_pow2 = (res & 0x80) != 0;
+            i->ts_exp = res & 0x7F;
+            if ((i->ts_pow2 && i->ts_exp > 63) || (!i->ts_pow2 && i->ts_exp > 19))
+                return fail(c, "unsupported timestamp resolution");
+        }
+        off += 4 + ((olen + 3u) & ~3u);
+    }
+
+    return 0;
+}
+
+static int pcapng_next_record(lfw_capture_t *c, lfw_capture_frame_t *f)
+{
+    for (;;) {
+        const uint8_t *p = cap_peek(c, 12);
+        if (!p) {
+            if (c->failed)
+                return -1;
+            return c->pos == c->end ? 0 : fail(c, "truncated block header");
+        }
+
+        lfw_u32 type;
+        memcpy(&type, p, 4);
+
+        /* The section header's byte-order magic sets the endianness */
+        if (type == PCAPNG_SHB) {
+            lfw_u32 bom;
+            memcpy(&bom, p + 8, 4);
+            if (bom == PCAPNG_BYTE_ORDER)
+                c->swapped = false;
+            else if (bom == __builtin_bswap32(PCAPNG_BYTE_ORDER))
+                c->swapped = true;
+            else
+                return fail(c, "bad section byte order");
+        }
+
+        type = rd32(c, p);
+        lfw_u32 total = rd32(c, p + 4);
+        if (total < 12 || (total & 3) || total > CAPTURE_MAX_RECORD)
+            return fail(c, "bad block length");
+
+        p = cap_peek(c, total);
+        if (!p)
+            return c->failed ? -1 : fail(c, "truncated block");
+
+        const uint8_t *body = p + 8;
+        lfw_u32 body_len = total - 12;
+        int rc = 0;
+
+        switch (type) {
+        case PCAPNG_SHB:
+            c->if_count = 0;
+            break;
+        case PCAPNG_IDB:
+            if (pcapng_add_if(c, body, body_len) < 0)
+                return -1;
+            break;
+        case PCAPNG_EPB:
+        case PCAPNG_OPB: {
+            if (body_len < 20)
+                return fail(c, "short packet block");
+            lfw_u32 ifid = type == PCAPNG_EPB ? rd32(c, body) : rd16(c, body);
+            lfw_u64 ts = ((lfw_u64)rd32(c, body + 4) << 32) | rd32(c, body + 8);
+            lfw_u32 caplen = rd32(c, body + 12);
+            lfw_u32 len = rd32(c, body + 16);
+            if (ifid >= c->if_count)
+                return fail(c, "packet on undeclared interface");
+            if (caplen > body_len - 20)
+                return fail(c, "packet overruns its block");
+            fill_frame(f, body + 20, caplen, len,
+                       pcapng_ts_ns(&c->ifs[ifid], ts), c->ifs[ifid].linktype);
+            rc = 1;
+            break;
+        }
+        case PCAPNG_SPB: {
+            if (body_len < 4 || c->if_count == 0)
+                return fail(c, "bad simple packet block");
+            lfw_u32 len = rd32(c, body);
+            lfw_u32 caplen = len < body_len - 4 ? len : body_len - 4;
+            fill_frame(f, body + 4, caplen, len, 0, c->ifs[0].linktype);
+            rc = 1;
+            break;
+        }
+        default:
+            break;
+        }
+
+        c->pos += total;
+        if (rc)
+            return rc;
+    }
+}
+
+/* ------------------------------
+ * Public API
+ * ------------------------------ */
+
+static bool open_source(lfw_capture_t *c, const char *path, char *err, size_t err_len)
+{
+    struct stat st;
+    uint8_t magic[4] = {0};
+
+    c->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (c->fd < 0 || fstat(c->fd, &st) != 0) {
+        snprintf(err, err_len, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    posix_fadvise(c->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    bool regular = S_ISREG(st.st_mode);
+    if (regular && pread(c->fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)) {
+        snprintf(err, err_len, "%s: file too short", path);
+        return false;
+    }
+
+    if (magic[0] == 0x1F && magic[1] == 0x8B) {
+#ifdef LFW_HAVE_ZLIB
+        c->gz = gzdopen(c->fd, "rb");
+        if (!c->gz) {
+            snprintf(err, err_len, "%s: gzdopen failed", path);
+            return false;
+        }
+        c->fd = -1;  /* owned by gz now */
+        gzbuffer(c->gz, 1U << 20);
+        c->src = SRC_GZIP;
+#else
+        snprintf(err, err_len, "%s: gzip support not built (needs zlib)", path);
+        return false;
+#endif
+    } else if (magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD) {
+#ifdef LFW_HAVE_ZSTD
+        c->zs = ZSTD_createDStream();
+        c->zin_buf = malloc(CAPTURE_ZSTD_IN);
+        if (!c->zs || !c->zin_buf) {
+            snprintf(err, err_len, "%s: out of memory", path);
+            return false;
+        }
+        ZSTD_initDStream(c->zs);
+        c->zin.src = c->zin_buf;
+        c->src = SRC_ZSTD;
+#else
+        snprintf(err, err_len, "%s: zstd support not built (needs libzstd)", path);
+        return false;
+#endif
+    } else if (regular && st.st_size > 0) {
+        c->map_size = (size_t)st.st_size;
+        c->map = mmap(NULL, c->map_size, PROT_READ, MAP_PRIVATE, c->fd, 0);
+        if (c->map == MAP_FAILED) {
+            c->map = NULL;
+            c->src = SRC_READ;
+        } else {
+            madvise(c->map, c->map_size, MADV_SEQUENTIAL);
+            madvise(c->map, c->map_size < 2 * CAPTURE_WINDOW ? c->map_size : 2 * CAPTURE_WINDOW,
+                    MADV_WILLNEED);
+            c->src = SRC_MMAP;
+            c->buf = c->map;
+            c->end = c->map_size;
+            c->window_end = CAPTURE_WINDOW;
+        }
+    } else {
+        c->src = SRC_READ;
+    }
+
+    if (c->src != SRC_MMAP) {
+        c->chunk_cap = CAPTURE_CHUNK;
+        c->chunk = malloc(c->chunk_cap);
+        if (!c->chunk) {
+            snprintf(err, err_len, "%s: out of memory", path);
+            return false;
+        }
+        c->buf = c->chunk;
+    }
+
+    return true;
+}
+
+lfw_capture_t *lfw_capture_open(const char *path, char *err, size_t err_len)
+{
+    if (!path || !err || err_len == 0)
+        return NULL;
+
+    lfw_capture_t *c = calloc(1, sizeof(*c));
+    if (!c) {
+        snprintf(err, err_len, "out of memory");
+        return NULL;
+    }
+    c->fd = -1;
+
+    if (!open_source(c, path, err, err_len)) {
+        lfw_capture_close(c);
+        return NULL;
+    }
+
+    const uint8_t *p = cap_peek(c, 4);
+    lfw_u32 magic = 0;
+    if (p)
+        memcpy(&magic, p, 4);
+
+    if (magic == PCAPNG_SHB) {
+        c->pcapng = true;
+    } else if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC ||
+               magic == __builtin_bswap32(PCAP_MAGIC_USEC) ||
+               magic == __builtin_bswap32(PCAP_MAGIC_NSEC)) {
+        c->swapped = magic == __builtin_bswap32(PCAP_MAGIC_USEC) ||
+                     magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+        c->nsec = magic == PCAP_MAGIC_NSEC || magic == __builtin_bswap32(PCAP_MAGIC_NSEC);
+
+        p = cap_peek(c, 24);
+        if (!p) {
+            snprintf(err, err_len, "%s: truncated pcap header", path);
+            lfw_capture_close(c);
+            return NULL;
+        }
+        /* Upper bits carry FCS information */
+        c->linktype = rd32(c, p + 20) & 0x03FFFFFF;
+        c->pos += 24;
+    } else {
+        snprintf(err, err_len, "%s: not a pcap or pcapng file", path);
+        lfw_capture_close(c);
+        return NULL;
+    }
+
+    const char *comp = c->src == SRC_GZIP ? "+gzip" : c->src == SRC_ZSTD ? "+zstd" : "";
+    snprintf(c->format, sizeof(c->format), "%s%s", c->pcapng ? "pcapng" : "pcap", comp);
+
+    return c;
+}
+
+int lfw_capture_next(lfw_capture_t *cap, lfw_capture_frame_t *frame)
+{
+    if (!cap || !frame)
+        return -1;
+
+    if (cap->failed)
+        return -1;
+
+    if (cap->src == SRC_MMAP)
+        map_advance(cap);
+
+    return cap->pcapng ? pcapng_next_record(cap, frame) : pcap_next_record(cap, frame);
+}
+
+const char *lfw_capture_error(const lfw_capture_t *cap)
+{
+    return cap ? cap->err : "invalid capture";
+}
+
+const char *lfw_capture_format(const lfw_capture_t *cap)
+{
+    return cap ? cap->format : "none";
+}
+
+void lfw_capture_close(lfw_capture_t *cap)
+{
+    if (!cap)
+        return;
+
+    if (cap->map)
+        munmap(cap->map, cap->map_size);
+#ifdef LFW_HAVE_ZLIB
+    if (cap->gz)
+        gzclose(cap->gz);
+#endif
+#ifdef LFW_HAVE_ZSTD
+    ZSTD_freeDStream(cap->zs);
+    free(cap->zin_buf);
+#endif
+    if (cap->fd >= 0)
+        close(cap->fd);
+    free(cap->chunk);
+    free(cap->ifs);
+    free(cap);
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_CAPTURE_H
+#define LFW_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lfw_types.h"
+#include "lfw_packet_parse.h"
+
+/*
+ * Streaming pcap / pcapng reader for the offline tools.
+ *
+ * Uncompressed files are mmap'd and parsed in place, so frames are
+ * handed out as pointers into the mapping. gzip (and zstd, when built
+ * with LFW_HAVE_ZSTD) captures are decompressed in chunks into a
+ * reusable buffer. Frame data is valid until the next call to
+ * lfw_capture_next.
+ */
+
+typedef struct lfw_capture lfw_capture_t;
+
+/* One captured frame */
+typedef struct {
+    const uint8_t *data;
+    lfw_u32        caplen;
+    lfw_u32        len;       /* Original length on the wire */
+    lfw_u64        ts_ns;     /* Capture timestamp, ns since the epoch */
+    lfw_u32        linktype;  /* LINKTYPE_* of the capturing interface */
+    lfw_link_t     link;      /* Parser framing for linktype */
+    bool           link_known;
+} lfw_capture_frame_t;
+
+/* Open a capture file; on failure NULL is returned and err is filled */
+lfw_capture_t *lfw_capture_open(const char *path, char *err, size_t err_len);
+
+/* Next frame: 1 on success, 0 at end of file, -1 on a malformed file */
+int lfw_capture_next(lfw_capture_t *cap, lfw_capture_frame_t *frame);
+
+/* Description of the last error */
+const char *lfw_capture_error(const lfw_capture_t *cap);
+
+/* Container and compression, e.g. "pcapng+gzip" */
+const char *lfw_capture_format(const lfw_capture_t *cap);
+
+/* Close and unmap */
+void lfw_capture_close(lfw_capture_t *cap);
+
+/* Map a LINKTYPE_* value to the parser's framing */
+bool lfw_capture_link(lfw_u32 linktype, lfw_link_t *link);
+
+#endif
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lfw_eventlog.h"
+
+/*
+ * Decoder for the daemon's binary telemetry log (lfw --event-log).
+ *
+ * Usage:
+ *   lfw-eventdump [-f json|csv] <file>...
+ *
+ * Files are decoded in the order given; to read a rotated set oldest
+ * first, list <path>.N ... <path>.1 <path>. JSON output has one object
+ * per line with the same fields as the daemon's syslog lines plus the
+ * wall-clock time; CSV output starts with a header row.
+ */
+
+typedef enum {
+    FORMAT_JSON,
+    FORMAT_CSV
+} dump_format_t;
+
+/* Records are read in blocks of this many */
+#define DUMP_BATCH 4096
+
+static const char *proto_name(lfw_u8 proto, char *buf, size_t len)
+{
+    switch (proto) {
+    case 1:  return "icmp";
+    case 2:  return "igmp";
+    case 6:  return "tcp";
+    case 17: return "udp";
+    case 50: return "esp";
+    case 51: return "ah";
+    case 58: return "icmpv6";
+    default:
+        snprintf(buf, len, "%u", proto);
+        return buf;
+    }
+}
+
+static void format_addr(const struct lfw_event *ev, bool src, char *buf, size_t len)
+{
+    const void *addr = src ? (const void *)&ev->src_ip : (const void *)&ev->dst_ip;
+
+    if (ev->ip_version == 4) {
+        inet_ntop(AF_INET, addr, buf, (socklen_t)len);
+    } else if (ev->ip_version == 6) {
+        inet_ntop(AF_INET6, addr, buf, (socklen_t)len);
+    } else {
+        snprintf(buf, len, "?");
+    }
+}
+
+/* RFC 3339 UTC time with nanoseconds */
+static void format_time(lfw_u64 epoch_ns, char *buf, size_t len)
+{
+    time_t sec = (time_t)(epoch_ns / 1000000000ULL);
+    struct tm tm;
+    char date[32];
+
+    gmtime_r(&sec, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf, len, "%s.%09lluZ", date, (unsigned long long)(epoch_ns % 1000000000ULL));
+}
+
+static void print_event(const struct lfw_event *ev, lfw_u64 mono_to_epoch_ns, dump_format_t format)
+{
+    char src[INET6_ADDRSTRLEN];
+    char dst[INET6_ADDRSTRLEN];
+    char when[64];
+    char proto_buf[8];
+
+    format_addr(ev, true, src, sizeof(src));
+    format_addr(ev, false, dst, sizeof(dst));
+    format_time(ev->timestamp + mono_to_epoch_ns, when, sizeof(when));
+
+    const char *proto = proto_name(ev->proto, proto_buf, sizeof(proto_buf));
+    const char *action = ev->action == 1 ? "ALLOW" : "DROP";
+    const char *flow = ev->kind == LFW_EVENT_FLOW_FIRST   ? "first" :
+                       ev->kind == LFW_EVENT_FLOW_SUMMARY ? "summary" :
+                       ev->kind == LFW_EVENT_FLOW_NEW     ? "new" : "packet";
+
+    /* Rules are numbered from 1, as in the daemon's statistics dump */
+    char rule[16] = "";
+    if (ev->rule != LFW_EVENT_RULE_NONE)
+        snprintf(rule, sizeof(rule), "%u", ev->rule + 1);
+
+    if (format == FORMAT_CSV) {
+        printf("%llu,%s,%s,%s,%s,%u,%s,%u,%llu,%u,%s,%s,%u\n",
+               (unsigned long long)ev->timestamp, when, action, proto,
+               src, ntohs(ev->src_port), dst, ntohs(ev->dst_port),
+               (unsigned long long)ev->pkt_len, ev->packets, rule, flow, ev->sample_rate);
+        return;
+    }
+
+    printf("{\"timestamp\": %llu, \"time\": \"%s\", \"action\": \"%s\", \"proto\": \"%s\", "
+           "\"src\": \"%s:%u\", \"dst\": \"%s:%u\", \"len\": %llu",
+           (unsigned long long)ev->timestamp, when, action, proto,
+           src, ntohs(ev->src_port), dst, ntohs(ev->dst_port),
+           (unsigned long long)ev->pkt_len);
+    if (rule[0])
+        printf(", \"rule\": %s", rule);
+    if (ev->kind != LFW_EVENT_PACKET)
+        printf(", \"flow\": \"%s\", \"packets\": %u", flow, ev->packets);
+    if (ev->sample_rate > 1)
+        printf(", \"sample\": %u", ev->sample_rate);
+    printf("}\n");
+}
+
+/* Decode one file; returns the number of records or -1 on error */
+static long long dump_file(const char *path, dump_format_t format)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    lfw_eventlog_header_t hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, LFW_EVENTLOG_MAGIC, sizeof(hdr.magic)) != 0) {
+        fprintf(stderr, "%s: not an lfw event log\n", path);
+        fclose(f);
+        return -1;
+    }
+    if (hdr.version != LFW_EVENTLOG_VERSION || hdr.record_size == 0 || hdr.record_size > 4096) {
+        fprintf(stderr, "%s: unsupported event log version %u\n", path, hdr.version);
+        fclose(f);
+        return -1;
+    }
+
+    /*
+     * Records written by a daemon with a different layout are decoded
+     * field-compatibly: shorter ones are extended with defaults (one
+     * packet, no rule, not sampled), longer ones cut.
+     */
+    size_t rec = hdr.record_size;
+    size_t copy = rec < sizeof(struct lfw_event) ? rec : sizeof(struct lfw_event);
+    unsigned char *buf = malloc(rec * DUMP_BATCH);
+    if (!buf) {
+        fprintf(stderr, "out of memory\n");
+        fclose(f);
+        return -1;
+    }
+
+    long long count = 0;
+    size_t n;
+    while ((n = fread(buf, 1, rec * DUMP_BATCH, f)) > 0) {
+        size_t records = n / rec;
+        for (size_t i = 0; i < records; i++) {
+            struct lfw_event ev = {0};
+            memcpy(&ev, buf + i * rec, copy);
+            if (copy < offsetof(struct lfw_event, packets) + sizeof(ev.packets))
+                ev.packets = 1;
+            if (copy < offsetof(struct lfw_event, rule) + sizeof(ev.rule))
+                ev.rule = LFW_EVENT_RULE_NONE;
+            if (copy < offsetof(struct lfw_event, sample_rate) + sizeof(ev.sample_rate))
+                ev.sample_rate = 1;
+            print_event(&ev, hdr.mono_to_epoch_ns, format);
+        }
+        count += (long long)records;
+
+        if (n % rec) {
+            /* Only the tail of a file still being written can be partial */
+            fprintf(stderr, "%s: ignoring truncated record at end of file\n", path);
+            break;
+        }
+    }
+
+    bool failed = ferror(f);
+    if (failed)
+        fprintf(stderr, "%s: read error\n", path);
+
+    free(buf);
+    fclose(f);
+    return failed ? -1 : count;
+}
+
+int main(int argc, char **argv)
+{
+    dump_format_t format = FORMAT_JSON;
+    bool bad_args = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt == 'f' && strcmp(optarg, "json") == 0) {
+            format = FORMAT_JSON;
+        } else if (opt == 'f' && strcmp(optarg, "csv") == 0) {
+            format = FORMAT_CSV;
+        } else {
+            bad_args = true;
+        }
+    }
+
+    if (bad_args || optind >= argc) {
+        fprintf(stderr, "usage: %s [-f json|csv] <file>...\n", argv[0]);
+        return 1;
+    }
+
+    if (format == FORMAT_CSV)
+        printf("timestamp,time,action,proto,src_ip,src_port,dst_ip,dst_port,len,packets,rule,flow,sample\n");
+
+    int rc = 0;
+    for (int i = optind; i < argc; i++) {
+        if (dump_file(argv[i], format) < 0)
+            rc = 1;
+    }
+
+    if (fflush(stdout) != 0) {
+        fprintf(stderr, "write error: %s\n", strerror(errno));
+        rc = 1;
+    }
+    return rc;
+}
@@ -1,13 +1,20 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 #include <stdio.h>
-#include <pcap.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "lfw_engine.h"
 #include "lfw_packet_parse.h"
 #include "lfw_config.h"
 #include "lfw_log.h"
 #include "lfw_state.h"
+#include "lfw_matcher.h"
+#include "lfw_capture.h"
+#include "lfw_pcapng_writer.h"
 
 /*
  * Offline pcap tester for lfw.
@@ -15,19 +22,348 @@
  * Behaviour is analogous to the main daemon in src/main.c:
  *   - load rules from /etc/lfw/lfw.rules by default
  *   - optionally override rules path via CLI
- *   - evaluate each packet with the same engine logic
+ *   - evaluate packets in batches with the same engine logic
  *
  * Usage:
- *   lfw_pcap_test <file.pcap> [rules_file]
+ *   lfw_pcap_test [-j workers] [-v] [-w out.pcapng] [-a accepted.pcapng]
+ *                 [-d dropped.pcapng] <file.pcap|file.pcapng[.gz|.zst]> [rules_file]
  *
- * If rules_file is omitted, /etc/lfw/lfw.rules is used.
+ * If rules_file is omitted, /etc/lfw/lfw.rules is used. Captures are read
+ * with the built-in reader (lfw_capture.c): mmap'd and parsed in place, or
+ * streamed through gzip/zstd when compressed.
+ *
+ * With -j N the reader hashes each packet's 5-tuple (direction-agnostic)
+ * to one of N worker threads, so every flow is evaluated on one thread in
+ * capture order, like RSS on a multi-queue NIC. Per-packet lines are only
+ * printed with -v; aggregate counters are always printed at the end.
+ *
+ * Connection timeouts run on capture time: the state table's clock is
+ * driven from packet timestamps, so a replay expires the same flows
+ * however fast it runs and with any number of workers.
+ *
+ * -w writes every evaluated packet back out as pcapng, -a and -d only the
+ * accepted or dropped ones. Each packet carries a comment with its
+ * verdict, the index of the deciding rule and the established flag, e.g.
+ * "lfw: verdict=drop rule=3 established=0" (rule=- for the default
+ * policy and established flows). Packets are written in evaluation
+ * order: capture order with one worker, per-flow capture order with -j.
  */
+
+#define REPLAY_MAX_WORKERS 64
+
+/* Batches queued per worker before the reader blocks. */
+#define REPLAY_QUEUE_DEPTH 32
+
+/* Initial frame storage per batch when writing output */
+#define REPLAY_FRAME_BYTES (LFW_ENGINE_BATCH_MAX * 2048)
+
+/* Captured frame kept for output; bytes at replay_batch_t.data + off */
+typedef struct {
+    lfw_u64 ts_ns;
+    size_t  off;
+    lfw_u32 caplen;
+    lfw_u32 len;
+    lfw_u32 linktype;
+} replay_frame_t;
+
+typedef struct {
+    lfw_packet_t   pkts[LFW_ENGINE_BATCH_MAX];
+    replay_frame_t frames[LFW_ENGINE_BATCH_MAX];  /* only kept with output */
+    lfw_u32        count;
+    lfw_u64        ts_sec;  /* capture second of every packet in the batch */
+
+    /* Frame bytes; swapped, not copied, between reader and queue */
+    uint8_t       *data;
+    size_t         data_len;
+    size_t         data_cap;
+} replay_batch_t;
+
+/* pcapng outputs shared by all workers */
+typedef struct {
+    lfw_pcapng_writer_t *all;       /* -w */
+    lfw_pcapng_writer_t *accepted;  /* -a */
+    lfw_pcapng_writer_t *dropped;   /* -d */
+    pthread_mutex_t      lock;
+} replay_output_t;
+
+struct replay_worker;
+
+/*
+ * Capture-time clock for the state table. Each worker evaluates a batch
+ * at that batch's own second; expiry runs at the low watermark, the
+ * second every worker has reached, so no worker that is behind sees a
+ * flow expired early. The reader ends each second with an (empty) tick
+ * batch to every worker, which keeps idle workers from holding the
+ * watermark back.
+ */
+typedef struct {
+    lfw_u64               sec;      /* low watermark */
+    struct replay_worker *workers;
+    int                   jobs;
+} replay_clock_t;
+
+typedef struct replay_worker {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;     /* queue became non-empty, non-full or closed */
+    replay_batch_t *ring;
+    lfw_u32         head;     /* next batch to evaluate */
+    lfw_u32         tail;     /* next free slot */
+    bool            closed;
+    lfw_engine_t   *engine;
+    replay_clock_t *clock;
+    replay_output_t *out;     /* NULL unless writing pcapng */
+    bool            verbose;
+    lfw_u64         sec;      /* second being evaluated, read by peers */
+
+    /* Written by the worker only, read after join */
+    lfw_u64         packets;
+    lfw_u64         accepted;
+    lfw_u64         established;
+    lfw_u64         dropped;
+} __attribute__((aligned(64))) replay_worker_t;
+
+/* Same value for both directions of a flow */
+static lfw_u32 flow_hash(const lfw_packet_t *pkt)
+{
+    lfw_u32 addr;
+
+    if (pkt->ip.src.ip_version == 4) {
+        addr = pkt->ip.src.v4.addr ^ pkt->ip.dst.v4.addr;
+    } else {
+        lfw_u32 a[4], b[4];
+        memcpy(a, pkt->ip.src.v6.addr, 16);
+        memcpy(b, pkt->ip.dst.v6.addr, 16);
+        addr = a[0] ^ a[1] ^ a[2] ^ a[3] ^ b[0] ^ b[1] ^ b[2] ^ b[3];
+    }
+
+    lfw_u64 h = ((lfw_u64)addr << 24) ^
+                ((lfw_u64)(pkt->l4.src_port.port ^ pkt->l4.dst_port.port) << 8) ^
+                (lfw_u64)pkt->protocol;
+
+    /* MurmurHash3 finalizer */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return (lfw_u32)h;
+}
+
+/* Second of the batch being evaluated on this thread (0: none) */
+static __thread lfw_u64 replay_thread_sec;
+
+static lfw_u64 replay_clock_now(void *ctx)
+{
+    const replay_clock_t *clock = (const replay_clock_t *)ctx;
+
+    if (replay_thread_sec)
+        return replay_thread_sec;
+    return __atomic_load_n(&clock->sec, __ATOMIC_ACQUIRE);
+}
+
+/* Raise the watermark to the slowest worker's second, expiring on a tick */
+static void replay_clock_sync(replay_clock_t *clock, lfw_engine_t *engine)
+{
+    lfw_u64 low = UINT64_MAX;
+
+    for (int q = 0; q < clock->jobs; q++) {
+        lfw_u64 sec = __atomic_load_n(&clock->workers[q].sec, __ATOMIC_ACQUIRE);
+        if (sec < low)
+            low = sec;
+    }
+
+    lfw_u64 cur = __atomic_load_n(&clock->sec, __ATOMIC_RELAXED);
+    while (low > cur) {
+        if (__atomic_compare_exchange_n(&clock->sec, &cur, low, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            /* Expire at the watermark, not at this worker's second */
+            replay_thread_sec = 0;
+            lfw_engine_tick(engine);
+            return;
+        }
+    }
+}
+
+/* Write one evaluated batch to the outputs, annotating every packet */
+static void replay_output_batch(replay_output_t *out,
+                                const replay_batch_t *b,
+                                const lfw_verdict_t *verdicts)
+{
+    char comment[80];
+
+    pthread_mutex_lock(&out->lock);
+
+    for (lfw_u32 i = 0; i < b->count; i++) {
+        const lfw_packet_t *pkt = &b->pkts[i];
+        const replay_frame_t *f = &b->frames[i];
+        bool accept = verdicts[i] == LFW_VERDICT_ACCEPT;
+        char rule[16] = "-";
+
+        if (pkt->rule_index != LFW_RULE_INDEX_NONE)
+            snprintf(rule, sizeof(rule), "%u", pkt->rule_index);
+        snprintf(comment, sizeof(comment), "lfw: verdict=%s rule=%s established=%d",
+                 accept ? "accept" : "drop", rule, pkt->is_established ? 1 : 0);
+
+        if (out->all)
+            lfw_pcapng_writer_add(out->all, f->linktype, f->ts_ns,
+                                  b->data + f->off, f->caplen, f->len, comment);
+
+        lfw_pcapng_writer_t *split = accept ? out->accepted : out->dropped;
+        if (split)
+            lfw_pcapng_writer_add(split, f->linktype, f->ts_ns,
+                                  b->data + f->off, f->caplen, f->len, comment);
+    }
+
+    pthread_mutex_unlock(&out->lock);
+}
+
+/* Close the outputs; false if any failed */
+static bool replay_output_close(replay_output_t *out)
+{
+    lfw_pcapng_writer_t *writers[] = { out->all, out->accepted, out->dropped };
+    char err[128];
+    bool ok = true;
+
+    for (size_t i = 0; i < sizeof(writers) / sizeof(writers[0]); i++) {
+        if (writers[i] && lfw_pcapng_writer_close(writers[i], err, sizeof(err)) < 0) {
+            fprintf(stderr, "[lfw-pcap] output error: %s\n", err);
+            ok = false;
+        }
+    }
+
+    out->all = out->accepted = out->dropped = NULL;
+    return ok;
+}
+
+static void *replay_worker_loop(void *arg)
+{
+    replay_worker_t *w = (replay_worker_t *)arg;
+    lfw_verdict_t verdicts[LFW_ENGINE_BATCH_MAX];
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        while (w->head == w->tail && !w->closed)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (w->head == w->tail) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        replay_batch_t *b = &w->ring[w->head % REPLAY_QUEUE_DEPTH];
+        pthread_mutex_unlock(&w->lock);
+
+        /* The slot stays owned by this worker until head advances. */
+        if (b->ts_sec != w->sec) {
+            __atomic_store_n(&w->sec, b->ts_sec, __ATOMIC_RELEASE);
+            replay_clock_sync(w->clock, w->engine);
+        }
+        replay_thread_sec = b->ts_sec;
+
+        lfw_engine_evaluate_batch(w->engine, b->pkts, b->count, verdicts);
+
+        for (lfw_u32 i = 0; i < b->count; i++) {
+            if (verdicts[i] == LFW_VERDICT_ACCEPT) {
+                w->accepted++;
+                if (b->pkts[i].is_established)
+                    w->established++;
+            } else {
+                w->dropped++;
+            }
+
+            if (w->verbose)
+                lfw_log_packet(&b->pkts[i], verdicts[i]);
+        }
+        w->packets += b->count;
+
+        if (w->out && b->count)
+            replay_output_batch(w->out, b, verdicts);
+
+        pthread_mutex_lock(&w->lock);
+        w->head++;
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    return NULL;
+}
+
+/* Queue b, which may be empty (a clock tick), and clear it */
+static void replay_push(replay_worker_t *w, replay_batch_t *b)
+{
+    pthread_mutex_lock(&w->lock);
+    while (w->tail - w->head == REPLAY_QUEUE_DEPTH)
+        pthread_cond_wait(&w->cond, &w->lock);
+    replay_batch_t *slot = &w->ring[w->tail % REPLAY_QUEUE_DEPTH];
+    memcpy(slot->pkts, b->pkts, b->count * sizeof(b->pkts[0]));
+    memcpy(slot->frames, b->frames, b->count * sizeof(b->frames[0]));
+    slot->count = b->count;
+    slot->ts_sec = b->ts_sec;
+
+    /* The reader takes over the slot's evaluated frame storage */
+    uint8_t *data = slot->data;
+    size_t data_cap = slot->data_cap;
+    slot->data = b->data;
+    slot->data_len = b->data_len;
+    slot->data_cap = b->data_cap;
+    b->data = data;
+    b->data_cap = data_cap;
+
+    w->tail++;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    b->count = 0;
+    b->data_len = 0;
+}
+
+/* Copy frame into b as the next packet's output bytes */
+static bool replay_keep_frame(replay_batch_t *b, const lfw_capture_frame_t *frame)
+{
+    if (b->data_len + frame->caplen > b->data_cap) {
+        size_t cap = b->data_cap ? b->data_cap : REPLAY_FRAME_BYTES;
+        while (cap < b->data_len + frame->caplen)
+            cap *= 2;
+        uint8_t *tmp = realloc(b->data, cap);
+        if (!tmp)
+            return false;
+        b->data = tmp;
+        b->data_cap = cap;
+    }
+
+    replay_frame_t *f = &b->frames[b->count];
+    f->ts_ns = frame->ts_ns;
+    f->off = b->data_len;
+    f->caplen = frame->caplen;
+    f->len = frame->len;
+    f->linktype = frame->linktype;
+
+    memcpy(b->data + b->data_len, frame->data, frame->caplen);
+    b->data_len += frame->caplen;
+    return true;
+}
+
+static void replay_close(replay_worker_t *w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->closed = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static double elapsed_sec(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) +
+           (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
 int main(int argc, char **argv)
 {
-    char errbuf[PCAP_ERRBUF_SIZE];
-    pcap_t *pcap;
-    struct pcap_pkthdr *hdr;
-    const u_char *data;
+    char errbuf[256];
+    lfw_capture_t *cap;
+    lfw_capture_frame_t frame;
     int rc;
 
     const char *config_path = "/etc/lfw/lfw.rules";
@@ -35,24 +371,73 @@ int main(int argc, char **argv)
     lfw_u32 rule_count = 0;
     lfw_action_t default_action = LFW_ACTION_ACCEPT;
     lfw_status_t status;
+    int jobs = 1;
+    bool verbose = false;
+    const char *out_all = NULL, *out_accepted = NULL, *out_dropped = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:vw:a:d:")) != -1) {
+        if (opt == 'j') {
+            jobs = atoi(optarg);
+            if (jobs < 1 || jobs > REPLAY_MAX_WORKERS) {
+                fprintf(stderr, "-j must be between 1 and %d\n", REPLAY_MAX_WORKERS);
+                return 1;
+            }
+        } else if (opt == 'v') {
+            verbose = true;
+        } else if (opt == 'w') {
+            out_all = optarg;
+        } else if (opt == 'a') {
+            out_accepted = optarg;
+        } else if (opt == 'd') {
+            out_dropped = optarg;
+        } else {
+            optind = argc + 1;
+            break;
+        }
+    }
 
-    if (argc < 2 || argc > 3) {
-        fprintf(stderr, "usage: %s <file.pcap> [rules_file]\n", argv[0]);
+    if (argc - optind < 1 || argc - optind > 2) {
+        fprintf(stderr, "usage: %s [-j workers] [-v] [-w out.pcapng] [-a accepted.pcapng] "
+                        "[-d dropped.pcapng] <file.pcap|file.pcapng> [rules_file]\n", argv[0]);
         return 1;
     }
 
     lfw_log_init(LFW_LOG_CONSOLE);
 
-    if (argc == 3) {
-        config_path = argv[2];
+    /*
+     * Workers only queue log records; a background thread formats them.
+     * With -v the rings are sized for a burst of per-packet lines.
+     */
+    lfw_log_async_config_t log_config = {
+        .ring_cells = verbose ? (1u << 16) : 0
+    };
+    if (lfw_log_start_async(&log_config) != LFW_OK)
+        fprintf(stderr, "[lfw-pcap] warning: async logging unavailable\n");
+
+    if (argc - optind == 2) {
+        config_path = argv[optind + 1];
     }
 
-    pcap = pcap_open_offline(argv[1], errbuf);
-    if (!pcap) {
-        fprintf(stderr, "pcap error: %s\n", errbuf);
+    cap = lfw_capture_open(argv[optind], errbuf, sizeof(errbuf));
+    if (!cap) {
+        fprintf(stderr, "capture error: %s\n", errbuf);
         return 1;
     }
 
+    replay_output_t out = { 0 };
+    bool writing = out_all || out_accepted || out_dropped;
+
+    if ((out_all && !(out.all = lfw_pcapng_writer_open(out_all, errbuf, sizeof(errbuf)))) ||
+        (out_accepted && !(out.accepted = lfw_pcapng_writer_open(out_accepted, errbuf, sizeof(errbuf)))) ||
+        (out_dropped && !(out.dropped = lfw_pcapng_writer_open(out_dropped, errbuf, sizeof(errbuf))))) {
+        fprintf(stderr, "output error: %s\n", errbuf);
+        replay_output_close(&out);
+        lfw_capture_close(cap);
+        return 1;
+    }
+    pthread_mutex_init(&out.lock, NULL);
+
     /* Try to load rules from the external config file (same logic as main.c). */
     lfw_loglevel_t dummy_loglevel = LFW_LOG_OPTIMAL;
     status = lfw_config_load_file(config_path,
@@ -83,11 +468,20 @@ int main(int argc, char **argv)
         default_action = LFW_ACTION_DROP;
     }
 
-    lfw_state_t *state = lfw_state_create();
+    replay_clock_t clock = { 0 };
+    lfw_state_config_t state_config = {
+        .clock = {
+            .now = replay_clock_now,
+            .ctx = &clock
+        }
+    };
+
+    lfw_state_t *state = lfw_state_create_with_config(&state_config);
     if (!state) {
         fprintf(stderr, "failed to create state table\n");
         if (rules) lfw_config_free_rules(rules);
-        pcap_close(pcap);
+        replay_output_close(&out);
+        lfw_capture_close(cap);
         return 1;
     }
 
@@ -98,62 +492,182 @@ int main(int argc, char **argv)
         },
         .ruleset = {
             .rules = rules,
-            .rule_count = rule_count
+            .rule_count = rule_count,
+            .matcher = lfw_matcher_create(rules, rule_count)
         },
         .connection_state = state
     };
 
     if (pthread_rwlock_init(&engine.rules_lock, NULL) != 0) {
         fprintf(stderr, "failed to initialize engine rwlock\n");
+        lfw_matcher_destroy(engine.ruleset.matcher);
         lfw_state_destroy(state);
         if (rules) lfw_config_free_rules(rules);
-        pcap_close(pcap);
+        replay_output_close(&out);
+        lfw_capture_close(cap);
         return 1;
     }
     strncpy(engine.config_path, config_path, sizeof(engine.config_path) - 1);
 
-    printf("[lfw-pcap] using rules: %s (rules: %u, default: %s)\n",
+    printf("[lfw-pcap] using rules: %s (rules: %u, default: %s, matcher: %s, capture: %s)\n",
            config_path,
            engine.ruleset.rule_count,
-           (engine.config.default_action == LFW_ACTION_ACCEPT) ? "ACCEPT" : "DROP");
-
-    int linktype = pcap_datalink(pcap);
-    int header_len = 14;
-    if (linktype == DLT_EN10MB) {
-        header_len = 14;
-    } else if (linktype == DLT_LINUX_SLL) {
-        header_len = 16;
-    } else {
-        fprintf(stderr, "[lfw-pcap] Warning: Unknown datalink type %d, assuming Ethernet (14 bytes)\n", linktype);
-        header_len = 14;
+           (engine.config.default_action == LFW_ACTION_ACCEPT) ? "ACCEPT" : "DROP",
+           lfw_matcher_isa(engine.ruleset.matcher),
+           lfw_capture_format(cap));
+
+    replay_worker_t *workers = aligned_alloc(64, (size_t)jobs * sizeof(replay_worker_t));
+    replay_batch_t *pending = calloc((size_t)jobs, sizeof(replay_batch_t));
+    int started = 0;
+
+    if (workers && pending) {
+        for (; started < jobs; started++) {
+            replay_worker_t *w = &workers[started];
+            memset(w, 0, sizeof(*w));
+            w->engine = &engine;
+            w->clock = &clock;
+            w->out = writing ? &out : NULL;
+            w->verbose = verbose;
+            w->ring = calloc(REPLAY_QUEUE_DEPTH, sizeof(replay_batch_t));
+            if (!w->ring)
+                break;
+            pthread_mutex_init(&w->lock, NULL);
+            pthread_cond_init(&w->cond, NULL);
+            if (pthread_create(&w->thread, NULL, replay_worker_loop, w) != 0) {
+                pthread_cond_destroy(&w->cond);
+                pthread_mutex_destroy(&w->lock);
+                free(w->ring);
+                break;
+            }
+        }
     }
 
-    while ((rc = pcap_next_ex(pcap, &hdr, &data)) == 1) {
+    bool replay_ok = started == jobs;
+    if (!replay_ok) {
+        fprintf(stderr, "failed to start %d replay workers\n", jobs);
+        jobs = started;
+    }
+    clock.workers = workers;
+    clock.jobs = jobs;
+
+    lfw_u64 skipped = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    bool warned_linktype = false;
+    lfw_u64 capture_sec = 0;
+
+    rc = 0;
+    while (replay_ok && (rc = lfw_capture_next(cap, &frame)) == 1) {
         lfw_packet_t pkt;
-        lfw_status_t st;
 
-        /* Skip link-layer header */
-        if (hdr->caplen <= (unsigned int)header_len)
-            continue;
+        if (!frame.link_known && !warned_linktype) {
+            warned_linktype = true;
+            fprintf(stderr, "[lfw-pcap] Warning: Unknown link type %u, assuming Ethernet\n",
+                    frame.linktype);
+        }
 
-        st = lfw_parse_packet(
-            data + header_len,
-            hdr->caplen - header_len,
+        /* Link-layer header (including VLAN tags) is decoded by the parser */
+        lfw_status_t st = lfw_parse_frame(
+            frame.link,
+            frame.data,
+            frame.caplen,
             LFW_DIR_INBOUND,
             &pkt
         );
 
-        if (st != LFW_OK)
+        if (st != LFW_OK) {
+            skipped++;
             continue;
+        }
+
+        /*
+         * Batches never span a second. Timestamps that step back are
+         * replayed at the current second, the clock only moves forward.
+         */
+        lfw_u64 sec = frame.ts_ns / 1000000000ULL;
+        if (sec > capture_sec) {
+            for (int q = 0; q < jobs; q++) {
+                if (pending[q].count)
+                    replay_push(&workers[q], &pending[q]);
+                pending[q].ts_sec = sec;
+                replay_push(&workers[q], &pending[q]);
+            }
+            capture_sec = sec;
+        }
+
+        int q = jobs > 1 ? (int)(flow_hash(&pkt) % (lfw_u32)jobs) : 0;
+        replay_batch_t *b = &pending[q];
+
+        if (writing && !replay_keep_frame(b, &frame)) {
+            fprintf(stderr, "[lfw-pcap] out of memory buffering output\n");
+            replay_ok = false;
+            break;
+        }
+
+        b->pkts[b->count++] = pkt;
+        if (b->count == LFW_ENGINE_BATCH_MAX)
+            replay_push(&workers[q], b);
+    }
+
+    lfw_u64 packets = 0, accepted = 0, established = 0, dropped = 0;
+
+    for (int q = 0; q < jobs; q++) {
+        if (pending[q].count)
+            replay_push(&workers[q], &pending[q]);
+        replay_close(&workers[q]);
+    }
 
-        lfw_verdict_t v = lfw_engine_evaluate(&engine, &pkt);
+    for (int q = 0; q < jobs; q++) {
+        replay_worker_t *w = &workers[q];
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        for (int i = 0; i < REPLAY_QUEUE_DEPTH; i++)
+            free(w->ring[i].data);
+        free(w->ring);
 
-        lfw_log_packet(&pkt, v);
+        packets     += w->packets;
+        accepted    += w->accepted;
+        established += w->established;
+        dropped     += w->dropped;
     }
 
+    double secs = elapsed_sec(&start);
+
+    /* Per-packet lines go out before the summary */
+    lfw_log_flush();
+    lfw_u64 log_dropped = lfw_log_get_dropped();
+
+    if (rc < 0)
+        fprintf(stderr, "[lfw-pcap] read error: %s\n", lfw_capture_error(cap));
+
+    printf("[lfw-pcap] %lu packets (%lu skipped) in %.3f s: %.0f pps on %d worker(s)\n",
+           (unsigned long)packets, (unsigned long)skipped, secs,
+           secs > 0 ? (double)packets / secs : 0.0, jobs);
+    printf("[lfw-pcap] verdicts: accept %lu (established %lu), drop %lu\n",
+           (unsigned long)accepted, (unsigned long)established, (unsigned long)dropped);
+    for (int q = 0; jobs > 1 && q < jobs; q++)
+        printf("[lfw-pcap]   worker %d: %lu packets\n", q, (unsigned long)workers[q].packets);
+    if (log_dropped)
+        printf("[lfw-pcap] %lu per-packet log lines dropped (output too slow)\n",
+               (unsigned long)log_dropped);
+
+    lfw_engine_dump_stats(&engine);
+
+    if (!replay_output_close(&out))
+        replay_ok = false;
+    pthread_mutex_destroy(&out.lock);
+
+    for (int q = 0; pending && q < jobs; q++)
+        free(pending[q].data);
+    free(pending);
+    free(workers);
+
     pthread_rwlock_destroy(&engine.rules_lock);
+    lfw_matcher_destroy(engine.ruleset.matcher);
     lfw_state_destroy(state);
-    pcap_close(pcap);
+    lfw_capture_close(cap);
 
     if (rules) {
         lfw_config_free_rules(rules);
@@ -161,5 +675,5 @@ int main(int argc, char **argv)
 
     lfw_log_close();
 
-    return 0;
+    return replay_ok ? 0 : 1;
 }
@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_pcapng_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Output is written in chunks of this size */
+#define WRITER_BUF (4UL << 20)
+
+/* Distinct link types (interfaces) per file */
+#define WRITER_MAX_IFS 16
+
+#define PCAPNG_SHB          0x0A0D0D0Au
+#define PCAPNG_BYTE_ORDER   0x1A2B3C4Du
+#define PCAPNG_IDB          0x00000001u
+#define PCAPNG_EPB          0x00000006u
+#define PCAPNG_OPT_END      0
+#define PCAPNG_OPT_COMMENT  1
+#define PCAPNG_OPT_TSRESOL  9
+
+/* Comments longer than this are truncated */
+#define WRITER_MAX_COMMENT 1024
+
+struct lfw_pcapng_writer {
+    int      fd;
+    uint8_t *buf;
+    size_t   len;
+    bool     failed;
+
+    lfw_u32  ifs[WRITER_MAX_IFS];  /* link type of each interface id */
+    lfw_u32  if_count;
+
+    char     err[128];
+};
+
+static inline lfw_u32 pad4(lfw_u32 n)
+{
+    return (n + 3u) & ~3u;
+}
+
+/* Record the first error; err is an errno value or 0 */
+static int fail(lfw_pcapng_writer_t *w, const char *msg, int err)
+{
+    if (!w->failed) {
+        if (err)
+            snprintf(w->err, sizeof(w->err), "%s: %s", msg, strerror(err));
+        else
+            snprintf(w->err, sizeof(w->err), "%s", msg);
+    }
+    w->failed = true;
+    return -1;
+}
+
+static int flush_buf(lfw_pcapng_writer_t *w)
+{
+    size_t off = 0;
+
+    while (off < w->len) {
+        ssize_t n = write(w->fd, w->buf + off, w->len - off);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return fail(w, "write", errno);
+        }
+        off += (size_t)n;
+    }
+
+    w->len = 0;
+    return 0;
+}
+
+/* Room for n more bytes, flushing first if needed */
+static uint8_t *reserve(lfw_pcapng_writer_t *w, size_t n)
+{
+    if (w->len + n > WRITER_BUF && flush_buf(w) < 0)
+        return NULL;
+
+    uint8_t *p = w->buf + w->len;
+    w->len += n;
+    return p;
+}
+
+static inline uint8_t *put32(uint8_t *p, lfw_u32 v)
+{
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+static inline uint8_t *put_opt(uint8_t *p, lfw_u16 code, const void *val, lfw_u16 len)
+{
+    memcpy(p, &code, 2);
+    memcpy(p + 2, &len, 2);
+    memcpy(p + 4, val, len);
+    memset(p + 4 + len, 0, pad4(len) - len);
+    return p + 4 + pad4(len);
+}
+
+static int write_shb(lfw_pcapng_writer_t *w)
+{
+    const lfw_u32 total = 28;
+    uint8_t *p = reserve(w, total);
+    if (!p)
+        return -1;
+
+    p = put32(p, PCAPNG_SHB);
+    p = put32(p, total);
+    p = put32(p, PCAPNG_BYTE_ORDER);
+    p = put32(p, 1);                   /* major 1, minor 0 */
+    p = put32(p, 0xFFFFFFFFu);         /* section length unknown */
+    p = put32(p, 0xFFFFFFFFu);
+    put32(p, total);
+    return 0;
+}
+
+/* Interface id for linktype, writing its description block on first use */
+static int interface_id(lfw_pcapng_writer_t *w, lfw_u32 linktype)
+{
+    for (lfw_u32 i = 0; i < w->if_count; i++) {
+        if (w->ifs[i] == linktype)
+            return (int)i;
+    }
+
+    if (w->if_count == WRITER_MAX_IFS)
+        return fail(w, "too many link types", 0);
+
+    /* Header, link type + snaplen, if_tsresol option, end of options */
+    const lfw_u32 total = 8 + 8 + 8 + 4 + 4;
+    uint8_t *p = reserve(w, total);
+    if (!p)
+        return -1;
+
+    lfw_u8 tsresol = 9;
+    lfw_u16 lt = (lfw_u16)linktype;
+    lfw_u16 reserved = 0;
+
+    p = put32(p, PCAPNG_IDB);
+    p = put32(p, total);
+    memcpy(p, &lt, 2);
+    memcpy(p + 2, &reserved, 2);
+    p = put32(p + 4, 0);               /* no snaplen limit */
+    p = put_opt(p, PCAPNG_OPT_TSRESOL, &tsresol, 1);
+    p = put32(p, PCAPNG_OPT_END);
+    put32(p, total);
+
+    w->ifs[w->if_count] = linktype;
+    return (int)w->if_count++;
+}
+
+lfw_pcapng_writer_t *lfw_pcapng_writer_open(const char *path, char *err, size_t err_len)
+{
+    if (!path || !err || err_len == 0)
+        return NULL;
+
+    lfw_pcapng_writer_t *w = calloc(1, sizeof(*w));
+    if (w)
+        w->buf = malloc(WRITER_BUF);
+    if (!w || !w->buf) {
+        snprintf(err, err_len, "out of memory");
+        free(w);
+        return NULL;
+    }
+
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (w->fd < 0) {
+        snprintf(err, err_len, "%s: %s", path, strerror(errno));
+        free(w->buf);
+        free(w);
+        return NULL;
+    }
+
+    write_shb(w);
+    return w;
+}
+
+int lfw_pcapng_writer_add(lfw_pcapng_writer_t *w,
+                          lfw_u32 linktype,
+                          lfw_u64 ts_ns,
+                          const uint8_t *data,
+                          lfw_u32 caplen,
+                          lfw_u32 len,
+                          const char *comment)
+{
+    if (!w || (caplen && !data))
+        return -1;
+    if (w->failed)
+        return -1;
+
+    int id = interface_id(w, linktype);
+    if (id < 0)
+        return -1;
+
+    size_t clen = comment ? strnlen(comment, WRITER_MAX_COMMENT) : 0;
+    size_t opts = clen ? 4 + pad4((lfw_u32)clen) + 4 : 0;
+    size_t total = 28 + pad4(caplen) + opts + 4;
+    if (total > WRITER_BUF)
+        return fail(w, "packet too large", 0);
+
+    uint8_t *p = reserve(w, total);
+    if (!p)
+        return -1;
+
+    p = put32(p, PCAPNG_EPB);
+    p = put32(p, (lfw_u32)total);
+    p = put32(p, (lfw_u32)id);
+    p = put32(p, (lfw_u32)(ts_ns >> 32));
+    p = put32(p, (lfw_u32)ts_ns);
+    p = put32(p, caplen);
+    p = put32(p, len);
+    memcpy(p, data, caplen);
+    memset(p + caplen, 0, pad4(caplen) - caplen);
+    p += pad4(caplen);
+    if (clen) {
+        p = put_opt(p, PCAPNG_OPT_COMMENT, comment, (lfw_u16)clen);
+        p = put32(p, PCAPNG_OPT_END);
+    }
+    put32(p, (lfw_u32)total);
+
+    return 0;
+}
+
+int lfw_pcapng_writer_close(lfw_pcapng_writer_t *w, char *err, size_t err_len)
+{
+    if (!w)
+        return -1;
+
+    int rc = w->failed ? -1 : flush_buf(w);
+    if (close(w->fd) != 0 && rc == 0)
+        rc = fail(w, "close", errno);
+    if (rc < 0 && err && err_len)
+        snprintf(err, err_len, "%s", w->err);
+
+    free(w->buf);
+    free(w);
+    return rc;
+}
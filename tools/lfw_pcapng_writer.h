@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_PCAPNG_WRITER_H
+#define LFW_PCAPNG_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lfw_types.h"
+
+/*
+ * Buffered pcapng writer for the offline tools.
+ *
+ * Blocks are assembled in a large in-memory buffer that is written out
+ * in one write() whenever it fills, so per-packet cost is a memcpy. One
+ * interface description block is emitted per link type on first use,
+ * with nanosecond timestamps. Not thread-safe: callers serialise access.
+ */
+
+typedef struct lfw_pcapng_writer lfw_pcapng_writer_t;
+
+/* Create (truncate) path and write the section header; NULL on failure */
+lfw_pcapng_writer_t *lfw_pcapng_writer_open(const char *path, char *err, size_t err_len);
+
+/*
+ * Append one enhanced packet block. comment (may be NULL) is stored as
+ * the packet's opt_comment. Returns 0, or -1 once a write has failed.
+ */
+int lfw_pcapng_writer_add(lfw_pcapng_writer_t *w,
+                          lfw_u32 linktype,
+                          lfw_u64 ts_ns,
+                          const uint8_t *data,
+                          lfw_u32 caplen,
+                          lfw_u32 len,
+                          const char *comment);
+
+/* Flush and close; -1 if any write failed, with the first error in err */
+int lfw_pcapng_writer_close(lfw_pcapng_writer_t *w, char *err, size_t err_len);
+
+#endif
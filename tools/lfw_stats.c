@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lfw_stats.h"
+#include "lfw_stats_print.h"
+
+/*
+ * Reader for the daemon's shared statistics region (lfw --stats-file).
+ *
+ * Usage:
+ *   lfw-stats [-j] [-i <ms>] <file>
+ *
+ * Prints one snapshot, or one every <ms> milliseconds with -i. Text
+ * output is meant for people; -j prints one JSON object per snapshot.
+ * When the daemon restarts it replaces the file, and a watching reader
+ * maps the new one.
+ */
+
+/* Map the region at path, remembering its inode to notice replacement */
+static lfw_stats_reader_t *open_region(const char *path, ino_t *ino)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    lfw_stats_reader_t *reader = lfw_stats_reader_open(path);
+    if (!reader) {
+        fprintf(stderr, "%s: %s\n", path,
+                errno == EPROTO ? "not an lfw statistics file of a supported version" : strerror(errno));
+        return NULL;
+    }
+
+    *ino = st.st_ino;
+    return reader;
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    unsigned long interval_ms = 0;
+    bool bad_args = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ji:")) != -1) {
+        if (opt == 'j') {
+            json = true;
+        } else if (opt == 'i') {
+            char *end = NULL;
+            interval_ms = strtoul(optarg, &end, 10);
+            if (!end || *end != '\0' || interval_ms == 0 || interval_ms > 3600000)
+                bad_args = true;
+        } else {
+            bad_args = true;
+        }
+    }
+
+    if (bad_args || optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-j] [-i <ms>] <file>\n", argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    ino_t ino = 0;
+    lfw_stats_reader_t *reader = open_region(path, &ino);
+    if (!reader)
+        return 1;
+
+    int rc = 0;
+    for (;;) {
+        lfw_stats_t snapshot;
+        if (lfw_stats_reader_read(reader, &snapshot) != LFW_OK) {
+            fprintf(stderr, "%s: no consistent snapshot\n", path);
+            rc = 1;
+            break;
+        }
+
+        if (json)
+            lfw_stats_print_json(&snapshot);
+        else
+            lfw_stats_print_text(&snapshot);
+
+        if (fflush(stdout) != 0) {
+            fprintf(stderr, "write error: %s\n", strerror(errno));
+            rc = 1;
+            break;
+        }
+        if (!interval_ms)
+            break;
+
+        struct timespec req = {
+            .tv_sec  = (time_t)(interval_ms / 1000),
+            .tv_nsec = (long)(interval_ms % 1000) * 1000000L,
+        };
+        nanosleep(&req, NULL);
+
+        /* Follow a restarted daemon to its new region */
+        struct stat st;
+        if (stat(path, &st) == 0 && st.st_ino != ino) {
+            lfw_stats_reader_t *fresh = open_region(path, &ino);
+            if (fresh) {
+                lfw_stats_reader_close(reader);
+                reader = fresh;
+            }
+        }
+        if (!json)
+            printf("\n");
+    }
+
+    lfw_stats_reader_close(reader);
+    return rc;
+}
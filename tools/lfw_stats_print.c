@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "lfw_stats_print.h"
+
+#include <stdio.h>
+#include <time.h>
+
+/* Index of conntrack_tcp_v4/v6, as LFW_TCP_STATE_* */
+static const char *const tcp_states[] = {"none", "syn_sent", "syn_recv", "established", "fin_wait", "closed"};
+#define TCP_STATE_COUNT (sizeof(tcp_states) / sizeof(tcp_states[0]))
+
+static void format_time(lfw_u64 epoch_ns, char *buf, size_t len)
+{
+    time_t sec = (time_t)(epoch_ns / 1000000000ULL);
+    struct tm tm;
+    char date[32];
+
+    gmtime_r(&sec, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf, len, "%s.%03lluZ", date, (unsigned long long)(epoch_ns % 1000000000ULL / 1000000ULL));
+}
+
+static void print_timer(const char *name, const lfw_stats_timer_t *t)
+{
+    printf("  %-14s runs %llu, last %.3f ms, mean %.3f ms\n", name, (unsigned long long)t->count,
+           (double)t->last_ns / 1e6, t->count ? (double)t->total_ns / (double)t->count / 1e6 : 0.0);
+}
+
+void lfw_stats_print_text(const lfw_stats_t *s)
+{
+    char when[64];
+
+    format_time(s->updated_ns, when, sizeof(when));
+    printf("updated %s, pid %u, interval %u ms\n", when, s->pid, s->interval_ms);
+    printf("conntrack: ipv4 %llu, ipv6 %llu\n",
+           (unsigned long long)s->conntrack_v4, (unsigned long long)s->conntrack_v6);
+    for (int v6 = 0; v6 <= 1; v6++) {
+        const lfw_u64 *states = v6 ? s->conntrack_tcp_v6 : s->conntrack_tcp_v4;
+        printf("  tcp %s:", v6 ? "ipv6" : "ipv4");
+        for (size_t i = 1; i < TCP_STATE_COUNT; i++)
+            printf("%s %s %llu", i > 1 ? "," : "", tcp_states[i], (unsigned long long)states[i]);
+        printf("\n");
+    }
+    printf("telemetry: received %llu, rate limited %llu, queue dropped %llu\n",
+           (unsigned long long)s->telemetry_received, (unsigned long long)s->telemetry_rate_limited,
+           (unsigned long long)s->telemetry_queue_dropped);
+    printf("kernel events: submitted %llu, lost %llu (drops %llu), wakeups %llu\n",
+           (unsigned long long)s->kernel_submitted, (unsigned long long)s->kernel_lost,
+           (unsigned long long)s->kernel_drop_lost, (unsigned long long)s->kernel_wakeups);
+    printf("timings:\n");
+    print_timer("gc sweep", &s->gc_sweep);
+    print_timer("fqdn resolve", &s->fqdn_resolve);
+    print_timer("reload", &s->reload);
+    printf("  reload failures %llu\n", (unsigned long long)s->reload_failures);
+
+    printf("verdict reasons:\n");
+    for (lfw_u32 i = 0; i < s->reason_count && i < LFW_STATS_MAX_REASONS; i++)
+        printf("  %-*.*s %llu\n", LFW_STATS_NAME_LEN, LFW_STATS_NAME_LEN, s->reason_names[i],
+               (unsigned long long)s->reasons[i]);
+
+    printf("rules:\n");
+    for (lfw_u32 i = 0; i < s->rule_count && i < LFW_STATS_MAX_RULES; i++)
+        printf("  #%-4u %-5s hits %llu, bytes %llu\n", i + 1, s->rule_actions[i] == 1 ? "allow" : "drop",
+               (unsigned long long)s->rules[i].hits, (unsigned long long)s->rules[i].bytes);
+}
+
+void lfw_stats_print_json(const lfw_stats_t *s)
+{
+    printf("{\"updated_ns\": %llu, \"pid\": %u, \"conntrack_v4\": %llu, \"conntrack_v6\": %llu, "
+           "\"telemetry_received\": %llu, \"telemetry_rate_limited\": %llu, \"telemetry_queue_dropped\": %llu, "
+           "\"kernel_submitted\": %llu, \"kernel_lost\": %llu, \"kernel_drop_lost\": %llu, \"kernel_wakeups\": %llu",
+           (unsigned long long)s->updated_ns, s->pid,
+           (unsigned long long)s->conntrack_v4, (unsigned long long)s->conntrack_v6,
+           (unsigned long long)s->telemetry_received, (unsigned long long)s->telemetry_rate_limited,
+           (unsigned long long)s->telemetry_queue_dropped, (unsigned long long)s->kernel_submitted,
+           (unsigned long long)s->kernel_lost, (unsigned long long)s->kernel_drop_lost,
+           (unsigned long long)s->kernel_wakeups);
+
+    for (int v6 = 0; v6 <= 1; v6++) {
+        const lfw_u64 *states = v6 ? s->conntrack_tcp_v6 : s->conntrack_tcp_v4;
+        printf(", \"conntrack_tcp_%s\": {", v6 ? "v6" : "v4");
+        for (size_t i = 1; i < TCP_STATE_COUNT; i++)
+            printf("%s\"%s\": %llu", i > 1 ? ", " : "", tcp_states[i], (unsigned long long)states[i]);
+        printf("}");
+    }
+
+    const lfw_stats_timer_t *timers[] = {&s->gc_sweep, &s->fqdn_resolve, &s->reload};
+    const char *const timer_names[] = {"gc_sweep", "fqdn_resolve", "reload"};
+    for (size_t i = 0; i < 3; i++)
+        printf(", \"%s\": {\"count\": %llu, \"total_ns\": %llu, \"last_ns\": %llu}", timer_names[i],
+               (unsigned long long)timers[i]->count, (unsigned long long)timers[i]->total_ns,
+               (unsigned long long)timers[i]->last_ns);
+    printf(", \"reload_failures\": %llu", (unsigned long long)s->reload_failures);
+
+    /* Reason names are plain identifiers set by the daemon */
+    printf(", \"reasons\": {");
+    for (lfw_u32 i = 0; i < s->reason_count && i < LFW_STATS_MAX_REASONS; i++)
+        printf("%s\"%.*s\": %llu", i ? ", " : "", LFW_STATS_NAME_LEN, s->reason_names[i],
+               (unsigned long long)s->reasons[i]);
+
+    printf("}, \"rules\": [");
+    for (lfw_u32 i = 0; i < s->rule_count && i < LFW_STATS_MAX_RULES; i++)
+        printf("%s{\"hits\": %llu, \"bytes\": %llu}", i ? ", " : "",
+               (unsigned long long)s->rules[i].hits, (unsigned long long)s->rules[i].bytes);
+    printf("]}\n");
+}
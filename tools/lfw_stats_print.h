@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LFW_STATS_PRINT_H
+#define LFW_STATS_PRINT_H
+
+#include "lfw_stats.h"
+
+/*
+ * Output formats of a statistics snapshot, shared by lfw-stats and lfwctl.
+ */
+
+/* Several lines meant for people */
+void lfw_stats_print_text(const lfw_stats_t *s);
+
+/* One JSON object on one line */
+void lfw_stats_print_json(const lfw_stats_t *s);
+
+#endif
@@ -0,0 +1,611 @@
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lfw_control.h"
+#include "lfw_rules.h"
+#include "lfw_stats.h"
+#include "lfw_stats_print.h"
+
+/*
+ * Client of the daemon's control socket (lfw --control).
+ *
+ * Usage:
+ *   lfwctl [-s <socket> | -i <interface>] [-j] <command> [args]
+ *
+ * Commands:
+ *   reload                        reread the rules file, report the outcome
+ *   stats                         print the daemon's counters
+ *   conntrack [filter] [limit n]  list tracked connections
+ *   flush <filter | all>          delete tracked connections
+ *   match <proto> <src> [sport] <dst> [dport]
+ *                                 tell which rule a new connection would hit
+ *   block <prefix>... [ttl <s>]   drop all traffic from or to the prefixes
+ *   allow <prefix>... [ttl <s>]   admit new connections the rules would not
+ *   unblock | unallow <prefix>... take prefixes off a dynamic list
+ *   dynamic list [block|allow] [family 4|6] [limit n]
+ *                                 list the dynamic lists
+ *   dynamic flush <block|allow|all>
+ *                                 empty dynamic lists
+ *
+ * A filter is any of: family 4|6, proto <name|number>, state <tcp state>,
+ * addr <ip>[/prefix], port <n>. Address and port match either endpoint.
+ *
+ * A prefix is <ip>[/len]; "-" reads prefixes from standard input, one per
+ * line, so a large batch goes over in as few requests as fit.
+ */
+
+#define CALL_TIMEOUT_MS 60000
+
+static const char *const tcp_states[] = {"none", "syn_sent", "syn_recv", "established", "fin_wait", "closed"};
+#define TCP_STATE_COUNT (sizeof(tcp_states) / sizeof(tcp_states[0]))
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-s <socket> | -i <interface>] [-j] <command> [args]\n"
+            "commands:\n"
+            "  reload\n"
+            "  stats\n"
+            "  conntrack [family 4|6] [proto <p>] [state <s>] [addr <ip>[/len]] [port <n>] [limit <n>]\n"
+            "  flush all | <filter as for conntrack>\n"
+            "  match <proto> <src> [sport] <dst> [dport]\n"
+            "  block | allow <ip>[/len]... | - [ttl <seconds>]\n"
+            "  unblock | unallow <ip>[/len]... | -\n"
+            "  dynamic list [block|allow] [family 4|6] [limit <n>]\n"
+            "  dynamic flush block|allow|all\n",
+            prog);
+}
+
+static bool parse_u32(const char *text, unsigned long max, lfw_u32 *out)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long v = strtoul(text, &end, 10);
+    if (errno || !end || end == text || *end != '\0' || v > max)
+        return false;
+    *out = (lfw_u32)v;
+    return true;
+}
+
+static bool parse_proto(const char *text, lfw_u8 *proto)
+{
+    static const struct {
+        const char *name;
+        lfw_u8      number;
+    } names[] = {{"tcp", 6}, {"udp", 17}, {"icmp", 1}, {"icmpv6", 58}, {"esp", 50}, {"ah", 51}};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcasecmp(text, names[i].name) == 0) {
+            *proto = names[i].number;
+            return true;
+        }
+    }
+
+    lfw_u32 v;
+    if (!parse_u32(text, 255, &v) || v == 0)
+        return false;
+    *proto = (lfw_u8)v;
+    return true;
+}
+
+static const char *proto_name(lfw_u8 proto, char *buf, size_t len)
+{
+    switch (proto) {
+    case 6:  return "tcp";
+    case 17: return "udp";
+    case 1:  return "icmp";
+    case 58: return "icmpv6";
+    default:
+        snprintf(buf, len, "%u", proto);
+        return buf;
+    }
+}
+
+/* Parse an IPv4 or IPv6 address into addr; returns 4, 6 or 0 if invalid */
+static int parse_addr(const char *text, lfw_u8 addr[16])
+{
+    memset(addr, 0, 16);
+    if (inet_pton(AF_INET, text, addr) == 1)
+        return 4;
+    if (inet_pton(AF_INET6, text, addr) == 1)
+        return 6;
+    return 0;
+}
+
+/* Parse <ip>[/prefix]; returns the family, 4 or 6, or 0 if invalid */
+static int parse_cidr(const char *text, lfw_u8 addr[16], lfw_u32 *prefix)
+{
+    char buf[INET6_ADDRSTRLEN + 8];
+    snprintf(buf, sizeof(buf), "%s", text);
+    char *slash = strchr(buf, '/');
+    if (slash)
+        *slash++ = '\0';
+
+    int family = parse_addr(buf, addr);
+    *prefix = family == 6 ? 128 : 32;
+    if (!family || (slash && (!parse_u32(slash, *prefix, prefix) || *prefix == 0)))
+        return 0;
+    return family;
+}
+
+static void format_addr(int family, const lfw_u8 addr[16], lfw_u16 port, char *buf, size_t len)
+{
+    char ip[INET6_ADDRSTRLEN];
+    inet_ntop(family == 6 ? AF_INET6 : AF_INET, addr, ip, sizeof(ip));
+    if (family == 6)
+        snprintf(buf, len, "[%s]:%u", ip, port);
+    else
+        snprintf(buf, len, "%s:%u", ip, port);
+}
+
+static bool parse_filter(int argc, char **argv, bool allow_limit, lfw_ctl_ct_filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+    filter->state = LFW_CTL_STATE_ANY;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char *key = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        lfw_u32 v;
+
+        if (!value) {
+            fprintf(stderr, "lfwctl: %s needs a value\n", key);
+            return false;
+        }
+
+        if (strcmp(key, "family") == 0 && (strcmp(value, "4") == 0 || strcmp(value, "6") == 0)) {
+            if (filter->prefix && filter->family != (lfw_u8)atoi(value)) {
+                fprintf(stderr, "lfwctl: family %s does not match addr\n", value);
+                return false;
+            }
+            filter->family = (lfw_u8)atoi(value);
+        } else if (strcmp(key, "proto") == 0 && parse_proto(value, &filter->proto)) {
+            continue;
+        } else if (strcmp(key, "port") == 0 && parse_u32(value, 65535, &v) && v) {
+            filter->port = (lfw_u16)v;
+        } else if (allow_limit && strcmp(key, "limit") == 0 && parse_u32(value, LFW_CTL_LIST_MAX, &v) && v) {
+            filter->limit = v;
+        } else if (strcmp(key, "state") == 0) {
+            size_t st = 0;
+            while (st < TCP_STATE_COUNT && strcmp(value, tcp_states[st]) != 0)
+                st++;
+            if (st == TCP_STATE_COUNT) {
+                fprintf(stderr, "lfwctl: unknown TCP state %s\n", value);
+                return false;
+            }
+            filter->state = (lfw_u8)st;
+        } else if (strcmp(key, "addr") == 0) {
+            lfw_u32 prefix;
+            int family = parse_cidr(value, filter->addr, &prefix);
+            if (!family || (filter->family && filter->family != family)) {
+                fprintf(stderr, "lfwctl: invalid addr %s\n", value);
+                return false;
+            }
+            filter->family = (lfw_u8)family;
+            filter->prefix = (lfw_u8)prefix;
+        } else {
+            fprintf(stderr, "lfwctl: invalid filter %s %s\n", key, value);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool parse_match(int argc, char **argv, lfw_ctl_match_t *match)
+{
+    memset(match, 0, sizeof(*match));
+    if (argc < 1 || !parse_proto(argv[0], &match->proto))
+        return false;
+
+    bool ports = match->proto == 6 || match->proto == 17;
+    if (argc != (ports ? 5 : 3))
+        return false;
+
+    int src_family = parse_addr(argv[1], match->src);
+    int dst_family = parse_addr(argv[ports ? 3 : 2], match->dst);
+    if (!src_family || src_family != dst_family)
+        return false;
+    match->family = (lfw_u8)src_family;
+
+    if (ports) {
+        lfw_u32 sport, dport;
+        if (!parse_u32(argv[2], 65535, &sport) || !parse_u32(argv[4], 65535, &dport))
+            return false;
+        match->src_port = (lfw_u16)sport;
+        match->dst_port = (lfw_u16)dport;
+    }
+    return true;
+}
+
+static void print_entries(const lfw_ctl_ct_list_t *list, const lfw_ctl_ct_entry_t *entries, bool json)
+{
+    char proto_buf[8], a[64], b[64];
+
+    if (json)
+        printf("{\"matched\": %u, \"entries\": [", list->matched);
+
+    for (lfw_u32 i = 0; i < list->count; i++) {
+        const lfw_ctl_ct_entry_t *e = &entries[i];
+        const char *proto = proto_name(e->proto, proto_buf, sizeof(proto_buf));
+        const char *state = e->proto == 6 && e->state < TCP_STATE_COUNT ? tcp_states[e->state] : "-";
+        const char *action = e->action == LFW_ACTION_ACCEPT ? "allow" : "drop";
+        format_addr(e->family, e->addr_a, e->port_a, a, sizeof(a));
+        format_addr(e->family, e->addr_b, e->port_b, b, sizeof(b));
+
+        /* Rules are numbered from 1, as in the rules file */
+        char rule[16];
+        if (e->rule == LFW_CTL_RULE_NONE)
+            snprintf(rule, sizeof(rule), json ? "null" : "default");
+        else
+            snprintf(rule, sizeof(rule), json ? "%u" : "#%u", e->rule + 1);
+
+        if (json) {
+            printf("%s{\"proto\": \"%s\", \"state\": \"%s\", \"a\": \"%s\", \"b\": \"%s\", \"action\": \"%s\", "
+                   "\"rule\": %s, \"idle_ms\": %u, \"packets\": %llu, \"bytes\": %llu}",
+                   i ? ", " : "", proto, state, a, b, action, rule, e->idle_ms,
+                   (unsigned long long)e->packets, (unsigned long long)e->bytes);
+            continue;
+        }
+
+        printf("%-6s %-11s %s <-> %s  %s by %s, idle %.1fs, %llu packets, %llu bytes\n", proto, state, a, b,
+               action, rule, e->idle_ms / 1000.0, (unsigned long long)e->packets, (unsigned long long)e->bytes);
+    }
+
+    if (json)
+        printf("]}\n");
+    else if (list->count < list->matched)
+        printf("%u of %u matching entries shown\n", list->count, list->matched);
+}
+
+/* Check a successful reply is at least size bytes */
+static bool reply_fits(lfw_u32 length, size_t size)
+{
+    if (length >= size)
+        return true;
+    fprintf(stderr, "lfwctl: short reply from the daemon\n");
+    return false;
+}
+
+/*
+ * Send one request and check its status. On success *reply holds the
+ * malloc'ed payload; on failure the reason has been printed.
+ */
+static bool call(const char *path, lfw_u16 code, const void *payload, lfw_u32 length, void **reply,
+                 lfw_u32 *reply_length)
+{
+    lfw_u16 status = 0;
+    *reply = NULL;
+    *reply_length = 0;
+    if (lfw_control_call(path, code, payload, length, CALL_TIMEOUT_MS, &status, reply, reply_length) != LFW_OK) {
+        fprintf(stderr, "lfwctl: %s: %s\n", path,
+                errno == EPROTO ? "not an lfw control socket of a supported version" : strerror(errno));
+        return false;
+    }
+
+    if (status != LFW_CTL_OK) {
+        fprintf(stderr, "lfwctl: %s\n", *reply_length ? (const char *)*reply : "request failed");
+        free(*reply);
+        *reply = NULL;
+        return false;
+    }
+    return true;
+}
+
+/* A batch of dynamic list entries on its way to the daemon */
+typedef struct {
+    const char          *path;
+    lfw_u16              code;
+    lfw_ctl_dyn_entry_t *entries;
+    lfw_u32              count;
+    unsigned long long   applied;
+} dyn_batch_t;
+
+static bool dyn_send_batch(dyn_batch_t *batch)
+{
+    if (!batch->count)
+        return true;
+
+    void *reply;
+    lfw_u32 reply_length;
+    bool ok = call(batch->path, batch->code, batch->entries, batch->count * (lfw_u32)sizeof(lfw_ctl_dyn_entry_t),
+                   &reply, &reply_length);
+    if (ok && reply_fits(reply_length, sizeof(lfw_ctl_dyn_result_t)))
+        batch->applied += ((const lfw_ctl_dyn_result_t *)reply)->applied;
+    else
+        ok = false;
+    free(reply);
+    batch->count = 0;
+    return ok;
+}
+
+static bool dyn_push(dyn_batch_t *batch, const char *text, lfw_u8 list, lfw_u32 ttl)
+{
+    lfw_ctl_dyn_entry_t *e = &batch->entries[batch->count];
+    memset(e, 0, sizeof(*e));
+    lfw_u32 prefix;
+    int family = parse_cidr(text, e->addr, &prefix);
+    if (!family) {
+        fprintf(stderr, "lfwctl: invalid prefix %s\n", text);
+        return false;
+    }
+    e->list = list;
+    e->family = (lfw_u8)family;
+    e->prefix = (lfw_u8)prefix;
+    e->ttl_s = ttl;
+
+    if (++batch->count == LFW_CTL_DYN_BATCH_MAX)
+        return dyn_send_batch(batch);
+    return true;
+}
+
+/* Prefixes from standard input, one per line; blank lines and # comments are skipped */
+static bool dyn_push_stdin(dyn_batch_t *batch, lfw_u8 list, lfw_u32 ttl)
+{
+    char line[256];
+    while (fgets(line, sizeof(line), stdin)) {
+        char *text = line + strspn(line, " \t");
+        text[strcspn(text, " \t\r\n#")] = '\0';
+        if (*text && !dyn_push(batch, text, list, ttl))
+            return false;
+    }
+    return true;
+}
+
+/* block, allow, unblock and unallow */
+static int dyn_edit(const char *path, const char *command, int argc, char **argv)
+{
+    bool add = strcmp(command, "block") == 0 || strcmp(command, "allow") == 0;
+    lfw_u8 list = strstr(command, "block") ? LFW_CTL_DYN_BLOCK : LFW_CTL_DYN_ALLOW;
+
+    lfw_u32 ttl = 0;
+    if (add && argc >= 2 && strcmp(argv[argc - 2], "ttl") == 0) {
+        if (!parse_u32(argv[argc - 1], 0xFFFFFFFFul, &ttl) || !ttl) {
+            fprintf(stderr, "lfwctl: invalid ttl %s\n", argv[argc - 1]);
+            return 1;
+        }
+        argc -= 2;
+    }
+    if (argc < 1) {
+        fprintf(stderr, "usage: lfwctl %s <ip>[/len]... | -%s\n", command, add ? " [ttl <seconds>]" : "");
+        return 1;
+    }
+
+    dyn_batch_t batch = {
+        .path = path,
+        .code = add ? LFW_CTL_DYN_ADD : LFW_CTL_DYN_DEL,
+        .entries = calloc(LFW_CTL_DYN_BATCH_MAX, sizeof(lfw_ctl_dyn_entry_t)),
+    };
+    if (!batch.entries) {
+        fprintf(stderr, "lfwctl: %s\n", strerror(errno));
+        return 1;
+    }
+
+    bool ok = true;
+    for (int i = 0; ok && i < argc; i++)
+        ok = strcmp(argv[i], "-") == 0 ? dyn_push_stdin(&batch, list, ttl) : dyn_push(&batch, argv[i], list, ttl);
+    if (ok)
+        ok = dyn_send_batch(&batch);
+
+    /* Batches sent before a failure stay applied */
+    if (ok || batch.applied)
+        printf("%s %llu entries\n", add ? "added" : "removed", batch.applied);
+    free(batch.entries);
+    return ok ? 0 : 1;
+}
+
+static bool parse_dyn_filter(int argc, char **argv, lfw_ctl_dyn_filter_t *filter)
+{
+    memset(filter, 0, sizeof(*filter));
+    filter->list = LFW_CTL_DYN_ANY;
+
+    for (int i = 0; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        lfw_u32 v;
+
+        if (strcmp(argv[i], "block") == 0) {
+            filter->list = LFW_CTL_DYN_BLOCK;
+        } else if (strcmp(argv[i], "allow") == 0) {
+            filter->list = LFW_CTL_DYN_ALLOW;
+        } else if (strcmp(argv[i], "family") == 0 && value && (strcmp(value, "4") == 0 || strcmp(value, "6") == 0)) {
+            filter->family = (lfw_u8)atoi(value);
+            i++;
+        } else if (strcmp(argv[i], "limit") == 0 && value && parse_u32(value, LFW_CTL_LIST_MAX, &v) && v) {
+            filter->limit = v;
+            i++;
+        } else {
+            fprintf(stderr, "lfwctl: invalid dynamic list filter %s\n", argv[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void print_dyn_entries(const lfw_ctl_dyn_list_t *list, const lfw_ctl_dyn_entry_t *entries, bool json)
+{
+    if (json)
+        printf("{\"matched\": %u, \"entries\": [", list->matched);
+
+    for (lfw_u32 i = 0; i < list->count; i++) {
+        const lfw_ctl_dyn_entry_t *e = &entries[i];
+        const char *name = e->list == LFW_CTL_DYN_BLOCK ? "block" : "allow";
+        char ip[INET6_ADDRSTRLEN];
+        inet_ntop(e->family == 6 ? AF_INET6 : AF_INET, e->addr, ip, sizeof(ip));
+
+        if (json) {
+            printf("%s{\"list\": \"%s\", \"prefix\": \"%s/%u\", \"ttl_s\": ", i ? ", " : "", name, ip, e->prefix);
+            if (e->ttl_s)
+                printf("%u}", e->ttl_s);
+            else
+                printf("null}");
+            continue;
+        }
+
+        if (e->ttl_s)
+            printf("%-5s %s/%u, %us left\n", name, ip, e->prefix, e->ttl_s);
+        else
+            printf("%-5s %s/%u\n", name, ip, e->prefix);
+    }
+
+    if (json)
+        printf("]}\n");
+    else if (list->count < list->matched)
+        printf("%u of %u matching entries shown\n", list->count, list->matched);
+}
+
+int main(int argc, char **argv)
+{
+    char path_buf[128];
+    const char *path = NULL;
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "+s:i:j")) != -1) {
+        if (opt == 's') {
+            path = optarg;
+        } else if (opt == 'i') {
+            snprintf(path_buf, sizeof(path_buf), "/run/lfw-%s.ctl", optarg);
+            path = path_buf;
+        } else if (opt == 'j') {
+            json = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!path || optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *command = argv[optind];
+    int nargs = argc - optind - 1;
+    char **args = argv + optind + 1;
+
+    lfw_u16 code;
+    const void *payload = NULL;
+    lfw_u32 length = 0;
+    lfw_ctl_ct_filter_t filter;
+    lfw_ctl_match_t match;
+    lfw_ctl_dyn_filter_t dyn_filter;
+
+    if (strcmp(command, "reload") == 0 && nargs == 0) {
+        code = LFW_CTL_RELOAD;
+    } else if (strcmp(command, "stats") == 0 && nargs == 0) {
+        code = LFW_CTL_STATS;
+    } else if (strcmp(command, "conntrack") == 0) {
+        if (!parse_filter(nargs, args, true, &filter))
+            return 1;
+        code = LFW_CTL_CONNTRACK_LIST;
+        payload = &filter;
+        length = sizeof(filter);
+    } else if (strcmp(command, "flush") == 0 && nargs > 0) {
+        /* An empty filter flushes everything, so it has to be asked for */
+        bool all = nargs == 1 && strcmp(args[0], "all") == 0;
+        if (!parse_filter(all ? 0 : nargs, args, false, &filter))
+            return 1;
+        code = LFW_CTL_CONNTRACK_FLUSH;
+        payload = &filter;
+        length = sizeof(filter);
+    } else if (strcmp(command, "match") == 0) {
+        if (!parse_match(nargs, args, &match)) {
+            fprintf(stderr, "usage: %s match <proto> <src> [sport] <dst> [dport]\n", argv[0]);
+            return 1;
+        }
+        code = LFW_CTL_MATCH;
+        payload = &match;
+        length = sizeof(match);
+    } else if (strcmp(command, "block") == 0 || strcmp(command, "allow") == 0 ||
+               strcmp(command, "unblock") == 0 || strcmp(command, "unallow") == 0) {
+        return dyn_edit(path, command, nargs, args);
+    } else if (strcmp(command, "dynamic") == 0 && nargs > 0 && strcmp(args[0], "list") == 0) {
+        if (!parse_dyn_filter(nargs - 1, args + 1, &dyn_filter))
+            return 1;
+        code = LFW_CTL_DYN_LIST;
+        payload = &dyn_filter;
+        length = sizeof(dyn_filter);
+    } else if (strcmp(command, "dynamic") == 0 && nargs == 2 && strcmp(args[0], "flush") == 0) {
+        /* As with conntrack, emptying both lists has to be asked for */
+        bool all = strcmp(args[1], "all") == 0;
+        if (!parse_dyn_filter(all ? 0 : 1, args + 1, &dyn_filter))
+            return 1;
+        code = LFW_CTL_DYN_FLUSH;
+        payload = &dyn_filter;
+        length = sizeof(dyn_filter);
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    void *reply;
+    lfw_u32 reply_length;
+    if (!call(path, code, payload, length, &reply, &reply_length))
+        return 1;
+
+    int rc = 0;
+    if (code == LFW_CTL_RELOAD && reply_fits(reply_length, sizeof(lfw_ctl_reload_t))) {
+        const lfw_ctl_reload_t *r = reply;
+        printf("reloaded: %u rules, default %s, %.1f ms\n", r->rule_count,
+               r->default_action == LFW_ACTION_ACCEPT ? "allow" : "drop", r->duration_ns / 1e6);
+    } else if (code == LFW_CTL_STATS) {
+        /* Older daemons send a shorter layout; missing fields read as zero */
+        lfw_stats_t snapshot;
+        memset(&snapshot, 0, sizeof(snapshot));
+        memcpy(&snapshot, reply, reply_length < sizeof(snapshot) ? reply_length : sizeof(snapshot));
+        if (json)
+            lfw_stats_print_json(&snapshot);
+        else
+            lfw_stats_print_text(&snapshot);
+    } else if (code == LFW_CTL_CONNTRACK_LIST && reply_fits(reply_length, sizeof(lfw_ctl_ct_list_t))) {
+        const lfw_ctl_ct_list_t *list = reply;
+        if (reply_fits(reply_length, sizeof(*list) + (size_t)list->count * sizeof(lfw_ctl_ct_entry_t)))
+            print_entries(list, (const lfw_ctl_ct_entry_t *)(list + 1), json);
+        else
+            rc = 1;
+    } else if (code == LFW_CTL_CONNTRACK_FLUSH && reply_fits(reply_length, sizeof(lfw_ctl_ct_flush_t))) {
+        const lfw_ctl_ct_flush_t *flush = reply;
+        printf("deleted %llu entries\n", (unsigned long long)flush->deleted);
+    } else if (code == LFW_CTL_MATCH && reply_fits(reply_length, offsetof(lfw_ctl_match_result_t, dynamic))) {
+        /* Older daemons do not report the dynamic lists */
+        lfw_ctl_match_result_t result;
+        memset(&result, 0, sizeof(result));
+        result.dynamic = LFW_CTL_DYN_ANY;
+        memcpy(&result, reply, reply_length < sizeof(result) ? reply_length : sizeof(result));
+        const lfw_ctl_match_result_t *m = &result;
+        const char *action = m->action == LFW_ACTION_ACCEPT ? "allow" : "drop";
+        if (m->rule == LFW_CTL_RULE_NONE)
+            printf("no rule matches: default policy, %s\n", action);
+        else
+            printf("rule #%u, %s\n", m->rule + 1, action);
+        if (m->tracked) {
+            const char *state = match.proto == 6 && m->tracked_state < TCP_STATE_COUNT ? tcp_states[m->tracked_state] : "-";
+            printf("tracked connection decides first: %s, state %s\n",
+                   m->tracked_action == LFW_ACTION_ACCEPT ? "allow" : "drop", state);
+        }
+        if (m->dynamic == LFW_CTL_DYN_BLOCK)
+            printf("dynamic block list drops it before all else\n");
+        else if (m->dynamic == LFW_CTL_DYN_ALLOW)
+            printf("dynamic allow list admits a new connection before the rules\n");
+    } else if (code == LFW_CTL_DYN_LIST && reply_fits(reply_length, sizeof(lfw_ctl_dyn_list_t))) {
+        const lfw_ctl_dyn_list_t *list = reply;
+        if (reply_fits(reply_length, sizeof(*list) + (size_t)list->count * sizeof(lfw_ctl_dyn_entry_t)))
+            print_dyn_entries(list, (const lfw_ctl_dyn_entry_t *)(list + 1), json);
+        else
+            rc = 1;
+    } else if (code == LFW_CTL_DYN_FLUSH && reply_fits(reply_length, sizeof(lfw_ctl_dyn_result_t))) {
+        const lfw_ctl_dyn_result_t *flush = reply;
+        printf("deleted %u entries\n", flush->applied);
+    } else {
+        rc = 1;
+    }
+
+    free(reply);
+    return rc;
+}